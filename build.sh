@@ -34,7 +34,7 @@ if [ "$1" = "windows" ]; then
   ## platform ##
   echo "(MinGW-w64) Compiling rotten_platform"
   #sem --jobs 4
-  /bin/i686-w64-mingw32-gcc ./src/sdl_platform.c $flags -Wl,-rpath,./ -I./third_party/SDL2_Mingw/i686-w64-mingw32/include/SDL2 -o ./build_w64/rotten_platform -lopengl32 -lm -lSDL2main -lSDL2 -L./third_party/SDL2_Mingw/i686-w64-mingw32/lib 
+  /bin/i686-w64-mingw32-gcc ./src/sdl_platform.c $flags -Wl,-rpath,./ -I./third_party/SDL2_Mingw/i686-w64-mingw32/include/SDL2 -o ./build_w64/rotten_platform -lopengl32 -lm -lpthread -lSDL2main -lSDL2 -L./third_party/SDL2_Mingw/i686-w64-mingw32/lib 
 
   #sem --wait
   echo "rotten_platform.exe lib/game.dll lib/renderer.dll" > build_w64/run.bat
@@ -104,17 +104,10 @@ else
   -Wno-unused-function 
   -Wno-missing-braces 
   -Dlinux 
-  -DSDL_VIDEO_DRIVER_X11"
-  if [ -d "./third_party/SDL2/Dist" ]; then
-    echo "Local SDL2 found"
-    sdl_install_path=$(realpath "./third_party/SDL2/Dist")
-    sdl_flags=$("$sdl_install_path"/bin/sdl2-config --cflags --libs)
-  else
-    echo "Local SDL2 not found, using system"
-    sdl_flags=$(sdl2-config --cflags --libs)
-  fi
+  -DSDL_VIDEO_DRIVER_X11
+  $EXTRA_FLAGS"
+  mkdir -p "./build/lib"
   touch build/readlock
-  echo "$sdl_flags"
   echo "(GCC) Compiling..."
   if [ -z "$1" ] || [ "$1" = "all" ] || [ "$1" = "renderer" ]; then
     ## renderer ##
@@ -131,9 +124,42 @@ else
 
   ## platform ##
   if [ -z "$1" ] || [ "$1" = "all" ] || [ "$1" = "platform" ]; then
+    if [ -d "./third_party/SDL2/Dist" ]; then
+      echo "Local SDL2 found"
+      sdl_install_path=$(realpath "./third_party/SDL2/Dist")
+      sdl_flags=$("$sdl_install_path"/bin/sdl2-config --cflags --libs)
+    else
+      echo "Local SDL2 not found, using system"
+      sdl_flags=$(sdl2-config --cflags --libs)
+    fi
+    echo "$sdl_flags"
     echo "(GCC) Compiling rotten_platform"
     #sem --jobs 4
-    gcc ./src/sdl_platform.c $flags $sdl_flags -std=c11 -o ./build/rotten_platform -Wl,-rpath,'$ORIGIN'/lib -lm 
+    gcc ./src/sdl_platform.c $flags $sdl_flags -std=c11 -o ./build/rotten_platform -Wl,-rpath,'$ORIGIN'/lib -lm -lpthread 
+  fi
+
+  ## headless ##
+  # Physics only runner, no SDL or OpenGL needed. Built with optimizations
+  # as it's used for measuring simulation cost.
+  if [ "$1" = "all" ] || [ "$1" = "headless" ]; then
+    echo "(GCC) Compiling rotten_headless"
+    g++ ./src/headless_platform.cpp $flags -O2 -std=c++11 -o ./build/rotten_headless -lm -lpthread
+  fi
+
+  ## benchmarks ##
+  if [ "$1" = "all" ] || [ "$1" = "bench" ]; then
+    echo "(GCC) Compiling broadphase_bench"
+    g++ ./src/broadphase_bench.cpp $flags -O2 -std=c++11 -o ./build/broadphase_bench -lm
+    echo "(GCC) Compiling terrain_bench"
+    g++ ./src/terrain_bench.cpp $flags -O2 -std=c++11 -o ./build/terrain_bench -lm
+    echo "(GCC) Compiling terrain_query_bench"
+    g++ ./src/terrain_query_bench.cpp $flags -O2 -std=c++11 -o ./build/terrain_query_bench -lm
+    echo "(GCC) Compiling physics_bench"
+    g++ ./src/physics_bench.cpp $flags -O2 -std=c++11 -o ./build/physics_bench -lm
+    echo "(GCC) Compiling terrain_bake_bench"
+    g++ ./src/terrain_bake_bench.cpp $flags -O2 -std=c++11 -o ./build/terrain_bake_bench -lm -lpthread
+    echo "(GCC) Compiling noise_bench"
+    g++ ./src/noise_bench.cpp $flags -O2 -std=c++11 -o ./build/noise_bench -lm -lpthread
   fi
 
   echo "(GCC) Create run script"
@@ -0,0 +1,137 @@
+// Broadphase benchmark.
+// Moves spheres around in a box and times the broadphase update for
+// 10 to 10k bodies. The box grows with the body count so every body has
+// about the same amount of neighbours. For the smaller counts the pairs
+// are checked against a brute force O(n^2) pass.
+//
+// Usage: broadphase_bench [--steps N] [--seed N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "game/car_game.cpp"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+static u32 benchRandomState = 1;
+
+static f32 benchRandom(f32 min, f32 max) {
+  // xorshift32
+  benchRandomState ^= benchRandomState << 13;
+  benchRandomState ^= benchRandomState >> 17;
+  benchRandomState ^= benchRandomState << 5;
+  return min + (max - min) * (f32)(benchRandomState >> 8) / (f32)(1 << 24);
+}
+
+static u32 bruteForcePairNum(physics_world *world) {
+  broadphase_state *broadphase = &world->broadphase;
+  u32 pairNum = 0;
+  for (u32 a = GROUND_BODY + 1; a < world->bodyNum; a++) {
+    for (u32 b = a + 1; b < world->bodyNum; b++) {
+      if (aabbOverlap(broadphase->bounds[a], broadphase->bounds[b])) {
+        pairNum++;
+      }
+    }
+  }
+  return pairNum;
+}
+
+int main(int argc, char **argv) {
+  u32 stepNum = 100;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+      stepNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      u32 seed = (u32)strtoul(argv[++i], NULL, 10);
+      benchRandomState = MAX(seed, 1u);
+    } else {
+      fprintf(stderr, "Usage: %s [--steps N] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+  ASSERT_ = benchAssert;
+
+  usize memSize = MEGABYTES(64);
+  void *permanentBuffer = malloc(memSize);
+  void *tempBuffer = malloc(memSize);
+  memory_arena permanentMemory, tempMemory;
+
+  const f32 dt = 1.f / 60.f;
+  const f32 spacing = 4.f;
+  u32 bodyNums[] = {10, 100, 1000, 10000};
+
+  printf("%8s %10s %12s %12s %10s\n", "bodies", "pairs", "ns/update",
+         "ns/body", "check");
+  for (u32 n = 0; n < arrayLen(bodyNums); n++) {
+    u32 bodyNum = bodyNums[n];
+    memArena_init(&permanentMemory, permanentBuffer, memSize);
+    memArena_init(&tempMemory, tempBuffer, memSize);
+
+    physics_world world = {};
+    u32 jointCapacity[_joint_type_num] = {};
+    allocPhysicsWorld(&world, &permanentMemory, bodyNum + 1, jointCapacity,
+                      bodyNum, 0);
+    f32 extent = spacing * cbrtf((f32)bodyNum);
+    for (u32 i = 0; i < bodyNum; i++) {
+      u32 body = physicsWorldAddBody(&world, 1);
+      shape *sphere = world.shapes + world.firstShape[body];
+      sphere->type = shape_type::SHAPE_SPHERE;
+      sphere->sphere.radius = benchRandom(0.3f, 1.5f);
+      world.orientation[body] = M3X3_IDENTITY;
+      world.position[body] = (v3){benchRandom(0.f, extent),
+                                  benchRandom(0.f, extent),
+                                  benchRandom(0.f, extent)};
+      world.velocity[body] = (v3){benchRandom(-10.f, 10.f),
+                                  benchRandom(-10.f, 10.f),
+                                  benchRandom(-10.f, 10.f)};
+    }
+
+    u64 ticks = 0;
+    u64 pairSum = 0;
+    b32 checked = bodyNum <= 1000;
+    b32 match = true;
+    for (u32 step = 0; step < stepNum; step++) {
+      for (u32 body = GROUND_BODY + 1; body < world.bodyNum; body++) {
+        v3 p = world.position[body] + world.velocity[body] * dt;
+        v3 v = world.velocity[body];
+        // Bounce from the walls of the box
+        if (p.x < 0.f || p.x > extent) v.x = -v.x;
+        if (p.y < 0.f || p.y > extent) v.y = -v.y;
+        if (p.z < 0.f || p.z > extent) v.z = -v.z;
+        world.position[body] = p;
+        world.velocity[body] = v;
+      }
+      memArena_clear(&tempMemory);
+      u64 begin = benchPerformanceCounter();
+      broadphaseUpdate(&world, &tempMemory, dt);
+      ticks += benchPerformanceCounter() - begin;
+      pairSum += world.broadphase.pairNum;
+      if (checked) {
+        match &= world.broadphase.droppedPairNum == 0 &&
+                 bruteForcePairNum(&world) == world.broadphase.pairNum;
+      }
+    }
+    printf("%8u %10.1f %12.1f %12.2f %10s\n", bodyNum,
+           (f64)pairSum / stepNum, (f64)ticks / stepNum,
+           (f64)ticks / stepNum / bodyNum,
+           checked ? (match ? "ok" : "FAILED") : "-");
+    if (!match) {
+      return 1;
+    }
+  }
+  return 0;
+}
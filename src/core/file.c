@@ -1,7 +1,13 @@
 #include <fcntl.h>
+#include <stdio.h>
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 utime readFileModTime(const char* filePath) {
   struct stat sb;
@@ -11,3 +17,97 @@ utime readFileModTime(const char* filePath) {
   }
   return 0;
 }
+
+static b32 writeBinaryFile(const char* filePath, rt_file_chunk* chunks,
+                           u32 chunkNum) {
+  char tempPath[512];
+  if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", filePath) >=
+      (i32)sizeof(tempPath)) {
+    return false;
+  }
+  FILE* file = fopen(tempPath, "wb");
+  if (!file) {
+    return false;
+  }
+  b32 written = true;
+  for (u32 i = 0; i < chunkNum && written; i++) {
+    written = chunks[i].size == 0 ||
+      fwrite(chunks[i].data, chunks[i].size, 1, file) == 1;
+  }
+  written &= fclose(file) == 0;
+#ifdef _WIN32
+  // rename doesn't replace an existing file on Windows
+  if (written) {
+    remove(filePath);
+  }
+#endif
+  if (!written || rename(tempPath, filePath) != 0) {
+    remove(tempPath);
+    return false;
+  }
+  return true;
+}
+
+#ifdef _WIN32
+static void* mapFile(const char* filePath, usize* fileSizeOut) {
+  HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+  LARGE_INTEGER size;
+  void* memory = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    HANDLE mapping =
+      CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+      memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+  if (memory) {
+    *fileSizeOut = (usize)size.QuadPart;
+  }
+  return memory;
+}
+
+static void unmapFile(void* memory, usize size) {
+  UnmapViewOfFile(memory);
+}
+
+// The pages of a file view can't be offered or discarded, only unmapping
+// the view drops them. Without a release the read tiles stay in the
+// working set until the system trims the clean pages.
+static void (*releaseMappedRange)(void* memory, usize size) = NULL;
+#else
+static void* mapFile(const char* filePath, usize* fileSizeOut) {
+  i32 fd = open(filePath, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat sb;
+  void* memory = NULL;
+  if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+    memory = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory == MAP_FAILED) {
+      memory = NULL;
+    }
+  }
+  // The mapping keeps the file open
+  close(fd);
+  if (memory) {
+    *fileSizeOut = sb.st_size;
+  }
+  return memory;
+}
+
+static void unmapFile(void* memory, usize size) {
+  munmap(memory, size);
+}
+
+// The range has to start at a page
+static void releaseMappedRange(void* memory, usize size) {
+  madvise(memory, size, MADV_DONTNEED);
+}
+#endif
@@ -475,6 +475,13 @@ inline quat quat_normalize(quat q) {
   return result;
 };
 
+// axis must be of unit length
+inline quat quat_from_axis_angle(v3 axis, f32 angle) {
+  f32 s = sinf(angle * 0.5f);
+  quat result = {cosf(angle * 0.5f), axis.x * s, axis.y * s, axis.z * s};
+  return result;
+};
+
 // Matrix 3x3 (column major)
 typedef union m2x2 {
   f32 arr[4];
@@ -918,4 +925,22 @@ inline f32 bezier6n(f32* p, f32 t) {
     powf(t,  5.f) * p[5];
 }
 
+// Polynomial atan2, max error about 1e-5 rad. Cheaper than atan2f where
+// that is good enough.
+inline f32 atan2Approx(f32 y, f32 x) {
+  f32 ax = fabsf(x);
+  f32 ay = fabsf(y);
+  if (ax == 0.f && ay == 0.f) {
+    return 0.f;
+  }
+  b32 swap = ay > ax;
+  f32 a = swap ? ax / ay : ay / ax;
+  f32 s = a * a;
+  f32 r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f +
+          s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+  if (swap) r = 0.5f * PI - r;
+  if (x < 0.f) r = PI - r;
+  return y < 0.f ? -r : r;
+}
+
 #endif // ROTTEN_MATH
@@ -49,6 +49,7 @@ typedef struct memory_arena {
 } memory_arena;
 
 void* memArena_alloc(memory_arena* arena, usize size);
+void* memArena_allocAlign(memory_arena* arena, usize size, usize align);
 void* memArena_calloc(memory_arena* arena, usize membNum, usize size);
 void* memArena_realloc(memory_arena* arena, void* ptr, usize size);
 void* memArena_allocUnalign(memory_arena* arena, usize size);
@@ -7,6 +7,8 @@
 #define pushSizeZeros(memory, size) \
   arenaAllocZeros(memory, size)
 #define pushType(memory, type) (type *)arenaAlloc(memory, sizeof(type))
+#define pushArrayAligned(memory, count, type, align) \
+  (type *)memArena_allocAlign(memory, (count) * sizeof(type), align)
 
 static void *arenaAlloc(memory_arena *mem, usize size) {
   void *it = memArena_alloc(mem, size);
@@ -19,8 +21,12 @@ static void *arenaAllocZeros(memory_arena *mem, usize size) {
 }
 
 void* memArena_alloc(memory_arena* arena, usize size) {
+  return memArena_allocAlign(arena, size, DEFAULT_ALIGNMENT);
+}
+
+void* memArena_allocAlign(memory_arena* arena, usize size, usize align) {
   uptr ptr = (uptr)arena->buffer + arena->head;
-  usize alignedPtr = alignForward(ptr, DEFAULT_ALIGNMENT);
+  usize alignedPtr = alignForward(ptr, align);
   usize requiredSize = size + (alignedPtr - ptr);
   ASAN_UNPOISON_MEMORY_REGION((void*)alignedPtr, requiredSize);
   ASSERT(requiredSize <= arena->remaining);
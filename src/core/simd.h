@@ -0,0 +1,252 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Wide float used by the batched solver paths. Lane count follows the
+// instruction set the compiler targets: AVX gives 8 lanes, SSE2 gives 4
+// and anything else falls back to 4 plain floats.
+//
+// Every operation is a single IEEE operation per lane, so a wide loop
+// produces the same bits as the scalar code when it keeps the same
+// operation order.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#define SIMD_NAME "avx"
+typedef __m256 f32w;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#define SIMD_NAME "sse2"
+typedef __m128 f32w;
+#else
+#define SIMD_WIDTH 4
+#define SIMD_NAME "scalar"
+typedef struct f32w {
+  f32 lane[SIMD_WIDTH];
+} f32w;
+#endif
+
+#define SIMD_ALIGNMENT (SIMD_WIDTH * sizeof(f32))
+
+#if defined(__AVX__)
+
+inline f32w f32w_zero() { return _mm256_setzero_ps(); }
+inline f32w f32w_splat(f32 s) { return _mm256_set1_ps(s); }
+inline f32w f32w_load(const f32* p) { return _mm256_load_ps(p); }
+inline void f32w_store(f32* p, f32w a) { _mm256_store_ps(p, a); }
+inline f32w f32w_loadu(const f32* p) { return _mm256_loadu_ps(p); }
+inline f32w f32w_add(f32w a, f32w b) { return _mm256_add_ps(a, b); }
+inline f32w f32w_sub(f32w a, f32w b) { return _mm256_sub_ps(a, b); }
+inline f32w f32w_mul(f32w a, f32w b) { return _mm256_mul_ps(a, b); }
+inline f32w f32w_div(f32w a, f32w b) { return _mm256_div_ps(a, b); }
+inline f32w f32w_sqrt(f32w a) { return _mm256_sqrt_ps(a); }
+// Same as MIN(a, b) and MAX(a, b) including the equal and NaN cases
+inline f32w f32w_min(f32w a, f32w b) { return _mm256_min_ps(a, b); }
+inline f32w f32w_max(f32w a, f32w b) { return _mm256_max_ps(a, b); }
+inline f32w f32w_neg(f32w a) {
+  return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f));
+}
+inline f32w f32w_abs(f32w a) {
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+}
+inline f32w f32w_greater(f32w a, f32w b) {
+  return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+}
+inline f32w f32w_less(f32w a, f32w b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+inline f32w f32w_and(f32w a, f32w b) { return _mm256_and_ps(a, b); }
+inline f32w f32w_or(f32w a, f32w b) { return _mm256_or_ps(a, b); }
+// mask ? a : b
+inline f32w f32w_select(f32w mask, f32w a, f32w b) {
+  return _mm256_blendv_ps(b, a, mask);
+}
+// Rounds toward zero, same as a (i32) cast for values that fit in i32
+inline f32w f32w_trunc(f32w a) {
+  return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+}
+inline b32 f32w_anyTrue(f32w mask) { return _mm256_movemask_ps(mask) != 0; }
+// The bits (p[i] >> shift) & mask of SIMD_WIDTH words as floats, mask
+// below 2^31. AVX has no 256 bit integer ops, the halves go through SSE2.
+inline f32w f32w_fromBits(const u32* p, u32 shift, u32 mask) {
+  __m128i count = _mm_cvtsi32_si128((i32)shift);
+  __m128i m = _mm_set1_epi32((i32)mask);
+  __m128i lo = _mm_loadu_si128((const __m128i*)p);
+  __m128i hi = _mm_loadu_si128((const __m128i*)(p + 4));
+  lo = _mm_and_si128(_mm_srl_epi32(lo, count), m);
+  hi = _mm_and_si128(_mm_srl_epi32(hi, count), m);
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_cvtepi32_ps(lo)),
+                              _mm_cvtepi32_ps(hi), 1);
+}
+
+#elif defined(__SSE2__)
+
+inline f32w f32w_zero() { return _mm_setzero_ps(); }
+inline f32w f32w_splat(f32 s) { return _mm_set1_ps(s); }
+inline f32w f32w_load(const f32* p) { return _mm_load_ps(p); }
+inline void f32w_store(f32* p, f32w a) { _mm_store_ps(p, a); }
+inline f32w f32w_loadu(const f32* p) { return _mm_loadu_ps(p); }
+inline f32w f32w_add(f32w a, f32w b) { return _mm_add_ps(a, b); }
+inline f32w f32w_sub(f32w a, f32w b) { return _mm_sub_ps(a, b); }
+inline f32w f32w_mul(f32w a, f32w b) { return _mm_mul_ps(a, b); }
+inline f32w f32w_div(f32w a, f32w b) { return _mm_div_ps(a, b); }
+inline f32w f32w_sqrt(f32w a) { return _mm_sqrt_ps(a); }
+inline f32w f32w_min(f32w a, f32w b) { return _mm_min_ps(a, b); }
+inline f32w f32w_max(f32w a, f32w b) { return _mm_max_ps(a, b); }
+inline f32w f32w_neg(f32w a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline f32w f32w_abs(f32w a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline f32w f32w_greater(f32w a, f32w b) { return _mm_cmpgt_ps(a, b); }
+inline f32w f32w_less(f32w a, f32w b) { return _mm_cmplt_ps(a, b); }
+inline f32w f32w_and(f32w a, f32w b) { return _mm_and_ps(a, b); }
+inline f32w f32w_or(f32w a, f32w b) { return _mm_or_ps(a, b); }
+inline f32w f32w_select(f32w mask, f32w a, f32w b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline f32w f32w_trunc(f32w a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+inline b32 f32w_anyTrue(f32w mask) { return _mm_movemask_ps(mask) != 0; }
+inline f32w f32w_fromBits(const u32* p, u32 shift, u32 mask) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  v = _mm_and_si128(_mm_srl_epi32(v, _mm_cvtsi32_si128((i32)shift)),
+                    _mm_set1_epi32((i32)mask));
+  return _mm_cvtepi32_ps(v);
+}
+
+#else
+
+#define F32W_LANES(expr) \
+  f32w r; \
+  for (i32 i = 0; i < SIMD_WIDTH; i++) { r.lane[i] = expr; } \
+  return r
+
+inline f32w f32w_zero() { F32W_LANES(0.0f); }
+inline f32w f32w_splat(f32 s) { F32W_LANES(s); }
+inline f32w f32w_load(const f32* p) { F32W_LANES(p[i]); }
+inline void f32w_store(f32* p, f32w a) {
+  for (i32 i = 0; i < SIMD_WIDTH; i++) { p[i] = a.lane[i]; }
+}
+inline f32w f32w_loadu(const f32* p) { F32W_LANES(p[i]); }
+inline f32w f32w_add(f32w a, f32w b) { F32W_LANES(a.lane[i] + b.lane[i]); }
+inline f32w f32w_sub(f32w a, f32w b) { F32W_LANES(a.lane[i] - b.lane[i]); }
+inline f32w f32w_mul(f32w a, f32w b) { F32W_LANES(a.lane[i] * b.lane[i]); }
+inline f32w f32w_div(f32w a, f32w b) { F32W_LANES(a.lane[i] / b.lane[i]); }
+inline f32w f32w_sqrt(f32w a) { F32W_LANES(sqrtf(a.lane[i])); }
+inline f32w f32w_min(f32w a, f32w b) { F32W_LANES(MIN(a.lane[i], b.lane[i])); }
+inline f32w f32w_max(f32w a, f32w b) { F32W_LANES(MAX(a.lane[i], b.lane[i])); }
+inline f32w f32w_neg(f32w a) { F32W_LANES(-a.lane[i]); }
+inline f32w f32w_abs(f32w a) { F32W_LANES(fabsf(a.lane[i])); }
+// Masks are stored as 0.0 / 1.0 in the scalar version
+inline f32w f32w_greater(f32w a, f32w b) {
+  F32W_LANES(a.lane[i] > b.lane[i] ? 1.0f : 0.0f);
+}
+inline f32w f32w_less(f32w a, f32w b) {
+  F32W_LANES(a.lane[i] < b.lane[i] ? 1.0f : 0.0f);
+}
+inline f32w f32w_and(f32w a, f32w b) {
+  F32W_LANES(a.lane[i] != 0.0f && b.lane[i] != 0.0f ? 1.0f : 0.0f);
+}
+inline f32w f32w_or(f32w a, f32w b) {
+  F32W_LANES(a.lane[i] != 0.0f || b.lane[i] != 0.0f ? 1.0f : 0.0f);
+}
+inline f32w f32w_select(f32w mask, f32w a, f32w b) {
+  F32W_LANES(mask.lane[i] != 0.0f ? a.lane[i] : b.lane[i]);
+}
+inline f32w f32w_trunc(f32w a) { F32W_LANES((f32)(i32)a.lane[i]); }
+inline f32w f32w_fromBits(const u32* p, u32 shift, u32 mask) {
+  F32W_LANES((f32)((p[i] >> shift) & mask));
+}
+inline b32 f32w_anyTrue(f32w mask) {
+  for (i32 i = 0; i < SIMD_WIDTH; i++) {
+    if (mask.lane[i] != 0.0f) return true;
+  }
+  return false;
+}
+
+#undef F32W_LANES
+
+#endif
+
+inline void setLane(f32w* w, u32 lane, f32 value) {
+  ((f32*)w)[lane] = value;
+}
+
+inline f32 getLane(f32w* w, u32 lane) {
+  return ((f32*)w)[lane];
+}
+
+// Wide vector3, one lane per vector
+typedef struct v3w {
+  f32w x, y, z;
+} v3w;
+
+inline void setLane(v3w* w, u32 lane, v3 value) {
+  setLane(&w->x, lane, value.x);
+  setLane(&w->y, lane, value.y);
+  setLane(&w->z, lane, value.z);
+}
+
+inline v3 getLane(v3w* w, u32 lane) {
+  return (v3){getLane(&w->x, lane), getLane(&w->y, lane),
+              getLane(&w->z, lane)};
+}
+
+inline v3w v3w_add(v3w a, v3w b) {
+  v3w result = {f32w_add(a.x, b.x), f32w_add(a.y, b.y), f32w_add(a.z, b.z)};
+  return result;
+}
+
+inline v3w v3w_sub(v3w a, v3w b) {
+  v3w result = {f32w_sub(a.x, b.x), f32w_sub(a.y, b.y), f32w_sub(a.z, b.z)};
+  return result;
+}
+
+inline v3w v3w_scale(v3w a, f32w s) {
+  v3w result = {f32w_mul(a.x, s), f32w_mul(a.y, s), f32w_mul(a.z, s)};
+  return result;
+}
+
+inline f32w v3w_dot(v3w a, v3w b) {
+  f32w result = f32w_add(f32w_add(f32w_mul(a.x, b.x), f32w_mul(a.y, b.y)),
+                         f32w_mul(a.z, b.z));
+  return result;
+}
+
+inline v3w v3w_cross(v3w a, v3w b) {
+  v3w result = {f32w_sub(f32w_mul(a.y, b.z), f32w_mul(a.z, b.y)),
+                f32w_sub(f32w_mul(a.z, b.x), f32w_mul(a.x, b.z)),
+                f32w_sub(f32w_mul(a.x, b.y), f32w_mul(a.y, b.x))};
+  return result;
+}
+
+// Matches v3_normalize, a zero vector is returned as is
+inline v3w v3w_normalize(v3w a) {
+  f32w length2 = v3w_dot(a, a);
+  f32w nonZero = f32w_greater(length2, f32w_zero());
+  f32w length = f32w_select(nonZero, f32w_sqrt(length2), length2);
+  v3w result = {f32w_select(nonZero, f32w_div(a.x, length), a.x),
+                f32w_select(nonZero, f32w_div(a.y, length), a.y),
+                f32w_select(nonZero, f32w_div(a.z, length), a.z)};
+  return result;
+}
+
+// Wide 3x3 matrix, same element layout as m3x3
+typedef struct m3x3w {
+  f32w m00, m01, m02;
+  f32w m10, m11, m12;
+  f32w m20, m21, m22;
+} m3x3w;
+
+// Matches m3x3_mul_v3
+inline v3w m3x3w_mul_v3w(m3x3w m, v3w v) {
+  v3w result = {
+    f32w_add(f32w_add(f32w_mul(m.m00, v.x), f32w_mul(m.m10, v.y)),
+             f32w_mul(m.m20, v.z)),
+    f32w_add(f32w_add(f32w_mul(m.m01, v.x), f32w_mul(m.m11, v.y)),
+             f32w_mul(m.m21, v.z)),
+    f32w_add(f32w_add(f32w_mul(m.m02, v.x), f32w_mul(m.m12, v.y)),
+             f32w_mul(m.m22, v.z)),
+  };
+  return result;
+}
+
+#endif // SIMD_H
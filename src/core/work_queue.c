@@ -0,0 +1,93 @@
+// Multi consumer, single producer work queue with a fixed worker thread
+// pool. Entries are added from the main thread, workers and the main thread
+// (in workQueue_completeAll) take them with an atomic compare and swap.
+#include <pthread.h>
+#include <semaphore.h>
+
+#define WORK_QUEUE_ENTRY_NUM 256
+#define WORK_QUEUE_MAX_THREADS 32
+
+typedef struct work_queue_entry {
+  rt_work_callback* callback;
+  void* data;
+} work_queue_entry;
+
+struct rt_work_queue {
+  u32 volatile completionGoal;
+  u32 volatile completionCount;
+  u32 volatile nextEntryToWrite;
+  u32 volatile nextEntryToRead;
+  sem_t semaphore;
+  work_queue_entry entries[WORK_QUEUE_ENTRY_NUM];
+
+  pthread_t threads[WORK_QUEUE_MAX_THREADS];
+  u32 threadNum;
+};
+
+static void workQueue_add(rt_work_queue* queue, rt_work_callback* callback,
+                          void* data) {
+  u32 entryIdx = queue->nextEntryToWrite;
+  u32 newNextEntryToWrite = (entryIdx + 1) % WORK_QUEUE_ENTRY_NUM;
+  ASSERT(newNextEntryToWrite !=
+         __atomic_load_n(&queue->nextEntryToRead, __ATOMIC_ACQUIRE));
+  work_queue_entry* entry = queue->entries + entryIdx;
+  entry->callback = callback;
+  entry->data = data;
+  queue->completionGoal++;
+  __atomic_store_n(&queue->nextEntryToWrite, newNextEntryToWrite,
+                   __ATOMIC_RELEASE);
+  sem_post(&queue->semaphore);
+}
+
+// Returns true when there was nothing to do
+static b32 workQueue_doNext(rt_work_queue* queue) {
+  u32 originalNextEntryToRead =
+    __atomic_load_n(&queue->nextEntryToRead, __ATOMIC_ACQUIRE);
+  if (originalNextEntryToRead ==
+      __atomic_load_n(&queue->nextEntryToWrite, __ATOMIC_ACQUIRE)) {
+    return true;
+  }
+  u32 newNextEntryToRead =
+    (originalNextEntryToRead + 1) % WORK_QUEUE_ENTRY_NUM;
+  if (__atomic_compare_exchange_n(&queue->nextEntryToRead,
+                                  &originalNextEntryToRead,
+                                  newNextEntryToRead, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    work_queue_entry entry = queue->entries[originalNextEntryToRead];
+    entry.callback(entry.data);
+    __atomic_add_fetch(&queue->completionCount, 1, __ATOMIC_ACQ_REL);
+  }
+  return false;
+}
+
+static void workQueue_completeAll(rt_work_queue* queue) {
+  while (__atomic_load_n(&queue->completionCount, __ATOMIC_ACQUIRE) !=
+         queue->completionGoal) {
+    workQueue_doNext(queue);
+  }
+  queue->completionGoal = 0;
+  __atomic_store_n(&queue->completionCount, 0, __ATOMIC_RELEASE);
+}
+
+static void* workQueue_threadProc(void* data) {
+  rt_work_queue* queue = (rt_work_queue*)data;
+  for (;;) {
+    if (workQueue_doNext(queue)) {
+      sem_wait(&queue->semaphore);
+    }
+  }
+  return NULL;
+}
+
+static void workQueue_init(rt_work_queue* queue, u32 threadNum) {
+  queue->completionGoal = 0;
+  queue->completionCount = 0;
+  queue->nextEntryToWrite = 0;
+  queue->nextEntryToRead = 0;
+  queue->threadNum = MIN(threadNum, WORK_QUEUE_MAX_THREADS);
+  sem_init(&queue->semaphore, 0, 0);
+  for (u32 i = 0; i < queue->threadNum; i++) {
+    pthread_create(queue->threads + i, NULL, workQueue_threadProc, queue);
+    pthread_detach(queue->threads[i]);
+  }
+}
@@ -9,13 +9,14 @@
 #include "../core/types.h"
 #include "../core/core.h"
 #include "../core/math.h"
+#include "../core/simd.h"
 #include "../core/mem.h"
 #include "../core/string.h"
 #include "../core/rotten_renderer.h"
 #include "../rotten_platform.h"
 
-#include "physics.h"
 #include "shapes.h"
+#include "physics.h"
 #include "collision.h"
 
 #include "car_game.h"
@@ -47,19 +48,31 @@ static void _free(void* ptr){}
 #include "noise.c"
 
 #include "collision_solver.cpp"
+#include "constraint_graph.cpp"
+#include "collision_solver_wide.cpp"
 
 #include "distance_joint.cpp"
 #include "hinge_joint.cpp"
 #include "slider_joint.cpp"
 #include "axis_joint.cpp"
 #include "joint.cpp"
+#include "broadphase.cpp"
+#include "physics_world.cpp"
+#include "island.cpp"
+#include "car_curves.cpp"
+#include "physics_thread.cpp"
 
 #include "ui_widgets.cpp"
 #include "ui.cpp"
 #include "mesh_shape.c"
 #include "gltf_import.cpp"
+#include "terrain_sample.cpp"
+#include "terrain_stream.cpp"
+#include "terrain_bake.cpp"
+#include "terrain_cache.cpp"
 #include "terrain.cpp"
 #include "car.cpp"
+#include "snapshot.cpp"
 #include "skybox.cpp"
 
 #endif //ALL_H
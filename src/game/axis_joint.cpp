@@ -5,54 +5,54 @@
 
 // Constraints motion along single axis - Chapter 2.3.5
 
-static void applyAxisLimitLinearVelocityStep(rigid_body* bodyA, rigid_body* bodyB, axis_joint* joint,
+static void applyAxisLimitLinearVelocityStep(physics_world* world,
+					     u32 bodyA, u32 bodyB, axis_joint* joint,
 					     f32 lambda, v3 aW, v3 rAPlusUCrossA, v3 rBCrossA) {
   f32 mA = joint->base.invMassA, mB = joint->base.invMassB;
-  m3x3 iA = bodyA->invWorlInertiaTensor;
-  m3x3 iB = bodyB->invWorlInertiaTensor;
+  m3x3 iA = world->invWorlInertiaTensor[bodyA];
+  m3x3 iB = world->invWorlInertiaTensor[bodyB];
   v3 impulse = aW * lambda;
   {
     v3 V = mA * impulse;
     v3 W = iA * rAPlusUCrossA * lambda;
 
-    bodyA->velocity = bodyA->velocity - V;
-    bodyA->angularVelocity = bodyA->angularVelocity - W;
+    world->velocity[bodyA] = world->velocity[bodyA] - V;
+    world->angularVelocity[bodyA] = world->angularVelocity[bodyA] - W;
   }
   {
     v3 V = mB * impulse;
     v3 W = iB * rBCrossA * lambda;
 
-    bodyB->velocity = bodyB->velocity + V;
-    bodyB->angularVelocity = bodyB->angularVelocity + W;
+    world->velocity[bodyB] = world->velocity[bodyB] + V;
+    world->angularVelocity[bodyB] = world->angularVelocity[bodyB] + W;
   }
 }
 
-inline void setupAxisJoint(joint* j, rigid_body* rbA, rigid_body* rbB,
+inline void setupAxisJoint(axis_joint* j, u32 rbA, u32 rbB,
 			   v3 pivotA, v3 pivotB, v3 axisIn,
 			   f32 herz, f32 damping) {
-  j->type = joint_type_axis;
-  j->axis.base.herz = herz;
-  j->axis.base.damping = damping;
-  j->axis.base.bodyA = rbA;
-  j->axis.base.bodyB = rbB;
-
-  j->axis.base.localOriginAnchorA = pivotA;
-  j->axis.base.localOriginAnchorB = pivotB;
-  j->axis.slideAxis = axisIn;
-
-  j->axis.base.localAnchorA = j->axis.base.localOriginAnchorA;
-  j->axis.base.localAnchorB = j->axis.base.localOriginAnchorB;
+  j->base.herz = herz;
+  j->base.damping = damping;
+  j->base.bodyA = rbA;
+  j->base.bodyB = rbB;
+
+  j->base.localOriginAnchorA = pivotA;
+  j->base.localOriginAnchorB = pivotB;
+  j->slideAxis = axisIn;
+
+  j->base.localAnchorA = j->base.localOriginAnchorA;
+  j->base.localAnchorB = j->base.localOriginAnchorB;
 }
 
-inline void preSolveAxisJoint(axis_joint* joint, f32 h) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void preSolveAxisJoint(physics_world* world, axis_joint* joint, f32 h) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
-  joint->base.invMassB = bodyB->invMass;
-  joint->base.invMassA = bodyA->invMass;
+  joint->base.invMassB = world->invMass[bodyB];
+  joint->base.invMassA = world->invMass[bodyA];
 
-  joint->base.invIB = bodyB->invWorlInertiaTensor;
-  joint->base.invIA = bodyA->invWorlInertiaTensor;
+  joint->base.invIB = world->invWorlInertiaTensor[bodyB];
+  joint->base.invIA = world->invWorlInertiaTensor[bodyA];
 
   v3 localAnchorA = joint->base.localAnchorA;
   v3 localAnchorB = joint->base.localAnchorB;
@@ -62,8 +62,8 @@ inline void preSolveAxisJoint(axis_joint* joint, f32 h) {
   m3x3 iA = joint->base.invIA;
   m3x3 iB = joint->base.invIB;
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 rA = qA * localAnchorA;
   v3 rB = qB * localAnchorB;
@@ -71,9 +71,9 @@ inline void preSolveAxisJoint(axis_joint* joint, f32 h) {
   // Constraint setup
   {
     v3 aW = qA * joint->slideAxis;
-    v3 dcA = bodyA->deltaPosition;
-    v3 dcB = bodyB->deltaPosition;
-    v3 centerDiff = (bodyB->position - bodyA->position);
+    v3 dcA = world->deltaPosition[bodyA];
+    v3 dcB = world->deltaPosition[bodyB];
+    v3 centerDiff = (world->position[bodyB] - world->position[bodyA]);
 
     v3 u = (dcB - dcA) + centerDiff + (rB - rA);
 
@@ -99,18 +99,19 @@ inline void preSolveAxisJoint(axis_joint* joint, f32 h) {
 
 // TODO: axis joint breaks if exposed to large forces.
 //       Figure out why.
-inline void solveAxisJoint(axis_joint* joint, f32 h, f32 invH, b32 useBias) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline f32 solveAxisJoint(physics_world* world, axis_joint* joint, f32 h,
+                          f32 invH, b32 useBias) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
-  v3 vA = bodyA->velocity;
-  v3 wA = bodyA->angularVelocity;
+  v3 vA = world->velocity[bodyA];
+  v3 wA = world->angularVelocity[bodyA];
 
-  v3 vB = bodyB->velocity;
-  v3 wB = bodyB->angularVelocity;
+  v3 vB = world->velocity[bodyB];
+  v3 wB = world->angularVelocity[bodyB];
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 localAnchorA = joint->base.localAnchorA;
   v3 localAnchorB = joint->base.localAnchorB;
@@ -121,8 +122,8 @@ inline void solveAxisJoint(axis_joint* joint, f32 h, f32 invH, b32 useBias) {
   // Constraint setup
   v3 aW = qA * joint->slideAxis;
 
-  v3 dcA = bodyA->deltaPosition;
-  v3 dcB = bodyB->deltaPosition;
+  v3 dcA = world->deltaPosition[bodyA];
+  v3 dcB = world->deltaPosition[bodyB];
 
   v3 u = (dcB - dcA) + joint->centerDiff0 + (rB - rA);
 
@@ -158,18 +159,19 @@ inline void solveAxisJoint(axis_joint* joint, f32 h, f32 invH, b32 useBias) {
   // Store total impulse
   impulse = joint->totalImpulse - oldImpulse;
 
-  applyAxisLimitLinearVelocityStep(bodyA, bodyB, joint, impulse, aW, rAPlusUCrossA, rBCrossA);
+  applyAxisLimitLinearVelocityStep(world, bodyA, bodyB, joint, impulse, aW, rAPlusUCrossA, rBCrossA);
+  return fabsf(impulse);
 }
 
-inline void warmStartAxisJoint(axis_joint* joint) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void warmStartAxisJoint(physics_world* world, axis_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
-  joint->base.invMassB = bodyB->invMass;
-  joint->base.invMassA = bodyA->invMass;
+  joint->base.invMassB = world->invMass[bodyB];
+  joint->base.invMassA = world->invMass[bodyA];
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 localAnchorA = joint->base.localAnchorA;
   v3 localAnchorB = joint->base.localAnchorB;
@@ -180,14 +182,14 @@ inline void warmStartAxisJoint(axis_joint* joint) {
   // Constraint setup
   v3 aW = qA * joint->slideAxis;
 
-  v3 dcA = bodyA->deltaPosition;
-  v3 dcB = bodyB->deltaPosition;
+  v3 dcA = world->deltaPosition[bodyA];
+  v3 dcB = world->deltaPosition[bodyB];
 
   v3 u = (dcB - dcA) + joint->centerDiff0 + (rB - rA);
 
   v3 rBCrossA = v3_cross(rB, aW);
   v3 rAPlusUCrossA = v3_cross(rA + u, aW);
 
-  applyAxisLimitLinearVelocityStep(bodyA, bodyB, joint, 
+  applyAxisLimitLinearVelocityStep(world, bodyA, bodyB, joint, 
                                    joint->totalImpulse, aW, rAPlusUCrossA, rBCrossA);
 }
@@ -0,0 +1,395 @@
+#include "all.h"
+// Dynamic AABB tree broadphase.
+//
+// Each body with shapes is a leaf in a balanced bounding volume tree. The
+// leaf box is enlarged by a margin and by the distance the body travels in
+// a few steps, so most steps the body stays inside its old box and the
+// tree is left alone. Only the bodies that left their box are reinserted
+// and query the tree for new pairs, the pairs between resting bodies are
+// kept from the previous step. Insert, remove and query are O(log n), so
+// a step costs O(m log n) for m moved bodies.
+
+#define BROADPHASE_MARGIN 0.1f
+#define BROADPHASE_VELOCITY_STEPS 2.f
+#define BROADPHASE_PAIRS_PER_BODY 8
+#define AABB_TREE_NULL -1
+
+inline b32 aabbOverlap(aabb a, aabb b) {
+  return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+         a.min.y <= b.max.y && b.min.y <= a.max.y &&
+         a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+inline b32 aabbContains(aabb a, aabb b) {
+  return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z &&
+         b.max.x <= a.max.x && b.max.y <= a.max.y && b.max.z <= a.max.z;
+}
+
+inline aabb aabbUnion(aabb a, aabb b) {
+  aabb result = {
+    {MIN(a.min.x, b.min.x), MIN(a.min.y, b.min.y), MIN(a.min.z, b.min.z)},
+    {MAX(a.max.x, b.max.x), MAX(a.max.y, b.max.y), MAX(a.max.z, b.max.z)}};
+  return result;
+}
+
+inline f32 aabbArea(aabb a) {
+  v3 d = a.max - a.min;
+  return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+inline void aabbAddPoint(aabb* box, v3 p) {
+  box->min.x = MIN(box->min.x, p.x);
+  box->min.y = MIN(box->min.y, p.y);
+  box->min.z = MIN(box->min.z, p.z);
+  box->max.x = MAX(box->max.x, p.x);
+  box->max.y = MAX(box->max.y, p.y);
+  box->max.z = MAX(box->max.z, p.z);
+}
+
+// Streams are pushed every frame like the rest of the world, the tree
+// itself is only reset on the first allocation.
+static void allocBroadphase(broadphase_state* broadphase, memory_arena* arena,
+                            u32 bodyCapacity) {
+  if (broadphase->nodeCapacity == 0) {
+    broadphase->nodeNum = 0;
+    broadphase->freeNode = AABB_TREE_NULL;
+    broadphase->root = AABB_TREE_NULL;
+  }
+  broadphase->bounds = pushArray(arena, bodyCapacity, aabb);
+  broadphase->proxy = pushArray(arena, bodyCapacity, i32);
+  broadphase->collisionGroup = pushArray(arena, bodyCapacity, u32);
+  broadphase->nodeCapacity = 2 * bodyCapacity;
+  broadphase->nodes =
+    pushArray(arena, broadphase->nodeCapacity, aabb_tree_node);
+  broadphase->pairCapacity = bodyCapacity * BROADPHASE_PAIRS_PER_BODY;
+  broadphase->pairs = pushArray(arena, broadphase->pairCapacity, body_pair);
+}
+
+static i32 aabbTreeAllocNode(broadphase_state* broadphase) {
+  i32 nodeIdx = broadphase->freeNode;
+  if (nodeIdx != AABB_TREE_NULL) {
+    broadphase->freeNode = broadphase->nodes[nodeIdx].parent;
+  } else {
+    ASSERT(broadphase->nodeNum < broadphase->nodeCapacity);
+    nodeIdx = broadphase->nodeNum++;
+  }
+  aabb_tree_node* node = broadphase->nodes + nodeIdx;
+  node->parent = AABB_TREE_NULL;
+  node->child1 = AABB_TREE_NULL;
+  node->child2 = AABB_TREE_NULL;
+  node->height = 0;
+  node->body = 0;
+  return nodeIdx;
+}
+
+static void aabbTreeFreeNode(broadphase_state* broadphase, i32 nodeIdx) {
+  broadphase->nodes[nodeIdx].parent = broadphase->freeNode;
+  broadphase->nodes[nodeIdx].height = -1;
+  broadphase->freeNode = nodeIdx;
+}
+
+// Rotates the taller child of node A up if the children heights differ by
+// more than one. Returns the new root of the subtree.
+static i32 aabbTreeBalance(broadphase_state* broadphase, i32 iA) {
+  aabb_tree_node* nodes = broadphase->nodes;
+  aabb_tree_node* A = nodes + iA;
+  if (A->child1 == AABB_TREE_NULL || A->height < 2) {
+    return iA;
+  }
+  i32 iB = A->child1;
+  i32 iC = A->child2;
+  aabb_tree_node* B = nodes + iB;
+  aabb_tree_node* C = nodes + iC;
+  i32 balance = C->height - B->height;
+
+  if (balance > 1) {
+    // Rotate C up
+    i32 iF = C->child1;
+    i32 iG = C->child2;
+    aabb_tree_node* F = nodes + iF;
+    aabb_tree_node* G = nodes + iG;
+    C->child1 = iA;
+    C->parent = A->parent;
+    A->parent = iC;
+    if (C->parent == AABB_TREE_NULL) {
+      broadphase->root = iC;
+    } else if (nodes[C->parent].child1 == iA) {
+      nodes[C->parent].child1 = iC;
+    } else {
+      nodes[C->parent].child2 = iC;
+    }
+    if (F->height > G->height) {
+      C->child2 = iF;
+      A->child2 = iG;
+      G->parent = iA;
+      A->box = aabbUnion(B->box, G->box);
+      C->box = aabbUnion(A->box, F->box);
+      A->height = 1 + MAX(B->height, G->height);
+      C->height = 1 + MAX(A->height, F->height);
+    } else {
+      C->child2 = iG;
+      A->child2 = iF;
+      F->parent = iA;
+      A->box = aabbUnion(B->box, F->box);
+      C->box = aabbUnion(A->box, G->box);
+      A->height = 1 + MAX(B->height, F->height);
+      C->height = 1 + MAX(A->height, G->height);
+    }
+    return iC;
+  }
+
+  if (balance < -1) {
+    // Rotate B up
+    i32 iD = B->child1;
+    i32 iE = B->child2;
+    aabb_tree_node* D = nodes + iD;
+    aabb_tree_node* E = nodes + iE;
+    B->child1 = iA;
+    B->parent = A->parent;
+    A->parent = iB;
+    if (B->parent == AABB_TREE_NULL) {
+      broadphase->root = iB;
+    } else if (nodes[B->parent].child1 == iA) {
+      nodes[B->parent].child1 = iB;
+    } else {
+      nodes[B->parent].child2 = iB;
+    }
+    if (D->height > E->height) {
+      B->child2 = iD;
+      A->child1 = iE;
+      E->parent = iA;
+      A->box = aabbUnion(C->box, E->box);
+      B->box = aabbUnion(A->box, D->box);
+      A->height = 1 + MAX(C->height, E->height);
+      B->height = 1 + MAX(A->height, D->height);
+    } else {
+      B->child2 = iE;
+      A->child1 = iD;
+      D->parent = iA;
+      A->box = aabbUnion(C->box, D->box);
+      B->box = aabbUnion(A->box, E->box);
+      A->height = 1 + MAX(C->height, D->height);
+      B->height = 1 + MAX(A->height, E->height);
+    }
+    return iB;
+  }
+  return iA;
+}
+
+// Walks up from the node fixing boxes and heights
+static void aabbTreeRefit(broadphase_state* broadphase, i32 nodeIdx) {
+  aabb_tree_node* nodes = broadphase->nodes;
+  while (nodeIdx != AABB_TREE_NULL) {
+    nodeIdx = aabbTreeBalance(broadphase, nodeIdx);
+    aabb_tree_node* node = nodes + nodeIdx;
+    aabb_tree_node* child1 = nodes + node->child1;
+    aabb_tree_node* child2 = nodes + node->child2;
+    node->height = 1 + MAX(child1->height, child2->height);
+    node->box = aabbUnion(child1->box, child2->box);
+    nodeIdx = node->parent;
+  }
+}
+
+static void aabbTreeInsertLeaf(broadphase_state* broadphase, i32 leaf) {
+  aabb_tree_node* nodes = broadphase->nodes;
+  if (broadphase->root == AABB_TREE_NULL) {
+    broadphase->root = leaf;
+    nodes[leaf].parent = AABB_TREE_NULL;
+    return;
+  }
+
+  // Find the cheapest sibling by the surface area heuristic
+  aabb leafBox = nodes[leaf].box;
+  i32 nodeIdx = broadphase->root;
+  while (nodes[nodeIdx].height > 0) {
+    aabb_tree_node* node = nodes + nodeIdx;
+    f32 area = aabbArea(node->box);
+    f32 combinedArea = aabbArea(aabbUnion(node->box, leafBox));
+    // Cost of making a new parent for this node and the leaf
+    f32 cost = 2.f * combinedArea;
+    // Cost of pushing the leaf further down the tree
+    f32 inheritanceCost = 2.f * (combinedArea - area);
+
+    f32 childCost[2];
+    i32 children[2] = {node->child1, node->child2};
+    for (i32 i = 0; i < 2; i++) {
+      aabb_tree_node* child = nodes + children[i];
+      f32 unionArea = aabbArea(aabbUnion(leafBox, child->box));
+      if (child->height == 0) {
+        childCost[i] = unionArea + inheritanceCost;
+      } else {
+        childCost[i] = unionArea - aabbArea(child->box) + inheritanceCost;
+      }
+    }
+    if (cost < childCost[0] && cost < childCost[1]) {
+      break;
+    }
+    nodeIdx = childCost[0] < childCost[1] ? children[0] : children[1];
+  }
+
+  i32 sibling = nodeIdx;
+  i32 oldParent = nodes[sibling].parent;
+  i32 newParent = aabbTreeAllocNode(broadphase);
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = aabbUnion(leafBox, nodes[sibling].box);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+  if (oldParent == AABB_TREE_NULL) {
+    broadphase->root = newParent;
+  } else if (nodes[oldParent].child1 == sibling) {
+    nodes[oldParent].child1 = newParent;
+  } else {
+    nodes[oldParent].child2 = newParent;
+  }
+  aabbTreeRefit(broadphase, newParent);
+}
+
+static void aabbTreeRemoveLeaf(broadphase_state* broadphase, i32 leaf) {
+  aabb_tree_node* nodes = broadphase->nodes;
+  if (leaf == broadphase->root) {
+    broadphase->root = AABB_TREE_NULL;
+    return;
+  }
+  i32 parent = nodes[leaf].parent;
+  i32 grandParent = nodes[parent].parent;
+  i32 sibling = nodes[parent].child1 == leaf ? nodes[parent].child2
+                                             : nodes[parent].child1;
+  if (grandParent == AABB_TREE_NULL) {
+    broadphase->root = sibling;
+    nodes[sibling].parent = AABB_TREE_NULL;
+  } else {
+    if (nodes[grandParent].child1 == parent) {
+      nodes[grandParent].child1 = sibling;
+    } else {
+      nodes[grandParent].child2 = sibling;
+    }
+    nodes[sibling].parent = grandParent;
+    aabbTreeRefit(broadphase, grandParent);
+  }
+  aabbTreeFreeNode(broadphase, parent);
+}
+
+// Shapes are placed the same way as in the terrain collision, see carCollide
+static aabb bodyBounds(physics_world* world, u32 body) {
+  aabb result = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+  v3 position = world->position[body];
+  v3 localCenter = world->localCenter[body];
+  m3x3 orientation = world->orientation[body];
+  shape* shapes = world->shapes + world->firstShape[body];
+  for (i32 i = 0; i < world->shapeNum[body]; i++) {
+    shape* bShape = shapes + i;
+    if (bShape->type == shape_type::SHAPE_POINT) {
+      aabbAddPoint(&result,
+                   position + orientation * (bShape->point.p - localCenter));
+    } else if (bShape->type == shape_type::SHAPE_SPHERE) {
+      v3 center = position + localCenter;
+      f32 r = bShape->sphere.radius;
+      aabbAddPoint(&result, center - (v3){r, r, r});
+      aabbAddPoint(&result, center + (v3){r, r, r});
+    }
+  }
+  return result;
+}
+
+// Enlarges the box by the margin and by the distance the body moves in
+// the next few steps
+static aabb broadphaseFatBounds(aabb box, v3 velocity, f32 delta) {
+  v3 margin = {BROADPHASE_MARGIN, BROADPHASE_MARGIN, BROADPHASE_MARGIN};
+  v3 d = velocity * (BROADPHASE_VELOCITY_STEPS * delta);
+  aabb result = {box.min - margin, box.max + margin};
+  result.min.x += MIN(d.x, 0.f);
+  result.min.y += MIN(d.y, 0.f);
+  result.min.z += MIN(d.z, 0.f);
+  result.max.x += MAX(d.x, 0.f);
+  result.max.y += MAX(d.y, 0.f);
+  result.max.z += MAX(d.z, 0.f);
+  return result;
+}
+
+static void broadphaseAddPair(broadphase_state* broadphase, u32 bodyA,
+                              u32 bodyB) {
+  if (broadphase->pairNum == broadphase->pairCapacity) {
+    broadphase->droppedPairNum++;
+    return;
+  }
+  body_pair* pair = broadphase->pairs + broadphase->pairNum++;
+  pair->bodyA = MIN(bodyA, bodyB);
+  pair->bodyB = MAX(bodyA, bodyB);
+}
+
+// Updates the tree and the candidate body pairs in broadphase->pairs.
+// Pairs have bodyA < bodyB and their enlarged boxes overlap.
+static void broadphaseUpdate(physics_world* world, memory_arena* tempArena,
+                             f32 delta) {
+  broadphase_state* broadphase = &world->broadphase;
+  aabb_tree_node* nodes = broadphase->nodes;
+  u8* moved = pushArrayZeros(tempArena, world->bodyNum, u8);
+  u32* movedBodies = pushArray(tempArena, world->bodyNum, u32);
+  u32 movedNum = 0;
+
+  for (u32 body = 0; body < world->bodyNum; body++) {
+    // Sleeping bodies don't move, disabled ones are moved by their owner
+    if (world->shapeNum[body] == 0 ||
+        !(world->awake[body] || world->disabled[body])) {
+      continue;
+    }
+    aabb box = bodyBounds(world, body);
+    i32 leaf = broadphase->proxy[body];
+    if (leaf != AABB_TREE_NULL) {
+      if (aabbContains(nodes[leaf].box, box)) {
+        continue;
+      }
+      aabbTreeRemoveLeaf(broadphase, leaf);
+    } else {
+      leaf = aabbTreeAllocNode(broadphase);
+      nodes[leaf].body = body;
+      broadphase->proxy[body] = leaf;
+    }
+    nodes[leaf].box = broadphaseFatBounds(box, world->velocity[body], delta);
+    broadphase->bounds[body] = nodes[leaf].box;
+    aabbTreeInsertLeaf(broadphase, leaf);
+    moved[body] = true;
+    movedBodies[movedNum++] = body;
+  }
+
+  // Boxes of resting bodies didn't change so their pairs are still valid
+  u32 pairNum = 0;
+  for (u32 i = 0; i < broadphase->pairNum; i++) {
+    body_pair pair = broadphase->pairs[i];
+    if (!moved[pair.bodyA] && !moved[pair.bodyB]) {
+      broadphase->pairs[pairNum++] = pair;
+    }
+  }
+  broadphase->pairNum = pairNum;
+  broadphase->droppedPairNum = 0;
+
+  u32* group = broadphase->collisionGroup;
+  i32* stack = pushArray(tempArena, broadphase->nodeCapacity, i32);
+  for (u32 i = 0; i < movedNum; i++) {
+    u32 bodyA = movedBodies[i];
+    aabb boxA = broadphase->bounds[bodyA];
+    u32 stackNum = 0;
+    stack[stackNum++] = broadphase->root;
+    while (stackNum > 0) {
+      aabb_tree_node* node = nodes + stack[--stackNum];
+      if (!aabbOverlap(node->box, boxA)) {
+        continue;
+      }
+      if (node->height > 0) {
+        stack[stackNum++] = node->child1;
+        stack[stackNum++] = node->child2;
+        continue;
+      }
+      u32 bodyB = node->body;
+      // Pairs of two moved bodies are added by the one with lower index
+      if (bodyB == bodyA || group[bodyB] == group[bodyA] ||
+          (moved[bodyB] && bodyB < bodyA)) {
+        continue;
+      }
+      broadphaseAddPair(broadphase, bodyA, bodyB);
+    }
+  }
+}
@@ -4,6 +4,16 @@
 
 #define WHEEL_NUM 4
 #define RIGID_BODY_NUM 1 + WHEEL_NUM
+#define CAR_CHASSIS_SHAPE_NUM 8
+#define MAX_CARS 256
+
+// Cars farther than carLodRaycastDistance from the first car switch to the
+// raycast model and back to the full model when closer than
+// carLodFullDistance. The gap keeps a car at the edge from switching back
+// and forth.
+static b32 enableCarLod = true;
+static f32 carLodRaycastDistance = 80.f;
+static f32 carLodFullDistance = 60.f;
 
 typedef struct vs_uniform_params {
   m4x4 modelMat;
@@ -62,7 +72,11 @@ car_properties carProperties = {
   .suspensionDamping = 1.0f,
   .engineInertia = 0.05f,
   .differentialRatio = 4.0f,
-  .transmissionEfficiency = 1.0f
+  .transmissionEfficiency = 1.0f,
+  .tireModel = tire_model_bezier,
+  .slipRatioPacejka = {.B = 8.f, .C = 1.6f, .D = 0.5f, .E = 0.6f, .Sv = 0.f},
+  .slipAnglePacejka = {.B = 6.f, .C = 1.4f, .D = 0.15f, .E = -0.5f,
+                       .Sv = 0.6f},
 };
 
 static read_gltf_node_result readGltfNodeData(memory_arena* tempArena,
@@ -243,117 +257,175 @@ static void carCreateModel(memory_arena* permanentArena, memory_arena* tempArena
   }
 }
 
-static void carSetInitialState(car_game_state* game) {
-  car_state* car = &game->car;
+inline u32 carWheelBody(car_state* car, u32 wheel) {
+  return car->chassis + 1 + wheel;
+}
+
+inline hinge_joint* carWheelHinge(physics_world* world, car_state* car,
+                                  u32 wheel) {
+  return world->hingeJoints + car->firstJoint[joint_type_hinge] + wheel;
+}
+
+inline slider_joint* carWheelSuspension(physics_world* world, car_state* car,
+                                        u32 wheel) {
+  return world->sliderJoints + car->firstJoint[joint_type_slider] + wheel;
+}
+
+inline axis_joint* carWheelSuspensionLimits(physics_world* world,
+                                            car_state* car, u32 wheel) {
+  return world->axisJoints + car->firstJoint[joint_type_axis] + wheel;
+}
+
+// Rest position of the wheel center in chassis space, relative to the
+// chassis center of mass
+inline v3 carWheelPivot(physics_world* world, car_state* car, u32 wheel) {
+  v3 offset = (v3){0.f, 0.f, car->properties.suspensionPosHeight} -
+    world->localCenter[car->chassis];
+  return car->wheelModel[wheel].transform[0] * offset;
+}
+
+static void allocCarWorld(car_game_state* game, memory_arena* arena) {
+  u32 jointCapacity[_joint_type_num] = {0};
+  jointCapacity[joint_type_hinge] = WHEEL_NUM * MAX_CARS;
+  jointCapacity[joint_type_slider] = WHEEL_NUM * MAX_CARS;
+  jointCapacity[joint_type_axis] = WHEEL_NUM * MAX_CARS;
+  allocPhysicsWorld(&game->world, arena,
+                    1 + (RIGID_BODY_NUM) * MAX_CARS,
+                    jointCapacity,
+                    (CAR_CHASSIS_SHAPE_NUM + WHEEL_NUM) * MAX_CARS,
+                    MAX_CONTACTS * MAX_CARS);
+  game->world.workQueue = platformApi->workQueue;
+  game->world.workerNum = platformApi->workerThreadNum;
+}
+
+static void carAddToWorld(car_game_state* game, car_state* car) {
+  physics_world* world = &game->world;
+  // Default tuning, set car->properties before carSetupBody to change it
   car->properties = carProperties;
-  car->body.chassis.id = 0;
-  car->body.chassis.forwardAxis = V3_X_UP;
-  car->body.chassis.orientation = M3X3_IDENTITY;
-  car->body.chassis.orientationQuat = QUAT_IDENTITY;
-  car->body.chassis.angularVelocity = (v3){0.f, 0.f, 0.f};
-  car->body.chassis.localCenter = carProperties.localCenter;
-  car->body.chassis.position = (v3){-27.175f, -150.252f, -44.260f};
-  car->body.chassis.origin =
-    car->body.chassis.position -
-    car->body.chassis.orientation * car->body.chassis.localCenter;
+  car->chassis = physicsWorldAddBody(world, CAR_CHASSIS_SHAPE_NUM);
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    u32 wheel = physicsWorldAddBody(world, 1);
+    world->broadphase.collisionGroup[wheel] = car->chassis;
+  }
+  for (u32 type = 0; type < _joint_type_num; type++) {
+    car->firstJoint[type] = world->typeJointNum[type];
+  }
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    physicsWorldAddJoint(world, joint_type_hinge);
+    physicsWorldAddJoint(world, joint_type_slider);
+    physicsWorldAddJoint(world, joint_type_axis);
+  }
+  car->firstContact = physicsWorldAddContacts(world, MAX_CONTACTS);
+}
+
+static void carSetInitialState(car_game_state* game, car_state* car) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  world->forwardAxis[chassis] = V3_X_UP;
+  world->orientation[chassis] = M3X3_IDENTITY;
+  world->orientationQuat[chassis] = QUAT_IDENTITY;
+  world->angularVelocity[chassis] = (v3){0.f, 0.f, 0.f};
+  world->localCenter[chassis] = car->properties.localCenter;
+  world->position[chassis] = (v3){-27.175f, -150.252f, -44.260f};
+  world->origin[chassis] =
+    world->position[chassis] -
+    world->orientation[chassis] * world->localCenter[chassis];
 
   for (i32 i = 0; i < WHEEL_NUM; i++) {
-    car->body.wheels[i].orientation = M3X3_IDENTITY;
-    car->body.wheels[i].orientationQuat = QUAT_IDENTITY;
-    car->body.wheels[i].id = 1 + i;
+    u32 wheel = carWheelBody(car, i);
+    world->orientation[wheel] = M3X3_IDENTITY;
+    world->orientationQuat[wheel] = QUAT_IDENTITY;
 
-    v3 offset = (v3){0.f, 0.f, carProperties.suspensionPosHeight} - car->body.chassis.localCenter;
-    v3 pivot = car->wheelModel[i].transform[0] * offset;
-    car->body.wheels[i].position =
-      pivot + car->body.chassis.position;
+    v3 pivot = carWheelPivot(world, car, i);
+    world->position[wheel] =
+      pivot + world->position[chassis];
 
-    car->body.wheels[i].origin =
-      car->body.wheels[i].position -
-      car->body.wheels[i].localCenter * car->body.wheels[i].orientation;
+    world->origin[wheel] =
+      world->position[wheel] -
+      world->localCenter[wheel] * world->orientation[wheel];
   }
 }
 
-static void carSetupBody(car_game_state* game) {
-  car_state* car = &game->car;
-  shape* chassisShape = &car->bodyShapes[0];
-  chassisShape->type = shape_type::SHAPE_BOX;
-  shape_box box = carProperties.chassisShape;
-  v3 boxVertices[8];
+static void carSetupBody(car_game_state* game, car_state* car) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  shape* shapes = world->shapes + world->firstShape[chassis];
+  shape_box box = car->properties.chassisShape;
+  v3 boxVertices[CAR_CHASSIS_SHAPE_NUM];
   u32 shapeNum = arrayLen(boxVertices);
   decomposeBoxShape(box, (f32*)boxVertices);
   for (u32 i = 0; i < shapeNum; i++) {
-    car->bodyShapes[i].type = shape_type::SHAPE_POINT;
-    car->bodyShapes[i].point.p = boxVertices[i];
+    shapes[i].type = shape_type::SHAPE_POINT;
+    shapes[i].point.p = boxVertices[i];
   }
-  car->body.chassis.shapeNum = shapeNum;
   v3 size = box.size;
-  f32 mass = carProperties.chassisMass;  // kg
+  f32 mass = car->properties.chassisMass;  // kg
 
-  car->body.chassis.localCenter = carProperties.localCenter;
-  car->body.chassis.mass = mass;
-  car->body.chassis.invMass = 1.0f / mass;
+  world->localCenter[chassis] = car->properties.localCenter;
+  world->mass[chassis] = mass;
+  world->invMass[chassis] = 1.0f / mass;
 
   // Solid cuboid
-  car->body.chassis.invBodyInertiaTensor.m00 =
+  m3x3 chassisInertia = {0};
+  chassisInertia.m00 =
     (1.f / 8.f) * mass * (size.y * size.y + size.z * size.z);
-  car->body.chassis.invBodyInertiaTensor.m11 =
+  chassisInertia.m11 =
     (1.f / 8.f) * mass * (size.x * size.x + size.z * size.z);
-  car->body.chassis.invBodyInertiaTensor.m22 =
+  chassisInertia.m22 =
     (1.f / 8.f) * mass * (size.x * size.x + size.y * size.y);
 
-  car->body.chassis.invBodyInertiaTensor =
-    m3x3_inverse(car->body.chassis.invBodyInertiaTensor);
+  world->invBodyInertiaTensor[chassis] = m3x3_inverse(chassisInertia);
 
-  car->body.chassis.friction = 0.3f;
-  m3x3 bI = car->body.chassis.invBodyInertiaTensor;
-  car->body.chassis.invWorlInertiaTensor =
-    car->body.chassis.orientation * bI *
-    m3x3_transpose(car->body.chassis.orientation);
+  world->friction[chassis] = 0.3f;
+  m3x3 bI = world->invBodyInertiaTensor[chassis];
+  world->invWorlInertiaTensor[chassis] =
+    world->orientation[chassis] * bI *
+    m3x3_transpose(world->orientation[chassis]);
 
   // Car wheels body setup
   for (u32 i = 0; i < WHEEL_NUM; i++) {
-    shape* sphere = &car->bodyShapes[car->body.chassis.shapeNum + i];
+    u32 wheel = carWheelBody(car, i);
+    shape* sphere = world->shapes + world->firstShape[wheel];
     sphere->type = shape_type::SHAPE_SPHERE;
-    sphere->sphere = carProperties.wheelShape;
+    sphere->sphere = car->properties.wheelShape;
     f32 wheelRadius = sphere->sphere.radius;
-    f32 mass = carProperties.wheelMass;  // kg
-    v3 offset = (v3){0.f, 0.f, carProperties.suspensionPosHeight} - car->body.chassis.localCenter;
-    v3 pivot = car->wheelModel[i].transform[0] * offset;
-    car->body.wheels[i].mass = mass;
-    car->body.wheels[i].invMass = 1.0f / mass;
+    f32 mass = car->properties.wheelMass;  // kg
+    v3 pivot = carWheelPivot(world, car, i);
+    world->mass[wheel] = mass;
+    world->invMass[wheel] = 1.0f / mass;
 
     // Solid Sylinder
     f32 wheelWidth = wheelRadius * 0.5f;
-    car->body.wheels[i].invBodyInertiaTensor.m00 =
+    m3x3* wheelInertia = world->invBodyInertiaTensor + wheel;
+    wheelInertia->m00 =
       (1.f / 12.f) * mass *
       (3.f * (wheelRadius * wheelRadius) + (wheelWidth * wheelWidth));
-    car->body.wheels[i].invBodyInertiaTensor.m11 =
+    wheelInertia->m11 =
       (1.f / 2.f) * mass * (wheelRadius * wheelRadius);
-    car->body.wheels[i].invBodyInertiaTensor.m22 =
+    wheelInertia->m22 =
       (1.f / 12.f) * mass *
       (3.f * (wheelRadius * wheelRadius) + (wheelWidth * wheelWidth));
 
-    m3x3 wbI = car->body.wheels[i].invBodyInertiaTensor;
-    car->body.wheels[i].invWorlInertiaTensor =
-      car->body.wheels[i].orientation *
+    m3x3 wbI = world->invBodyInertiaTensor[wheel];
+    world->invWorlInertiaTensor[wheel] =
+      world->orientation[wheel] *
       wbI *
-      m3x3_transpose(car->body.wheels[i].orientation);
+      m3x3_transpose(world->orientation[wheel]);
 
-    car->body.wheels[i].friction = i < 2 ?
-      carProperties.rearWheelBaseFriction :
-      carProperties.frontWheelBaseFriction;
-    car->body.wheels[i].shapeNum = 1;
+    world->friction[wheel] = i < 2 ?
+      car->properties.rearWheelBaseFriction :
+      car->properties.frontWheelBaseFriction;
 
-    setupHingeJoint(&car->joints[i].wheelHinge, &car->body.chassis,
-                    &car->body.wheels[i], pivot, {0.f,0.f,0.f},
+    setupHingeJoint(carWheelHinge(world, car, i), chassis,
+                    wheel, pivot, {0.f,0.f,0.f},
                     {0.0f,1.0f,0.0f}, 30.f, 1.0f);
-    setupSliderJoint(&car->joints[i].wheelSuspension, &car->body.chassis,
-                     &car->body.wheels[i], {pivot.x,pivot.y,pivot.z}, {0.f,0.f,0.f},
+    setupSliderJoint(carWheelSuspension(world, car, i), chassis,
+                     wheel, {pivot.x,pivot.y,pivot.z}, {0.f,0.f,0.f},
                      {0.f,0.f,1.f}, 30.f, 1.0f);
-    setupAxisJoint(&car->joints[i].wheelSuspensionLimits, &car->body.chassis,
-                   &car->body.wheels[i], pivot, {0.f,0.f,0.f},
+    setupAxisJoint(carWheelSuspensionLimits(world, car, i), chassis,
+                   wheel, pivot, {0.f,0.f,0.f},
                    {0.0f,0.0f,1.0f}, 
-                   carProperties.suspensionHz, carProperties.suspensionDamping);
+                   car->properties.suspensionHz, car->properties.suspensionDamping);
   }
 }
 
@@ -397,10 +469,13 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
                       ui_widget_context* widgetContext,
                       m4x4 view, m4x4 proj) {
   car_state* car = &game->car;
+  physics_world* world = &game->world;
+  render_state* state = game->renderState;
+  u32 chassis = car->chassis;
     // Max eight levels deep nested children, should be enough.
   if (isBitSet(game->debug.visibilityState, visibility_state_car)) {
-    v4 origin = v4_from_v3(car->body.chassis.origin - game->camera.position, 1.f);
-    m4x4 orientation = m4x4_from_m3x3(car->body.chassis.orientation);
+    v4 origin = v4_from_v3(world->renderOrigin[chassis] - game->camera.position, 1.f);
+    m4x4 orientation = m4x4_from_m3x3(world->renderOrientation[chassis]);
     m4x4 modelMat = m4x4_translate_make(origin) * orientation;
 
     m4x4 matStack[8];
@@ -479,10 +554,11 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
       matStackIdx = 0;
       childNum = 0;
 
-      v4 originVec = v4_from_v3(car->body.wheels[wheelIdx].origin - game->camera.position, 1.f);
+      u32 wheel = carWheelBody(car, wheelIdx);
+      v4 originVec = v4_from_v3(world->renderOrigin[wheel] - game->camera.position, 1.f);
 
       m4x4 origin = m4x4_translate_make(originVec);
-      m4x4 orientation = m4x4_from_m3x3(car->body.wheels[wheelIdx].orientation);
+      m4x4 orientation = m4x4_from_m3x3(world->renderOrientation[wheel]);
 
       modelMat = origin * orientation;
 
@@ -530,15 +606,16 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
 
   if (isBitSet(game->debug.visibilityState, visibility_state_car_colliders))
   {
-    v3 vertices[8];
-    for (u32 i = 0; i < 8; i++) {
-      vertices[i] = car->bodyShapes[i].point.p;
+    v3 vertices[CAR_CHASSIS_SHAPE_NUM];
+    shape* shapes = world->shapes + world->firstShape[chassis];
+    for (u32 i = 0; i < CAR_CHASSIS_SHAPE_NUM; i++) {
+      vertices[i] = shapes[i].point.p;
     }
     shape_box box = createBoxShape((f32*)vertices);
     {
-      v4 originVec = v4_from_v3(car->body.chassis.origin - game->camera.position, 1.f);
+      v4 originVec = v4_from_v3(world->renderOrigin[chassis] - game->camera.position, 1.f);
       m4x4 origin = m4x4_translate_make(originVec);
-      m4x4 orientation = m4x4_from_m3x3(car->body.chassis.orientation);
+      m4x4 orientation = m4x4_from_m3x3(world->renderOrientation[chassis]);
 
       m4x4 modelMat = origin * orientation;
 
@@ -554,8 +631,8 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
     }
     // Note: in greater speeds the contact points may visually lag behind.
     //       This is because the velocity integration happens after contact test
-    for (u32 i = 0; i < car->contactPointNum; i++) {
-      contact_point* contactPoint = car->contactPointStorage + i;
+    for (u32 i = 0; i < state->contactPointNum; i++) {
+      contact_point* contactPoint = state->contactPoints + i;
       if (contactPoint->shapeIdx == -1) continue;
       v3 point = (v3){contactPoint->point.x,contactPoint->point.y,contactPoint->point.z};
       shape_box box =
@@ -575,14 +652,14 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
   if (isBitSet(game->debug.visibilityState, visibility_state_slip_angle))
   {
     for (u32 i = 0; i < WHEEL_NUM; i++){
-      f32 slipAngle = car->stats.slipAngle[i];
+      f32 slipAngle = state->carStats.slipAngle[i];
 
       rt_command_render_simple_arrow* cmd =
         rt_pushRenderCommand(rendererBuffer, render_simple_arrow);
       m4x4 m = m4x4_translate_make(
-        v4_from_v3(car->body.wheels[i].position - game->camera.position, 1.0f)) *
+        v4_from_v3(state->bodies.position[carWheelBody(car, i)] - game->camera.position, 1.0f)) *
         m4x4_rotate_make({0.0f,0.0f, -slipAngle}) *
-        m4x4_from_m3x3(car->body.chassis.orientation) *
+        m4x4_from_m3x3(world->renderOrientation[chassis]) *
         m4x4_scale_make({1.0f + fabsf(slipAngle),1.0f,1.0f});
 
       v4 c = LERP(
@@ -601,32 +678,25 @@ static void renderCar(car_game_state* game, memory_arena* tempArena,
 
 static f32 torqueFromRpm(car_state* car, i32 rpm, f32 throttle) {
   f32 rpmN = (f32)abs(rpm) / 7000.f;
-  f32 torque = (bezier6n(carProperties.motorTorqueCurve, rpmN) * 
-    carProperties.motorTorque * carProperties.differentialRatio * 
-    carProperties.gearRatios[car->stats.gear] * 
-    carProperties.transmissionEfficiency) * throttle;
+  f32 torque = (curveLutSample(&car->curves.motorTorque, rpmN) * 
+    car->properties.motorTorque * car->properties.differentialRatio * 
+    car->properties.gearRatios[car->stats.gear] * 
+    car->properties.transmissionEfficiency) * throttle;
 
   return torque;
 }
 
 static i32 rpmFromAngVel(car_state* car, f32 angVel) {
-  i32 rpm = angVel * carProperties.differentialRatio * 60 / 2 * PI
-    * carProperties.gearRatios[car->stats.gear];
+  i32 rpm = angVel * car->properties.differentialRatio * 60 / 2 * PI
+    * car->properties.gearRatios[car->stats.gear];
   return rpm;
 }
 
-static void carUpdate(car_game_state* game, 
-                      memory_arena* tempArena,
-                      rt_command_buffer* rendererBuffer,
-                      f32 delta) { 
-  car_state* car = &game->car;
-  input_state* input = &game->input;
-  v3 extraForces[RIGID_BODY_NUM];
-  v3 extraTorques[RIGID_BODY_NUM];
-  for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
-    extraForces[i] = V3_ZERO;
-    extraTorques[i] = V3_ZERO;
-  }
+static void carApplyInput(car_game_state* game, car_state* car,
+                          input_state* input, f32 delta) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  carCurvesUpdate(&car->curves, &car->properties);
 
   f32 angVelMSecMap[] = {0.f, 5.0f, 15.f, 30.f, 50.f, 100.f};
 
@@ -637,23 +707,28 @@ static void carUpdate(car_game_state* game,
     -(f32)(input->moveDown >= button_state_pressed) +
     (f32)(input->moveUp >= button_state_pressed)};
 
-  f32 longSpeed = v3_dot(car->body.chassis.forwardAxis, car->body.chassis.velocity);
+  f32 longSpeed = v3_dot(world->forwardAxis[chassis], world->velocity[chassis]);
   f32 longSpeedN = fabs(longSpeed / 50.f);
 
-  v3 hingeAxis = car->joints[0].wheelHinge.hinge.hingeAxis;
-  v4 localAxisARot = car->joints[0].wheelHinge.hinge.localAxisARotation;
+  hinge_joint* wheelHinges[WHEEL_NUM];
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    wheelHinges[i] = carWheelHinge(world, car, i);
+  }
+  v3 hingeAxis = wheelHinges[0]->hingeAxis;
+  v4 localAxisARot = wheelHinges[0]->localAxisARotation;
   f32 rotationRate = 0.f;
   for (i32 i = 0; i < 2; i++) {
     v3 wheelWAxis =
-      v3_rotate_axis_angle(hingeAxis * car->body.wheels[i].orientation,
+      v3_rotate_axis_angle(hingeAxis * world->orientation[carWheelBody(car, i)],
                            localAxisARot.w, localAxisARot.xyz);
   
-    rotationRate += v3_dot(wheelWAxis, car->body.wheels[i].angularVelocity);
+    rotationRate += v3_dot(wheelWAxis,
+                           world->angularVelocity[carWheelBody(car, i)]);
   }
  
   f32 flywheelRadius = 0.9f;
   f32 angVelMSec = (rotationRate / 2.f) * 
-    carProperties.wheelShape.radius * flywheelRadius;
+    car->properties.wheelShape.radius * flywheelRadius;
   b32 shiftingGears = car->stats.gearShiftT > 0.0f;
 
   car->stats.gearShiftT -= delta;
@@ -671,15 +746,15 @@ static void carUpdate(car_game_state* game,
   if (car->stats.gearShiftT > 0.f) {
     rpm -= 2000 * delta;
   }
-  car->joints[0].wheelHinge.hinge.motorTorque = -0.f;
-  car->joints[1].wheelHinge.hinge.motorTorque = -0.f;
+  wheelHinges[0]->motorTorque = -0.f;
+  wheelHinges[1]->motorTorque = -0.f;
   car->stats.accelerating = accelerating;
-  f32 trueRpm = LERP(car->stats.rpm, rpm, carProperties.engineInertia);
+  f32 trueRpm = LERP(car->stats.rpm, rpm, car->properties.engineInertia);
   f32 torque = torqueFromRpm(car, rpm, throttle);
 
   
   if (!shiftingGears) {
-    if (trueRpm >= 5000 && car->stats.gear < carProperties.gearNum - 1) {
+    if (trueRpm >= 5000 && car->stats.gear < car->properties.gearNum - 1) {
       car->stats.gear++;
       car->stats.gearShiftT = 0.25f;
     } 
@@ -702,245 +777,650 @@ static void carUpdate(car_game_state* game,
     }
   }
 
-  car->joints[0].wheelHinge.hinge.motorTorque = torque;
-  car->joints[1].wheelHinge.hinge.motorTorque = torque;
+  wheelHinges[0]->motorTorque = torque;
+  wheelHinges[1]->motorTorque = torque;
   car->stats.motorTorque = torque;
+  car->stats.longSpeed = longSpeed;
   car->stats.rpm = trueRpm;
   f32 turnRate =
     0.15f *
     (fabsf(axis.y) > 0.1f ? LERP(1.0, 1.0, 1.0f - longSpeedN) : 1.f);
   car->turnAngle = LERP(car->turnAngle, 0.35f * axis.x, turnRate);
 
-  car->joints[2].wheelHinge.hinge.localAxisARotation = {0.0f, 0, 1.0f, -car->turnAngle};
-  car->joints[3].wheelHinge.hinge.localAxisARotation = {0.0f, 0, 1.0f, -car->turnAngle};
-
-  car->joints[2].wheelHinge.hinge.localAxisBRotation = {0.0f, 0, 1.0f, car->turnAngle};
-  car->joints[3].wheelHinge.hinge.localAxisBRotation = {0.0f, 0, 1.0f, car->turnAngle};
-
-  f32 stepDelta = delta;
-
-  f32 currentTime = 0;
-  f32 targetTime = stepDelta;
-
-   if (input->reset == button_state_pressed) {
-    carSetInitialState(game);
-    car->body.chassis.velocity = (v3){0.0f,0.0f,0.0f};
-    car->body.chassis.angularVelocity = (v3){0.0f,0.0f,0.0f};
-    game->input.pausePhysics = false;
-  }
-
-  static rigid_body terrainBody = {0};
-  terrainBody.id = 100;
-  terrainBody.friction = 0.6f;
-  terrainBody.orientationQuat = QUAT_IDENTITY;
-
-  contact_manifold manifold[MAX_CONTACTS];
-  // TODO: CCD
-  while (currentTime < stepDelta) {
-    // Calculate forces
-    f32 itDelta = targetTime - currentTime;
-
-    // Body contacts
-    i32 shapeIdx = 0;
-    u32 contactIdx = 0;
-    for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
-      rigid_body* body = car->body.bodies + i;
-      for (i32 d = 0; d < body->shapeNum; d++, shapeIdx++) {
-        shape* bShape = car->bodyShapes + shapeIdx;
-        f32 depth = 0.f;
-        v3 normal;
-        v3 u = {0};
-        if (bShape->type == shape_type::SHAPE_POINT) {
-          u = (body->orientation * (bShape->point.p - body->localCenter));
-          v3 worldU = u + (v3){body->position.x,body->position.y,body->position.z};
-          depth = getGeometryHeight(worldU, game, &normal);
-        } else if (bShape->type == shape_type::SHAPE_SPHERE) {
-          v3 worldU = {
-            body->position.x + body->localCenter.x,
-            body->position.y + body->localCenter.y,
-            body->position.z + body->localCenter.z};
-          depth = getGeometryHeight(worldU, game,
-                                    &normal);
-          depth = depth - bShape->sphere.radius;
-          u = normal * (depth - bShape->sphere.radius);
+  wheelHinges[2]->localAxisARotation = {0.0f, 0, 1.0f, -car->turnAngle};
+  wheelHinges[3]->localAxisARotation = {0.0f, 0, 1.0f, -car->turnAngle};
+
+  wheelHinges[2]->localAxisBRotation = {0.0f, 0, 1.0f, car->turnAngle};
+  wheelHinges[3]->localAxisBRotation = {0.0f, 0, 1.0f, car->turnAngle};
+
+  if (axis.x != 0.f || axis.y != 0.f || input->reset == button_state_pressed) {
+    physicsWorldWakeBody(world, chassis);
+  }
+  if (input->reset == button_state_pressed) {
+    carSetInitialState(game, car);
+    world->velocity[chassis] = (v3){0.0f,0.0f,0.0f};
+    world->angularVelocity[chassis] = (v3){0.0f,0.0f,0.0f};
+  }
+}
+
+// Sweeps a wheel sphere along its displacement over the step against the
+// terrain. On a hit returns the separation and normal of the terrain
+// plane at the time of impact, the contact is then speculative and only
+// keeps the wheel from passing the plane during the step.
+static b32 carSweepWheel(car_game_state* game, v3 position, v3 displacement,
+                         f32 radius, f32* separation, v3* normal) {
+  f32 length = v3_length(displacement);
+  // Nothing to sweep, or the body has blown up
+  if (length == 0.f || !(length < geometrySize.x * 0.5f)) {
+    return false;
+  }
+  // Sample at most half a grid cell or radius apart
+  v2 cellSize = terrainCellSize(&game->terrain);
+  f32 spacing = 0.5f * MIN(MIN(cellSize.x, cellSize.y), radius);
+  u32 sampleNum = CLAMP((u32)ceilf(length / spacing), 1u, (u32)CCD_MAX_SAMPLES);
+
+  v3 n;
+  f32 t0 = 0.f;
+  f32 t1 = 0.f;
+  b32 hit = false;
+  for (u32 i = 1; i <= sampleNum && !hit; i++) {
+    t0 = t1;
+    t1 = (f32)i / sampleNum;
+    hit = getGeometryHeight(position + displacement * t1, game, &n) < radius;
+  }
+  if (!hit) {
+    return false;
+  }
+  for (u32 i = 0; i < CCD_BISECT_NUM; i++) {
+    f32 t = 0.5f * (t0 + t1);
+    if (getGeometryHeight(position + displacement * t, game, &n) < radius) {
+      t1 = t;
+    } else {
+      t0 = t;
+    }
+  }
+  v3 p = position + displacement * t1;
+  f32 height = getGeometryHeight(p, game, &n);
+  v3 terrainPoint = {p.x, p.y, p.z - height};
+  *normal = n;
+  *separation = MAX(v3_dot(position - terrainPoint, n) - radius, 0.f);
+  return true;
+}
+
+// Makes contacts from the terrain depths of the car shapes and prepares
+// the contact constraints. Returns the number of constraints written.
+static u32 carCollide(car_game_state* game, car_state* car,
+                      f32* shapeDepth, v3* shapeNormal,
+                      contact_manifold* manifold,
+                      contact_constraint* constraints, f32 delta) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  contact_point* contactPointStorage = world->contactPoints + car->firstContact;
+  f32 longSpeed = car->stats.longSpeed;
+  // Contacts of a sleeping car are kept for warm starting after wake up
+  if (!world->awake[chassis]) {
+    return 0;
+  }
+  // Wheels are in the island of the chassis
+  f32 h = delta / world->substeps[chassis];
+
+  // Body contacts, matched to the contacts of the previous step by shape
+  u32 contactIdx = 0;
+  u32 oldContactNum = car->contactPointNum;
+  // The raycast model keeps its wheels parked, only the chassis touches
+  u32 bodyNum = car->lod == car_lod_raycast ? 1 : RIGID_BODY_NUM;
+  for (u32 body = chassis; body < chassis + bodyNum; body++) {
+    i32 shapeIdx = world->firstShape[body];
+    for (i32 d = 0; d < world->shapeNum[body]; d++, shapeIdx++) {
+      shape* bShape = world->shapes + shapeIdx;
+      v3 position = world->position[body];
+      v3 localCenter = world->localCenter[body];
+      f32 depth = 0.f;
+      v3 normal;
+      v3 u = {0};
+      b32 touching = false;
+      if (bShape->type == shape_type::SHAPE_POINT) {
+        u = (world->orientation[body] * (bShape->point.p - localCenter));
+        depth = shapeDepth[shapeIdx];
+        normal = shapeNormal[shapeIdx];
+        touching = depth < 0.f;
+        if (enableCCD && !touching) {
+          // Speculative contact if the point can reach the terrain
+          // during the step
+          v3 pointVelocity = world->velocity[body] +
+            v3_cross(world->angularVelocity[body], u);
+          touching = depth < -v3_dot(pointVelocity, normal) * delta;
         }
-        i32 oldContact =
-          findOldContact(car->contactPointStorage, contactIdx, shapeIdx);
-
-        if (depth < 0.f) {
-          v3 uu = (v3){u.x,u.y,u.z};
-          contact_manifold* man = manifold + contactIdx++;
-          man->point.separation = depth;
-          man->point.localPointA = body->position + uu;
-          man->point.localPointB = uu;
-          man->point.point = body->position + uu;
-          man->point.shapeIdx = shapeIdx;
-          man->point.normal = normal;
-          man->point.normalImpulse = 0.f;
-          man->point.tangentImpulse[0] = 0.f;
-          man->point.tangentImpulse[1] = 0.f;
-          man->bodyB = body;
-          man->bodyA = &terrainBody;
-          if (oldContact != -1) {
-            man->point = car->contactPointStorage[oldContact];
-          }
+      } else if (bShape->type == shape_type::SHAPE_SPHERE) {
+        f32 radius = bShape->sphere.radius;
+        depth = shapeDepth[shapeIdx];
+        normal = shapeNormal[shapeIdx];
+        depth = depth - radius;
+        u = normal * (depth - radius);
+        touching = depth < 0.f;
+        if (enableCCD && !touching &&
+            carSweepWheel(game, position, world->velocity[body] * delta,
+                          radius, &depth, &normal)) {
+          u = normal * -radius;
+          touching = true;
         }
+      }
+      i32 oldContact =
+        findOldContact(contactPointStorage, oldContactNum, shapeIdx);
+
+      if (touching) {
+        ASSERT(contactIdx < MAX_CONTACTS);
+        v3 uu = (v3){u.x,u.y,u.z};
+        contact_manifold* man = manifold + contactIdx++;
+        man->point.separation = depth;
+        man->point.localPointA = position + uu;
+        man->point.localPointB = uu;
+        man->point.point = position + uu;
+        man->point.shapeIdx = shapeIdx;
+        man->point.normal = normal;
+        man->point.normalImpulse = 0.f;
+        man->point.tangentImpulse[0] = 0.f;
+        man->point.tangentImpulse[1] = 0.f;
+        man->bodyB = body;
+        man->bodyA = GROUND_BODY;
         if (oldContact != -1) {
-          car->contactPointStorage[oldContact].shapeIdx = -1;
+          world->counters.warmStartHitNum++;
+          // The geometry is the new one, only the impulses carry over
+          contact_point* oldPoint = contactPointStorage + oldContact;
+          man->point.normalImpulse = oldPoint->normalImpulse;
+          man->point.tangentImpulse[0] = oldPoint->tangentImpulse[0];
+          man->point.tangentImpulse[1] = oldPoint->tangentImpulse[1];
         }
       }
-    }
-    car->contactPointNum = contactIdx;
-
-    f32 h = itDelta / subStepAmount;
-    f32 invH = 1.0f / h;
-
-    // Prepare contacts
-    u32 constraintNum = contactIdx;
-    u32 jointNum = arrayLen(car->jointsAll);
-    contact_constraint constraints[contactIdx];
-    u16 constraintIdx = 0;
-    for (u16 idx = 0; idx < constraintNum; idx++) {
-      contact_manifold* man = manifold + idx;
-      if (man->point.shapeIdx == -1) {
-        continue;
+      if (oldContact != -1) {
+        contactPointStorage[oldContact].shapeIdx = -1;
       }
-      contact_constraint* constraint = constraints + constraintIdx++;
-      preSolve(man, constraint, constraintNum, h);
-      if (constraint->bodyB->id > 0) {
-        rigid_body *wheelBody = man->bodyB;
-        u32 id = wheelBody->id - 1;
-        hinge_joint* wheelJoint = &car->joints[id].wheelHinge.hinge;
-
-        v3 hA = wheelJoint->hingeAxis;
-        v4 locABRot = wheelJoint->localAxisBRotation;
-        v4 locAARot = wheelJoint->localAxisARotation;
-
-        v3 sideAxis = v3_rotate_axis_angle(hA * car->body.chassis.orientation, locABRot.w, locABRot.xyz);
-        v3 upAxis = man->point.normal;
-        v3 forwardAxis = v3_cross(sideAxis, upAxis);
-
-        v3 wheelWAxis = v3_rotate_axis_angle(hA * wheelBody->orientation, locAARot.w, locAARot.xyz);
-        f32 wheelAngSpeed = v3_dot(wheelWAxis, wheelBody->angularVelocity) * car->properties.wheelShape.radius;
-        b32 isWheelStopped = fabs(wheelAngSpeed) < 0.001f;
-        f32 slipRatio = 0.f;
-        
-        if (fabsf(longSpeed) > 0.1f) {
-          f32 slideSgn =
-            isWheelStopped ? SIGNF(longSpeed) : SIGNF(wheelAngSpeed);
-          f32 slip = MAX((wheelAngSpeed - longSpeed) * slideSgn, 0.f);
-          slipRatio = slip / fabs(longSpeed);
-        }
-        f32 slipT = CLAMP(slipRatio / 2.f, 0.0f, 1.0f);
-        f32 slipRatioForce = bezier6n(
-          carProperties.slipRatioForceCurve,
-          slipT);
-
-        f32 wLatSpeed = v3_dot(wheelBody->velocity, sideAxis);
-        f32 wLongSpeed = v3_dot(wheelBody->velocity, forwardAxis);
-
-        f32 slipAngle = wLongSpeed > 0.05f ? atan2f(wLatSpeed, wLongSpeed) : 0.f;
-
-        f32 t = longSpeed > 10.f ? CLAMP(slipAngle / 2.f,-1.0,1.f) : 0.f;
-        f32 slipAngleForce = bezier6n(
-          carProperties.slipAngleForceCurve,
-          fabsf(t));
-        
-        f32 slipAngleFriction = ((id > 1) ? 
-          carProperties.slipAngleForceCoeffFW : 
-          carProperties.slipAngleForceCoeffRW
-        ) * slipAngleForce;
-
-        f32 slipRatioFriction = slipRatioForce * carProperties.slipRatioForceCoeff;
-        f32 frictionAdjustment= MAX(slipRatioFriction + slipAngleFriction, 0.0f);
-        constraint->friction = constraint->friction + frictionAdjustment;
-
-        car->stats.frictionAdjustment[id] = frictionAdjustment;
-        car->stats.slipRatio[id] = slipRatio;
-        car->stats.slipAngle[id] = slipAngle; 
+    }
+  }
+  car->contactPointNum = contactIdx;
+
+  // Prepare contacts
+  u64 timer = physicsTimerBegin();
+  u32 manifoldNum = contactIdx;
+  u16 constraintIdx = 0;
+  for (u16 idx = 0; idx < manifoldNum; idx++) {
+    contact_manifold* man = manifold + idx;
+    if (man->point.shapeIdx == -1) {
+      continue;
+    }
+    contact_constraint* constraint = constraints + constraintIdx++;
+    preSolve(world, man, constraint, manifoldNum, h);
+    if (constraint->bodyB != chassis) {
+      u32 wheelBody = man->bodyB;
+      u32 id = wheelBody - chassis - 1;
+      hinge_joint* wheelJoint = carWheelHinge(world, car, id);
+
+      v3 hA = wheelJoint->hingeAxis;
+      v4 locABRot = wheelJoint->localAxisBRotation;
+      v4 locAARot = wheelJoint->localAxisARotation;
+
+      v3 sideAxis = v3_rotate_axis_angle(hA * world->orientation[chassis], locABRot.w, locABRot.xyz);
+      v3 upAxis = man->point.normal;
+      v3 forwardAxis = v3_cross(sideAxis, upAxis);
+
+      v3 wheelWAxis = v3_rotate_axis_angle(hA * world->orientation[wheelBody], locAARot.w, locAARot.xyz);
+      f32 wheelAngSpeed = v3_dot(wheelWAxis, world->angularVelocity[wheelBody]) * car->properties.wheelShape.radius;
+      b32 isWheelStopped = fabs(wheelAngSpeed) < 0.001f;
+      f32 slipRatio = 0.f;
+      
+      if (fabsf(longSpeed) > 0.1f) {
+        f32 slideSgn =
+          isWheelStopped ? SIGNF(longSpeed) : SIGNF(wheelAngSpeed);
+        f32 slip = MAX((wheelAngSpeed - longSpeed) * slideSgn, 0.f);
+        slipRatio = slip / fabs(longSpeed);
       }
+      f32 wLatSpeed = v3_dot(world->velocity[wheelBody], sideAxis);
+      f32 wLongSpeed = v3_dot(world->velocity[wheelBody], forwardAxis);
 
-    }
-       // printf("force %f %f %f torque %f %f %f\n", 
-       //  extraForces[0].x, extraForces[0].y, extraForces[0].z,
-       //  extraTorques[0].x, extraTorques[0].y, extraTorques[0].z);
+      f32 slipAngle =
+        wLongSpeed > 0.05f ? atan2Approx(wLatSpeed, wLongSpeed) : 0.f;
 
-    for (u32 i = 0; i < jointNum; ++i) {
-      jointPreSolve(car->jointsAll + i, h);
-    }
+      f32 t = longSpeed > 10.f ? CLAMP(slipAngle / 2.f,-1.0,1.f) : 0.f;
 
-    // Solve
-    // body 2 * substepCount
-    // constraint 2 * substepCount (merge warm starting)
-    for (i32 substep = 0; substep < subStepAmount; ++substep) {
-      // Integrate velocities
-      for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
-        integrateVelocities(h, &car->body.bodies[i], extraForces[i], extraTorques[i]);
-      }
+      f32 slipAngleFriction = ((id > 1) ? 
+        car->properties.slipAngleForceCoeffFW : 
+        car->properties.slipAngleForceCoeffRW
+      ) * curveLutSample(&car->curves.slipAngleForce, fabsf(t));
 
-      // Warm start
-      for (u32 i = 0; i < jointNum; ++i) {
-        jointWarmStart(car->jointsAll + i);
-      }
+      f32 slipRatioFriction =
+        curveLutSample(&car->curves.slipRatioForce,
+                       CLAMP(slipRatio / 2.f, 0.0f, 1.0f)) *
+        car->properties.slipRatioForceCoeff;
+      f32 frictionAdjustment= MAX(slipRatioFriction + slipAngleFriction, 0.0f);
+      constraint->friction = constraint->friction + frictionAdjustment;
 
-      // Warm start
-      for (u32 i = 0; i < constraintNum; ++i) {
-        contact_constraint* constraint = constraints + i;
-        warmStart(constraint, constraintNum);
-      }
-      for (u32 i = 0; i < jointNum; ++i) {
-        jointSolve(car->jointsAll + i, h, invH, true);
-      }
+      car->stats.slipRatio[id] = slipRatio;
+      car->stats.slipAngle[id] = slipAngle; 
+      car->stats.frictionAdjustment[id] = frictionAdjustment;
+    }
+  }
+  physicsTimerEnd(world, physics_timer_contact_prepare, timer);
+  world->counters.contactNum += constraintIdx;
+  return constraintIdx;
+}
 
-      // Solve velocities using position bias
-      for (u32 i = 0; i < constraintNum; ++i) {
-        contact_constraint* constraint = constraints + i;
-        solve(constraint, constraintNum, invH, true);
-      }
-      // Integrate positions using biased velocities
-      for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
-        integratePositions(h, &car->body.bodies[i]);
-      }
+// Stores the solved contact impulses for warm starting and updates the
+// derived body quantities after the world step.
+static void carFinalizeStep(car_game_state* game, car_state* car,
+                            contact_constraint* constraints,
+                            u32 constraintNum) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  contact_point* contactPointStorage = world->contactPoints + car->firstContact;
+  for (u32 i = 0; i < constraintNum; ++i) {
+    contact_constraint* constraint = constraints + i;
+    storeContactImpulse(contactPointStorage + i, constraint, constraintNum);
+  }
+  world->origin[chassis] =
+    world->position[chassis] -
+    world->orientation[chassis] * world->localCenter[chassis];
 
-      // Relax biased velocities and impulses.
-      // Relaxing the impulses reduces warm starting overshoot.
+  world->forwardAxis[chassis] = world->orientation[chassis] * (v3){1.f,0.0f,0.0f};
+  world->sideAxis[chassis] = world->orientation[chassis] * (v3){0.0f,1.0f,0.0f};
 
-      for (u32 i = 0; i < jointNum; ++i) {
-        jointSolve(car->jointsAll + i, h, invH, false);
-      }
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    u32 wheel = carWheelBody(car, i);
+    world->origin[wheel] =
+      world->position[wheel] -
+      world->localCenter[wheel] * world->orientation[wheel];
+  }
+}
 
-      // Solve velocities using position bias
-      for (u32 i = 0; i < constraintNum; ++i) {
-        contact_constraint* constraint = constraints + i;
-        solve(constraint, constraintNum, invH, false);
-      }
-    }
+// Axle of a parked wheel where its hinge holds it
+static v3 carRaycastWheelAxle(physics_world* world, car_state* car, u32 i) {
+  hinge_joint* hinge = carWheelHinge(world, car, i);
+  v4 rotationA = hinge->localAxisARotation;
+  v4 rotationB = hinge->localAxisBRotation;
+  return v3_rotate_axis_angle(
+    v3_rotate_axis_angle(hinge->hingeAxis * world->orientation[car->chassis],
+                         rotationA.w, rotationA.xyz),
+    -rotationB.w, rotationB.xyz);
+}
 
-    // finalizePositions(&car->body.chassis);
-    for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
-      finalizePositions(&car->body.bodies[i], h);
+// Raycast model, a cheap stand-in for cars far from the camera. The wheel
+// bodies and their joints are parked and the chassis is held up by four
+// suspension rays instead. Each ray sweeps the wheel sphere down the
+// suspension travel to the rest position of the wheel. The compression
+// pushes the chassis through a spring and damper with the frequency and
+// damping ratio of the suspension joint, stepped implicitly so the stiff
+// spring holds with one force per step. The tires use the friction of the
+// wheel contacts: the sideways slide is stopped and the wheel spin is
+// pulled to the ground speed, up to the friction limit adjusted by the
+// slip angle and slip ratio curves. Each wheel keeps its own spin with the
+// inertia of the wheel body, the motor torque drives or brakes it like the
+// hinge motor. The parked wheels still add their weight to the tire load,
+// their mass to the car and the drag the world gives every body, so the
+// car accelerates and tops out like the full model.
+static void carRaycastWheels(car_game_state* game, car_state* car,
+                             f32 delta) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  if (!world->awake[chassis]) {
+    return;
+  }
+  m3x3 orientation = world->orientation[chassis];
+  v3 position = world->position[chassis];
+  v3 velocity = world->velocity[chassis];
+  v3 angularVelocity = world->angularVelocity[chassis];
+  v3 up = orientation * (v3){0.f, 0.f, 1.f};
+  f32 radius = car->properties.wheelShape.radius;
+  f32 travel = radius;
+  // Each wheel carries a quarter of the chassis
+  f32 mass = world->mass[chassis] / WHEEL_NUM;
+  f32 omega = 2.f * PI * car->properties.suspensionHz;
+  f32 stiffness = mass * omega * omega;
+  f32 damping = 2.f * mass * car->properties.suspensionDamping * omega;
+  f32 softness =
+    1.f + delta * damping / mass + delta * delta * stiffness / mass;
+  f32 wheelMass = car->properties.wheelMass;
+  f32 wheelInertia = 0.5f * wheelMass * radius * radius;
+  f32 carMass = world->mass[chassis] + WHEEL_NUM * wheelMass;
+  f32 massScale = world->mass[chassis] / carMass;
+  // Mass of a quarter car and the wheel spin seen at the tire
+  f32 rollMass =
+    1.f / (WHEEL_NUM / carMass + radius * radius / wheelInertia);
+
+  v3 force = world->force[chassis];
+  v3 torque = world->torque[chassis];
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    car->stats.slipAngle[i] = 0.f;
+    car->stats.slipRatio[i] = 0.f;
+    car->stats.frictionAdjustment[i] = 0.f;
+    v3 pivot = position + orientation * carWheelPivot(world, car, i);
+    v3 pivotVelocity = velocity + v3_cross(angularVelocity, pivot - position);
+    v3 drag = -(Kdl * pivotVelocity * v3_normalize(pivotVelocity)) -
+      (Krr * pivotVelocity);
+    addForceToPoint(drag * massScale, pivot, position, &force, &torque);
+
+    hinge_joint* hinge = carWheelHinge(world, car, i);
+    f32 spin = car->wheelSpin[i];
+    f32 motorSpin = hinge->motorTorque / wheelInertia * delta;
+    if (hinge->motorTorque < 0.f && spin > 0.f) {
+      // Braking stops the wheel, it doesn't turn it backwards
+      spin = MAX(spin + motorSpin, 0.f);
+    } else {
+      spin += motorSpin;
     }
+    car->wheelSpin[i] = spin;
 
-    for (u32 i = 0; i < constraintNum; ++i) {
-      contact_constraint* constraint = constraints + i;
-      storeContactImpulse(car->contactPointStorage + i, constraint, constraintNum);
+    v3 top = pivot + up * travel;
+    terrain_hit hit;
+    if (!terrainSphereCast(game, top, up * -1.f, radius, travel, &hit)) {
+      car->wheelRayDistance[i] = travel;
+      continue;
+    }
+    car->wheelRayDistance[i] = hit.distance;
+
+    v3 center = hit.point;
+    v3 centerVelocity =
+      velocity + v3_cross(angularVelocity, center - position);
+    f32 compression = travel - hit.distance;
+    f32 compressionSpeed = -v3_dot(centerVelocity, up);
+    f32 load = (stiffness * compression +
+                (damping + delta * stiffness) * compressionSpeed) / softness;
+    load = MAX(load, 0.f);
+
+    // Tire axes on the ground, the front wheels turn with their hinges
+    v4 axisRotation = hinge->localAxisBRotation;
+    v3 normal = v3_normalize(hit.normal);
+    v3 side = v3_rotate_axis_angle(hinge->hingeAxis * orientation,
+                                   axisRotation.w, axisRotation.xyz);
+    v3 forward = v3_normalize(v3_cross(side, normal));
+    side = v3_cross(normal, forward);
+    v3 contact = center - normal * radius;
+    v3 contactVelocity =
+      velocity + v3_cross(angularVelocity, contact - position);
+    f32 longSpeed = v3_dot(contactVelocity, forward);
+    f32 latSpeed = v3_dot(contactVelocity, side);
+
+    // Slip ratio the same way the wheel contacts measure it
+    f32 wheelSpeed = spin * radius;
+    f32 slipRatio = 0.f;
+    if (fabsf(longSpeed) > 0.1f) {
+      f32 slideSgn =
+        fabsf(wheelSpeed) < 0.001f ? SIGNF(longSpeed) : SIGNF(wheelSpeed);
+      slipRatio =
+        MAX((wheelSpeed - longSpeed) * slideSgn, 0.f) / fabsf(longSpeed);
+    }
+    f32 slipRatioFriction =
+      curveLutSample(&car->curves.slipRatioForce,
+                     CLAMP(slipRatio / 2.f, 0.f, 1.f)) *
+      car->properties.slipRatioForceCoeff;
+    f32 slipAngle =
+      longSpeed > 0.05f ? atan2Approx(latSpeed, longSpeed) : 0.f;
+    f32 t = car->stats.longSpeed > 10.f ? CLAMP(slipAngle / 2.f, -1.f, 1.f)
+                                        : 0.f;
+    f32 slipAngleFriction = (i > 1 ? car->properties.slipAngleForceCoeffFW
+                                   : car->properties.slipAngleForceCoeffRW) *
+      curveLutSample(&car->curves.slipAngleForce, fabsf(t));
+    f32 frictionAdjustment = MAX(slipRatioFriction + slipAngleFriction, 0.f);
+    f32 friction =
+      sqrtf(world->friction[carWheelBody(car, i)] +
+            world->friction[GROUND_BODY]) + frictionAdjustment;
+
+    f32 lateral = -latSpeed * mass / delta;
+    f32 longitudinal = (wheelSpeed - longSpeed) * rollMass / delta;
+    f32 tireForce = sqrtf(lateral * lateral + longitudinal * longitudinal);
+    f32 maxForce =
+      friction * (load - v3_dot(Gravity, normal) * wheelMass);
+    if (tireForce > maxForce) {
+      f32 scale = maxForce / tireForce;
+      lateral *= scale;
+      longitudinal *= scale;
     }
-    car->body.chassis.origin =
-      car->body.chassis.position -
-      car->body.chassis.orientation * car->body.chassis.localCenter;
+    car->wheelSpin[i] = spin - longitudinal * delta * radius / wheelInertia;
+    addForceToPoint(normal * load, contact, position, &force, &torque);
+    addForceToPoint(side * lateral + forward * (longitudinal * massScale),
+                    contact, position, &force, &torque);
+
+    car->stats.slipAngle[i] = slipAngle;
+    car->stats.slipRatio[i] = slipRatio;
+    car->stats.frictionAdjustment[i] = frictionAdjustment;
+  }
+  world->force[chassis] = force;
+  world->torque[chassis] = torque;
+}
 
-    car->body.chassis.forwardAxis = car->body.chassis.orientation * (v3){1.f,0.0f,0.0f};
-    car->body.chassis.sideAxis = car->body.chassis.orientation * (v3){0.0f,1.0f,0.0f};
+// Moves the parked wheels along with the chassis after the step, turning
+// with their spin. The renderer draws them and the full model takes over
+// from their state.
+static void carPlaceRaycastWheels(car_game_state* game, car_state* car,
+                                  f32 delta) {
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  if (!world->awake[chassis]) {
+    return;
+  }
+  m3x3 orientation = world->orientation[chassis];
+  quat orientationQuat = world->orientationQuat[chassis];
+  v3 position = world->position[chassis];
+  v3 velocity = world->velocity[chassis];
+  v3 angularVelocity = world->angularVelocity[chassis];
+  v3 up = orientation * (v3){0.f, 0.f, 1.f};
+  v3 chassisSide = orientation * (v3){0.f, 1.f, 0.f};
+  f32 radius = car->properties.wheelShape.radius;
+  f32 travel = radius;
+  for (u32 i = 0; i < WHEEL_NUM; i++) {
+    u32 wheel = carWheelBody(car, i);
+    v3 center = position + orientation * carWheelPivot(world, car, i) +
+      up * (travel - car->wheelRayDistance[i]);
+    // The full model takes over without a jump
+    v3 side = carRaycastWheelAxle(world, car, i);
+    v3 centerVelocity =
+      velocity + v3_cross(angularVelocity, center - position);
+    f32 spin = car->wheelSpin[i];
+    car->wheelRollAngle[i] =
+      fmodf(car->wheelRollAngle[i] + spin * delta, 2.f * PI);
+    f32 turn = atan2f(v3_dot(v3_cross(chassisSide, side), up),
+                      v3_dot(chassisSide, side));
+
+    quat q = orientationQuat *
+      quat_from_axis_angle((v3){0.f, 0.f, 1.f}, turn) *
+      quat_from_axis_angle((v3){0.f, 1.f, 0.f}, car->wheelRollAngle[i]);
+    world->orientationQuat[wheel] = q;
+    world->orientation[wheel] = m3x3_from_quat(q);
+    world->position[wheel] = center;
+    world->velocity[wheel] = centerVelocity;
+    world->velocity0[wheel] = centerVelocity;
+    world->angularVelocity[wheel] = angularVelocity + side * spin;
+  }
+}
 
+static void carSetLod(car_game_state* game, car_state* car, car_lod lod) {
+  if (car->lod == lod) {
+    return;
+  }
+  physics_world* world = &game->world;
+  u32 chassis = car->chassis;
+  // Wheels are parked and returned with the whole car awake
+  physicsWorldWakeBody(world, chassis);
+  if (lod == car_lod_raycast) {
+    m3x3 orientation = world->orientation[chassis];
+    v3 up = orientation * (v3){0.f, 0.f, 1.f};
+    f32 travel = car->properties.wheelShape.radius;
     for (u32 i = 0; i < WHEEL_NUM; i++) {
-      car->body.wheels[i].origin =
-        car->body.wheels[i].position -
-        car->body.wheels[i].localCenter * car->body.wheels[i].orientation;
+      u32 wheel = carWheelBody(car, i);
+      physicsWorldDisableBody(world, wheel);
+      v3 rest = world->position[chassis] +
+        orientation * carWheelPivot(world, car, i);
+      f32 compression = v3_dot(world->position[wheel] - rest, up);
+      car->wheelRayDistance[i] = CLAMP(travel - compression, 0.f, travel);
+      car->wheelRollAngle[i] = 0.f;
+      car->wheelSpin[i] =
+        v3_dot(world->angularVelocity[wheel] - world->angularVelocity[chassis],
+               carRaycastWheelAxle(world, car, i));
     }
+  } else {
+    for (u32 i = 0; i < WHEEL_NUM; i++) {
+      physicsWorldEnableBody(world, carWheelBody(car, i),
+                             world->substeps[chassis]);
+      // Impulses from before parking don't fit the joints anymore
+      hinge_joint* hinge = carWheelHinge(world, car, i);
+      hinge->totalLambda = (v2){0.f, 0.f};
+      hinge->motorImpulse = 0.f;
+      slider_joint* slider = carWheelSuspension(world, car, i);
+      slider->totalImpulse = (v2){0.f, 0.f};
+      slider->totalLimitImpulse = 0.f;
+      carWheelSuspensionLimits(world, car, i)->totalImpulse = 0.f;
+    }
+  }
+  car->lod = lod;
+}
+
+// The first car is the one the camera follows, the others pick their
+// model by the distance to it
+static void carUpdateLods(car_game_state* game, car_state** cars,
+                          u32 carNum) {
+  if (!enableCarLod) {
+    return;
+  }
+  physics_world* world = &game->world;
+  v3 center = world->position[cars[0]->chassis];
+  f32 raycastDistance2 = carLodRaycastDistance * carLodRaycastDistance;
+  f32 fullDistance2 = carLodFullDistance * carLodFullDistance;
+  for (u32 i = 1; i < carNum; i++) {
+    car_state* car = cars[i];
+    f32 distance2 = v3_length2(world->position[car->chassis] - center);
+    if (car->lod == car_lod_full && distance2 > raycastDistance2) {
+      carSetLod(game, car, car_lod_raycast);
+    } else if (car->lod == car_lod_raycast && distance2 < fullDistance2) {
+      carSetLod(game, car, car_lod_full);
+    }
+  }
+}
+
+// Steps every given car in the same physics world step. All cars are
+// driven with the same input.
+static void carStepWorld(car_game_state* game, car_state** cars, u32 carNum,
+                         input_state* input, memory_arena* tempArena,
+                         f32 delta) {
+  physics_world* world = &game->world;
+  u64 stepTimer = physicsTimerBegin();
+  carUpdateLods(game, cars, carNum);
+  terrainStreamUpdate(game, cars, carNum);
+  for (u32 i = 0; i < carNum; i++) {
+    carApplyInput(game, cars[i], input, delta);
+  }
+
+  u64 timer = physicsTimerBegin();
+
+  // Car vs car pairs, no narrowphase for them yet. The pairs still wake
+  // sleeping cars that a moving car gets close to.
+  broadphaseUpdate(world, tempArena, delta);
+  physicsWorldWakeBodies(world);
+
+  contact_manifold* manifold =
+    pushArray(tempArena, MAX_CONTACTS, contact_manifold);
+  contact_constraint* constraints =
+    pushArray(tempArena, carNum * MAX_CONTACTS, contact_constraint);
+  u32* carConstraintNum = pushArray(tempArena, carNum, u32);
+
+  // Terrain depths of every awake shape in the world in one batch
+  u32 shapeNum = world->totalShapeNum;
+  u32* shapeIndices = pushArray(tempArena, shapeNum, u32);
+  v3* shapePoints = pushArray(tempArena, shapeNum, v3);
+  f32* pointDepth = pushArray(tempArena, shapeNum, f32);
+  v3* pointNormal = pushArray(tempArena, shapeNum, v3);
+  u32 pointNum = physicsWorldShapePoints(world, shapeIndices, shapePoints);
+  getGeometryHeightBatch(game, shapePoints, pointNum, pointDepth, pointNormal);
+  f32* shapeDepth = pushArray(tempArena, shapeNum, f32);
+  v3* shapeNormal = pushArray(tempArena, shapeNum, v3);
+  for (u32 i = 0; i < pointNum; i++) {
+    shapeDepth[shapeIndices[i]] = pointDepth[i];
+    shapeNormal[shapeIndices[i]] = pointNormal[i];
+  }
+
+  u32 constraintNum = 0;
+  for (u32 i = 0; i < carNum; i++) {
+    carConstraintNum[i] =
+      carCollide(game, cars[i], shapeDepth, shapeNormal, manifold,
+                 constraints + constraintNum, delta);
+    constraintNum += carConstraintNum[i];
+    if (cars[i]->lod == car_lod_raycast) {
+      carRaycastWheels(game, cars[i], delta);
+    }
+  }
+  physicsTimerEnd(world, physics_timer_contacts, timer);
+
+  physicsWorldSolve(world, tempArena, constraints, constraintNum, delta);
+  timer = physicsTimerBegin();
+  physicsWorldUpdateIslands(world, tempArena, constraints, constraintNum,
+                            delta);
+  world->counters.islandNum = world->islandNum;
+  world->counters.islandSubstepSum = world->islandSubstepSum;
+  world->counters.islandSubstepMax = world->islandSubstepMax;
+  game->physicsSubstepMax =
+    MAX(game->physicsSubstepMax, world->islandSubstepMax);
+
+  contact_constraint* carConstraints = constraints;
+  for (u32 i = 0; i < carNum; i++) {
+    if (cars[i]->lod == car_lod_raycast) {
+      carPlaceRaycastWheels(game, cars[i], delta);
+    }
+    carFinalizeStep(game, cars[i], carConstraints, carConstraintNum[i]);
+    carConstraints += carConstraintNum[i];
+  }
+  physicsTimerEnd(world, physics_timer_islands, timer);
+  physicsTimerEnd(world, physics_timer_step, stepTimer);
+  world->counters.stepNum++;
+  physicsCountersAdd(game->physicsTotals, world->counters);
+  world->counters = (physics_counters){0};
+}
+
+// Runs as many fixed physics steps as the frame time covers. Returns the
+// number of steps taken.
+static u32 carStepFrame(car_game_state* game, car_state** cars, u32 carNum,
+                        input_state* input, memory_arena* tempArena,
+                        f32 delta) {
+  physics_world* world = &game->world;
+  game->physicsAccumulator += delta;
+  u32 stepNum = 0;
+  while (game->physicsAccumulator >= physicsStepDelta) {
+    if (stepNum == PHYSICS_MAX_STEPS_PER_FRAME) {
+      game->physicsAccumulator = fmodf(game->physicsAccumulator,
+                                       physicsStepDelta);
+      break;
+    }
+    // Step allocations are dropped after each step
+    memory_arena stepArena = *tempArena;
+    physicsWorldStoreState(world);
+    carStepWorld(game, cars, carNum, input, &stepArena, physicsStepDelta);
+    game->physicsAccumulator -= physicsStepDelta;
+    stepNum++;
+  }
+  return stepNum;
+}
+
+// Steps the physics by delta with the latest input and publishes the
+// results. Runs on the physics thread, or from carUpdate when the platform
+// has none. Returns the time until the next step is due.
+static f32 physicsUpdate(car_game_state* game, memory_arena* tempArena,
+                         f32 delta) {
+  input_state* input = physicsInputUpdate(game);
+  car_state* cars[] = {&game->car};
+  u32 stepNum = carStepFrame(game, cars, arrayLen(cars), input, tempArena,
+                             input->pausePhysics ? 0.f : delta);
+  if (stepNum) {
+    physicsInputConsumed(input);
+  }
+  renderStatePublish(game, &game->car);
+  return physicsStepDelta - game->physicsAccumulator;
+}
 
-    currentTime = targetTime;
-    targetTime = itDelta;
+static void carUpdate(car_game_state* game, 
+                      memory_arena* tempArena,
+                      rt_command_buffer* rendererBuffer,
+                      f32 delta) { 
+  physicsInputPublish(game);
+  if (!platformApi->physicsThread) {
+    physicsUpdate(game, tempArena, delta);
   }
+  renderStateUpdate(game);
 }
 
 static void createCar(car_game_state* game,
@@ -951,8 +1431,16 @@ static void createCar(car_game_state* game,
   if (!game->car.initialized || reload) {
     carCreateModel(permanentArena, tempArena, rendererBuffer, game,
                    assetModTime);
-    if (!game->car.initialized) carSetInitialState(game);
-    carSetupBody(game);
+    if (!game->car.initialized) {
+      carAddToWorld(game, &game->car);
+      carSetInitialState(game, &game->car);
+    }
+    // Reloading picks up changes to the carProperties initializer
+    physicsInputSetProperties(game, &carProperties);
+    carSetupBody(game, &game->car);
+    // Camera reads the render state before the first update
+    renderStatePublish(game, &game->car);
+    renderStateUpdate(game);
     game->car.initialized = true;
   }
 }
@@ -0,0 +1,54 @@
+#include "all.h"
+// Tire and engine curves.
+//
+// The slip ratio, slip angle and torque curves are baked to uniformly
+// sampled tables, so the per contact lookups are a lerp instead of a
+// Bezier or magic formula evaluation. carCurvesUpdate rebakes the tables
+// whenever car_properties has changed since the last bake, so edits from
+// the UI or a hot reload show up on the next step.
+
+static f32 pacejka(pacejka_params p, f32 x) {
+  f32 bx = p.B * x;
+  return p.D * sinf(p.C * atanf(bx - p.E * (bx - atanf(bx)))) + p.Sv;
+}
+
+static void curveLutBakeBezier(curve_lut* lut, f32* points) {
+  for (u32 i = 0; i <= CURVE_LUT_SIZE; i++) {
+    lut->samples[i] = bezier6n(points, (f32)i / CURVE_LUT_SIZE);
+  }
+}
+
+static void curveLutBakePacejka(curve_lut* lut, pacejka_params params) {
+  for (u32 i = 0; i <= CURVE_LUT_SIZE; i++) {
+    lut->samples[i] = pacejka(params, (f32)i / CURVE_LUT_SIZE);
+  }
+}
+
+static void carCurvesUpdate(car_curves* curves, car_properties* properties) {
+  if (curves->baked && memcmp(&curves->bakedProperties, properties,
+                              sizeof(car_properties)) == 0) {
+    return;
+  }
+  if (properties->tireModel == tire_model_pacejka) {
+    curveLutBakePacejka(&curves->slipRatioForce,
+                        properties->slipRatioPacejka);
+    curveLutBakePacejka(&curves->slipAngleForce,
+                        properties->slipAnglePacejka);
+  } else {
+    curveLutBakeBezier(&curves->slipRatioForce,
+                       properties->slipRatioForceCurve);
+    curveLutBakeBezier(&curves->slipAngleForce,
+                       properties->slipAngleForceCurve);
+  }
+  curveLutBakeBezier(&curves->motorTorque, properties->motorTorqueCurve);
+  curves->bakedProperties = *properties;
+  curves->baked = true;
+}
+
+// t is clamped to [0, 1]
+inline f32 curveLutSample(const curve_lut* lut, f32 t) {
+  f32 x = CLAMP(t, 0.f, 1.f) * CURVE_LUT_SIZE;
+  u32 i = MIN((u32)x, (u32)CURVE_LUT_SIZE - 1);
+  f32 frac = x - (f32)i;
+  return LERP(lut->samples[i], lut->samples[i + 1], frac);
+}
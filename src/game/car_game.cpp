@@ -6,18 +6,19 @@ extern "C" RT_GAME_AUDIO_CALLBACK(gameAudioUpdate) {
   if (_game && _game->initialized) {
     u64 count = platform.api.getPerformanceCounter();
     car_audio_state* carAudioState = &_game->car.audioState;
-    i32 rpm = _game->car.stats.rpm;
+    car_stats* stats = audioStatsAcquire(_game);
+    i32 rpm = stats->rpm;
     f32 invSampleRate = 1.f / audioOut.samplesPerSecond;
     for (i32 i = 0; i < audioOut.sampleCount; i++) {
       i16* bufferOut = (i16*)audioOut.buffer + i * 2;
       f32 audioSample[2] = {0.0f, 0.0f};
       carAudioState->sampleIndex++;
       f32 engineSample = sampleEngineAudio(carAudioState, audioOut.samplesPerSecond, 
-                                           rpm, _game->car.stats.accelerating) * 0.3f;
+                                           rpm, stats->accelerating) * 0.3f;
 
       // Shitty audio effects for sliding and wind
       f32 r = ((f32)rand() / (f32)RAND_MAX) * 2.f - 1.f;
-      f32 gravelVolume = MIN(fabs(_game->car.stats.slipAngle[2]),1.0);
+      f32 gravelVolume = MIN(fabs(stats->slipAngle[2]),1.0);
       f32 gravelSample = 
         filter(r, invSampleRate, 20,0.2f, Lowpass, carAudioState->gravelFilter);
       gravelSample *= gravelVolume;
@@ -56,6 +57,23 @@ extern "C" RT_GAME_AUDIO_CALLBACK(gameAudioUpdate) {
   }
 }
 
+// Called by the platform physics thread, the game state is shared with
+// gameUpdate through the exchanges in physics_thread.cpp.
+extern "C" RT_GAME_PHYSICS_UPDATE(gamePhysicsUpdate) {
+  if (!_game || !_game->initialized) {
+    return physicsStepDelta;
+  }
+  memory_arena tempMemory;
+  memArena_init(&tempMemory, platform.physicsMemBuffer,
+                platform.physicsMemSize);
+  u64 counter = platform.api.getPerformanceCounter();
+  f32 delta = _game->physicsCounter ?
+    (f32)(counter - _game->physicsCounter) /
+    (f32)platform.api.getPerformanceFrequency() : 0.f;
+  _game->physicsCounter = counter;
+  return physicsUpdate(_game, &tempMemory, delta);
+}
+
 inline str8 loadBin(const char* path) {
   str8 result;
   result.buffer = (u8*)platformApi->loadBinaryFile(path, &result.len);
@@ -103,9 +121,15 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
   ui_widget_context* widgetContext = allocUiWidgets(&tempMemory);
   b32 initialize = !game->initialized || reloaded;
 
-  allocTerrain(game, &permanentMemory);
   // Initial component initialization
   if (initialize) {
+    // The physics thread steps the world that is built here
+    if (platformApi->physicsThread) {
+      platformApi->lockPhysics();
+    }
+    allocTerrain(game, &permanentMemory);
+    allocCarWorld(game, &permanentMemory);
+    allocPhysicsExchange(game, &permanentMemory);
     LOG(LOG_LEVEL_DEBUG, "terrain loaded");
     if (!game->initialized) {
       game->camera.fov = 90;
@@ -116,6 +140,7 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
       game->debug.visibilityState = visibility_state_car | visibility_state_terrain;
       game->debug.drawDebugPanel = false;
       game->input.pausePhysics = true;
+      initPhysicsExchange(game);
     }
     setupUiWidgets(widgetContext);    
     createSkyBox(game, &permanentMemory, &tempMemory, &rendererBuffer);
@@ -132,6 +157,9 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
      ASSERT(result.buffer != 0);
     }
     game->initialized = true;
+    if (platformApi->physicsThread) {
+      platformApi->unlockPhysics();
+    }
   }
 
   // Input event parsing.
@@ -153,8 +181,6 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
   game->input.mouse.movement[0] = 0;
   game->input.mouse.movement[1] = 0;
 
-
-  b32 pausePhysics = game->input.pausePhysics;
   for(u32 i = 0; i < input.eventNum; i++) {
     rt_input_event* event = input.events + i;
     if (event->type == rt_input_type_key) {
@@ -231,9 +257,9 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
   m4x4 viewM = M4X4_IDENTITY;
 
   /// Free view camera
-  m3x3 orientation = game->car.body.chassis.orientation;
+  m3x3 orientation = game->world.renderOrientation[game->car.chassis];
   if (game->state == game_state_intro) {
-    cam->yaw += 0.1f;
+    cam->yaw += 6.f * time.delta;
     orientation = m3x3_rotate_make({0.0f, 0.f, -DEG2RAD(cam->yaw)});
     orientation = orientation * m3x3_rotate_make({0.0f, DEG2RAD(cam->pitch),0});
   }
@@ -245,12 +271,14 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
       orientation = orientation * m3x3_rotate_make({0.0f, DEG2RAD(cam->pitch),0});
     }
   }
-  v3 camTarget = game->car.body.chassis.position -
-    game->car.body.chassis.localCenter;
+  v3 camTarget = game->world.renderPosition[game->car.chassis] -
+    game->renderState->bodies.localCenter[game->car.chassis];
   v3 camOffset = (v3){5.f,0.f,-3.f} * orientation;
   v3 camPos = camTarget - camOffset;
+  // Same follow speed as 0.1 per frame at 60 fps
+  f32 camFollow = 1.f - powf(0.9f, time.delta * 60.f);
   cam->position = LERP(cam->position, camPos, 
-                       (game->debug.freeCameraView || initialize) ? 1.0f : 0.1f);
+                       (game->debug.freeCameraView || initialize) ? 1.0f : camFollow);
   viewM = lookAt(cam->position - camTarget,(v3){0.0f,0.0f, 1.f});
 
   rt_pushRenderCommand(&rendererBuffer, begin);
@@ -268,8 +296,7 @@ extern "C" RT_GAME_UPDATE_AND_RENDER(gameUpdate) {
   renderSkybox(game, &tempMemory, &rendererBuffer, viewM, projM);
   renderTerrain(game, &tempMemory, &rendererBuffer, viewM, projM);
   updateCar(game,&tempMemory, &rendererBuffer,
-                     widgetContext, viewM, projM,
-		     pausePhysics ? 0 : time.delta);
+                     widgetContext, viewM, projM, time.delta);
 
   renderCar(game, &tempMemory, &rendererBuffer, widgetContext, viewM, projM);
   // Nuklear ui
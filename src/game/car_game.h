@@ -86,6 +86,210 @@ typedef struct model_material_data {
   v4 baseColorValue;
 } mode_material_data;
 
+static v2 heightMapImgSize = {1024.f, 1024.f};
+// World extent, of the tile file when the terrain is streamed
+static v2 geometrySize = {4096.f, 4096.f};
+static v3 heightMapScale = {geometrySize.x / heightMapImgSize.x,
+                            geometrySize.y / heightMapImgSize.y, 80.f};
+
+// log2 of the height map size
+#define TERRAIN_MINMAX_LEVEL_NUM 10
+
+// Height map sample of the physics queries, see terrain_sample.cpp
+typedef struct terrain_sample {
+  u16 height;
+  // Hemi-octahedral, 8 bits per axis
+  u16 normal;
+} terrain_sample;
+
+// The samples are stored in square tiles of this many a side
+#define TERRAIN_SAMPLE_TILE 4
+
+typedef enum noise_basis {
+  noise_basis_gradient,
+  noise_basis_simplex,
+} noise_basis;
+
+typedef enum noise_fractal_type {
+  // Sum of the octaves, about -1..1
+  noise_fractal_fbm,
+  // Sum of (1 - |octave|)^2, sharp ridges where the noise crosses zero,
+  // 0..1
+  noise_fractal_ridged,
+} noise_fractal_type;
+
+// Octaves of noise, see noise.c
+typedef struct noise_fractal {
+  noise_basis basis;
+  noise_fractal_type type;
+  u32 octaves;
+  // Cycles per unit of the input in the first octave
+  f32 frequency;
+  // Frequency and amplitude factors from an octave to the next
+  f32 lacunarity;
+  f32 gain;
+  // The input is moved by up to this much fBm before sampling, 0 is off
+  f32 warp;
+  u32 seed;
+} noise_fractal;
+
+// Procedural terrain of noise in meters, see terrainStreamGenerate
+typedef struct terrain_generator {
+  noise_fractal noise;
+  // The height is baseHeight + heightScale * noise, the noise clamped to
+  // -1..1
+  f32 baseHeight;
+  f32 heightScale;
+} terrain_generator;
+
+#define TERRAIN_TILE_MAGIC 0x454c4954
+#define TERRAIN_TILE_VERSION 2
+#define TERRAIN_TILE_NONE 0xffffffff
+// Largest tile is 2^TERRAIN_TILE_MAX_LEVELS cells a side, largest world
+// 2^TERRAIN_STREAM_MAX_LEVELS
+#define TERRAIN_TILE_MAX_LEVELS 8
+#define TERRAIN_STREAM_MAX_LEVELS 24
+// Tile loads queued to the background loader at most
+#define TERRAIN_STREAM_MAX_LOADS 64
+
+// Tiled terrain file. The header is followed by the terrain_tile_info of
+// every tile and then by the tiles, tileStride bytes apart from
+// tileOffset on, so every tile starts at a page. A tile has
+// (tileSize + 1)^2 samples in rows, the last row and column repeat the
+// first ones of the next tile so that a cell never spans two tiles.
+// First come the terrain_sample samples in rows, then one material byte
+// per sample.
+typedef struct terrain_tile_header {
+  u32 magic;
+  u32 version;
+  // Cells per tile side and tiles per world side, powers of two
+  u32 tileSize;
+  u32 tileNum;
+  f32 cellSize;
+  u32 tileStride;
+  u64 tileOffset;
+} terrain_tile_header;
+
+typedef struct terrain_tile_info {
+  // Smallest and largest height of the samples
+  v2 range;
+  // The height of a sample is heightMin + height * heightStep
+  f32 heightMin;
+  f32 heightStep;
+} terrain_tile_info;
+
+typedef enum terrain_slot_state {
+  terrain_slot_free,
+  terrain_slot_loading,
+  terrain_slot_ready,
+} terrain_slot_state;
+
+typedef struct terrain_stream terrain_stream;
+
+typedef struct terrain_tile_slot {
+  terrain_stream* stream;
+  u32 tile;
+  terrain_slot_state state;
+  // Stream update the tile was last needed in, the least recently used
+  // tile is evicted first
+  u32 lastUsed;
+  // Set by the loader once the data is in
+  u32 volatile loaded;
+  terrain_sample* samples;
+  u8* material;
+  // Quantization of the samples, see terrain_tile_info
+  f32 heightMin;
+  f32 heightStep;
+  // Height ranges of the squares of 2^level cells in the tile, levels 1
+  // to tileShift - 1
+  v2* minMax[TERRAIN_TILE_MAX_LEVELS];
+  // Height range of the whole tile
+  v2 range;
+  // Noise heights of the tile and a sample around it, procedural only
+  f32* heights;
+} terrain_tile_slot;
+
+typedef struct terrain_stream_counters {
+  u32 loadNum;
+  // Loads the physics couldn't wait for the loader
+  u32 syncLoadNum;
+  u32 evictionNum;
+} terrain_stream_counters;
+
+// Terrain paged in from a memory mapped tile file or generated, see
+// terrain_stream.cpp
+struct terrain_stream {
+  // NULL when the tiles are generated
+  u8* file;
+  usize fileSize;
+  terrain_generator generator;
+  terrain_tile_header header;
+  u32 tileShift;
+  i32 cellNum;
+  u32 levelNum;
+  // Slot of every tile or TERRAIN_TILE_NONE
+  u32* tileSlot;
+  // Height ranges of the squares of 2^(tileShift + i) cells, the first
+  // level is the range table of the file
+  v2* minMax[TERRAIN_STREAM_MAX_LEVELS];
+  terrain_tile_slot* slots;
+  u32 slotNum;
+  // Loads queued to the background loader
+  u32 queuedNum;
+  u32 updateNum;
+  terrain_stream_counters counters;
+};
+
+#define TERRAIN_CACHE_MAGIC 0x454b4142
+#define TERRAIN_CACHE_VERSION 2
+
+typedef enum terrain_cache_section {
+  terrain_cache_section_image,
+  terrain_cache_section_terrain_vertices,
+  terrain_cache_section_terrain_indices,
+  terrain_cache_section_geometry_vertices,
+  terrain_cache_section_geometry_indices,
+  terrain_cache_section_geometry,
+  _terrain_cache_section_num
+} terrain_cache_section;
+
+// What the terrain is baked from, a cache made from anything else is
+// baked again
+typedef struct terrain_cache_key {
+  i64 sourceModTime;
+  i32 imageWidth;
+  i32 imageHeight;
+  v3 heightMapScale;
+  v2 meshGridSize;
+  v2 meshCellNum;
+} terrain_cache_key;
+
+// Baked terrain file, see terrain_cache.cpp. The sections follow the
+// header in the order of terrain_cache_section, each one at a 64 byte
+// boundary.
+typedef struct terrain_cache_header {
+  u32 magic;
+  u32 version;
+  terrain_cache_key key;
+  u32 terrainIndexNum;
+  u32 geometryIndexNum;
+  f32 heightMin;
+  f32 heightStep;
+  u64 sectionOffset[_terrain_cache_section_num];
+  u64 sectionSize[_terrain_cache_section_num];
+} terrain_cache_header;
+
+// The outputs of the startup bake that go to the renderer and the
+// collision geometry
+typedef struct terrain_bake_data {
+  rt_image_data heightMapImg;
+  mesh_data terrainMesh;
+  mesh_data geometryMesh;
+  terrain_sample *samples;
+  f32 heightMin;
+  f32 heightStep;
+} terrain_bake_data;
+
 typedef struct terrain_object {
   struct {
     rt_vertex_array_handle vertexArrayHandle;
@@ -107,7 +311,22 @@ typedef struct terrain_object {
     u32 elementNum;
   } geometry_model;
   rt_image_data heightMapImg;
-  v4 *geometry;
+  // Packed height map for the physics queries, the height of a sample is
+  // heightMin + height * heightStep
+  terrain_sample *samples;
+  f32 heightMin;
+  f32 heightStep;
+  // Smallest and largest height of each square of 2^level cells for the
+  // ray and sphere casts, levels 1 to TERRAIN_MINMAX_LEVEL_NUM. Single
+  // cells use their corner heights.
+  v2 *minMax[TERRAIN_MINMAX_LEVEL_NUM];
+  // Set when the terrain is streamed from a tile file instead, the
+  // queries read the stream then
+  terrain_stream *stream;
+  // Mapped cache file the height map image points to when the bake was
+  // loaded from the cache
+  void *cacheFile;
+  usize cacheFileSize;
   b32 initialized;
 } terrain_object;
 
@@ -135,6 +354,22 @@ typedef struct model_data {
   u32 meshNum;
 } model_data;
 
+enum tire_model {
+  // Bezier curves through the six control points of the curve arrays
+  tire_model_bezier,
+  // Pacejka magic formula with the pacejka_params of the curve
+  tire_model_pacejka,
+};
+
+// y = D * sin(C * atan(B * x - E * (B * x - atan(B * x)))) + Sv
+typedef struct pacejka_params {
+  f32 B;
+  f32 C;
+  f32 D;
+  f32 E;
+  f32 Sv;
+} pacejka_params;
+
 typedef struct car_properties {
   f32 chassisMass;
   f32 wheelMass;
@@ -160,8 +395,28 @@ typedef struct car_properties {
   f32 engineInertia;
   f32 differentialRatio;
   f32 transmissionEfficiency;
+  tire_model tireModel;
+  pacejka_params slipRatioPacejka;
+  pacejka_params slipAnglePacejka;
 } car_properties;
 
+// Curves sampled uniformly over [0, 1], the last sample is t = 1
+#define CURVE_LUT_SIZE 128
+
+typedef struct curve_lut {
+  f32 samples[CURVE_LUT_SIZE + 1];
+} curve_lut;
+
+// Tire and engine curves baked from car_properties, rebaked whenever the
+// properties change.
+typedef struct car_curves {
+  curve_lut slipRatioForce;
+  curve_lut slipAngleForce;
+  curve_lut motorTorque;
+  car_properties bakedProperties;
+  b32 baked;
+} car_curves;
+
 typedef f32 audio_filter_state[4];
 
 typedef struct car_audio_state{
@@ -175,41 +430,48 @@ typedef struct car_audio_state{
   i32 sampleIndex;
 } audio_state;
 
+typedef struct car_stats {
+  f32 frictionAdjustment[4];
+  f32 slipAngle[4];
+  f32 slipRatio[4];
+  f32 motorTorque;
+  f32 longSpeed;
+  f32 rpm;
+  i32 gear;
+  b32 accelerating;
+  f32 gearShiftT;
+} car_stats;
+
+// Level of detail of the car simulation. The raycast model is the chassis
+// alone, held up by four suspension rays, see carRaycastWheels.
+typedef enum car_lod {
+  car_lod_full,
+  car_lod_raycast,
+} car_lod;
+
 typedef struct car_state {
   car_properties properties;
+  car_curves curves;
   model_data chassisModel;
   model_data wheelModel[4];
   rt_shader_program_handle programHandle;
   car_audio_state audioState;
-  union {
-    rigid_body bodies[5];
-    struct {
-      rigid_body chassis;
-      rigid_body wheels[4];
-    };
-  } body;
-  shape bodyShapes[12];
-  union {
-    joint jointsAll[12];
-    struct {
-      joint wheelHinge;
-      joint wheelSuspension;
-      joint wheelSuspensionLimits;
-    }joints[4];
-  };
-  struct {
-    f32 frictionAdjustment[4];
-    f32 slipAngle[4];
-    f32 slipRatio[4];
-    f32 motorTorque;
-    f32 rpm;
-    i32 gear;
-    b32 accelerating;
-    f32 gearShiftT;
-  } stats; 
-  contact_point contactPointStorage[MAX_CONTACTS];
+  // Indices to the physics world. Wheel bodies follow the chassis body and
+  // each wheel owns a hinge, suspension and suspension limit joint, stored
+  // from firstJoint[type] on in the joint array of each type.
+  u32 chassis;
+  u32 firstJoint[_joint_type_num];
+  u32 firstContact;
+  car_stats stats;
   u32 contactPointNum;
   f32 turnAngle;
+  car_lod lod;
+  // Raycast model wheels: distance from the top of the suspension travel
+  // to the wheel center along the ray, the roll angle of the wheel and its
+  // angular velocity around the axle
+  f32 wheelRayDistance[4];
+  f32 wheelRollAngle[4];
+  f32 wheelSpin[4];
   b32 initialized;
 } car_state;
 
@@ -250,6 +512,20 @@ typedef struct profiler_state {
   u64 counter[_profiler_counter_entry_num]; 
   f64 average[_profiler_counter_entry_num]; 
   f32 elapsedTime;
+  u32 frameNum;
+  // Largest substep count of the steps seen since the last average
+  u32 maxSubsteps;
+  f64 averageSubsteps;
+  u32 peakSubsteps;
+  // Physics phase and counter totals of the latest render state
+  physics_counters physics;
+  physics_counters prevPhysics;
+  f64 physicsAverage[_physics_timer_num];
+  f64 averageContacts;
+  f64 averageJoints;
+  f64 averagePassSubsteps;
+  f64 warmStartHitRate;
+  f64 relaxSkipRate;
 } profiler_state;
 
 
@@ -259,18 +535,62 @@ typedef struct profiler_state {
   profiler.accumulated[profiler_counter_entry_##entry] += \
   platformApi->getPerformanceCounter() - profiler.counter[profiler_counter_entry_##entry]
 
+#define physicsCountersAdd(totals, counters) \
+  for (i32 i = 0; i < _physics_timer_num; i++) { \
+    totals.ticks[i] += counters.ticks[i]; \
+  } \
+  totals.stepNum += counters.stepNum; \
+  totals.contactNum += counters.contactNum; \
+  totals.warmStartHitNum += counters.warmStartHitNum; \
+  totals.jointNum += counters.jointNum; \
+  totals.substepNum += counters.substepNum; \
+  totals.relaxPassNum += counters.relaxPassNum; \
+  totals.relaxSkipNum += counters.relaxSkipNum; \
+  totals.islandNum += counters.islandNum; \
+  totals.islandSubstepSum += counters.islandSubstepSum; \
+  totals.islandSubstepMax = \
+    MAX(totals.islandSubstepMax, counters.islandSubstepMax)
+
 #define profilerAverage(profiler, delta, stepSec) \
   profiler.elapsedTime += delta; \
+  profiler.frameNum++; \
   if (profiler.elapsedTime > stepSec) { \
     u64 freq = platformApi->getPerformanceFrequency(); \
     profiler.average[profiler_counter_entry_total] = 0.f; \
     for(i32 i = 0; i < profiler_counter_entry_total; i++) { \
       profiler.average[i] = 1000.f * (f64)(profiler.accumulated[i] - profiler.prevAccumulated[i]) /\
-        (stepSec * 60.0) / freq; \
+        profiler.frameNum / freq; \
       profiler.prevAccumulated[i] = profiler.accumulated[i]; \
       profiler.average[profiler_counter_entry_total] += profiler.average[i]; \
     } \
+    for(i32 i = 0; i < _physics_timer_num; i++) { \
+      profiler.physicsAverage[i] = 1000.f * (f64)(profiler.physics.ticks[i] - \
+        profiler.prevPhysics.ticks[i]) / profiler.frameNum / freq; \
+    } \
+    u64 physicsSteps = profiler.physics.stepNum - profiler.prevPhysics.stepNum; \
+    u64 physicsContacts = \
+      profiler.physics.contactNum - profiler.prevPhysics.contactNum; \
+    f64 invPhysicsSteps = physicsSteps ? 1.0 / physicsSteps : 0.0; \
+    profiler.averageContacts = physicsContacts * invPhysicsSteps; \
+    profiler.averageJoints = \
+      (profiler.physics.jointNum - profiler.prevPhysics.jointNum) * invPhysicsSteps; \
+    profiler.averagePassSubsteps = \
+      (profiler.physics.substepNum - profiler.prevPhysics.substepNum) * invPhysicsSteps; \
+    profiler.warmStartHitRate = physicsContacts ? 100.0 * \
+      (profiler.physics.warmStartHitNum - profiler.prevPhysics.warmStartHitNum) / \
+      physicsContacts : 0.0; \
+    u64 relaxRun = profiler.physics.relaxPassNum - profiler.prevPhysics.relaxPassNum; \
+    u64 relaxSkip = profiler.physics.relaxSkipNum - profiler.prevPhysics.relaxSkipNum; \
+    profiler.relaxSkipRate = relaxRun + relaxSkip ? \
+      100.0 * relaxSkip / (relaxRun + relaxSkip) : 0.0; \
+    u64 islands = profiler.physics.islandNum - profiler.prevPhysics.islandNum; \
+    profiler.averageSubsteps = islands ? (f64)(profiler.physics.islandSubstepSum - \
+      profiler.prevPhysics.islandSubstepSum) / islands : 0.0; \
+    profiler.prevPhysics = profiler.physics; \
+    profiler.peakSubsteps = profiler.maxSubsteps; \
+    profiler.maxSubsteps = 0; \
     profiler.elapsedTime = profiler.elapsedTime - stepSec; \
+    profiler.frameNum = 0; \
   }
 
 enum debug_state {
@@ -279,6 +599,46 @@ enum debug_state {
   _game_state_num
 };
 
+// Latest value exchange between one writer and one reader thread. The
+// writer fills its back slot and swaps it with the middle one, the reader
+// swaps the middle with its front slot when something new is there. With
+// three slots neither side ever waits for the other, the writer always
+// has a slot that the reader isn't reading from.
+typedef struct triple_buffer {
+  u32 back;
+  // Slot index, TRIPLE_BUFFER_NEW is set until the reader takes it
+  u32 middle;
+  u32 front;
+} triple_buffer;
+
+// What the main thread sends the physics, the car properties edited on
+// the main thread go with the input
+typedef struct physics_input {
+  input_state input;
+  car_properties carProperties;
+} physics_input;
+
+// What the main thread renders from, filled by the thread that steps the
+// physics after every update. Body streams are pushed with the world.
+typedef struct render_state {
+  // Performance counter at the update and the time since the last step
+  u64 counter;
+  f32 accumulator;
+  body_transforms bodies;
+  v3 chassisVelocity;
+  v3 chassisForwardAxis;
+  car_stats carStats;
+  // Tire curves the physics sampled, for the UI plots
+  curve_lut slipRatioForce;
+  curve_lut slipAngleForce;
+  u32 contactPointNum;
+  contact_point contactPoints[MAX_CONTACTS];
+  solver_convergence convergence;
+  // Totals since the start and the peak of the steps since the last update
+  physics_counters physics;
+  u32 islandSubstepMax;
+} render_state;
+
 typedef struct car_game_state {
   b32 initialized;
   debug_state state;
@@ -287,9 +647,30 @@ typedef struct car_game_state {
   camera_state camera;
   skybox_object skybox;
   terrain_object terrain;
+  physics_world world;
+  // Frame time not yet simulated, less than physicsStepDelta
+  f32 physicsAccumulator;
   car_state car;
   debug_draw_state debug;
   profiler_state profiler;
+  // Main thread input to the physics, physics to the renderer and the
+  // audio callback
+  physics_input inputSlots[3];
+  triple_buffer inputBuffer;
+  render_state renderSlots[3];
+  triple_buffer renderBuffer;
+  car_stats audioSlots[3];
+  triple_buffer audioBuffer;
+  // Render state taken for this frame
+  render_state* renderState;
+  // Main thread copy of the car properties for the UI, sent with the
+  // input
+  car_properties carProperties;
+  // Owned by the thread that steps the physics
+  input_state physicsInput;
+  u64 physicsCounter;
+  physics_counters physicsTotals;
+  u32 physicsSubstepMax;
 } car_game_state;
 
 static platform_api *platformApi = NULL;
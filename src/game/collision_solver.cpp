@@ -18,8 +18,8 @@ typedef struct contact_constraint_point {
 } contact_constraint_point;
 
 typedef struct contact_constraint {
-  rigid_body* bodyA;
-  rigid_body* bodyB;
+  u32 bodyA;
+  u32 bodyB;
   contact_constraint_point ccp;
   v3 normal;
   v3 tangents[2];
@@ -36,19 +36,20 @@ static i32 findOldContact(contact_point* contactPoints, u32 size, i32 shapeIdx)
   return -1;
 }
 
-static void preSolve(contact_manifold* man,
+static void preSolve(physics_world* world, contact_manifold* man,
                      contact_constraint* constraint, u32 contactNum, float h) {
   constraint->bodyA = man->bodyA;
   constraint->bodyB = man->bodyB;
   compute_basis(man->point.normal, constraint->tangents, constraint->tangents + 1);
   constraint->normal = man->point.normal;
 
-  constraint->friction = sqrtf(man->bodyA->friction + man->bodyB->friction);
+  constraint->friction =
+    sqrtf(world->friction[man->bodyA] + world->friction[man->bodyB]);
 
-  f32 mA = constraint->bodyA->invMass;
-  m3x3 iA = constraint->bodyA->invWorlInertiaTensor;
-  f32 mB = constraint->bodyB->invMass;
-  m3x3 iB = constraint->bodyB->invWorlInertiaTensor;
+  f32 mA = world->invMass[constraint->bodyA];
+  m3x3 iA = world->invWorlInertiaTensor[constraint->bodyA];
+  f32 mB = world->invMass[constraint->bodyB];
+  m3x3 iB = world->invWorlInertiaTensor[constraint->bodyB];
 
   contact_constraint_point* ccp = &constraint->ccp;
   ccp->point = man->point;
@@ -85,25 +86,28 @@ static void preSolve(contact_manifold* man,
   ccp->massCoefficient = c * ccp->impulseCoefficient;
 }
 
-static void warmStart(contact_constraint* constraint, u32 constraintNum) {
+static void warmStart(physics_world* world, contact_constraint* constraint,
+                      u32 constraintNum) {
   contact_constraint_point* cp = &constraint->ccp;
+  u32 bodyA = constraint->bodyA;
+  u32 bodyB = constraint->bodyB;
 
   v3 normal = constraint->normal;
   v3 P = (cp->point.normalImpulse * normal);
 
-  float mA = constraint->bodyA->invMass;
-  m3x3 iA = constraint->bodyA->invWorlInertiaTensor;
+  float mA = world->invMass[bodyA];
+  m3x3 iA = world->invWorlInertiaTensor[bodyA];
 
-  v3 vA = constraint->bodyA->velocity;
-  v3 wA = constraint->bodyA->angularVelocity;
+  v3 vA = world->velocity[bodyA];
+  v3 wA = world->angularVelocity[bodyA];
 
   v3 rA = cp->point.localPointA;
 
-  float mB = constraint->bodyB->invMass;
-  m3x3 iB = constraint->bodyB->invWorlInertiaTensor;
+  float mB = world->invMass[bodyB];
+  m3x3 iB = world->invWorlInertiaTensor[bodyB];
 
-  v3 vB = constraint->bodyB->velocity;
-  v3 wB = constraint->bodyB->angularVelocity;
+  v3 vB = world->velocity[bodyB];
+  v3 wB = world->angularVelocity[bodyB];
 
   v3 rB = cp->point.localPointB;
 
@@ -117,31 +121,37 @@ static void warmStart(contact_constraint* constraint, u32 constraintNum) {
   vB = vB + mB * P;
   wB = wB + iB * v3_cross(rB, P);
 
-  constraint->bodyA->velocity = vA;
-  constraint->bodyA->angularVelocity = wA;
-  constraint->bodyB->velocity = vB;
-  constraint->bodyB->angularVelocity = wB;
+  // Ground is shared between contacts solved in parallel
+  if (bodyA != GROUND_BODY) {
+    world->velocity[bodyA] = vA;
+    world->angularVelocity[bodyA] = wA;
+  }
+  world->velocity[bodyB] = vB;
+  world->angularVelocity[bodyB] = wB;
 }
 
-static void solve(contact_constraint* constraint, u32 constraintNum, float invH,
-                  b32 useBias) {
+// Returns the largest change of the normal and friction impulses
+static f32 solve(physics_world* world, contact_constraint* constraint,
+                 u32 constraintNum, float invH, b32 useBias) {
   contact_constraint_point* cp = &constraint->ccp;
+  u32 bodyA = constraint->bodyA;
+  u32 bodyB = constraint->bodyB;
 
-  float mA = constraint->bodyA->invMass;
-  m3x3 iA = constraint->bodyA->invWorlInertiaTensor;
+  float mA = world->invMass[bodyA];
+  m3x3 iA = world->invWorlInertiaTensor[bodyA];
 
-  v3 vA = constraint->bodyA->velocity;
-  v3 wA = constraint->bodyA->angularVelocity;
+  v3 vA = world->velocity[bodyA];
+  v3 wA = world->angularVelocity[bodyA];
 
-  v3 dcA = constraint->bodyA->deltaPosition;
+  v3 dcA = world->deltaPosition[bodyA];
 
-  float mB = constraint->bodyB->invMass;
-  m3x3 iB = constraint->bodyB->invWorlInertiaTensor;
+  float mB = world->invMass[bodyB];
+  m3x3 iB = world->invWorlInertiaTensor[bodyB];
 
-  v3 vB = constraint->bodyB->velocity;
-  v3 wB = constraint->bodyB->angularVelocity;
+  v3 vB = world->velocity[bodyB];
+  v3 wB = world->angularVelocity[bodyB];
 
-  v3 dcB = constraint->bodyB->deltaPosition;
+  v3 dcB = world->deltaPosition[bodyB];
 
   v3 normal = constraint->normal;
 
@@ -156,6 +166,7 @@ static void solve(contact_constraint* constraint, u32 constraintNum, float invH,
   v3 vrB = v3_cross(wB, rB);
 
   v3 dv = (vB + vrB) - (vA + vrA);
+  f32 impulseDelta;
   // Normal
   {
     v3 ds = (dcB - dcA) + (rB - rA);
@@ -183,6 +194,7 @@ static void solve(contact_constraint* constraint, u32 constraintNum, float invH,
     f32 newImpulse = MAX(cp->point.normalImpulse + impulse, 0.0f);
     impulse = newImpulse - cp->point.normalImpulse;
     cp->point.normalImpulse = newImpulse;
+    impulseDelta = fabsf(impulse);
 
     // Apply contact impulse
     v3 P = impulse * normal;
@@ -206,6 +218,7 @@ static void solve(contact_constraint* constraint, u32 constraintNum, float invH,
       cp->point.tangentImpulse[i] =
           CLAMP(oldLambda + lambda, -maxFriction, maxFriction);
       lambda = cp->point.tangentImpulse[i] - oldLambda;
+      impulseDelta = MAX(impulseDelta, fabsf(lambda));
 
       // Apply contact impulse
       v3 impulse = constraint->tangents[i] * lambda;
@@ -217,48 +230,14 @@ static void solve(contact_constraint* constraint, u32 constraintNum, float invH,
     }
   }
 
-  constraint->bodyA->velocity = vA;
-  constraint->bodyA->angularVelocity = wA;
-  constraint->bodyB->velocity = vB;
-  constraint->bodyB->angularVelocity = wB;
-}
-
-static void integrateVelocities(float h,
-				rigid_body* body,
-				v3 extForces,
-				v3 extTorques) {
-  // Integrate velocities
-  v3 cmForce = - (Kdl * body->velocity * v3_normalize(body->velocity))
-    - (Krr * body->velocity)
-    + (Gravity * body->mass)
-    + extForces;
-  // Dampings
-  v3 torque = -Kda * body->angularVelocity + extTorques;
-
-  // vCM = vCM + h * (FT/M)
-  v3 acc = body->invMass * cmForce;
-  body->velocity = body->velocity + acc * h;
-  // ICM-1 = A * _I-1 * AT
-  body->invWorlInertiaTensor = body->orientation *
-                                   body->invBodyInertiaTensor *
-                                   m3x3_transpose(body->orientation);
-
-  body->angularVelocity = body->angularVelocity + body->invWorlInertiaTensor * torque * h;
-}
-
-static void integratePositions(float h,
-			       rigid_body* body) {
-  body->deltaPosition = body->deltaPosition + body->velocity * h;
-  quat q = {0.0f,
-            body->angularVelocity.x * h * 0.5f,
-            body->angularVelocity.y * h * 0.5f,
-            body->angularVelocity.z * h * 0.5f};
-  body->orientationQuat =
-      body->orientationQuat + q * body->orientationQuat;
-  body->orientationQuat = quat_normalize(body->orientationQuat);
-  //mat3s o = glms_quat_mat3(body->orientationQuat);
-  //copyType(o.raw, body->orientation.arr, m3x3);
-  body->orientation = m3x3_from_quat(body->orientationQuat);
+  // Ground is shared between contacts solved in parallel
+  if (bodyA != GROUND_BODY) {
+    world->velocity[bodyA] = vA;
+    world->angularVelocity[bodyA] = wA;
+  }
+  world->velocity[bodyB] = vB;
+  world->angularVelocity[bodyB] = wB;
+  return impulseDelta;
 }
 
 static void storeContactImpulse(contact_point* point,
@@ -266,12 +245,3 @@ static void storeContactImpulse(contact_point* point,
                                 u32 constrainNum) {
   *point = constraint->ccp.point;
 }
-
-static void finalizePositions(rigid_body* body, f32 h) {
-  v3 a = (body->velocity0 - body->velocity) / h;
-  body->acceleration = a;
-
-  body->position = body->position + body->deltaPosition;
-  body->deltaPosition = V3_ZERO;
-  body->velocity0 = body->velocity;
-}
@@ -0,0 +1,276 @@
+#include "all.h"
+// Wide contact solver, SIMD_WIDTH contact constraints are solved at once.
+// Same idea as in Box2D v3 contact_solver.c: each color of the contact
+// graph is packed to wide constraints, the body state is gathered to lanes
+// and scattered back after solving. Overflow constraints are solved with
+// the scalar solver.
+//
+// Solving a lane does the same float operations in the same order as
+// solve() and warmStart(), so as long as the contacts of a body are solved
+// in the same order the result matches the scalar solver bit by bit.
+
+typedef struct contact_constraint_wide {
+  v3w normal;
+  v3w tangents[2];
+  v3w rA;
+  v3w rB;
+  f32w adjustedSeparation;
+  f32w normalMass;
+  f32w tangentMass[2];
+  f32w massCoefficient;
+  f32w biasCoefficient;
+  f32w impulseCoefficient;
+  f32w friction;
+  f32w normalImpulse;
+  f32w tangentImpulse[2];
+
+  u32 bodyA[SIMD_WIDTH];
+  u32 bodyB[SIMD_WIDTH];
+  u32 constraintIdx[SIMD_WIDTH];
+  u32 laneNum;
+} contact_constraint_wide;
+
+typedef struct contact_solver_wide {
+  contact_constraint_wide* constraints;
+  u32 constraintNum;
+  // Wide constraints of color c are [colorFirst[c], colorFirst[c + 1])
+  u32 colorFirst[GRAPH_COLOR_NUM + 1];
+} contact_solver_wide;
+
+typedef struct body_state_wide {
+  v3w v;
+  v3w w;
+  v3w dp;
+  f32w invMass;
+  m3x3w invI;
+} body_state_wide;
+
+static body_state_wide gatherBodies(physics_world* world, u32* bodies) {
+  body_state_wide result;
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    u32 body = bodies[lane];
+    m3x3 invI = world->invWorlInertiaTensor[body];
+    setLane(&result.v, lane, world->velocity[body]);
+    setLane(&result.w, lane, world->angularVelocity[body]);
+    setLane(&result.dp, lane, world->deltaPosition[body]);
+    setLane(&result.invMass, lane, world->invMass[body]);
+    setLane(&result.invI.m00, lane, invI.m00);
+    setLane(&result.invI.m01, lane, invI.m01);
+    setLane(&result.invI.m02, lane, invI.m02);
+    setLane(&result.invI.m10, lane, invI.m10);
+    setLane(&result.invI.m11, lane, invI.m11);
+    setLane(&result.invI.m12, lane, invI.m12);
+    setLane(&result.invI.m20, lane, invI.m20);
+    setLane(&result.invI.m21, lane, invI.m21);
+    setLane(&result.invI.m22, lane, invI.m22);
+  }
+  return result;
+}
+
+static void scatterBodies(physics_world* world, u32* bodies,
+                          body_state_wide* state) {
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    u32 body = bodies[lane];
+    // Static ground is shared by many lanes and never moves
+    if (body == GROUND_BODY) continue;
+    world->velocity[body] = getLane(&state->v, lane);
+    world->angularVelocity[body] = getLane(&state->w, lane);
+  }
+}
+
+static void prepareContactsWide(memory_arena* arena,
+                                contact_constraint* constraints,
+                                constraint_graph* graph,
+                                contact_solver_wide* solver) {
+  u32 wideNum = 0;
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    solver->colorFirst[c] = wideNum;
+    wideNum += (graph->colors[c].indexNum + SIMD_WIDTH - 1) / SIMD_WIDTH;
+  }
+  solver->colorFirst[GRAPH_COLOR_NUM] = wideNum;
+
+  solver->constraintNum = wideNum;
+  solver->constraints = pushArrayAligned(arena, wideNum,
+                                         contact_constraint_wide,
+                                         SIMD_ALIGNMENT);
+  memset(solver->constraints, 0, wideNum * sizeof(contact_constraint_wide));
+
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    graph_color* color = graph->colors + c;
+    for (u32 slot = 0; slot < color->indexNum; slot++) {
+      contact_constraint_wide* wide =
+        solver->constraints + solver->colorFirst[c] + slot / SIMD_WIDTH;
+      u32 lane = slot % SIMD_WIDTH;
+      if (lane == 0) {
+        // Padding lanes point to the static ground and solve to zero
+        for (u32 i = 0; i < SIMD_WIDTH; i++) {
+          wide->bodyA[i] = GROUND_BODY;
+          wide->bodyB[i] = GROUND_BODY;
+        }
+      }
+
+      u32 idx = color->indices[slot];
+      contact_constraint* constraint = constraints + idx;
+      contact_constraint_point* cp = &constraint->ccp;
+      wide->bodyA[lane] = constraint->bodyA;
+      wide->bodyB[lane] = constraint->bodyB;
+      wide->constraintIdx[lane] = idx;
+      wide->laneNum = lane + 1;
+
+      setLane(&wide->normal, lane, constraint->normal);
+      setLane(&wide->tangents[0], lane, constraint->tangents[0]);
+      setLane(&wide->tangents[1], lane, constraint->tangents[1]);
+      setLane(&wide->rA, lane, cp->point.localPointA);
+      setLane(&wide->rB, lane, cp->point.localPointB);
+      setLane(&wide->adjustedSeparation, lane, cp->adjustedSeparation);
+      setLane(&wide->normalMass, lane, cp->normalMass);
+      setLane(&wide->tangentMass[0], lane, cp->tangentMass[0]);
+      setLane(&wide->tangentMass[1], lane, cp->tangentMass[1]);
+      setLane(&wide->massCoefficient, lane, cp->massCoefficient);
+      setLane(&wide->biasCoefficient, lane, cp->biasCoefficient);
+      setLane(&wide->impulseCoefficient, lane, cp->impulseCoefficient);
+      setLane(&wide->friction, lane, constraint->friction);
+      setLane(&wide->normalImpulse, lane, cp->point.normalImpulse);
+      setLane(&wide->tangentImpulse[0], lane, cp->point.tangentImpulse[0]);
+      setLane(&wide->tangentImpulse[1], lane, cp->point.tangentImpulse[1]);
+    }
+  }
+}
+
+static void warmStartWide(physics_world* world,
+                          contact_constraint_wide* constraint) {
+  body_state_wide A = gatherBodies(world, constraint->bodyA);
+  body_state_wide B = gatherBodies(world, constraint->bodyB);
+
+  v3w P = v3w_scale(constraint->normal, constraint->normalImpulse);
+  for (u32 i = 0; i < 2; i++) {
+    P = v3w_add(P, v3w_scale(constraint->tangents[i],
+                             constraint->tangentImpulse[i]));
+  }
+
+  A.v = v3w_sub(A.v, v3w_scale(P, A.invMass));
+  A.w = v3w_sub(A.w, m3x3w_mul_v3w(A.invI, v3w_cross(constraint->rA, P)));
+
+  B.v = v3w_add(B.v, v3w_scale(P, B.invMass));
+  B.w = v3w_add(B.w, m3x3w_mul_v3w(B.invI, v3w_cross(constraint->rB, P)));
+
+  scatterBodies(world, constraint->bodyA, &A);
+  scatterBodies(world, constraint->bodyB, &B);
+}
+
+// Returns the largest impulse change of the lanes, same as solve()
+static f32 solveWide(physics_world* world,
+                     contact_constraint_wide* constraint, f32 invH,
+                     b32 useBias) {
+  body_state_wide A = gatherBodies(world, constraint->bodyA);
+  body_state_wide B = gatherBodies(world, constraint->bodyB);
+
+  v3w normal = constraint->normal;
+  v3w rA = constraint->rA;
+  v3w rB = constraint->rB;
+
+  // Relative velocity at contact
+  v3w vrA = v3w_cross(A.w, rA);
+  v3w vrB = v3w_cross(B.w, rB);
+  v3w dv = v3w_sub(v3w_add(B.v, vrB), v3w_add(A.v, vrA));
+  f32w impulseDelta;
+
+  // Normal
+  {
+    v3w ds = v3w_add(v3w_sub(B.dp, A.dp), v3w_sub(rB, rA));
+    f32w separation = f32w_add(v3w_dot(ds, normal),
+                               constraint->adjustedSeparation);
+
+    f32w zero = f32w_zero();
+    f32w one = f32w_splat(1.0f);
+    f32w bias = zero;
+    f32w massScale = one;
+    f32w impulseScale = zero;
+    if (useBias) {
+      bias = f32w_min(f32w_mul(constraint->biasCoefficient, separation),
+                      f32w_splat(4.0f));
+      massScale = constraint->massCoefficient;
+      impulseScale = constraint->impulseCoefficient;
+    }
+    // Speculative
+    f32w speculative = f32w_greater(separation, zero);
+    bias = f32w_select(speculative,
+                       f32w_mul(separation, f32w_splat(invH)), bias);
+    massScale = f32w_select(speculative, one, massScale);
+    impulseScale = f32w_select(speculative, zero, impulseScale);
+
+    f32w vn = v3w_dot(dv, normal);
+
+    // Compute normal impulse
+    f32w impulse = f32w_sub(
+      f32w_mul(f32w_mul(f32w_neg(constraint->normalMass), massScale),
+               f32w_add(vn, bias)),
+      f32w_mul(impulseScale, constraint->normalImpulse));
+    // Clamp the accumulated impulse
+    f32w newImpulse =
+      f32w_max(f32w_add(constraint->normalImpulse, impulse), zero);
+    impulse = f32w_sub(newImpulse, constraint->normalImpulse);
+    constraint->normalImpulse = newImpulse;
+    impulseDelta = f32w_max(impulse, f32w_neg(impulse));
+
+    // Apply contact impulse
+    v3w P = v3w_scale(normal, impulse);
+    A.v = v3w_sub(A.v, v3w_scale(P, A.invMass));
+    A.w = v3w_sub(A.w, m3x3w_mul_v3w(A.invI, v3w_cross(rA, P)));
+    B.v = v3w_add(B.v, v3w_scale(P, B.invMass));
+    B.w = v3w_add(B.w, m3x3w_mul_v3w(B.invI, v3w_cross(rB, P)));
+  }
+
+  // Friction
+  {
+    f32w maxFriction =
+      f32w_mul(constraint->friction, constraint->normalImpulse);
+    for (u32 i = 0; i < 2; ++i) {
+      v3w tangent = constraint->tangents[i];
+      // Compute tangent force
+      f32w lambda = f32w_mul(f32w_neg(v3w_dot(dv, tangent)),
+                             constraint->tangentMass[i]);
+
+      // Clamp the accumulated force
+      f32w oldLambda = constraint->tangentImpulse[i];
+      f32w newLambda =
+        f32w_min(f32w_max(f32w_add(oldLambda, lambda),
+                          f32w_neg(maxFriction)), maxFriction);
+      constraint->tangentImpulse[i] = newLambda;
+      lambda = f32w_sub(newLambda, oldLambda);
+      impulseDelta = f32w_max(impulseDelta,
+                              f32w_max(lambda, f32w_neg(lambda)));
+
+      // Apply contact impulse
+      v3w impulse = v3w_scale(tangent, lambda);
+      A.v = v3w_sub(A.v, v3w_scale(impulse, A.invMass));
+      A.w = v3w_sub(A.w, m3x3w_mul_v3w(A.invI, v3w_cross(rA, impulse)));
+      B.v = v3w_add(B.v, v3w_scale(impulse, B.invMass));
+      B.w = v3w_add(B.w, m3x3w_mul_v3w(B.invI, v3w_cross(rB, impulse)));
+    }
+  }
+
+  scatterBodies(world, constraint->bodyA, &A);
+  scatterBodies(world, constraint->bodyB, &B);
+
+  f32 residual = 0.f;
+  for (u32 lane = 0; lane < constraint->laneNum; lane++) {
+    residual = MAX(residual, getLane(&impulseDelta, lane));
+  }
+  return residual;
+}
+
+// Copies the accumulated impulses back to the scalar constraints so they
+// can be stored for warm starting the next step.
+static void contactStoreImpulsesWide(contact_solver_wide* solver,
+                                     contact_constraint* constraints) {
+  for (u32 i = 0; i < solver->constraintNum; i++) {
+    contact_constraint_wide* wide = solver->constraints + i;
+    for (u32 lane = 0; lane < wide->laneNum; lane++) {
+      contact_point* point = &constraints[wide->constraintIdx[lane]].ccp.point;
+      point->normalImpulse = getLane(&wide->normalImpulse, lane);
+      point->tangentImpulse[0] = getLane(&wide->tangentImpulse[0], lane);
+      point->tangentImpulse[1] = getLane(&wide->tangentImpulse[1], lane);
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#include "all.h"
+// Constraint graph coloring. Constraints inside one color don't share a
+// dynamic body, so a color can be solved in any order or in parallel.
+//
+// A constraint always gets a higher color than the earlier constraints of
+// its bodies. This keeps the solve order of every body the same as in the
+// serial solver, which makes the colored solver give the same results no
+// matter how the colors are split between threads. Constraints of a body
+// that runs out of colors are solved serially after the colors.
+
+#define GRAPH_COLOR_NUM 24
+
+typedef struct graph_color {
+  u32* indices;
+  u32 indexNum;
+} graph_color;
+
+typedef struct constraint_graph {
+  graph_color colors[GRAPH_COLOR_NUM];
+  u32* overflow;
+  u32 overflowNum;
+} constraint_graph;
+
+// Body pairs are stored as {bodyA, bodyB} for each constraint.
+static void colorConstraints(physics_world* world, memory_arena* arena,
+                             u32* bodyPairs, u32 constraintNum,
+                             constraint_graph* graph) {
+  u8* nextColor = pushArrayZeros(arena, world->bodyNum, u8);
+  u8* constraintColor = pushArray(arena, constraintNum, u8);
+  u32 colorCount[GRAPH_COLOR_NUM] = {0};
+
+  graph->overflow = pushArray(arena, constraintNum, u32);
+  graph->overflowNum = 0;
+
+  for (u32 i = 0; i < constraintNum; i++) {
+    u32 bodyA = bodyPairs[2 * i];
+    u32 bodyB = bodyPairs[2 * i + 1];
+    u32 color = 0;
+    if (bodyA != GROUND_BODY) color = MAX(color, nextColor[bodyA]);
+    if (bodyB != GROUND_BODY) color = MAX(color, nextColor[bodyB]);
+    if (color >= GRAPH_COLOR_NUM) {
+      // Later constraints of these bodies have to overflow as well
+      color = GRAPH_COLOR_NUM;
+      graph->overflow[graph->overflowNum++] = i;
+    } else {
+      colorCount[color]++;
+    }
+    if (bodyA != GROUND_BODY) nextColor[bodyA] = color + 1;
+    if (bodyB != GROUND_BODY) nextColor[bodyB] = color + 1;
+    constraintColor[i] = color;
+  }
+
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    graph->colors[c].indices = pushArray(arena, colorCount[c], u32);
+    graph->colors[c].indexNum = 0;
+  }
+  for (u32 i = 0; i < constraintNum; i++) {
+    u32 color = constraintColor[i];
+    if (color == GRAPH_COLOR_NUM) continue;
+    graph_color* graphColor = graph->colors + color;
+    graphColor->indices[graphColor->indexNum++] = i;
+  }
+}
+
+static void remapGraphIndices(constraint_graph* graph, u32* indices) {
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    graph_color* color = graph->colors + c;
+    for (u32 i = 0; i < color->indexNum; i++) {
+      color->indices[i] = indices[color->indices[i]];
+    }
+  }
+  for (u32 i = 0; i < graph->overflowNum; i++) {
+    graph->overflow[i] = indices[graph->overflow[i]];
+  }
+}
+
+// Joint colors are split by joint type so every type runs its own loop,
+// typeFirst[t] to typeFirst[t + 1] are the joints of type t in the color.
+typedef struct joint_graph {
+  constraint_graph graph;
+  u32 typeFirst[GRAPH_COLOR_NUM][_joint_type_num + 1];
+} joint_graph;
+
+// Only the joints of the islands in the solver pass are colored. The color
+// indices point to the joint array of the type and the overflow indices
+// to world->jointOrder.
+static void colorJoints(physics_world* world, memory_arena* arena,
+                        u32 substeps, joint_graph* jointGraph) {
+  constraint_graph* graph = &jointGraph->graph;
+  u32* jointIndices = pushArray(arena, world->jointNum, u32);
+  u32* bodyPairs = pushArray(arena, 2 * world->jointNum, u32);
+  u32 jointNum = 0;
+  for (u32 i = 0; i < world->jointNum; i++) {
+    joint_base* base = physicsWorldJointBase(world, world->jointOrder[i]);
+    if (!jointInPass(world, base, substeps)) continue;
+    jointIndices[jointNum] = i;
+    bodyPairs[2 * jointNum] = base->bodyA;
+    bodyPairs[2 * jointNum + 1] = base->bodyB;
+    jointNum++;
+  }
+  colorConstraints(world, arena, bodyPairs, jointNum, graph);
+  remapGraphIndices(graph, jointIndices);
+
+  // Stable counting sort by type. Constraints inside a color don't share
+  // bodies so the order inside a color doesn't change the results.
+  u32* sorted = pushArray(arena, jointNum, u32);
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    graph_color* color = graph->colors + c;
+    u32* typeFirst = jointGraph->typeFirst[c];
+    u32 typeNext[_joint_type_num];
+    for (u32 t = 0; t <= _joint_type_num; t++) typeFirst[t] = 0;
+    for (u32 i = 0; i < color->indexNum; i++) {
+      typeFirst[world->jointOrder[color->indices[i]].type + 1]++;
+    }
+    for (u32 t = 0; t < _joint_type_num; t++) {
+      typeFirst[t + 1] += typeFirst[t];
+      typeNext[t] = typeFirst[t];
+    }
+    for (u32 i = 0; i < color->indexNum; i++) {
+      joint_ref ref = world->jointOrder[color->indices[i]];
+      sorted[typeNext[ref.type]++] = ref.index;
+    }
+    for (u32 i = 0; i < color->indexNum; i++) {
+      color->indices[i] = sorted[i];
+    }
+  }
+}
+
+// Same for the contacts, the graph indices point to constraints.
+static void colorContacts(physics_world* world, memory_arena* arena,
+                          contact_constraint* constraints, u32 constraintNum,
+                          u32 substeps, constraint_graph* graph) {
+  u32* contactIndices = pushArray(arena, constraintNum, u32);
+  u32* bodyPairs = pushArray(arena, 2 * constraintNum, u32);
+  u32 contactNum = 0;
+  for (u32 i = 0; i < constraintNum; i++) {
+    if (!bodyInPass(world, constraints[i].bodyA, substeps) &&
+        !bodyInPass(world, constraints[i].bodyB, substeps)) {
+      continue;
+    }
+    contactIndices[contactNum] = i;
+    bodyPairs[2 * contactNum] = constraints[i].bodyA;
+    bodyPairs[2 * contactNum + 1] = constraints[i].bodyB;
+    contactNum++;
+  }
+  colorConstraints(world, arena, bodyPairs, contactNum, graph);
+  remapGraphIndices(graph, contactIndices);
+}
@@ -4,16 +4,16 @@
 
 // The distance joint only allows arbitrary rotation between two bodies but no translation.
 // It has three degrees of freedom.
-static void applyLinearVelocityStep(rigid_body* bodyA, rigid_body* bodyB, distance_joint* joint,
-                              v3 impulse) {
-  m3x3 iA = bodyA->invWorlInertiaTensor; 
-  m3x3 iB = bodyB->invWorlInertiaTensor; 
+static void applyLinearVelocityStep(physics_world* world, u32 bodyA, u32 bodyB,
+                                    distance_joint* joint, v3 impulse) {
+  m3x3 iA = world->invWorlInertiaTensor[bodyA]; 
+  m3x3 iB = world->invWorlInertiaTensor[bodyB]; 
   
   v3 localAnchorA = joint->base.localAnchorA; 
   v3 localAnchorB = joint->base.localAnchorB; 
  
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 rA = qA * localAnchorA;
   v3 rB = qB * localAnchorB;
@@ -26,49 +26,49 @@ static void applyLinearVelocityStep(rigid_body* bodyA, rigid_body* bodyB, distan
   v3 vB = mB * impulse;
   v3 wB = iB * v3_cross(rB, impulse);
 
-  bodyA->velocity = bodyA->velocity - vA;
-  bodyA->angularVelocity = bodyA->angularVelocity - wA;
+  world->velocity[bodyA] = world->velocity[bodyA] - vA;
+  world->angularVelocity[bodyA] = world->angularVelocity[bodyA] - wA;
   
-  bodyB->velocity = bodyB->velocity + vB;
-  bodyB->angularVelocity = bodyB->angularVelocity + wB;
+  world->velocity[bodyB] = world->velocity[bodyB] + vB;
+  world->angularVelocity[bodyB] = world->angularVelocity[bodyB] + wB;
 }
 
-inline void setupDistanceJoint(joint* j, rigid_body* rbA, rigid_body* rbB,
+inline void setupDistanceJoint(distance_joint* j, u32 rbA, u32 rbB,
 			       v3 pivotA, v3 pivotB, v3 axisInA, v3 axisInB,
 			       f32 herz, f32 damping) {
-  j->type = joint_type_distance;
-  j->distance.base.herz = herz;
-  j->distance.base.damping = damping;
-  j->distance.base.bodyA = rbA;
-  j->distance.base.bodyB = rbB;
-
-  j->distance.base.localOriginAnchorA = pivotA;
-  j->distance.base.localOriginAnchorB = pivotB;
+  j->base.herz = herz;
+  j->base.damping = damping;
+  j->base.bodyA = rbA;
+  j->base.bodyB = rbB;
+
+  j->base.localOriginAnchorA = pivotA;
+  j->base.localOriginAnchorB = pivotB;
 }
 
-inline void preSolveDistanceJoint(distance_joint* joint, f32 h) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void preSolveDistanceJoint(physics_world* world, distance_joint* joint,
+                                  f32 h) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
   joint->base.localAnchorA = joint->base.localOriginAnchorA;
   joint->base.localAnchorB = joint->base.localOriginAnchorB;
 
-  joint->base.invMassB = bodyB->invMass;
-  joint->base.invMassA = bodyA->invMass;
+  joint->base.invMassB = world->invMass[bodyB];
+  joint->base.invMassA = world->invMass[bodyA];
 
-  joint->base.invIA = bodyA->invWorlInertiaTensor; 
-  joint->base.invIB = bodyB->invWorlInertiaTensor; 
+  joint->base.invIA = world->invWorlInertiaTensor[bodyA]; 
+  joint->base.invIB = world->invWorlInertiaTensor[bodyB]; 
   
   v3 localAnchorA = joint->base.localAnchorA; 
   v3 localAnchorB = joint->base.localAnchorB; 
  
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 rA = qA * localAnchorA;
   v3 rB = qB * localAnchorB;
 
-  v3 centerDiff = bodyB->position - bodyA->position;
+  v3 centerDiff = world->position[bodyB] - world->position[bodyA];
 
   // constraint setup
   {
@@ -93,22 +93,23 @@ inline void preSolveDistanceJoint(distance_joint* joint, f32 h) {
   }
 }
 
-inline void solveDistanceJoint(distance_joint* joint, f32 h, f32 invH,
-                              b32 useBias) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline f32 solveDistanceJoint(physics_world* world, distance_joint* joint,
+                              f32 h, f32 invH, b32 useBias) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
+  f32 impulseDelta = 0.f;
 
   // point-to-point constraint
   // This constraint removes three translation degrees of freedom from the system
   if (1) {
-    v3 vA = bodyA->velocity;
-    v3 wA = bodyA->angularVelocity;
+    v3 vA = world->velocity[bodyA];
+    v3 wA = world->angularVelocity[bodyA];
 
-    v3 vB = bodyB->velocity;
-    v3 wB = bodyB->angularVelocity;
+    v3 vB = world->velocity[bodyB];
+    v3 wB = world->angularVelocity[bodyB];
 
-    m3x3 qA = bodyA->orientation;
-    m3x3 qB = bodyB->orientation;
+    m3x3 qA = world->orientation[bodyA];
+    m3x3 qB = world->orientation[bodyB];
 
     v3 localAnchorA = joint->base.localAnchorA;
     v3 localAnchorB = joint->base.localAnchorB;
@@ -128,8 +129,8 @@ inline void solveDistanceJoint(distance_joint* joint, f32 h, f32 invH,
     v3 jv = ((vA - v3_cross(rA, wA)) - vB + v3_cross(rB, wB));
 
     if (useBias) {
-      v3 dcA = bodyA->deltaPosition;
-      v3 dcB = bodyB->deltaPosition;
+      v3 dcA = world->deltaPosition[bodyA];
+      v3 dcB = world->deltaPosition[bodyB];
 
       // Calculate translation bias velocity
       // bias = beta / h * CPos
@@ -151,14 +152,27 @@ inline void solveDistanceJoint(distance_joint* joint, f32 h, f32 invH,
     // Store total impulse
     impulse = newImpulse - joint->totalImpulse;
     joint->totalImpulse = newImpulse;
+    impulseDelta = v3_length(impulse);
 
-    applyLinearVelocityStep(bodyA, bodyB, joint, impulse);
+    applyLinearVelocityStep(world, bodyA, bodyB, joint, impulse);
   }
+  return impulseDelta;
 }
 
-inline void warmStartDistanceJoint(distance_joint* joint) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void warmStartDistanceJoint(physics_world* world,
+                                   distance_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
+
+  applyLinearVelocityStep(world, bodyA, bodyB, joint, joint->totalImpulse);
+}
 
-  applyLinearVelocityStep(bodyA, bodyB, joint, joint->totalImpulse);
+inline f32 distanceJointPositionError(physics_world* world,
+                                      distance_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
+  v3 rA = world->orientation[bodyA] * joint->base.localAnchorA;
+  v3 rB = world->orientation[bodyB] * joint->base.localAnchorB;
+  v3 CPos = world->position[bodyB] + rB - world->position[bodyA] - rA;
+  return v3_length(CPos);
 }
@@ -5,31 +5,30 @@
 // A hinge joint only allows relative rotation between two bodies around a single axis. It has one
 // degree of freed - Chapter 2.4
 
-static void applyAxialVelocityStep(rigid_body* bodyA, rigid_body* bodyB, hinge_joint* joint,
-                              v3 impulse) {
-  m3x3 iA = bodyA->invWorlInertiaTensor;
-  m3x3 iB = bodyB->invWorlInertiaTensor;
+static void applyAxialVelocityStep(physics_world* world, u32 bodyA, u32 bodyB,
+                                   hinge_joint* joint, v3 impulse) {
+  m3x3 iA = world->invWorlInertiaTensor[bodyA];
+  m3x3 iB = world->invWorlInertiaTensor[bodyB];
 
   v3 wA = iA * impulse;
   v3 wB = iB * impulse;
 
-  bodyA->angularVelocity = bodyA->angularVelocity - wA;
-  bodyB->angularVelocity = bodyB->angularVelocity + wB;
+  world->angularVelocity[bodyA] = world->angularVelocity[bodyA] - wA;
+  world->angularVelocity[bodyB] = world->angularVelocity[bodyB] + wB;
 }
 
-inline void setupHingeJoint(joint* j, rigid_body* rbA, rigid_body* rbB,
+inline void setupHingeJoint(hinge_joint* j, u32 rbA, u32 rbB,
 			    v3 pivotA, v3 pivotB, v3 axisIn,
 			    f32 herz, f32 damping) {
-  j->type = joint_type_hinge;
-  j->distance.base.herz = herz;
-  j->distance.base.damping = damping;
-  j->hinge.base.bodyA = rbA;
-  j->hinge.base.bodyB = rbB;
+  j->base.herz = herz;
+  j->base.damping = damping;
+  j->base.bodyA = rbA;
+  j->base.bodyB = rbB;
 
-  j->hinge.base.localOriginAnchorA = pivotA;
-  j->hinge.base.localOriginAnchorB = pivotB;
+  j->base.localOriginAnchorA = pivotA;
+  j->base.localOriginAnchorB = pivotB;
 
-  j->hinge.hingeAxis = axisIn;
+  j->hingeAxis = axisIn;
 }
 
 inline v3 fixA2(v3 a1, v3 a2) {
@@ -50,26 +49,27 @@ inline v3 fixA2(v3 a1, v3 a2) {
   return a2;
 }
 
-inline void preSolveHingeJoint(hinge_joint* joint, f32 h) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void preSolveHingeJoint(physics_world* world, hinge_joint* joint,
+                               f32 h) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
   joint->base.localAnchorA = joint->base.localOriginAnchorA;
   joint->base.localAnchorB = joint->base.localOriginAnchorB;
 
-  joint->base.invMassB = bodyB->invMass;
-  joint->base.invMassA = bodyA->invMass;
+  joint->base.invMassB = world->invMass[bodyB];
+  joint->base.invMassA = world->invMass[bodyA];
 
-  joint->base.invIA = bodyA->invWorlInertiaTensor; 
-  joint->base.invIB = bodyB->invWorlInertiaTensor; 
+  joint->base.invIA = world->invWorlInertiaTensor[bodyA]; 
+  joint->base.invIB = world->invWorlInertiaTensor[bodyB]; 
   
   v3 hingeAxis = {joint->hingeAxis.x, joint->hingeAxis.y, joint->hingeAxis.z};
   v4 locAxisARot = { joint->localAxisARotation.x, joint->localAxisARotation.y, joint->localAxisARotation.z, joint->localAxisARotation.w};
   v4 locAxisBRot = { joint->localAxisBRotation.x, joint->localAxisBRotation.y, joint->localAxisBRotation.z, joint->localAxisBRotation.w};
   v3 glmA1 =
-      v3_rotate_axis_angle(hingeAxis * bodyA->orientation, locAxisARot.w, locAxisARot.xyz);
+      v3_rotate_axis_angle(hingeAxis * world->orientation[bodyA], locAxisARot.w, locAxisARot.xyz);
   v3 glmA2 =
-      v3_rotate_axis_angle(hingeAxis * bodyB->orientation, locAxisBRot.w, locAxisARot.xyz);
+      v3_rotate_axis_angle(hingeAxis * world->orientation[bodyB], locAxisBRot.w, locAxisARot.xyz);
 
   v3 A1 = {glmA1.x, glmA1.y, glmA1.z};
   v3 A2 = fixA2(A1, {glmA2.x, glmA2.y, glmA2.z});
@@ -98,17 +98,18 @@ inline void preSolveHingeJoint(hinge_joint* joint, f32 h) {
 				    &joint->base.massCoefficient);
 }
 
-inline void solveHingeJoint(hinge_joint* joint, f32 h, f32 invH, b32 useBias) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline f32 solveHingeJoint(physics_world* world, hinge_joint* joint, f32 h,
+                           f32 invH, b32 useBias) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
   // Hinge constraint
   // This constraint removes two rotational degrees of freedom from the system.
-  v3 wA = bodyA->angularVelocity;
-  v3 wB = bodyB->angularVelocity;
+  v3 wA = world->angularVelocity[bodyA];
+  v3 wB = world->angularVelocity[bodyB];
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 wD = wA - wB;
 
@@ -173,12 +174,13 @@ inline void solveHingeJoint(hinge_joint* joint, f32 h, f32 invH, b32 useBias) {
   lambda = newLambda - joint->totalLambda;
   joint->totalLambda = newLambda;
   v3 impulse = B2xA1 * lambda.arr[0] + C2xA1 * lambda.arr[1];
+  f32 impulseDelta = sqrtf(lambda.x * lambda.x + lambda.y * lambda.y);
 
-  applyAxialVelocityStep(bodyA, bodyB, joint, impulse);
+  applyAxialVelocityStep(world, bodyA, bodyB, joint, impulse);
 
   // Motor
-  m3x3 invWorldInertiaTensorA = joint->base.bodyA->invWorlInertiaTensor;
-  m3x3 invWorldInertiaTensorB = joint->base.bodyB->invWorlInertiaTensor;
+  m3x3 invWorldInertiaTensorA = world->invWorlInertiaTensor[joint->base.bodyA];
+  m3x3 invWorldInertiaTensorB = world->invWorlInertiaTensor[joint->base.bodyB];
 
   if (fabsf(joint->motorTorque) > 0.1f) {
     f32 K =
@@ -195,17 +197,19 @@ inline void solveHingeJoint(hinge_joint* joint, f32 h, f32 invH, b32 useBias) {
     joint->motorImpulse =
         CLAMP(joint->motorImpulse + impulse, -maxImpulse, maxImpulse);
     impulse = joint->motorImpulse - oldImpulse;
+    impulseDelta = MAX(impulseDelta, fabsf(impulse));
 
-    applyAxialVelocityStep(bodyA, bodyB, joint, A1 * impulse);
+    applyAxialVelocityStep(world, bodyA, bodyB, joint, A1 * impulse);
   }
+  return impulseDelta;
 }
 
-inline void warmStartHingeJoint(hinge_joint* joint) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void warmStartHingeJoint(physics_world* world, hinge_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 glmA1 =
       v3_rotate_axis_angle(joint->hingeAxis * qA, joint->localAxisARotation.w, joint->localAxisARotation.xyz);
@@ -227,5 +231,21 @@ inline void warmStartHingeJoint(hinge_joint* joint) {
     axialImpulse = axialImpulse + A1 * joint->motorImpulse;
   }
 
-  applyAxialVelocityStep(bodyA, bodyB, joint, axialImpulse);
+  applyAxialVelocityStep(world, bodyA, bodyB, joint, axialImpulse);
+}
+
+// Angle between the hinge axes of the bodies (sine)
+inline f32 hingeJointPositionError(physics_world* world, hinge_joint* joint) {
+  m3x3 qA = world->orientation[joint->base.bodyA];
+  m3x3 qB = world->orientation[joint->base.bodyB];
+  v3 A1 = v3_rotate_axis_angle(joint->hingeAxis * qA,
+                               joint->localAxisARotation.w,
+                               joint->localAxisARotation.xyz);
+  v3 A2 = fixA2(A1, v3_rotate_axis_angle(joint->hingeAxis * qB,
+                                         joint->localAxisBRotation.w,
+                                         joint->localAxisBRotation.xyz));
+  v3 B2 = perpendicular(A2);
+  v3 C2 = v3_cross(A2, B2);
+  v2 CRot = {v3_dot(A1, B2), v3_dot(A1, C2)};
+  return sqrtf(CRot.x * CRot.x + CRot.y * CRot.y);
 }
@@ -0,0 +1,217 @@
+#include "all.h"
+// Simulation islands, sleeping and adaptive substeps.
+//
+// After every step the awake bodies are grouped to islands with union find
+// over the joints and contacts. Contacts with the static ground don't join
+// bodies. A body that stays below the sleep velocities collects sleep
+// time and when the smallest sleep time of an island reaches timeToSleep
+// the whole island goes to sleep. Sleeping bodies are skipped by the
+// integration, their joints are not solved and their shapes are not
+// tested against the terrain.
+//
+// The islands that stay awake pick the substep count of the next step.
+// Fast bodies, joints that drift apart and deep contacts all ask for more
+// substeps, a calm island gets by with minSubStepAmount.
+
+#define ISLAND_NONE 0xffffffff
+
+static u32 islandFind(u32* parent, u32 body) {
+  while (parent[body] != body) {
+    parent[body] = parent[parent[body]];
+    body = parent[body];
+  }
+  return body;
+}
+
+static void islandLink(u32* parent, u32 bodyA, u32 bodyB) {
+  if (bodyA == GROUND_BODY || bodyB == GROUND_BODY) {
+    return;
+  }
+  u32 rootA = islandFind(parent, bodyA);
+  u32 rootB = islandFind(parent, bodyB);
+  if (rootA != rootB) {
+    parent[MAX(rootA, rootB)] = MIN(rootA, rootB);
+  }
+}
+
+// Wakes the whole island of the body
+static void physicsWorldWakeBody(physics_world* world, u32 body) {
+  if (body == GROUND_BODY || world->awake[body] || world->disabled[body]) {
+    return;
+  }
+  u32 islandBody = body;
+  do {
+    u32 next = world->islandNext[islandBody];
+    world->awake[islandBody] = true;
+    world->sleepTime[islandBody] = 0.f;
+    world->islandNext[islandBody] = islandBody;
+    world->substeps[islandBody] = (u8)subStepAmount;
+    world->awakeBodyNum++;
+    islandBody = next;
+  } while (islandBody != body);
+}
+
+// Parks an awake body, wake its island first so it's not in a ring of
+// sleeping bodies
+static void physicsWorldDisableBody(physics_world* world, u32 body) {
+  ASSERT(world->awake[body] && !world->disabled[body]);
+  world->disabled[body] = true;
+  world->awake[body] = false;
+  world->awakeBodyNum--;
+}
+
+// Returns a parked body to the simulation awake, substeps is the substep
+// count it starts with
+static void physicsWorldEnableBody(physics_world* world, u32 body,
+                                   u32 substeps) {
+  ASSERT(world->disabled[body]);
+  world->disabled[body] = false;
+  world->awake[body] = true;
+  world->sleepTime[body] = 0.f;
+  world->islandNext[body] = body;
+  world->substeps[body] = (u8)substeps;
+  world->awakeBodyNum++;
+}
+
+// Wakes the sleeping bodies that have a force applied or that are close
+// to a moving body.
+static void physicsWorldWakeBodies(physics_world* world) {
+  if (world->awakeBodyNum == world->bodyNum - 1) {
+    return;
+  }
+  for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+    if (!world->awake[body] &&
+        (v3_length2(world->force[body]) > 0.f ||
+         v3_length2(world->torque[body]) > 0.f)) {
+      physicsWorldWakeBody(world, body);
+    }
+  }
+  broadphase_state* broadphase = &world->broadphase;
+  for (u32 i = 0; i < broadphase->pairNum; i++) {
+    u32 bodyA = broadphase->pairs[i].bodyA;
+    u32 bodyB = broadphase->pairs[i].bodyB;
+    if (world->awake[bodyA] == world->awake[bodyB]) continue;
+    u32 moving = world->awake[bodyA] ? bodyA : bodyB;
+    if (world->sleepTime[moving] == 0.f) {
+      physicsWorldWakeBody(world, moving == bodyA ? bodyB : bodyA);
+    }
+  }
+}
+
+static u32 islandPickSubsteps(f32 maxSpeed, f32 jointError,
+                              f32 penetration, f32 delta) {
+  f32 substeps = (f32)minSubStepAmount;
+  substeps = MAX(substeps, ceilf(maxSpeed * delta / substepTravel));
+  substeps = MAX(substeps, ceilf(jointError / substepJointError));
+  substeps = MAX(substeps, ceilf(penetration / substepPenetration));
+  return (u32)MIN(substeps, (f32)maxSubStepAmount);
+}
+
+// Builds the islands of the awake bodies, puts the islands that have
+// been resting long enough to sleep and picks the substep count of the
+// others.
+static void physicsWorldUpdateIslands(physics_world* world,
+                                      memory_arena* tempArena,
+                                      contact_constraint* constraints,
+                                      u32 constraintNum, f32 delta) {
+  u32 bodyNum = world->bodyNum;
+  world->islandNum = 0;
+  world->islandSubstepSum = 0;
+  world->islandSubstepMax = 0;
+  u32* parent = pushArray(tempArena, bodyNum, u32);
+  f32* islandSleepTime = pushArray(tempArena, bodyNum, f32);
+  u32* islandFirst = pushArray(tempArena, bodyNum, u32);
+  // Fastest body, largest joint error and deepest contact of each island
+  f32* islandSpeed = pushArrayZeros(tempArena, bodyNum, f32);
+  f32* islandJointError = pushArrayZeros(tempArena, bodyNum, f32);
+  f32* islandPenetration = pushArrayZeros(tempArena, bodyNum, f32);
+  u32* islandSubsteps = pushArrayZeros(tempArena, bodyNum, u32);
+  for (u32 i = 0; i < bodyNum; i++) {
+    parent[i] = i;
+    islandSleepTime[i] = FLT_MAX;
+    islandFirst[i] = ISLAND_NONE;
+  }
+
+  for (u32 i = 0; i < world->jointNum; i++) {
+    joint_base* j = physicsWorldJointBase(world, world->jointOrder[i]);
+    if (!jointAwake(world, j)) continue;
+    islandLink(parent, j->bodyA, j->bodyB);
+  }
+  for (u32 i = 0; i < constraintNum; i++) {
+    islandLink(parent, constraints[i].bodyA, constraints[i].bodyB);
+  }
+
+  // The errors also go to the solver convergence report
+  solver_convergence* convergence = &world->convergence;
+  for (u32 i = 0; i < world->jointNum; i++) {
+    joint_ref ref = world->jointOrder[i];
+    joint_base* j = physicsWorldJointBase(world, ref);
+    if (!jointAwake(world, j)) continue;
+    u32 body = j->bodyA == GROUND_BODY ? j->bodyB : j->bodyA;
+    u32 root = islandFind(parent, body);
+    f32 error = jointPositionError(world, ref);
+    islandJointError[root] = MAX(islandJointError[root], error);
+    convergence->jointPositionError =
+      MAX(convergence->jointPositionError, error);
+  }
+  for (u32 i = 0; i < constraintNum; i++) {
+    u32 body = constraints[i].bodyA == GROUND_BODY ? constraints[i].bodyB
+                                                  : constraints[i].bodyA;
+    u32 root = islandFind(parent, body);
+    f32 penetration = -constraints[i].ccp.point.separation;
+    islandPenetration[root] = MAX(islandPenetration[root], penetration);
+    convergence->contactPenetration =
+      MAX(convergence->contactPenetration, penetration);
+  }
+
+  f32 linearTolerance = sleepLinearVelocity * sleepLinearVelocity;
+  f32 angularTolerance = sleepAngularVelocity * sleepAngularVelocity;
+  for (u32 body = GROUND_BODY + 1; body < bodyNum; body++) {
+    if (!world->awake[body]) continue;
+    f32 speed2 = v3_length2(world->velocity[body]);
+    if (speed2 > linearTolerance ||
+        v3_length2(world->angularVelocity[body]) > angularTolerance) {
+      world->sleepTime[body] = 0.f;
+    } else {
+      world->sleepTime[body] += delta;
+    }
+    u32 root = islandFind(parent, body);
+    islandSleepTime[root] = MIN(islandSleepTime[root], world->sleepTime[body]);
+    islandSpeed[root] = MAX(islandSpeed[root], speed2);
+  }
+
+  for (u32 body = GROUND_BODY + 1; body < bodyNum; body++) {
+    if (!world->awake[body]) continue;
+    u32 root = islandFind(parent, body);
+    if (!enableSleeping || islandSleepTime[root] < timeToSleep) {
+      if (!islandSubsteps[root]) {
+        islandSubsteps[root] = subStepAmount;
+        if (adaptiveSubsteps) {
+          islandSubsteps[root] =
+            islandPickSubsteps(sqrtf(islandSpeed[root]),
+                               islandJointError[root],
+                               islandPenetration[root], delta);
+        }
+        world->islandNum++;
+        world->islandSubstepSum += islandSubsteps[root];
+        world->islandSubstepMax =
+          MAX(world->islandSubstepMax, islandSubsteps[root]);
+      }
+      world->substeps[body] = (u8)islandSubsteps[root];
+      continue;
+    }
+
+    world->awake[body] = false;
+    world->awakeBodyNum--;
+    world->velocity[body] = V3_ZERO;
+    world->velocity0[body] = V3_ZERO;
+    world->angularVelocity[body] = V3_ZERO;
+    u32 first = islandFirst[root];
+    if (first == ISLAND_NONE) {
+      islandFirst[root] = body;
+    } else {
+      world->islandNext[body] = world->islandNext[first];
+      world->islandNext[first] = body;
+    }
+  }
+}
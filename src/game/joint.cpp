@@ -1,59 +1,136 @@
 #include "all.h"
+// Joint stages over one joint type at a time. The type is switched on once
+// per range and the loops call the typed functions directly, so they are
+// inlined into the loop without a per joint branch.
 
-static void jointPreSolve(joint* j, f32 h) {
-  ASSERT(j->type);
-  switch (j->type) {
+static void jointsPreSolve(physics_world* world, joint_type type,
+                           u32 substeps, u32 begin, u32 end, f32 h) {
+  switch (type) {
     case joint_type_hinge:
-      preSolveHingeJoint(&j->hinge, h);
+      for (u32 i = begin; i < end; i++) {
+        hinge_joint* j = world->hingeJoints + i;
+        if (!jointInPass(world, &j->base, substeps)) continue;
+        preSolveHingeJoint(world, j, h);
+      }
       break;
     case joint_type_distance:
-      preSolveDistanceJoint(&j->distance, h);
+      for (u32 i = begin; i < end; i++) {
+        distance_joint* j = world->distanceJoints + i;
+        if (!jointInPass(world, &j->base, substeps)) continue;
+        preSolveDistanceJoint(world, j, h);
+      }
       break;
     case joint_type_slider:
-      preSolveSliderJoint(&j->slider, h);
+      for (u32 i = begin; i < end; i++) {
+        slider_joint* j = world->sliderJoints + i;
+        if (!jointInPass(world, &j->base, substeps)) continue;
+        preSolveSliderJoint(world, j, h);
+      }
       break;
     case joint_type_axis:
-      preSolveAxisJoint(&j->axis, h);
+      for (u32 i = begin; i < end; i++) {
+        axis_joint* j = world->axisJoints + i;
+        if (!jointInPass(world, &j->base, substeps)) continue;
+        preSolveAxisJoint(world, j, h);
+      }
       break;
       InvalidDefaultCase;
   };
 }
 
-static void jointSolve(joint* j, f32 h, f32 invH,
-			    b32 useBias) {
-  ASSERT(j->type);
-  switch (j->type) {
+// indices point to the joint array of the type
+static void jointsWarmStart(physics_world* world, joint_type type,
+                            u32* indices, u32 begin, u32 end) {
+  switch (type) {
     case joint_type_hinge:
-      solveHingeJoint(&j->hinge, h, invH, useBias);
+      for (u32 i = begin; i < end; i++) {
+        warmStartHingeJoint(world, world->hingeJoints + indices[i]);
+      }
       break;
     case joint_type_distance:
-      solveDistanceJoint(&j->distance, h, invH, useBias);
+      for (u32 i = begin; i < end; i++) {
+        warmStartDistanceJoint(world, world->distanceJoints + indices[i]);
+      }
       break;
     case joint_type_slider:
-      solveSliderJoint(&j->slider, h, invH, useBias);
+      for (u32 i = begin; i < end; i++) {
+        warmStartSliderJoint(world, world->sliderJoints + indices[i]);
+      }
       break;
     case joint_type_axis:
-      solveAxisJoint(&j->axis, h, invH, useBias);
+      for (u32 i = begin; i < end; i++) {
+        warmStartAxisJoint(world, world->axisJoints + indices[i]);
+      }
       break;
       InvalidDefaultCase;
   };
 }
 
-static void jointWarmStart(joint* j) {
-  ASSERT(j->type);
-  switch (j->type) {
+// Returns the largest impulse change of the joints, the convergence
+// residual of the range. Angular joints count their angular impulse.
+static f32 jointsSolve(physics_world* world, joint_type type, u32* indices,
+                       u32 begin, u32 end, f32 h, f32 invH, b32 useBias) {
+  f32 residual = 0.f;
+  switch (type) {
     case joint_type_hinge:
-      warmStartHingeJoint(&j->hinge);
+      for (u32 i = begin; i < end; i++) {
+        f32 delta = solveHingeJoint(world, world->hingeJoints + indices[i],
+                                    h, invH, useBias);
+        residual = MAX(residual, delta);
+      }
       break;
     case joint_type_distance:
-      warmStartDistanceJoint(&j->distance);
+      for (u32 i = begin; i < end; i++) {
+        f32 delta = solveDistanceJoint(world,
+                                       world->distanceJoints + indices[i], h,
+                                       invH, useBias);
+        residual = MAX(residual, delta);
+      }
       break;
     case joint_type_slider:
-      warmStartSliderJoint(&j->slider);
+      for (u32 i = begin; i < end; i++) {
+        f32 delta = solveSliderJoint(world, world->sliderJoints + indices[i],
+                                     h, invH, useBias);
+        residual = MAX(residual, delta);
+      }
       break;
     case joint_type_axis:
-      warmStartAxisJoint(&j->axis);
+      for (u32 i = begin; i < end; i++) {
+        f32 delta = solveAxisJoint(world, world->axisJoints + indices[i], h,
+                                   invH, useBias);
+        residual = MAX(residual, delta);
+      }
       break;
       InvalidDefaultCase;
   };
+  return residual;
+}
+
+// Single joint versions for the serially solved overflow joints
+static void jointWarmStart(physics_world* world, joint_ref ref) {
+  jointsWarmStart(world, ref.type, &ref.index, 0, 1);
+}
+
+static f32 jointSolve(physics_world* world, joint_ref ref, f32 h, f32 invH,
+                      b32 useBias) {
+  return jointsSolve(world, ref.type, &ref.index, 0, 1, h, invH, useBias);
+}
+
+// Position error left after the step, in meters or radians for the
+// angular constraints
+static f32 jointPositionError(physics_world* world, joint_ref ref) {
+  switch (ref.type) {
+    case joint_type_hinge:
+      return hingeJointPositionError(world, world->hingeJoints + ref.index);
+    case joint_type_distance:
+      return distanceJointPositionError(world,
+                                        world->distanceJoints + ref.index);
+    case joint_type_slider:
+      return sliderJointPositionError(world, world->sliderJoints + ref.index);
+    case joint_type_axis:
+      // Soft spring, stretching is what it's for
+      return 0.f;
+      InvalidDefaultCase;
+  };
+  return 0.f;
 }
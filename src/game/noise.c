@@ -28,3 +28,530 @@ static f32 lerpPerlinNoise1D(f32 n) {
   //printf("n %f idx %d fract %f from %f to %f result %f\n",n, idx, fract, from, to, result);
   return result;
 }
+
+// Gradient (Perlin) and simplex noise in 2D and 3D.
+//
+// Every noise has a scalar version and a wide one that evaluates
+// SIMD_WIDTH samples per call. The lattice math runs wide and only the
+// permutation lookups of the corner hashes are done per lane, with the
+// same float operations as the scalar version so both give the same bits. The seed
+// picks a different permutation of the lattice. The results are about in
+// -1..1.
+
+#define NOISE_F2 0.36602540378f
+#define NOISE_G2 0.21132486540f
+#define NOISE_F3 (1.f / 3.f)
+#define NOISE_G3 (1.f / 6.f)
+
+inline i32 noisePerm(i32 i) {
+  return perlinNoisePermutation[i & 255];
+}
+
+inline i32 noiseHash2(i32 seed, i32 x, i32 y) {
+  return noisePerm(noisePerm(seed + x) + y);
+}
+
+inline i32 noiseHash3(i32 seed, i32 x, i32 y, i32 z) {
+  return noisePerm(noisePerm(noisePerm(seed + x) + y) + z);
+}
+
+inline f32 noiseFade(f32 t) {
+  return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+// The gradients aren't looked up, the hash bits pick the axes and the
+// signs of the dot product, (x, y, z) and a zero are indexed so the
+// scalar version doesn't branch on the hash. In 2D the low three bits pick
+// one of the four diagonals or one of the four axes.
+static const f32 noiseSigns[2] = {1.f, -1.f};
+
+inline f32 noiseDot2(i32 hash, f32 x, f32 y) {
+  i32 h = hash & 7;
+  f32 p[3] = {x, y, 0.f};
+  f32 u = p[h >= 6];
+  f32 v = p[h < 4 ? 1 : 2];
+  return noiseSigns[h & 1] * u + noiseSigns[h >> 1 & 1] * v;
+}
+
+// The 12 cube edge directions and four of them again from the low four
+// bits, like Perlin's improved noise
+static const u8 noiseAxisV3[16] = {1, 1, 1, 1, 2, 2, 2, 2,
+                                   2, 2, 2, 2, 0, 2, 0, 2};
+
+inline f32 noiseDot3(i32 hash, f32 x, f32 y, f32 z) {
+  i32 h = hash & 15;
+  f32 p[3] = {x, y, z};
+  f32 u = p[h >> 3];
+  f32 v = p[noiseAxisV3[h]];
+  return noiseSigns[h & 1] * u + noiseSigns[h >> 1 & 1] * v;
+}
+
+// Simplex corner falloff times the gradient dot, r2Max - r^2 to the 4th
+inline f32 noiseCorner(f32 t, f32 dot) {
+  t = MAX(t, 0.f);
+  t *= t;
+  return t * t * dot;
+}
+
+static f32 noiseGradient2(f32 x, f32 y, u32 seed) {
+  f32 fx = floorf(x);
+  f32 fy = floorf(y);
+  i32 ix = (i32)fx;
+  i32 iy = (i32)fy;
+  i32 s = noisePerm((i32)seed);
+  f32 x0 = x - fx;
+  f32 y0 = y - fy;
+  f32 x1 = x0 - 1.f;
+  f32 y1 = y0 - 1.f;
+  f32 n00 = noiseDot2(noiseHash2(s, ix, iy), x0, y0);
+  f32 n10 = noiseDot2(noiseHash2(s, ix + 1, iy), x1, y0);
+  f32 n01 = noiseDot2(noiseHash2(s, ix, iy + 1), x0, y1);
+  f32 n11 = noiseDot2(noiseHash2(s, ix + 1, iy + 1), x1, y1);
+  f32 u = noiseFade(x0);
+  f32 v = noiseFade(y0);
+  f32 a = n00 + (n10 - n00) * u;
+  f32 b = n01 + (n11 - n01) * u;
+  return a + (b - a) * v;
+}
+
+static f32 noiseGradient3(f32 x, f32 y, f32 z, u32 seed) {
+  f32 fx = floorf(x);
+  f32 fy = floorf(y);
+  f32 fz = floorf(z);
+  i32 ix = (i32)fx;
+  i32 iy = (i32)fy;
+  i32 iz = (i32)fz;
+  i32 s = noisePerm((i32)seed);
+  f32 x0 = x - fx;
+  f32 y0 = y - fy;
+  f32 z0 = z - fz;
+  f32 x1 = x0 - 1.f;
+  f32 y1 = y0 - 1.f;
+  f32 z1 = z0 - 1.f;
+  f32 n000 = noiseDot3(noiseHash3(s, ix, iy, iz), x0, y0, z0);
+  f32 n100 = noiseDot3(noiseHash3(s, ix + 1, iy, iz), x1, y0, z0);
+  f32 n010 = noiseDot3(noiseHash3(s, ix, iy + 1, iz), x0, y1, z0);
+  f32 n110 = noiseDot3(noiseHash3(s, ix + 1, iy + 1, iz), x1, y1, z0);
+  f32 n001 = noiseDot3(noiseHash3(s, ix, iy, iz + 1), x0, y0, z1);
+  f32 n101 = noiseDot3(noiseHash3(s, ix + 1, iy, iz + 1), x1, y0, z1);
+  f32 n011 = noiseDot3(noiseHash3(s, ix, iy + 1, iz + 1), x0, y1, z1);
+  f32 n111 = noiseDot3(noiseHash3(s, ix + 1, iy + 1, iz + 1), x1, y1, z1);
+  f32 u = noiseFade(x0);
+  f32 v = noiseFade(y0);
+  f32 w = noiseFade(z0);
+  f32 a0 = n000 + (n100 - n000) * u;
+  f32 b0 = n010 + (n110 - n010) * u;
+  f32 a1 = n001 + (n101 - n001) * u;
+  f32 b1 = n011 + (n111 - n011) * u;
+  f32 c0 = a0 + (b0 - a0) * v;
+  f32 c1 = a1 + (b1 - a1) * v;
+  return c0 + (c1 - c0) * w;
+}
+
+static f32 noiseSimplex2(f32 x, f32 y, u32 seed) {
+  f32 s = (x + y) * NOISE_F2;
+  f32 fi = floorf(x + s);
+  f32 fj = floorf(y + s);
+  f32 t = (fi + fj) * NOISE_G2;
+  f32 x0 = x - (fi - t);
+  f32 y0 = y - (fj - t);
+  // Lower or upper triangle of the skewed cell
+  f32 i1 = x0 > y0 ? 1.f : 0.f;
+  f32 j1 = 1.f - i1;
+  f32 x1 = x0 - i1 + NOISE_G2;
+  f32 y1 = y0 - j1 + NOISE_G2;
+  f32 x2 = x0 - 1.f + 2.f * NOISE_G2;
+  f32 y2 = y0 - 1.f + 2.f * NOISE_G2;
+
+  i32 ii = (i32)fi;
+  i32 jj = (i32)fj;
+  i32 sd = noisePerm((i32)seed);
+  f32 n0 = noiseCorner(0.5f - x0 * x0 - y0 * y0,
+                       noiseDot2(noiseHash2(sd, ii, jj), x0, y0));
+  f32 n1 = noiseCorner(0.5f - x1 * x1 - y1 * y1,
+                       noiseDot2(noiseHash2(sd, ii + (i32)i1, jj + (i32)j1),
+                                 x1, y1));
+  f32 n2 = noiseCorner(0.5f - x2 * x2 - y2 * y2,
+                       noiseDot2(noiseHash2(sd, ii + 1, jj + 1), x2, y2));
+  return 70.f * (n0 + n1 + n2);
+}
+
+static f32 noiseSimplex3(f32 x, f32 y, f32 z, u32 seed) {
+  f32 s = (x + y + z) * NOISE_F3;
+  f32 fi = floorf(x + s);
+  f32 fj = floorf(y + s);
+  f32 fk = floorf(z + s);
+  f32 t = (fi + fj + fk) * NOISE_G3;
+  f32 x0 = x - (fi - t);
+  f32 y0 = y - (fj - t);
+  f32 z0 = z - (fk - t);
+  // Second and third corner offsets from the order of x0, y0 and z0
+  f32 gx = x0 < y0 ? 0.f : 1.f;
+  f32 gy = y0 < z0 ? 0.f : 1.f;
+  f32 gz = z0 < x0 ? 0.f : 1.f;
+  f32 i1 = MIN(gx, 1.f - gz);
+  f32 j1 = MIN(gy, 1.f - gx);
+  f32 k1 = MIN(gz, 1.f - gy);
+  f32 i2 = MAX(gx, 1.f - gz);
+  f32 j2 = MAX(gy, 1.f - gx);
+  f32 k2 = MAX(gz, 1.f - gy);
+  f32 x1 = x0 - i1 + NOISE_G3;
+  f32 y1 = y0 - j1 + NOISE_G3;
+  f32 z1 = z0 - k1 + NOISE_G3;
+  f32 x2 = x0 - i2 + 2.f * NOISE_G3;
+  f32 y2 = y0 - j2 + 2.f * NOISE_G3;
+  f32 z2 = z0 - k2 + 2.f * NOISE_G3;
+  f32 x3 = x0 - 0.5f;
+  f32 y3 = y0 - 0.5f;
+  f32 z3 = z0 - 0.5f;
+
+  i32 ii = (i32)fi;
+  i32 jj = (i32)fj;
+  i32 kk = (i32)fk;
+  i32 sd = noisePerm((i32)seed);
+  f32 n0 = noiseCorner(0.6f - x0 * x0 - y0 * y0 - z0 * z0,
+                       noiseDot3(noiseHash3(sd, ii, jj, kk), x0, y0, z0));
+  f32 n1 = noiseCorner(
+    0.6f - x1 * x1 - y1 * y1 - z1 * z1,
+    noiseDot3(noiseHash3(sd, ii + (i32)i1, jj + (i32)j1, kk + (i32)k1),
+              x1, y1, z1));
+  f32 n2 = noiseCorner(
+    0.6f - x2 * x2 - y2 * y2 - z2 * z2,
+    noiseDot3(noiseHash3(sd, ii + (i32)i2, jj + (i32)j2, kk + (i32)k2),
+              x2, y2, z2));
+  f32 n3 = noiseCorner(0.6f - x3 * x3 - y3 * y3 - z3 * z3,
+                       noiseDot3(noiseHash3(sd, ii + 1, jj + 1, kk + 1),
+                                 x3, y3, z3));
+  return 32.f * (n0 + n1 + n2 + n3);
+}
+
+// Same as floorf for values in the i32 range
+inline f32w noiseFloorWide(f32w a) {
+  f32w t = f32w_trunc(a);
+  return f32w_select(f32w_greater(t, a), f32w_sub(t, f32w_splat(1.f)), t);
+}
+
+inline f32w noiseFadeWide(f32w t) {
+  f32w a = f32w_sub(f32w_mul(t, f32w_splat(6.f)), f32w_splat(15.f));
+  a = f32w_add(f32w_mul(t, a), f32w_splat(10.f));
+  return f32w_mul(f32w_mul(f32w_mul(t, t), t), a);
+}
+
+inline f32w noiseLerpWide(f32w a, f32w b, f32w t) {
+  return f32w_add(a, f32w_mul(f32w_sub(b, a), t));
+}
+
+// Lattice hash of every lane, only the hashes are gathered per lane and
+// the gradient selects run wide on their bits
+typedef struct noise_hash_wide {
+  u32 lane[SIMD_WIDTH];
+} noise_hash_wide;
+
+// The sign flips of noiseDot2 and noiseDot3, the same bits as the
+// multiply by -1
+inline f32w noiseFlipWide(noise_hash_wide *h, u32 bit, f32w a) {
+  f32w flip = f32w_greater(f32w_fromBits(h->lane, bit, 1), f32w_splat(0.5f));
+  return f32w_select(flip, f32w_neg(a), a);
+}
+
+// Same as noiseDot2
+inline f32w noiseDot2Wide(noise_hash_wide *h, f32w x, f32w y) {
+  f32w bits = f32w_fromBits(h->lane, 0, 7);
+  f32w u = f32w_select(f32w_less(bits, f32w_splat(5.5f)), x, y);
+  f32w v = f32w_select(f32w_less(bits, f32w_splat(3.5f)), y, f32w_zero());
+  return f32w_add(noiseFlipWide(h, 0, u), noiseFlipWide(h, 1, v));
+}
+
+// Same as noiseDot3, the top two bits choose the axes
+inline f32w noiseDot3Wide(noise_hash_wide *h, f32w x, f32w y, f32w z) {
+  f32w top = f32w_fromBits(h->lane, 2, 3);
+  f32w even = f32w_less(f32w_fromBits(h->lane, 0, 1), f32w_splat(0.5f));
+  f32w u = f32w_select(f32w_less(top, f32w_splat(1.5f)), x, y);
+  f32w v = f32w_select(f32w_and(f32w_greater(top, f32w_splat(2.5f)), even),
+                       x, z);
+  v = f32w_select(f32w_less(top, f32w_splat(0.5f)), y, v);
+  return f32w_add(noiseFlipWide(h, 0, u), noiseFlipWide(h, 1, v));
+}
+
+inline f32w noiseCornerWide(f32w t, f32w dot) {
+  t = f32w_max(t, f32w_zero());
+  t = f32w_mul(t, t);
+  return f32w_mul(f32w_mul(t, t), dot);
+}
+
+// r2Max - x^2 - y^2 - z^2
+inline f32w noiseFalloffWide(f32 r2Max, f32w x, f32w y, f32w z) {
+  f32w t = f32w_sub(f32w_sub(f32w_splat(r2Max), f32w_mul(x, x)),
+                    f32w_mul(y, y));
+  return f32w_sub(t, f32w_mul(z, z));
+}
+
+static f32w noiseGradient2Wide(f32w x, f32w y, u32 seed) {
+  f32w one = f32w_splat(1.f);
+  f32w fx = noiseFloorWide(x);
+  f32w fy = noiseFloorWide(y);
+  i32 s = noisePerm((i32)seed);
+  noise_hash_wide g00, g10, g01, g11;
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    i32 ix = (i32)getLane(&fx, lane);
+    i32 iy = (i32)getLane(&fy, lane);
+    g00.lane[lane] = (u32)noiseHash2(s, ix, iy);
+    g10.lane[lane] = (u32)noiseHash2(s, ix + 1, iy);
+    g01.lane[lane] = (u32)noiseHash2(s, ix, iy + 1);
+    g11.lane[lane] = (u32)noiseHash2(s, ix + 1, iy + 1);
+  }
+  f32w x0 = f32w_sub(x, fx);
+  f32w y0 = f32w_sub(y, fy);
+  f32w x1 = f32w_sub(x0, one);
+  f32w y1 = f32w_sub(y0, one);
+  f32w n00 = noiseDot2Wide(&g00, x0, y0);
+  f32w n10 = noiseDot2Wide(&g10, x1, y0);
+  f32w n01 = noiseDot2Wide(&g01, x0, y1);
+  f32w n11 = noiseDot2Wide(&g11, x1, y1);
+  f32w u = noiseFadeWide(x0);
+  f32w v = noiseFadeWide(y0);
+  return noiseLerpWide(noiseLerpWide(n00, n10, u), noiseLerpWide(n01, n11, u),
+                       v);
+}
+
+static f32w noiseGradient3Wide(f32w x, f32w y, f32w z, u32 seed) {
+  f32w one = f32w_splat(1.f);
+  f32w fx = noiseFloorWide(x);
+  f32w fy = noiseFloorWide(y);
+  f32w fz = noiseFloorWide(z);
+  i32 s = noisePerm((i32)seed);
+  noise_hash_wide g[8];
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    i32 ix = (i32)getLane(&fx, lane);
+    i32 iy = (i32)getLane(&fy, lane);
+    i32 iz = (i32)getLane(&fz, lane);
+    // Corner c is at (c & 1, c >> 1 & 1, c >> 2), the corners share the
+    // first two steps of noiseHash3
+    for (i32 c = 0; c < 4; c++) {
+      i32 h = noisePerm(noisePerm(s + ix + (c & 1)) + iy + (c >> 1));
+      g[c].lane[lane] = (u32)noisePerm(h + iz);
+      g[c + 4].lane[lane] = (u32)noisePerm(h + iz + 1);
+    }
+  }
+  f32w x0 = f32w_sub(x, fx);
+  f32w y0 = f32w_sub(y, fy);
+  f32w z0 = f32w_sub(z, fz);
+  f32w x1 = f32w_sub(x0, one);
+  f32w y1 = f32w_sub(y0, one);
+  f32w z1 = f32w_sub(z0, one);
+  f32w u = noiseFadeWide(x0);
+  f32w v = noiseFadeWide(y0);
+  f32w w = noiseFadeWide(z0);
+  f32w a0 = noiseLerpWide(noiseDot3Wide(g + 0, x0, y0, z0),
+                          noiseDot3Wide(g + 1, x1, y0, z0), u);
+  f32w b0 = noiseLerpWide(noiseDot3Wide(g + 2, x0, y1, z0),
+                          noiseDot3Wide(g + 3, x1, y1, z0), u);
+  f32w a1 = noiseLerpWide(noiseDot3Wide(g + 4, x0, y0, z1),
+                          noiseDot3Wide(g + 5, x1, y0, z1), u);
+  f32w b1 = noiseLerpWide(noiseDot3Wide(g + 6, x0, y1, z1),
+                          noiseDot3Wide(g + 7, x1, y1, z1), u);
+  return noiseLerpWide(noiseLerpWide(a0, b0, v), noiseLerpWide(a1, b1, v), w);
+}
+
+static f32w noiseSimplex2Wide(f32w x, f32w y, u32 seed) {
+  f32w zero = f32w_zero();
+  f32w one = f32w_splat(1.f);
+  f32w g2 = f32w_splat(NOISE_G2);
+  f32w s = f32w_mul(f32w_add(x, y), f32w_splat(NOISE_F2));
+  f32w fi = noiseFloorWide(f32w_add(x, s));
+  f32w fj = noiseFloorWide(f32w_add(y, s));
+  f32w t = f32w_mul(f32w_add(fi, fj), g2);
+  f32w x0 = f32w_sub(x, f32w_sub(fi, t));
+  f32w y0 = f32w_sub(y, f32w_sub(fj, t));
+  f32w i1 = f32w_select(f32w_greater(x0, y0), one, zero);
+  f32w j1 = f32w_sub(one, i1);
+  f32w x1 = f32w_add(f32w_sub(x0, i1), g2);
+  f32w y1 = f32w_add(f32w_sub(y0, j1), g2);
+  f32w x2 = f32w_add(f32w_sub(x0, one), f32w_splat(2.f * NOISE_G2));
+  f32w y2 = f32w_add(f32w_sub(y0, one), f32w_splat(2.f * NOISE_G2));
+
+  i32 sd = noisePerm((i32)seed);
+  noise_hash_wide c0, c1, c2;
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    i32 ii = (i32)getLane(&fi, lane);
+    i32 jj = (i32)getLane(&fj, lane);
+    c0.lane[lane] = (u32)noiseHash2(sd, ii, jj);
+    c1.lane[lane] = (u32)noiseHash2(sd, ii + (i32)getLane(&i1, lane),
+                                    jj + (i32)getLane(&j1, lane));
+    c2.lane[lane] = (u32)noiseHash2(sd, ii + 1, jj + 1);
+  }
+  f32w n0 = noiseCornerWide(noiseFalloffWide(0.5f, x0, y0, zero),
+                            noiseDot2Wide(&c0, x0, y0));
+  f32w n1 = noiseCornerWide(noiseFalloffWide(0.5f, x1, y1, zero),
+                            noiseDot2Wide(&c1, x1, y1));
+  f32w n2 = noiseCornerWide(noiseFalloffWide(0.5f, x2, y2, zero),
+                            noiseDot2Wide(&c2, x2, y2));
+  return f32w_mul(f32w_splat(70.f), f32w_add(f32w_add(n0, n1), n2));
+}
+
+static f32w noiseSimplex3Wide(f32w x, f32w y, f32w z, u32 seed) {
+  f32w zero = f32w_zero();
+  f32w one = f32w_splat(1.f);
+  f32w g3 = f32w_splat(NOISE_G3);
+  f32w g3x2 = f32w_splat(2.f * NOISE_G3);
+  f32w half = f32w_splat(0.5f);
+  f32w s = f32w_mul(f32w_add(f32w_add(x, y), z), f32w_splat(NOISE_F3));
+  f32w fi = noiseFloorWide(f32w_add(x, s));
+  f32w fj = noiseFloorWide(f32w_add(y, s));
+  f32w fk = noiseFloorWide(f32w_add(z, s));
+  f32w t = f32w_mul(f32w_add(f32w_add(fi, fj), fk), g3);
+  f32w x0 = f32w_sub(x, f32w_sub(fi, t));
+  f32w y0 = f32w_sub(y, f32w_sub(fj, t));
+  f32w z0 = f32w_sub(z, f32w_sub(fk, t));
+  f32w gx = f32w_select(f32w_less(x0, y0), zero, one);
+  f32w gy = f32w_select(f32w_less(y0, z0), zero, one);
+  f32w gz = f32w_select(f32w_less(z0, x0), zero, one);
+  f32w lx = f32w_sub(one, gx);
+  f32w ly = f32w_sub(one, gy);
+  f32w lz = f32w_sub(one, gz);
+  f32w i1 = f32w_min(gx, lz);
+  f32w j1 = f32w_min(gy, lx);
+  f32w k1 = f32w_min(gz, ly);
+  f32w i2 = f32w_max(gx, lz);
+  f32w j2 = f32w_max(gy, lx);
+  f32w k2 = f32w_max(gz, ly);
+  f32w x1 = f32w_add(f32w_sub(x0, i1), g3);
+  f32w y1 = f32w_add(f32w_sub(y0, j1), g3);
+  f32w z1 = f32w_add(f32w_sub(z0, k1), g3);
+  f32w x2 = f32w_add(f32w_sub(x0, i2), g3x2);
+  f32w y2 = f32w_add(f32w_sub(y0, j2), g3x2);
+  f32w z2 = f32w_add(f32w_sub(z0, k2), g3x2);
+  f32w x3 = f32w_sub(x0, half);
+  f32w y3 = f32w_sub(y0, half);
+  f32w z3 = f32w_sub(z0, half);
+
+  i32 sd = noisePerm((i32)seed);
+  noise_hash_wide c0, c1, c2, c3;
+  for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+    i32 ii = (i32)getLane(&fi, lane);
+    i32 jj = (i32)getLane(&fj, lane);
+    i32 kk = (i32)getLane(&fk, lane);
+    c0.lane[lane] = (u32)noiseHash3(sd, ii, jj, kk);
+    c1.lane[lane] = (u32)noiseHash3(sd, ii + (i32)getLane(&i1, lane),
+                                    jj + (i32)getLane(&j1, lane),
+                                    kk + (i32)getLane(&k1, lane));
+    c2.lane[lane] = (u32)noiseHash3(sd, ii + (i32)getLane(&i2, lane),
+                                    jj + (i32)getLane(&j2, lane),
+                                    kk + (i32)getLane(&k2, lane));
+    c3.lane[lane] = (u32)noiseHash3(sd, ii + 1, jj + 1, kk + 1);
+  }
+  f32w n0 = noiseCornerWide(noiseFalloffWide(0.6f, x0, y0, z0),
+                            noiseDot3Wide(&c0, x0, y0, z0));
+  f32w n1 = noiseCornerWide(noiseFalloffWide(0.6f, x1, y1, z1),
+                            noiseDot3Wide(&c1, x1, y1, z1));
+  f32w n2 = noiseCornerWide(noiseFalloffWide(0.6f, x2, y2, z2),
+                            noiseDot3Wide(&c2, x2, y2, z2));
+  f32w n3 = noiseCornerWide(noiseFalloffWide(0.6f, x3, y3, z3),
+                            noiseDot3Wide(&c3, x3, y3, z3));
+  return f32w_mul(f32w_splat(32.f),
+                  f32w_add(f32w_add(f32w_add(n0, n1), n2), n3));
+}
+
+// Fractal noise, SIMD_WIDTH samples per call.
+//
+// The octaves are summed with the amplitude falling by gain and the
+// frequency growing by lacunarity, each octave with its own seed, and
+// the sum is divided by the amplitude sum. Domain warp samples two fBm
+// fields of at most three octaves first and moves the input by them.
+
+#define NOISE_WARP_OCTAVES 3
+
+static f32w noiseFractal2Wide(const noise_fractal *fractal, f32w x, f32w y) {
+  f32w one = f32w_splat(1.f);
+  f32w sum = f32w_zero();
+  f32 frequency = fractal->frequency;
+  f32 amplitude = 1.f;
+  f32 amplitudeSum = 0.f;
+  for (u32 octave = 0; octave < fractal->octaves; octave++) {
+    f32w fx = f32w_mul(x, f32w_splat(frequency));
+    f32w fy = f32w_mul(y, f32w_splat(frequency));
+    u32 seed = fractal->seed + octave;
+    f32w n = fractal->basis == noise_basis_simplex
+      ? noiseSimplex2Wide(fx, fy, seed)
+      : noiseGradient2Wide(fx, fy, seed);
+    if (fractal->type == noise_fractal_ridged) {
+      n = f32w_sub(one, f32w_abs(n));
+      n = f32w_mul(n, n);
+    }
+    sum = f32w_add(sum, f32w_mul(n, f32w_splat(amplitude)));
+    amplitudeSum += amplitude;
+    amplitude *= fractal->gain;
+    frequency *= fractal->lacunarity;
+  }
+  return amplitudeSum > 0.f ? f32w_div(sum, f32w_splat(amplitudeSum)) : sum;
+}
+
+static f32w noiseFractal3Wide(const noise_fractal *fractal, f32w x, f32w y,
+                              f32w z) {
+  f32w one = f32w_splat(1.f);
+  f32w sum = f32w_zero();
+  f32 frequency = fractal->frequency;
+  f32 amplitude = 1.f;
+  f32 amplitudeSum = 0.f;
+  for (u32 octave = 0; octave < fractal->octaves; octave++) {
+    f32w f = f32w_splat(frequency);
+    f32w fx = f32w_mul(x, f);
+    f32w fy = f32w_mul(y, f);
+    f32w fz = f32w_mul(z, f);
+    u32 seed = fractal->seed + octave;
+    f32w n = fractal->basis == noise_basis_simplex
+      ? noiseSimplex3Wide(fx, fy, fz, seed)
+      : noiseGradient3Wide(fx, fy, fz, seed);
+    if (fractal->type == noise_fractal_ridged) {
+      n = f32w_sub(one, f32w_abs(n));
+      n = f32w_mul(n, n);
+    }
+    sum = f32w_add(sum, f32w_mul(n, f32w_splat(amplitude)));
+    amplitudeSum += amplitude;
+    amplitude *= fractal->gain;
+    frequency *= fractal->lacunarity;
+  }
+  return amplitudeSum > 0.f ? f32w_div(sum, f32w_splat(amplitudeSum)) : sum;
+}
+
+// The fBm of the warp offsets, a seed apart from the fractal for each axis
+inline noise_fractal noiseWarpFractal(const noise_fractal *fractal,
+                                      u32 axis) {
+  noise_fractal result = *fractal;
+  result.type = noise_fractal_fbm;
+  result.octaves = MIN(fractal->octaves, (u32)NOISE_WARP_OCTAVES);
+  result.warp = 0.f;
+  result.seed = fractal->seed + 101 * (axis + 1);
+  return result;
+}
+
+// noiseFractal2Wide with the domain warp of the fractal
+static f32w noiseSample2Wide(const noise_fractal *fractal, f32w x, f32w y) {
+  if (fractal->warp != 0.f) {
+    f32w warp = f32w_splat(fractal->warp);
+    noise_fractal warpX = noiseWarpFractal(fractal, 0);
+    noise_fractal warpY = noiseWarpFractal(fractal, 1);
+    f32w dx = noiseFractal2Wide(&warpX, x, y);
+    f32w dy = noiseFractal2Wide(&warpY, x, y);
+    x = f32w_add(x, f32w_mul(dx, warp));
+    y = f32w_add(y, f32w_mul(dy, warp));
+  }
+  return noiseFractal2Wide(fractal, x, y);
+}
+
+static f32w noiseSample3Wide(const noise_fractal *fractal, f32w x, f32w y,
+                             f32w z) {
+  if (fractal->warp != 0.f) {
+    f32w warp = f32w_splat(fractal->warp);
+    noise_fractal warpX = noiseWarpFractal(fractal, 0);
+    noise_fractal warpY = noiseWarpFractal(fractal, 1);
+    noise_fractal warpZ = noiseWarpFractal(fractal, 2);
+    f32w dx = noiseFractal3Wide(&warpX, x, y, z);
+    f32w dy = noiseFractal3Wide(&warpY, x, y, z);
+    f32w dz = noiseFractal3Wide(&warpZ, x, y, z);
+    x = f32w_add(x, f32w_mul(dx, warp));
+    y = f32w_add(y, f32w_mul(dy, warp));
+    z = f32w_add(z, f32w_mul(dz, warp));
+  }
+  return noiseFractal3Wide(fractal, x, y, z);
+}
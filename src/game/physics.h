@@ -9,37 +9,119 @@ static f32 Kda = 0.05f;        // angular damping factor
 static v3 Gravity = {0.0f, 0.0f, -15.0f};
 
 static u16 subStepAmount = 4;
+// With adaptiveSubsteps every island picks its substep count after each
+// step from its fastest body, largest joint error and deepest contact,
+// between minSubStepAmount and maxSubStepAmount. Woken islands and
+// adaptiveSubsteps = false use subStepAmount.
+static b32 adaptiveSubsteps = true;
+static u16 minSubStepAmount = 1;
+static u16 maxSubStepAmount = 8;
+// One more substep per this much travel of a body during the step, joint
+// error (m, rad for hinges) and contact penetration (m)
+static f32 substepTravel = 0.1f;
+static f32 substepJointError = 0.02f;
+static f32 substepPenetration = 0.02f;
+// Physics steps at a fixed rate independent of the frame rate, the render
+// state is interpolated between the last two steps.
+static f32 physicsStepDelta = 1.f / 120.f;
+// Frames longer than this many steps drop the rest of the time
+#define PHYSICS_MAX_STEPS_PER_FRAME 8
+// Solve contacts SIMD_WIDTH at a time, scalar solver is used otherwise.
+static b32 useWideContactSolver = true;
+// Islands that stay slower than the thresholds for timeToSleep seconds
+// are not simulated until something wakes them.
+static b32 enableSleeping = true;
+static f32 sleepLinearVelocity = 0.05f;
+static f32 sleepAngularVelocity = 0.05f;
+static f32 timeToSleep = 0.5f;
+// Wheels are swept against the terrain over the step and chassis points
+// closing in on it get speculative contacts, so fast cars don't tunnel
+// with fewer substeps or a longer step.
+static b32 enableCCD = true;
+#define CCD_MAX_SAMPLES 16
+#define CCD_BISECT_NUM 4
+// Each substep runs the biased solve followed by relaxIterations relax
+// passes. With relaxEarlyExit the rest of the relax passes of a substep
+// are skipped once the previous relax pass changed no impulse more than
+// relaxTolerance (N s). The first relax pass always runs.
+static u32 relaxIterations = 1;
+static b32 relaxEarlyExit = false;
+static f32 relaxTolerance = 0.05f;
+#define MAX_RELAX_ITERATIONS 8
+
+// Time spent in each phase of the physics step. The phases nest, the
+// depth of each is in physicsTimerDepth.
+static b32 enablePhysicsTimers = true;
+
+enum physics_timer {
+  physics_timer_step,
+  physics_timer_contacts,
+  physics_timer_contact_prepare,
+  physics_timer_solve,
+  physics_timer_joint_prepare,
+  physics_timer_integrate,
+  physics_timer_warm_start,
+  physics_timer_biased_solve,
+  physics_timer_relax,
+  physics_timer_finalize,
+  physics_timer_islands,
+  _physics_timer_num,
+};
 
-typedef struct rigid_body {
-  u32 id;
-  f32 mass;
-  f32 invMass;
-  f32 friction;
-
-  v3 velocity;
-  v3 velocity0;
-  v3 angularVelocity;
-
-  // Position (center of mass)
-  v3 position;
-  v3 forwardAxis;
-  v3 sideAxis;
-  // Body origin (not center of mass)
-  v3 origin;
-
-  // Location of center of mass relative to the body origin
-  v3 localCenter;
+static const char* physicsTimerNames[_physics_timer_num] = {
+  "Step", "Contacts", "Contact prepare", "Solve", "Joint prepare",
+  "Integrate", "Warm start", "Biased solve", "Relax", "Finalize", "Islands",
+};
 
-  m3x3 invBodyInertiaTensor;
-  quat orientationQuat;
-  i32 shapeNum;
+static const u32 physicsTimerDepth[_physics_timer_num] = {
+  0, 1, 2, 1, 2, 2, 2, 2, 2, 2, 1,
+};
 
-  // auxiliary quantities
-  m3x3 orientation;
-  m3x3 invWorlInertiaTensor;
-  v3 deltaPosition;
-  v3 acceleration;
-} rigid_body;
+// Summed over the steps until the owner resets them
+typedef struct physics_counters {
+  u64 ticks[_physics_timer_num];
+  u64 stepNum;
+  u64 contactNum;
+  // Contacts that found their point of the previous step
+  u64 warmStartHitNum;
+  u64 jointNum;
+  // Substeps of every solver pass
+  u64 substepNum;
+  // Relax passes run and skipped by relaxEarlyExit
+  u64 relaxPassNum;
+  u64 relaxSkipNum;
+  // Awake islands and the substeps they picked, the max is not summed
+  u64 islandNum;
+  u64 islandSubstepSum;
+  u32 islandSubstepMax;
+} physics_counters;
+
+// Convergence of the last step. Iteration 0 is the biased solve and the
+// rest are the relax passes. A residual is the largest impulse change of
+// any constraint in the pass over all substeps, angular joints count
+// their angular impulse.
+typedef struct solver_convergence {
+  f32 jointResidual[MAX_RELAX_ITERATIONS + 1];
+  f32 contactResidual[MAX_RELAX_ITERATIONS + 1];
+  u32 iterationNum;
+  // Largest errors left after the step, m or rad for hinges
+  f32 jointPositionError;
+  f32 contactPenetration;
+} solver_convergence;
+
+// Body transforms of the last two steps that the render state is
+// interpolated from. Points either to the world streams or to a copy of
+// them taken after a step.
+typedef struct body_transforms {
+  u32 bodyNum;
+  // Bodies added after the last step have no previous state
+  u32 previousBodyNum;
+  v3* previousPosition;
+  quat* previousOrientationQuat;
+  v3* position;
+  quat* orientationQuat;
+  v3* localCenter;
+} body_transforms;
 
 typedef struct contact_point {
   v3 localPointA;
@@ -55,13 +137,13 @@ typedef struct contact_point {
 
 typedef struct contact_manifold {
   contact_point point;
-  rigid_body *bodyA;
-  rigid_body *bodyB;
+  u32 bodyA;
+  u32 bodyB;
 } contact_manifold;
 
 typedef struct joint_base {
-  rigid_body *bodyA;
-  rigid_body *bodyB;
+  u32 bodyA;
+  u32 bodyB;
 
   u32 id;
   v3 localOriginAnchorA;
@@ -145,17 +227,193 @@ enum joint_type {
   joint_type_distance,
   joint_type_slider,
   joint_type_axis,
+  _joint_type_num,
 };
 
-typedef struct joint {
+// Index to the joint array of the type
+typedef struct joint_ref {
   joint_type type;
-  union {
-    hinge_joint hinge;
-    distance_joint distance;
-    slider_joint slider;
-    axis_joint axis;
-  };
-} joint;
+  u32 index;
+} joint_ref;
+
+// Rigid bodies are stored in the physics world as structure of arrays.
+// Each body is an index into the streams below, index 0 is reserved for
+// the static ground body.
+#define GROUND_BODY 0
+
+typedef struct body_pair {
+  u32 bodyA;
+  u32 bodyB;
+} body_pair;
+
+typedef struct aabb_tree_node {
+  aabb box;
+  // Next free node when the node is not in use
+  i32 parent;
+  i32 child1;
+  i32 child2;
+  // Leaf is 0, free node is -1
+  i32 height;
+  u32 body;
+} aabb_tree_node;
+
+// Dynamic AABB tree broadphase, see broadphase.cpp
+typedef struct broadphase_state {
+  // Enlarged body bounds, same as the box of the body leaf
+  aabb* bounds;
+  i32* proxy;
+  // Bodies of the same group never form a pair, e.g. a chassis and its wheels
+  u32* collisionGroup;
+
+  aabb_tree_node* nodes;
+  u32 nodeCapacity;
+  u32 nodeNum;
+  i32 freeNode;
+  i32 root;
+
+  // Candidate pairs, kept between steps
+  body_pair* pairs;
+  u32 pairNum;
+  u32 pairCapacity;
+  u32 droppedPairNum;
+} broadphase_state;
+
+typedef struct physics_world {
+  u32 bodyNum;
+  u32 bodyCapacity;
+
+  // Body streams
+  f32* mass;
+  f32* invMass;
+  f32* friction;
+
+  v3* velocity;
+  v3* velocity0;
+  v3* angularVelocity;
+
+  // Position (center of mass)
+  v3* position;
+  v3* forwardAxis;
+  v3* sideAxis;
+  // Body origin (not center of mass)
+  v3* origin;
+
+  // Location of center of mass relative to the body origin
+  v3* localCenter;
+
+  m3x3* invBodyInertiaTensor;
+  quat* orientationQuat;
+
+  // auxiliary quantities
+  m3x3* orientation;
+  m3x3* invWorlInertiaTensor;
+  v3* deltaPosition;
+  v3* acceleration;
+
+  // External force and torque accumulators, cleared after each step.
+  v3* force;
+  v3* torque;
+
+  // Sleeping bodies of one island form a ring through islandNext, waking
+  // any of them wakes the whole island.
+  u8* awake;
+  f32* sleepTime;
+  u32* islandNext;
+  u32 awakeBodyNum;
+  // Disabled bodies are parked out of the simulation, nothing wakes them
+  // and the joints attached to them are not solved. The raycast car model
+  // parks its wheels this way.
+  u8* disabled;
+  // Substep count of the island of the body and the decision of the last
+  // step for the profiler
+  u8* substeps;
+  u32 islandNum;
+  u32 islandSubstepSum;
+  u32 islandSubstepMax;
+
+  // State of the previous step and the interpolated state for rendering.
+  // The render state is written by the thread that renders, which is not
+  // the one stepping the world when physics runs on its own thread.
+  v3* previousPosition;
+  quat* previousOrientationQuat;
+  u32 previousBodyNum;
+  v3* renderPosition;
+  v3* renderOrigin;
+  m3x3* renderOrientation;
+
+  // Collision shapes, each body owns a contiguous range.
+  u32* firstShape;
+  i32* shapeNum;
+  shape* shapes;
+  u32 totalShapeNum;
+  u32 shapeCapacity;
+
+  // Each joint type has its own array so the solver loops over one type
+  // at a time without branching. jointOrder has every joint in the order
+  // they were added, a body sees its joints solved in that order.
+  hinge_joint* hingeJoints;
+  distance_joint* distanceJoints;
+  slider_joint* sliderJoints;
+  axis_joint* axisJoints;
+  u32 typeJointNum[_joint_type_num];
+  u32 typeJointCapacity[_joint_type_num];
+  joint_ref* jointOrder;
+  u32 jointNum;
+  u32 jointCapacity;
+
+  // Contact points are kept between steps for warm starting.
+  contact_point* contactPoints;
+  u32 contactNum;
+  u32 contactCapacity;
+
+  broadphase_state broadphase;
+
+  physics_counters counters;
+  solver_convergence convergence;
+
+  // Colors of the constraint graph are split between the worker threads
+  rt_work_queue* workQueue;
+  u32 workerNum;
+} physics_world;
+
+// Every joint type starts with joint_base
+inline joint_base* physicsWorldJointBase(physics_world* world, joint_ref ref) {
+  switch (ref.type) {
+    case joint_type_hinge:
+      return &world->hingeJoints[ref.index].base;
+    case joint_type_distance:
+      return &world->distanceJoints[ref.index].base;
+    case joint_type_slider:
+      return &world->sliderJoints[ref.index].base;
+    case joint_type_axis:
+      return &world->axisJoints[ref.index].base;
+    default:
+      return NULL;
+  }
+}
+
+// Joints of a sleeping island are not solved. Both bodies of a joint are
+// always in the same island, the ground is never awake.
+inline b32 jointEnabled(physics_world* world, joint_base* base) {
+  return !world->disabled[base->bodyA] && !world->disabled[base->bodyB];
+}
+
+inline b32 jointAwake(physics_world* world, joint_base* base) {
+  return (world->awake[base->bodyA] || world->awake[base->bodyB]) &&
+         jointEnabled(world, base);
+}
+
+// The solver steps the islands with the same substep count together, one
+// pass for each count in use.
+inline b32 bodyInPass(physics_world* world, u32 body, u32 substeps) {
+  return world->awake[body] && world->substeps[body] == substeps;
+}
+
+inline b32 jointInPass(physics_world* world, joint_base* base, u32 substeps) {
+  return (bodyInPass(world, base->bodyA, substeps) ||
+          bodyInPass(world, base->bodyB, substeps)) &&
+         jointEnabled(world, base);
+}
 
 inline void addForceToPoint(v3 f, v3 p, v3 cm, v3* forcesIn, v3* torquesIn) {
   v3 force = *forcesIn;
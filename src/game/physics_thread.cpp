@@ -0,0 +1,159 @@
+#include "all.h"
+// Exchanges between the physics and the main thread.
+//
+// When the platform runs gamePhysicsUpdate on a thread of its own, the
+// physics steps at its fixed rate there and the main thread only reads
+// what the physics publishes: a render state with the body transforms of
+// the last two steps and the car stats for the renderer and the UI, and
+// the car stats once more for the audio callback. The input goes the other
+// way, together with the main thread copy of the car properties, so the
+// UI never touches the properties or the curve tables the physics uses.
+// Each exchange is a triple buffer, so a slow physics update never
+// holds up a frame and a slow frame never holds up the physics. Without a
+// physics thread carUpdate runs both ends on the main thread.
+//
+// Changes to the world from the main thread, like building the car on a
+// reload, are done while holding the platform physics lock.
+
+#define TRIPLE_BUFFER_NEW 0x80000000
+
+static void tripleBufferInit(triple_buffer* buffer) {
+  buffer->back = 0;
+  buffer->middle = 1;
+  buffer->front = 2;
+}
+
+// Publishes the back slot, returns the slot to fill next
+inline u32 tripleBufferPublish(triple_buffer* buffer) {
+  u32 middle = __atomic_exchange_n(&buffer->middle,
+                                   buffer->back | TRIPLE_BUFFER_NEW,
+                                   __ATOMIC_ACQ_REL);
+  buffer->back = middle & ~TRIPLE_BUFFER_NEW;
+  return buffer->back;
+}
+
+// Returns the slot of the latest published value, the same slot again if
+// nothing new has been published
+inline u32 tripleBufferAcquire(triple_buffer* buffer) {
+  if (__atomic_load_n(&buffer->middle, __ATOMIC_ACQUIRE) & TRIPLE_BUFFER_NEW) {
+    u32 middle = __atomic_exchange_n(&buffer->middle, buffer->front,
+                                     __ATOMIC_ACQ_REL);
+    buffer->front = middle & ~TRIPLE_BUFFER_NEW;
+  }
+  return buffer->front;
+}
+
+static void allocPhysicsExchange(car_game_state* game, memory_arena* arena) {
+  u32 bodyCapacity = game->world.bodyCapacity;
+  for (u32 i = 0; i < arrayLen(game->renderSlots); i++) {
+    body_transforms* bodies = &game->renderSlots[i].bodies;
+    bodies->previousPosition = pushArray(arena, bodyCapacity, v3);
+    bodies->previousOrientationQuat = pushArray(arena, bodyCapacity, quat);
+    bodies->position = pushArray(arena, bodyCapacity, v3);
+    bodies->orientationQuat = pushArray(arena, bodyCapacity, quat);
+    bodies->localCenter = pushArray(arena, bodyCapacity, v3);
+  }
+}
+
+static void initPhysicsExchange(car_game_state* game) {
+  tripleBufferInit(&game->inputBuffer);
+  tripleBufferInit(&game->renderBuffer);
+  tripleBufferInit(&game->audioBuffer);
+}
+
+// Main thread side of the input exchange
+static void physicsInputPublish(car_game_state* game) {
+  physics_input* slot = game->inputSlots + game->inputBuffer.back;
+  slot->input = game->input;
+  slot->carProperties = game->carProperties;
+  tripleBufferPublish(&game->inputBuffer);
+}
+
+// Sets the car properties of both threads, with the physics lock held or
+// without a physics thread. Every slot gets them so a slot published
+// before can't bring back the old ones.
+static void physicsInputSetProperties(car_game_state* game,
+                                      car_properties* properties) {
+  game->car.properties = *properties;
+  game->carProperties = *properties;
+  for (u32 i = 0; i < arrayLen(game->inputSlots); i++) {
+    game->inputSlots[i].carProperties = *properties;
+  }
+}
+
+// Takes the latest input to physicsInput and the car properties the main
+// thread edited. A press may come and go between two updates that take no
+// step, so a button stays pressed until physicsInputConsumed is called
+// after a step.
+static input_state* physicsInputUpdate(car_game_state* game) {
+  physics_input* slot =
+    game->inputSlots + tripleBufferAcquire(&game->inputBuffer);
+  game->car.properties = slot->carProperties;
+  input_state* latest = &slot->input;
+  input_state* input = &game->physicsInput;
+  for (u32 i = 0; i < arrayLen(input->buttons); i++) {
+    b32 down = latest->buttons[i] >= button_state_pressed;
+    input->buttons[i] = !down ? button_state_up
+      : input->buttons[i] == button_state_held ? button_state_held
+      : button_state_pressed;
+  }
+  input->mouse = latest->mouse;
+  input->pausePhysics = latest->pausePhysics;
+  return input;
+}
+
+static void physicsInputConsumed(input_state* input) {
+  for (u32 i = 0; i < arrayLen(input->buttons); i++) {
+    if (input->buttons[i] == button_state_pressed) {
+      input->buttons[i] = button_state_held;
+    }
+  }
+}
+
+// Physics side, called after every update
+static void renderStatePublish(car_game_state* game, car_state* car) {
+  physics_world* world = &game->world;
+  render_state* state = game->renderSlots + game->renderBuffer.back;
+  state->counter = platformApi->getPerformanceCounter();
+  state->accumulator = game->physicsAccumulator;
+  body_transforms transforms = physicsWorldTransforms(world);
+  bodyTransformsCopy(&state->bodies, &transforms);
+  state->chassisVelocity = world->velocity[car->chassis];
+  state->chassisForwardAxis = world->forwardAxis[car->chassis];
+  state->carStats = car->stats;
+  state->slipRatioForce = car->curves.slipRatioForce;
+  state->slipAngleForce = car->curves.slipAngleForce;
+  state->contactPointNum = car->contactPointNum;
+  memcpy(state->contactPoints, world->contactPoints + car->firstContact,
+         car->contactPointNum * sizeof(contact_point));
+  state->convergence = world->convergence;
+  state->physics = game->physicsTotals;
+  state->islandSubstepMax = game->physicsSubstepMax;
+  game->physicsSubstepMax = 0;
+  tripleBufferPublish(&game->renderBuffer);
+
+  game->audioSlots[game->audioBuffer.back] = car->stats;
+  tripleBufferPublish(&game->audioBuffer);
+}
+
+// Takes the latest render state for this frame and interpolates the
+// render transforms to the current time. The physics may have moved on
+// since the update, that time is added to its accumulator.
+static void renderStateUpdate(car_game_state* game) {
+  render_state* state =
+    game->renderSlots + tripleBufferAcquire(&game->renderBuffer);
+  f32 elapsed =
+    (f32)(platformApi->getPerformanceCounter() - state->counter) /
+    (f32)platformApi->getPerformanceFrequency();
+  f32 alpha = (state->accumulator + elapsed) / physicsStepDelta;
+  physicsWorldInterpolate(&game->world, &state->bodies, MIN(alpha, 1.f));
+  game->renderState = state;
+  game->profiler.physics = state->physics;
+  game->profiler.maxSubsteps =
+    MAX(game->profiler.maxSubsteps, state->islandSubstepMax);
+}
+
+// Audio callback side
+inline car_stats* audioStatsAcquire(car_game_state* game) {
+  return game->audioSlots + tripleBufferAcquire(&game->audioBuffer);
+}
@@ -0,0 +1,664 @@
+#include "all.h"
+
+// Physics world stores the rigid bodies of every vehicle as structure of
+// arrays so integration walks each stream linearly. Joints, collision shapes
+// and persistent contact points of all vehicles live in flat arrays as well.
+
+inline u64 physicsTimerBegin() {
+  return enablePhysicsTimers ? platformApi->getPerformanceCounter() : 0;
+}
+
+inline void physicsTimerEnd(physics_world* world, physics_timer timer,
+                            u64 begin) {
+  if (enablePhysicsTimers) {
+    world->counters.ticks[timer] +=
+      platformApi->getPerformanceCounter() - begin;
+  }
+}
+
+static u32 physicsWorldAddBody(physics_world* world, i32 shapeNum) {
+  ASSERT(world->bodyNum < world->bodyCapacity);
+  ASSERT(world->totalShapeNum + shapeNum <= world->shapeCapacity);
+  u32 body = world->bodyNum++;
+
+  world->mass[body] = 0.f;
+  world->invMass[body] = 0.f;
+  world->friction[body] = 0.f;
+  world->velocity[body] = V3_ZERO;
+  world->velocity0[body] = V3_ZERO;
+  world->angularVelocity[body] = V3_ZERO;
+  world->position[body] = V3_ZERO;
+  world->forwardAxis[body] = V3_ZERO;
+  world->sideAxis[body] = V3_ZERO;
+  world->origin[body] = V3_ZERO;
+  world->localCenter[body] = V3_ZERO;
+  world->invBodyInertiaTensor[body] = (m3x3){0};
+  world->orientationQuat[body] = QUAT_IDENTITY;
+  world->orientation[body] = (m3x3){0};
+  world->invWorlInertiaTensor[body] = (m3x3){0};
+  world->deltaPosition[body] = V3_ZERO;
+  world->acceleration[body] = V3_ZERO;
+  world->force[body] = V3_ZERO;
+  world->torque[body] = V3_ZERO;
+  world->awake[body] = true;
+  world->sleepTime[body] = 0.f;
+  world->islandNext[body] = body;
+  world->awakeBodyNum++;
+  world->disabled[body] = false;
+  world->substeps[body] = (u8)subStepAmount;
+
+  world->broadphase.proxy[body] = AABB_TREE_NULL;
+  world->broadphase.collisionGroup[body] = body;
+  world->firstShape[body] = world->totalShapeNum;
+  world->shapeNum[body] = shapeNum;
+  world->totalShapeNum += shapeNum;
+  return body;
+}
+
+// Returns the index of the new joint in the array of its type
+static u32 physicsWorldAddJoint(physics_world* world, joint_type type) {
+  ASSERT(world->jointNum < world->jointCapacity);
+  ASSERT(world->typeJointNum[type] < world->typeJointCapacity[type]);
+  u32 index = world->typeJointNum[type]++;
+  world->jointOrder[world->jointNum++] = (joint_ref){type, index};
+  switch (type) {
+    case joint_type_hinge:
+      world->hingeJoints[index] = (hinge_joint){0};
+      break;
+    case joint_type_distance:
+      world->distanceJoints[index] = (distance_joint){0};
+      break;
+    case joint_type_slider:
+      world->sliderJoints[index] = (slider_joint){0};
+      break;
+    case joint_type_axis:
+      world->axisJoints[index] = (axis_joint){0};
+      break;
+      InvalidDefaultCase;
+  }
+  return index;
+}
+
+static u32 physicsWorldAddContacts(physics_world* world, u32 contactNum) {
+  ASSERT(world->contactNum + contactNum <= world->contactCapacity);
+  u32 first = world->contactNum;
+  memset(world->contactPoints + first, 0, contactNum * sizeof(contact_point));
+  world->contactNum += contactNum;
+  return first;
+}
+
+// Point of each shape of the awake bodies that is tested against the
+// terrain, spheres use their center. Returns the number of points.
+static u32 physicsWorldShapePoints(physics_world* world, u32* shapeIndices,
+                                   v3* points) {
+  u32 pointNum = 0;
+  for (u32 body = 0; body < world->bodyNum; body++) {
+    if (!world->awake[body]) continue;
+    v3 position = world->position[body];
+    v3 localCenter = world->localCenter[body];
+    u32 shapeIdx = world->firstShape[body];
+    for (i32 i = 0; i < world->shapeNum[body]; i++, shapeIdx++) {
+      shape* bShape = world->shapes + shapeIdx;
+      shapeIndices[pointNum] = shapeIdx;
+      if (bShape->type == shape_type::SHAPE_POINT) {
+        v3 u = world->orientation[body] * (bShape->point.p - localCenter);
+        points[pointNum++] = u + position;
+      } else {
+        points[pointNum++] = position + localCenter;
+      }
+    }
+  }
+  return pointNum;
+}
+
+// Streams are pushed to the arena again on every reload, same as the
+// terrain geometry, so the capacities must stay constant between reloads.
+// jointCapacity has the capacity of each joint type.
+static void allocPhysicsWorld(physics_world* world, memory_arena* arena,
+                              u32 bodyCapacity, const u32* jointCapacity,
+                              u32 shapeCapacity, u32 contactCapacity) {
+  world->bodyCapacity = bodyCapacity;
+  world->mass = pushArray(arena, bodyCapacity, f32);
+  world->invMass = pushArray(arena, bodyCapacity, f32);
+  world->friction = pushArray(arena, bodyCapacity, f32);
+  world->velocity = pushArray(arena, bodyCapacity, v3);
+  world->velocity0 = pushArray(arena, bodyCapacity, v3);
+  world->angularVelocity = pushArray(arena, bodyCapacity, v3);
+  world->position = pushArray(arena, bodyCapacity, v3);
+  world->forwardAxis = pushArray(arena, bodyCapacity, v3);
+  world->sideAxis = pushArray(arena, bodyCapacity, v3);
+  world->origin = pushArray(arena, bodyCapacity, v3);
+  world->localCenter = pushArray(arena, bodyCapacity, v3);
+  world->invBodyInertiaTensor = pushArray(arena, bodyCapacity, m3x3);
+  world->orientationQuat = pushArray(arena, bodyCapacity, quat);
+  world->orientation = pushArray(arena, bodyCapacity, m3x3);
+  world->invWorlInertiaTensor = pushArray(arena, bodyCapacity, m3x3);
+  world->deltaPosition = pushArray(arena, bodyCapacity, v3);
+  world->acceleration = pushArray(arena, bodyCapacity, v3);
+  world->force = pushArray(arena, bodyCapacity, v3);
+  world->torque = pushArray(arena, bodyCapacity, v3);
+  world->awake = pushArray(arena, bodyCapacity, u8);
+  world->sleepTime = pushArray(arena, bodyCapacity, f32);
+  world->islandNext = pushArray(arena, bodyCapacity, u32);
+  world->disabled = pushArray(arena, bodyCapacity, u8);
+  world->substeps = pushArray(arena, bodyCapacity, u8);
+  world->previousPosition = pushArray(arena, bodyCapacity, v3);
+  world->previousOrientationQuat = pushArray(arena, bodyCapacity, quat);
+  world->renderPosition = pushArray(arena, bodyCapacity, v3);
+  world->renderOrigin = pushArray(arena, bodyCapacity, v3);
+  world->renderOrientation = pushArray(arena, bodyCapacity, m3x3);
+  world->firstShape = pushArray(arena, bodyCapacity, u32);
+  world->shapeNum = pushArray(arena, bodyCapacity, i32);
+
+  world->shapeCapacity = shapeCapacity;
+  world->shapes = pushArray(arena, shapeCapacity, shape);
+
+  world->jointCapacity = 0;
+  for (u32 type = 0; type < _joint_type_num; type++) {
+    world->typeJointCapacity[type] = jointCapacity[type];
+    world->jointCapacity += jointCapacity[type];
+  }
+  world->hingeJoints =
+    pushArray(arena, jointCapacity[joint_type_hinge], hinge_joint);
+  world->distanceJoints =
+    pushArray(arena, jointCapacity[joint_type_distance], distance_joint);
+  world->sliderJoints =
+    pushArray(arena, jointCapacity[joint_type_slider], slider_joint);
+  world->axisJoints =
+    pushArray(arena, jointCapacity[joint_type_axis], axis_joint);
+  world->jointOrder = pushArray(arena, world->jointCapacity, joint_ref);
+
+  world->contactCapacity = contactCapacity;
+  world->contactPoints = pushArray(arena, contactCapacity, contact_point);
+
+  allocBroadphase(&world->broadphase, arena, bodyCapacity);
+
+  if (world->bodyNum == 0) {
+    // Static ground body, terrain contacts use it as body A.
+    u32 ground = physicsWorldAddBody(world, 0);
+    world->friction[ground] = 0.6f;
+    world->awake[ground] = false;
+    world->awakeBodyNum--;
+  }
+}
+
+static void integrateVelocities(physics_world* world, float h, u32 substeps,
+                                u32 begin, u32 end) {
+  for (u32 i = begin; i < end; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    v3 velocity = world->velocity[i];
+    // Integrate velocities
+    v3 cmForce = - (Kdl * velocity * v3_normalize(velocity))
+      - (Krr * velocity)
+      + (Gravity * world->mass[i])
+      + world->force[i];
+
+    // vCM = vCM + h * (FT/M)
+    v3 acc = world->invMass[i] * cmForce;
+    world->velocity[i] = velocity + acc * h;
+  }
+
+  // ICM-1 = A * _I-1 * AT
+  for (u32 i = begin; i < end; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    m3x3 orientation = world->orientation[i];
+    world->invWorlInertiaTensor[i] = orientation *
+                                     world->invBodyInertiaTensor[i] *
+                                     m3x3_transpose(orientation);
+  }
+
+  for (u32 i = begin; i < end; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    // Dampings
+    v3 torque = -Kda * world->angularVelocity[i] + world->torque[i];
+    world->angularVelocity[i] = world->angularVelocity[i] +
+      world->invWorlInertiaTensor[i] * torque * h;
+  }
+}
+
+static void integratePositions(physics_world* world, float h, u32 substeps,
+                               u32 begin, u32 end) {
+  for (u32 i = begin; i < end; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    world->deltaPosition[i] = world->deltaPosition[i] + world->velocity[i] * h;
+  }
+
+  for (u32 i = begin; i < end; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    v3 angularVelocity = world->angularVelocity[i];
+    quat orientationQuat = world->orientationQuat[i];
+    quat q = {0.0f,
+              angularVelocity.x * h * 0.5f,
+              angularVelocity.y * h * 0.5f,
+              angularVelocity.z * h * 0.5f};
+    orientationQuat = orientationQuat + q * orientationQuat;
+    orientationQuat = quat_normalize(orientationQuat);
+    world->orientationQuat[i] = orientationQuat;
+    world->orientation[i] = m3x3_from_quat(orientationQuat);
+  }
+}
+
+static void finalizePositions(physics_world* world, f32 h, u32 substeps) {
+  for (u32 i = GROUND_BODY + 1; i < world->bodyNum; i++) {
+    if (!bodyInPass(world, i, substeps)) continue;
+    v3 a = (world->velocity0[i] - world->velocity[i]) / h;
+    world->acceleration[i] = a;
+
+    world->position[i] = world->position[i] + world->deltaPosition[i];
+    world->deltaPosition[i] = V3_ZERO;
+    world->velocity0[i] = world->velocity[i];
+    world->force[i] = V3_ZERO;
+    world->torque[i] = V3_ZERO;
+  }
+}
+
+static void physicsWorldStoreState(physics_world* world) {
+  memcpy(world->previousPosition, world->position,
+         world->bodyNum * sizeof(v3));
+  memcpy(world->previousOrientationQuat, world->orientationQuat,
+         world->bodyNum * sizeof(quat));
+  world->previousBodyNum = world->bodyNum;
+}
+
+inline body_transforms physicsWorldTransforms(physics_world* world) {
+  body_transforms transforms;
+  transforms.bodyNum = world->bodyNum;
+  transforms.previousBodyNum = world->previousBodyNum;
+  transforms.previousPosition = world->previousPosition;
+  transforms.previousOrientationQuat = world->previousOrientationQuat;
+  transforms.position = world->position;
+  transforms.orientationQuat = world->orientationQuat;
+  transforms.localCenter = world->localCenter;
+  return transforms;
+}
+
+// dst streams must have room for src->bodyNum bodies
+static void bodyTransformsCopy(body_transforms* dst,
+                               const body_transforms* src) {
+  u32 bodyNum = src->bodyNum;
+  dst->bodyNum = bodyNum;
+  dst->previousBodyNum = src->previousBodyNum;
+  memcpy(dst->previousPosition, src->previousPosition,
+         src->previousBodyNum * sizeof(v3));
+  memcpy(dst->previousOrientationQuat, src->previousOrientationQuat,
+         src->previousBodyNum * sizeof(quat));
+  memcpy(dst->position, src->position, bodyNum * sizeof(v3));
+  memcpy(dst->orientationQuat, src->orientationQuat, bodyNum * sizeof(quat));
+  memcpy(dst->localCenter, src->localCenter, bodyNum * sizeof(v3));
+}
+
+// Blends the render state between the previous and the current step,
+// alpha is the fraction of a step the render time is past the last step.
+static void physicsWorldInterpolate(physics_world* world,
+                                    const body_transforms* transforms,
+                                    f32 alpha) {
+  for (u32 i = 0; i < transforms->bodyNum; i++) {
+    v3 position = transforms->position[i];
+    quat q = transforms->orientationQuat[i];
+    if (i < transforms->previousBodyNum) {
+      v3 p0 = transforms->previousPosition[i];
+      quat q0 = transforms->previousOrientationQuat[i];
+      position = p0 + (position - p0) * alpha;
+      // Shortest arc
+      f32 d = q0.s * q.s + q0.x * q.x + q0.y * q.y + q0.z * q.z;
+      if (d < 0.f) {
+        q = (quat){-q.s, -q.x, -q.y, -q.z};
+      }
+      q = quat_normalize((quat){q0.s + (q.s - q0.s) * alpha,
+                                q0.x + (q.x - q0.x) * alpha,
+                                q0.y + (q.y - q0.y) * alpha,
+                                q0.z + (q.z - q0.z) * alpha});
+    }
+    m3x3 orientation = m3x3_from_quat(q);
+    world->renderPosition[i] = position;
+    world->renderOrientation[i] = orientation;
+    world->renderOrigin[i] =
+      position - orientation * transforms->localCenter[i];
+  }
+}
+
+// Solver work is split to stages. Items of one stage and color are
+// independent and can be run on any thread.
+enum solver_stage {
+  solver_stage_integrate_velocities,
+  solver_stage_integrate_positions,
+  solver_stage_joint_prepare,
+  solver_stage_joint_warm_start,
+  solver_stage_joint_solve,
+  solver_stage_joint_relax,
+  solver_stage_contact_warm_start,
+  solver_stage_contact_solve,
+  solver_stage_contact_relax,
+};
+
+// Smaller stages are not worth waking up the workers
+#define SOLVER_TASK_MIN_ITEMS 32
+#define SOLVER_MAX_TASKS 32
+
+typedef struct solver_context {
+  physics_world* world;
+  contact_constraint* constraints;
+  u32 constraintNum;
+  joint_graph jointGraph;
+  constraint_graph contactGraph;
+  contact_solver_wide wideSolver;
+  b32 wide;
+  u32 substeps;
+  f32 h;
+  f32 invH;
+} solver_context;
+
+typedef struct solver_task {
+  solver_context* context;
+  solver_stage stage;
+  u32 color;
+  u32 begin;
+  u32 end;
+  // Largest impulse change of the solve and relax stages
+  f32 residual;
+} solver_task;
+
+static void solverRunTask(solver_task* task) {
+  solver_context* context = task->context;
+  physics_world* world = context->world;
+  f32 h = context->h;
+  f32 invH = context->invH;
+  u32* joints = context->jointGraph.graph.colors[task->color].indices;
+  u32* jointTypeFirst = context->jointGraph.typeFirst[task->color];
+  u32* contacts = context->contactGraph.colors[task->color].indices;
+  contact_constraint_wide* wideConstraints =
+    context->wideSolver.constraints +
+    context->wideSolver.colorFirst[task->color];
+
+  switch (task->stage) {
+    case solver_stage_integrate_velocities:
+      integrateVelocities(world, h, context->substeps, task->begin,
+                          task->end);
+      break;
+    case solver_stage_integrate_positions:
+      integratePositions(world, h, context->substeps, task->begin,
+                         task->end);
+      break;
+    case solver_stage_joint_prepare: {
+      // The range goes over the joint arrays one type after another
+      u32 typeFirst = 0;
+      for (u32 t = 0; t < _joint_type_num; t++) {
+        u32 typeEnd = typeFirst + world->typeJointNum[t];
+        u32 begin = MAX(task->begin, typeFirst);
+        u32 end = MIN(task->end, typeEnd);
+        if (begin < end) {
+          jointsPreSolve(world, (joint_type)t, context->substeps,
+                         begin - typeFirst, end - typeFirst, h);
+        }
+        typeFirst = typeEnd;
+      }
+    } break;
+    case solver_stage_joint_warm_start:
+      for (u32 t = 0; t < _joint_type_num; t++) {
+        u32 begin = MAX(task->begin, jointTypeFirst[t]);
+        u32 end = MIN(task->end, jointTypeFirst[t + 1]);
+        if (begin < end) {
+          jointsWarmStart(world, (joint_type)t, joints, begin, end);
+        }
+      }
+      break;
+    case solver_stage_joint_solve:
+    case solver_stage_joint_relax: {
+      b32 useBias = task->stage == solver_stage_joint_solve;
+      for (u32 t = 0; t < _joint_type_num; t++) {
+        u32 begin = MAX(task->begin, jointTypeFirst[t]);
+        u32 end = MIN(task->end, jointTypeFirst[t + 1]);
+        if (begin < end) {
+          f32 residual = jointsSolve(world, (joint_type)t, joints, begin,
+                                     end, h, invH, useBias);
+          task->residual = MAX(task->residual, residual);
+        }
+      }
+    } break;
+    case solver_stage_contact_warm_start:
+      for (u32 i = task->begin; i < task->end; i++) {
+        if (context->wide) {
+          warmStartWide(world, wideConstraints + i);
+        } else {
+          warmStart(world, context->constraints + contacts[i],
+                    context->constraintNum);
+        }
+      }
+      break;
+    case solver_stage_contact_solve:
+    case solver_stage_contact_relax: {
+      b32 useBias = task->stage == solver_stage_contact_solve;
+      for (u32 i = task->begin; i < task->end; i++) {
+        f32 residual;
+        if (context->wide) {
+          residual = solveWide(world, wideConstraints + i, invH, useBias);
+        } else {
+          residual = solve(world, context->constraints + contacts[i],
+                           context->constraintNum, invH, useBias);
+        }
+        task->residual = MAX(task->residual, residual);
+      }
+    } break;
+      InvalidDefaultCase;
+  }
+}
+
+static RT_WORK_CALLBACK(solverTaskCallback) {
+  solverRunTask((solver_task*)data);
+}
+
+// Returns the largest residual of the tasks. It is a maximum so it
+// doesn't depend on how the range was split.
+static f32 solverRunStage(solver_context* context, solver_stage stage,
+                          u32 color, u32 begin, u32 end) {
+  physics_world* world = context->world;
+  u32 itemNum = end - begin;
+  u32 taskNum = world->workQueue ?
+    MIN(world->workerNum + 1, itemNum / SOLVER_TASK_MIN_ITEMS) : 1;
+  if (taskNum <= 1) {
+    solver_task task = {context, stage, color, begin, end, 0.f};
+    solverRunTask(&task);
+    return task.residual;
+  }
+
+  solver_task tasks[SOLVER_MAX_TASKS];
+  taskNum = MIN(taskNum, arrayLen(tasks));
+  u32 itemsPerTask = itemNum / taskNum;
+  for (u32 i = 0; i < taskNum; i++) {
+    u32 taskBegin = begin + i * itemsPerTask;
+    u32 taskEnd = i == taskNum - 1 ? end : taskBegin + itemsPerTask;
+    tasks[i] = (solver_task){context, stage, color, taskBegin, taskEnd, 0.f};
+    if (i > 0) {
+      platformApi->addWork(world->workQueue, solverTaskCallback, tasks + i);
+    }
+  }
+  solverRunTask(tasks);
+  platformApi->completeAllWork(world->workQueue);
+  f32 residual = 0.f;
+  for (u32 i = 0; i < taskNum; i++) {
+    residual = MAX(residual, tasks[i].residual);
+  }
+  return residual;
+}
+
+// Runs a joint or contact stage color by color, followed by the overflow
+// constraints on the calling thread. Returns the residual of the stage.
+static f32 solverRunColors(solver_context* context, solver_stage stage) {
+  b32 jointStage = stage == solver_stage_joint_warm_start ||
+                   stage == solver_stage_joint_solve ||
+                   stage == solver_stage_joint_relax;
+  constraint_graph* graph =
+    jointStage ? &context->jointGraph.graph : &context->contactGraph;
+  f32 residual = 0.f;
+  for (u32 c = 0; c < GRAPH_COLOR_NUM; c++) {
+    u32 itemNum = graph->colors[c].indexNum;
+    if (!jointStage && context->wide) {
+      itemNum = context->wideSolver.colorFirst[c + 1] -
+                context->wideSolver.colorFirst[c];
+    }
+    if (itemNum) {
+      f32 colorResidual = solverRunStage(context, stage, c, 0, itemNum);
+      residual = MAX(residual, colorResidual);
+    }
+  }
+
+  physics_world* world = context->world;
+  f32 h = context->h;
+  f32 invH = context->invH;
+  for (u32 i = 0; i < graph->overflowNum; i++) {
+    u32 idx = graph->overflow[i];
+    f32 delta = 0.f;
+    switch (stage) {
+      case solver_stage_joint_warm_start:
+        jointWarmStart(world, world->jointOrder[idx]);
+        break;
+      case solver_stage_joint_solve:
+        delta = jointSolve(world, world->jointOrder[idx], h, invH, true);
+        break;
+      case solver_stage_joint_relax:
+        delta = jointSolve(world, world->jointOrder[idx], h, invH, false);
+        break;
+      case solver_stage_contact_warm_start:
+        warmStart(world, context->constraints + idx, context->constraintNum);
+        break;
+      case solver_stage_contact_solve:
+        delta = solve(world, context->constraints + idx,
+                      context->constraintNum, invH, true);
+        break;
+      case solver_stage_contact_relax:
+        delta = solve(world, context->constraints + idx,
+                      context->constraintNum, invH, false);
+        break;
+        InvalidDefaultCase;
+    }
+    residual = MAX(residual, delta);
+  }
+  return residual;
+}
+
+// Temporal Gauss-Seidel step of the islands that use the given substep
+// count.
+static void physicsWorldSolvePass(physics_world* world,
+                                  memory_arena* tempArena,
+                                  contact_constraint* constraints,
+                                  u32 constraintNum, u32 substeps,
+                                  f32 delta) {
+  f32 h = delta / substeps;
+  solver_context context = {0};
+  context.world = world;
+  context.constraints = constraints;
+  context.constraintNum = constraintNum;
+  context.wide = useWideContactSolver;
+  context.substeps = substeps;
+  context.h = h;
+  context.invH = 1.0f / h;
+
+  colorJoints(world, tempArena, substeps, &context.jointGraph);
+  colorContacts(world, tempArena, constraints, constraintNum, substeps,
+                &context.contactGraph);
+  if (context.wide) {
+    prepareContactsWide(tempArena, constraints, &context.contactGraph,
+                        &context.wideSolver);
+  }
+
+  u32 firstBody = GROUND_BODY + 1;
+  u32 relaxNum = CLAMP(relaxIterations, 1u, (u32)MAX_RELAX_ITERATIONS);
+  solver_convergence* convergence = &world->convergence;
+  convergence->iterationNum = MAX(convergence->iterationNum, 1);
+  u64 timer = physicsTimerBegin();
+  solverRunStage(&context, solver_stage_joint_prepare, 0, 0, world->jointNum);
+  physicsTimerEnd(world, physics_timer_joint_prepare, timer);
+
+  // Solve
+  // body 2 * substepCount
+  // constraint 2 * substepCount (merge warm starting)
+  for (u32 substep = 0; substep < substeps; ++substep) {
+    // Integrate velocities
+    timer = physicsTimerBegin();
+    solverRunStage(&context, solver_stage_integrate_velocities, 0,
+                   firstBody, world->bodyNum);
+    physicsTimerEnd(world, physics_timer_integrate, timer);
+
+    // Warm start
+    timer = physicsTimerBegin();
+    solverRunColors(&context, solver_stage_joint_warm_start);
+    solverRunColors(&context, solver_stage_contact_warm_start);
+    physicsTimerEnd(world, physics_timer_warm_start, timer);
+
+    timer = physicsTimerBegin();
+    f32 jointResidual = solverRunColors(&context, solver_stage_joint_solve);
+    // Solve velocities using position bias
+    f32 contactResidual =
+      solverRunColors(&context, solver_stage_contact_solve);
+    physicsTimerEnd(world, physics_timer_biased_solve, timer);
+    convergence->jointResidual[0] =
+      MAX(convergence->jointResidual[0], jointResidual);
+    convergence->contactResidual[0] =
+      MAX(convergence->contactResidual[0], contactResidual);
+
+    // Integrate positions using biased velocities
+    timer = physicsTimerBegin();
+    solverRunStage(&context, solver_stage_integrate_positions, 0,
+                   firstBody, world->bodyNum);
+    physicsTimerEnd(world, physics_timer_integrate, timer);
+
+    // Relax biased velocities and impulses.
+    // Relaxing the impulses reduces warm starting overshoot.
+    timer = physicsTimerBegin();
+    for (u32 iteration = 1; iteration <= relaxNum; iteration++) {
+      // The first pass always runs, it removes the position bias velocity
+      if (relaxEarlyExit && iteration > 1 &&
+          jointResidual < relaxTolerance &&
+          contactResidual < relaxTolerance) {
+        world->counters.relaxSkipNum += relaxNum - iteration + 1;
+        break;
+      }
+      jointResidual = solverRunColors(&context, solver_stage_joint_relax);
+      contactResidual = solverRunColors(&context, solver_stage_contact_relax);
+      convergence->jointResidual[iteration] =
+        MAX(convergence->jointResidual[iteration], jointResidual);
+      convergence->contactResidual[iteration] =
+        MAX(convergence->contactResidual[iteration], contactResidual);
+      convergence->iterationNum = MAX(convergence->iterationNum, iteration + 1);
+      world->counters.relaxPassNum++;
+    }
+    physicsTimerEnd(world, physics_timer_relax, timer);
+  }
+
+  timer = physicsTimerBegin();
+  finalizePositions(world, h, substeps);
+
+  if (context.wide) {
+    contactStoreImpulsesWide(&context.wideSolver, constraints);
+  }
+  physicsTimerEnd(world, physics_timer_finalize, timer);
+
+  constraint_graph* jointGraph = &context.jointGraph.graph;
+  world->counters.substepNum += substeps;
+  world->counters.jointNum += jointGraph->overflowNum;
+  for (u32 color = 0; color < GRAPH_COLOR_NUM; color++) {
+    world->counters.jointNum += jointGraph->colors[color].indexNum;
+  }
+}
+
+// Steps every awake body, joint and contact of the world. Islands don't
+// share constraints, so each substep count is solved on its own.
+static void physicsWorldSolve(physics_world* world, memory_arena* tempArena,
+                              contact_constraint* constraints,
+                              u32 constraintNum, f32 delta) {
+  u64 timer = physicsTimerBegin();
+  world->convergence = (solver_convergence){0};
+  b32 used[256] = {0};
+  for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+    if (world->awake[body]) {
+      used[world->substeps[body]] = true;
+    }
+  }
+  for (u32 substeps = 1; substeps < arrayLen(used); substeps++) {
+    if (used[substeps]) {
+      physicsWorldSolvePass(world, tempArena, constraints, constraintNum,
+                            substeps, delta);
+    }
+  }
+  physicsTimerEnd(world, physics_timer_solve, timer);
+}
@@ -25,6 +25,12 @@ typedef struct shape_point {
   v3 p;
 } shape_point;
 
+// Axis aligned bounding box in world space
+typedef struct aabb {
+  v3 min;
+  v3 max;
+} aabb;
+
 typedef enum shape_type {
   SHAPE_UNDEFINED,
   SHAPE_BOX,
@@ -4,7 +4,8 @@
 
 // A slider joint only allows relative translation between two bodies in a single direction. It has
 // only one degree of freedom - Chapter 2.3
-static void applySliderLinearVelocityStep(rigid_body* bodyA, rigid_body* bodyB, slider_joint* joint,
+static void applySliderLinearVelocityStep(physics_world* world,
+					  u32 bodyA, u32 bodyB, slider_joint* joint,
 					  v2 lambda,
 					  v3 nA, v3 nB,
 					  v3 iA_rAPlusUCrossNA, v3 iA_rAPlusUCrossNB,
@@ -16,37 +17,37 @@ static void applySliderLinearVelocityStep(rigid_body* bodyA, rigid_body* bodyB,
     v3 V = mA * impulse;
     v3 W = iA_rAPlusUCrossNA * lambda.x + iA_rAPlusUCrossNB * lambda.y;
 
-    bodyA->velocity = bodyA->velocity - V;
-    bodyA->angularVelocity = bodyA->angularVelocity - W;
+    world->velocity[bodyA] = world->velocity[bodyA] - V;
+    world->angularVelocity[bodyA] = world->angularVelocity[bodyA] - W;
   }
   {
     v3 V = mB * impulse;
     v3 W = iB_rBCrossNA * lambda.x + iB_rBCrossNB * lambda.y;
 
-    bodyB->velocity = bodyB->velocity + V;
-    bodyB->angularVelocity = bodyB->angularVelocity + W;
+    world->velocity[bodyB] = world->velocity[bodyB] + V;
+    world->angularVelocity[bodyB] = world->angularVelocity[bodyB] + W;
   }
 }
 
-inline void setupSliderJoint(joint* j, rigid_body* rbA, rigid_body* rbB,
+inline void setupSliderJoint(slider_joint* j, u32 rbA, u32 rbB,
 			     v3 pivotA, v3 pivotB, v3 axisIn,
 			     f32 herz, f32 damping) {
-  j->type = joint_type_slider;
-  j->slider.base.herz = herz;
-  j->slider.base.damping = damping;
-  j->slider.base.bodyA = rbA;
-  j->slider.base.bodyB = rbB;
-
-  j->slider.base.localOriginAnchorA = {pivotA.x,pivotA.y,pivotA.z};
-  j->slider.base.localOriginAnchorB = {pivotB.x,pivotB.y,pivotB.z};
-  j->slider.slideAxis = axisIn;
-  j->slider.rangeMin = -0.25f;
-  j->slider.rangeMax = 0.f;
+  j->base.herz = herz;
+  j->base.damping = damping;
+  j->base.bodyA = rbA;
+  j->base.bodyB = rbB;
+
+  j->base.localOriginAnchorA = {pivotA.x,pivotA.y,pivotA.z};
+  j->base.localOriginAnchorB = {pivotB.x,pivotB.y,pivotB.z};
+  j->slideAxis = axisIn;
+  j->rangeMin = -0.25f;
+  j->rangeMax = 0.f;
 }
 
-inline void preSolveSliderJoint(slider_joint* joint, f32 h) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void preSolveSliderJoint(physics_world* world, slider_joint* joint,
+                                f32 h) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
   joint->base.localAnchorA = joint->base.localOriginAnchorA;
   joint->base.localAnchorB = joint->base.localOriginAnchorB;
@@ -54,18 +55,18 @@ inline void preSolveSliderJoint(slider_joint* joint, f32 h) {
   v3 localAnchorA = joint->base.localAnchorA;
   v3 localAnchorB = joint->base.localAnchorB;
 
-  joint->base.invMassB = bodyB->invMass;
-  joint->base.invMassA = bodyA->invMass;
+  joint->base.invMassB = world->invMass[bodyB];
+  joint->base.invMassA = world->invMass[bodyA];
 
-  joint->base.invIB = bodyB->invWorlInertiaTensor;
-  joint->base.invIA = bodyA->invWorlInertiaTensor;
+  joint->base.invIB = world->invWorlInertiaTensor[bodyB];
+  joint->base.invIA = world->invWorlInertiaTensor[bodyA];
 
   f32 invMA = joint->base.invMassA, invMB = joint->base.invMassB;
   m3x3 iA = joint->base.invIA;
   m3x3 iB = joint->base.invIB;
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 rA = qA * localAnchorA;
   v3 rB = qB * localAnchorB;
@@ -74,9 +75,9 @@ inline void preSolveSliderJoint(slider_joint* joint, f32 h) {
   v3 nA = perpendicular(aW);
   v3 nB = v3_cross(nA, aW);
 
-  v3 dcA = bodyA->deltaPosition;
-  v3 dcB = bodyB->deltaPosition;
-  v3 centerDiff = (bodyB->position - bodyA->position);
+  v3 dcA = world->deltaPosition[bodyA];
+  v3 dcB = world->deltaPosition[bodyB];
+  v3 centerDiff = (world->position[bodyB] - world->position[bodyA]);
 
   v3 u = (dcB - dcA) + centerDiff + rB - rA;
 
@@ -114,16 +115,16 @@ inline void preSolveSliderJoint(slider_joint* joint, f32 h) {
       &joint->base.impulseCoefficient, &joint->base.massCoefficient);
 }
 
-inline void solveSliderJoint(slider_joint* joint, f32 h, f32 invH,
-                             b32 useBias) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline f32 solveSliderJoint(physics_world* world, slider_joint* joint,
+                            f32 h, f32 invH, b32 useBias) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
-  v3 vA = bodyA->velocity;
-  v3 wA = bodyA->angularVelocity;
+  v3 vA = world->velocity[bodyA];
+  v3 wA = world->angularVelocity[bodyA];
 
-  v3 vB = bodyB->velocity;
-  v3 wB = bodyB->angularVelocity;
+  v3 vB = world->velocity[bodyB];
+  v3 wB = world->angularVelocity[bodyB];
 
   m3x3 iA = joint->base.invIA;
   m3x3 iB = joint->base.invIB;
@@ -137,8 +138,8 @@ inline void solveSliderJoint(slider_joint* joint, f32 h, f32 invH,
 
     v3 deltaV = vB - vA;
 
-    m3x3 qA = bodyA->orientation;
-    m3x3 qB = bodyB->orientation;
+    m3x3 qA = world->orientation[bodyA];
+    m3x3 qB = world->orientation[bodyB];
 
     v3 rA = qA * localAnchorA;
     v3 rB = qB * localAnchorB;
@@ -154,8 +155,8 @@ inline void solveSliderJoint(slider_joint* joint, f32 h, f32 invH,
     v3 nA = perpendicular(aW);
     v3 nB = v3_cross(nA, aW);
 
-    v3 dcA = bodyA->deltaPosition;
-    v3 dcB = bodyB->deltaPosition;
+    v3 dcA = world->deltaPosition[bodyA];
+    v3 dcB = world->deltaPosition[bodyB];
 
     v3 u = (dcB - dcA) + joint->centerDiff0 + rB - rA;
 
@@ -211,22 +212,23 @@ inline void solveSliderJoint(slider_joint* joint, f32 h, f32 invH,
     impulse = newImpulse - joint->totalImpulse;
     joint->totalImpulse = newImpulse;
 
-    applySliderLinearVelocityStep(bodyA, bodyB, joint, impulse,
+    applySliderLinearVelocityStep(world, bodyA, bodyB, joint, impulse,
 				  nA, nB,
                                   iA_rAPlusUCrossNA, iA_rAPlusUCrossNB,
                                   iB_rBCrossNA, iB_rBCrossNB);
+    return sqrtf(impulse.x * impulse.x + impulse.y * impulse.y);
   }
 }
 
-inline void warmStartSliderJoint(slider_joint* joint) {
-  rigid_body* bodyA = joint->base.bodyA;
-  rigid_body* bodyB = joint->base.bodyB;
+inline void warmStartSliderJoint(physics_world* world, slider_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
 
   m3x3 iA = joint->base.invIA;
   m3x3 iB = joint->base.invIB;
 
-  m3x3 qA = bodyA->orientation;
-  m3x3 qB = bodyB->orientation;
+  m3x3 qA = world->orientation[bodyA];
+  m3x3 qB = world->orientation[bodyB];
 
   v3 localAnchorA = joint->base.localAnchorA;
   v3 localAnchorB = joint->base.localAnchorB;
@@ -239,11 +241,11 @@ inline void warmStartSliderJoint(slider_joint* joint) {
   v3 nA = perpendicular(aW);
   v3 nB = v3_cross(nA, aW);
 
-  v3 dcA = bodyA->deltaPosition;
-  v3 dcB = bodyB->deltaPosition;
+  v3 dcA = world->deltaPosition[bodyA];
+  v3 dcB = world->deltaPosition[bodyB];
 
-  v3 pA = bodyA->position;
-  v3 pB = bodyB->position;
+  v3 pA = world->position[bodyA];
+  v3 pB = world->position[bodyB];
 
   v3 centerDiff = pB - pA;
 
@@ -262,7 +264,20 @@ inline void warmStartSliderJoint(slider_joint* joint) {
   v3 iB_rBCrossNA = iB * rBCrossNA;
   v3 iB_rBCrossNB = iB * rBCrossNB;
 
-  applySliderLinearVelocityStep(bodyA, bodyB, joint, joint->totalImpulse, nA,
+  applySliderLinearVelocityStep(world, bodyA, bodyB, joint, joint->totalImpulse, nA,
                                 nB, iA_rAPlusUCrossNA, iA_rAPlusUCrossNB,
                                 iB_rBCrossNA, iB_rBCrossNB);
 }
+
+// Distance of the anchors off the slide axis
+inline f32 sliderJointPositionError(physics_world* world,
+                                    slider_joint* joint) {
+  u32 bodyA = joint->base.bodyA;
+  u32 bodyB = joint->base.bodyB;
+  m3x3 qA = world->orientation[bodyA];
+  v3 rA = qA * joint->base.localAnchorA;
+  v3 rB = world->orientation[bodyB] * joint->base.localAnchorB;
+  v3 aW = qA * joint->slideAxis;
+  v3 u = world->position[bodyB] + rB - world->position[bodyA] - rA;
+  return v3_length(u - aW * v3_dot(u, aW));
+}
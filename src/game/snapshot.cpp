@@ -0,0 +1,261 @@
+#include "all.h"
+// Simulation snapshots.
+//
+// A snapshot is the complete state the next physics step depends on:
+// the body streams, joints with their accumulated impulses, stored contact
+// points, broadphase tree and pairs and the car stats. It is a flat blob
+// of one header and the streams copied back to back, so saving and
+// restoring are a few dozen memcpys. A snapshot restores only into the
+// world it was taken from, or one built the same way, the counts in the
+// header must match.
+//
+// snapshot_ring keeps the latest snapshots for rewinding and re-simulating
+// the steps after them.
+
+#define SNAPSHOT_MAGIC 0x50414e53 // "SNAP"
+#define SNAPSHOT_VERSION 3
+
+typedef struct snapshot_header {
+  u32 magic;
+  u32 version;
+  u32 size;
+  u32 bodyNum;
+  u32 typeJointNum[_joint_type_num];
+  u32 jointNum;
+  u32 shapeNum;
+  u32 contactNum;
+  u32 nodeNum;
+  u32 pairNum;
+  u32 carNum;
+} snapshot_header;
+
+enum snapshot_mode {
+  snapshot_mode_measure,
+  snapshot_mode_save,
+  snapshot_mode_restore,
+};
+
+typedef struct snapshot_stream {
+  snapshot_mode mode;
+  u8* cursor;
+  usize size;
+} snapshot_stream;
+
+static void snapshotBytes(snapshot_stream* stream, void* data, usize size) {
+  if (stream->mode == snapshot_mode_save) {
+    memcpy(stream->cursor + stream->size, data, size);
+  } else if (stream->mode == snapshot_mode_restore) {
+    memcpy(data, stream->cursor + stream->size, size);
+  }
+  stream->size += size;
+}
+
+#define snapshotArray(stream, array, num) \
+  snapshotBytes(stream, array, (num) * sizeof(*(array)))
+#define snapshotValue(stream, value) \
+  snapshotBytes(stream, &(value), sizeof(value))
+
+// Same walk for measuring, saving and restoring so the layouts can't
+// drift apart. The render state is left out, it is interpolated from the
+// previous and current state.
+static void snapshotWorld(snapshot_stream* stream, car_game_state* game,
+                          car_state** cars, u32 carNum) {
+  physics_world* world = &game->world;
+  u32 bodyNum = world->bodyNum;
+  snapshotArray(stream, world->mass, bodyNum);
+  snapshotArray(stream, world->invMass, bodyNum);
+  snapshotArray(stream, world->friction, bodyNum);
+  snapshotArray(stream, world->velocity, bodyNum);
+  snapshotArray(stream, world->velocity0, bodyNum);
+  snapshotArray(stream, world->angularVelocity, bodyNum);
+  snapshotArray(stream, world->position, bodyNum);
+  snapshotArray(stream, world->forwardAxis, bodyNum);
+  snapshotArray(stream, world->sideAxis, bodyNum);
+  snapshotArray(stream, world->origin, bodyNum);
+  snapshotArray(stream, world->localCenter, bodyNum);
+  snapshotArray(stream, world->invBodyInertiaTensor, bodyNum);
+  snapshotArray(stream, world->orientationQuat, bodyNum);
+  snapshotArray(stream, world->orientation, bodyNum);
+  snapshotArray(stream, world->invWorlInertiaTensor, bodyNum);
+  snapshotArray(stream, world->deltaPosition, bodyNum);
+  snapshotArray(stream, world->acceleration, bodyNum);
+  snapshotArray(stream, world->force, bodyNum);
+  snapshotArray(stream, world->torque, bodyNum);
+  snapshotArray(stream, world->awake, bodyNum);
+  snapshotArray(stream, world->sleepTime, bodyNum);
+  snapshotArray(stream, world->islandNext, bodyNum);
+  snapshotArray(stream, world->disabled, bodyNum);
+  snapshotArray(stream, world->substeps, bodyNum);
+  snapshotArray(stream, world->previousPosition, bodyNum);
+  snapshotArray(stream, world->previousOrientationQuat, bodyNum);
+  snapshotValue(stream, world->awakeBodyNum);
+  snapshotValue(stream, world->previousBodyNum);
+  snapshotArray(stream, world->shapes, world->totalShapeNum);
+
+  snapshotArray(stream, world->hingeJoints,
+                world->typeJointNum[joint_type_hinge]);
+  snapshotArray(stream, world->distanceJoints,
+                world->typeJointNum[joint_type_distance]);
+  snapshotArray(stream, world->sliderJoints,
+                world->typeJointNum[joint_type_slider]);
+  snapshotArray(stream, world->axisJoints,
+                world->typeJointNum[joint_type_axis]);
+  snapshotArray(stream, world->contactPoints, world->contactNum);
+
+  broadphase_state* broadphase = &world->broadphase;
+  snapshotArray(stream, broadphase->bounds, bodyNum);
+  snapshotArray(stream, broadphase->proxy, bodyNum);
+  snapshotArray(stream, broadphase->nodes, broadphase->nodeNum);
+  snapshotValue(stream, broadphase->freeNode);
+  snapshotValue(stream, broadphase->root);
+  snapshotArray(stream, broadphase->pairs, broadphase->pairNum);
+  snapshotValue(stream, broadphase->droppedPairNum);
+
+  snapshotValue(stream, game->physicsAccumulator);
+  for (u32 i = 0; i < carNum; i++) {
+    car_state* car = cars[i];
+    snapshotValue(stream, car->stats);
+    snapshotValue(stream, car->contactPointNum);
+    snapshotValue(stream, car->turnAngle);
+    snapshotValue(stream, car->lod);
+    snapshotArray(stream, car->wheelRayDistance, WHEEL_NUM);
+    snapshotArray(stream, car->wheelRollAngle, WHEEL_NUM);
+    snapshotArray(stream, car->wheelSpin, WHEEL_NUM);
+  }
+}
+
+static snapshot_header snapshotHeader(car_game_state* game, u32 carNum) {
+  physics_world* world = &game->world;
+  snapshot_header header = {0};
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.bodyNum = world->bodyNum;
+  for (u32 type = 0; type < _joint_type_num; type++) {
+    header.typeJointNum[type] = world->typeJointNum[type];
+  }
+  header.jointNum = world->jointNum;
+  header.shapeNum = world->totalShapeNum;
+  header.contactNum = world->contactNum;
+  header.nodeNum = world->broadphase.nodeNum;
+  header.pairNum = world->broadphase.pairNum;
+  header.carNum = carNum;
+  return header;
+}
+
+// Bytes needed for a snapshot of the current state. The tree node and
+// pair counts change between steps, snapshotMaxSize covers them all.
+static usize snapshotSize(car_game_state* game, car_state** cars,
+                          u32 carNum) {
+  snapshot_stream stream = {snapshot_mode_measure, NULL,
+                            sizeof(snapshot_header)};
+  snapshotWorld(&stream, game, cars, carNum);
+  return stream.size;
+}
+
+static usize snapshotMaxSize(car_game_state* game, car_state** cars,
+                             u32 carNum) {
+  broadphase_state* broadphase = &game->world.broadphase;
+  return snapshotSize(game, cars, carNum) +
+    (broadphase->nodeCapacity - broadphase->nodeNum) * sizeof(aabb_tree_node) +
+    (broadphase->pairCapacity - broadphase->pairNum) * sizeof(body_pair);
+}
+
+// Returns the snapshot size, or 0 if it doesn't fit to the buffer.
+static usize snapshotSave(car_game_state* game, car_state** cars, u32 carNum,
+                          void* buffer, usize capacity) {
+  usize size = snapshotSize(game, cars, carNum);
+  if (size > capacity) {
+    return 0;
+  }
+  snapshot_header header = snapshotHeader(game, carNum);
+  header.size = (u32)size;
+  memcpy(buffer, &header, sizeof(header));
+  snapshot_stream stream = {snapshot_mode_save, (u8*)buffer,
+                            sizeof(snapshot_header)};
+  snapshotWorld(&stream, game, cars, carNum);
+  return size;
+}
+
+// Fails without touching the world if the snapshot is from another
+// version or a world with different bodies, joints or cars.
+static b32 snapshotRestore(car_game_state* game, car_state** cars,
+                           u32 carNum, const void* buffer, usize size) {
+  snapshot_header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, buffer, sizeof(header));
+  snapshot_header expected = snapshotHeader(game, carNum);
+  // Tree and pair counts are part of the restored state
+  expected.nodeNum = header.nodeNum;
+  expected.pairNum = header.pairNum;
+  expected.size = header.size;
+  broadphase_state* broadphase = &game->world.broadphase;
+  if (memcmp(&header, &expected, sizeof(header)) != 0 ||
+      header.size != size ||
+      header.nodeNum > broadphase->nodeCapacity ||
+      header.pairNum > broadphase->pairCapacity) {
+    return false;
+  }
+  broadphase->nodeNum = header.nodeNum;
+  broadphase->pairNum = header.pairNum;
+  snapshot_stream stream = {snapshot_mode_restore, (u8*)buffer,
+                            sizeof(snapshot_header)};
+  snapshotWorld(&stream, game, cars, carNum);
+  ASSERT(stream.size == size);
+  return true;
+}
+
+// Fixed number of equally sized slots, the oldest snapshot is overwritten
+// when the ring is full.
+typedef struct snapshot_ring {
+  u8* buffer;
+  usize* slotSize;
+  usize slotCapacity;
+  u32 slotNum;
+  // Next slot to write and the number of valid snapshots before it
+  u32 head;
+  u32 count;
+} snapshot_ring;
+
+static void allocSnapshotRing(snapshot_ring* ring, memory_arena* arena,
+                              u32 slotNum, usize slotCapacity) {
+  ring->buffer = pushArray(arena, slotNum * slotCapacity, u8);
+  ring->slotSize = pushArrayZeros(arena, slotNum, usize);
+  ring->slotCapacity = slotCapacity;
+  ring->slotNum = slotNum;
+  ring->head = 0;
+  ring->count = 0;
+}
+
+static b32 snapshotRingPush(snapshot_ring* ring, car_game_state* game,
+                            car_state** cars, u32 carNum) {
+  u8* slot = ring->buffer + ring->head * ring->slotCapacity;
+  usize size = snapshotSave(game, cars, carNum, slot, ring->slotCapacity);
+  if (!size) {
+    return false;
+  }
+  ring->slotSize[ring->head] = size;
+  ring->head = (ring->head + 1) % ring->slotNum;
+  ring->count = MIN(ring->count + 1, ring->slotNum);
+  return true;
+}
+
+// Restores the snapshot pushed stepsBack pushes before the latest one and
+// drops the newer ones, so re-simulating from there pushes the new
+// history. Returns false if the ring doesn't reach that far back.
+static b32 snapshotRingRewind(snapshot_ring* ring, car_game_state* game,
+                              car_state** cars, u32 carNum, u32 stepsBack) {
+  if (stepsBack >= ring->count) {
+    return false;
+  }
+  u32 slotIdx = (ring->head + ring->slotNum - 1 - stepsBack) % ring->slotNum;
+  if (!snapshotRestore(game, cars, carNum,
+                       ring->buffer + slotIdx * ring->slotCapacity,
+                       ring->slotSize[slotIdx])) {
+    return false;
+  }
+  ring->head = (slotIdx + 1) % ring->slotNum;
+  ring->count -= stepsBack;
+  return true;
+}
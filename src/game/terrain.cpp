@@ -11,44 +11,15 @@ typedef struct terrain_vs_uniform_params {
   i32 terrainTexSamplerId;
 } terrain_vs_uniform_params;
 
-static v2 heightMapImgSize = {1024.f, 1024.f};
-static v2 geometrySize = {4096.f, 4096.f};
-static v3 heightMapScale = {geometrySize.x / heightMapImgSize.x,
-                            geometrySize.y / heightMapImgSize.y, 80.f};
-
 static f32 terrainMeshGridSizeX = 1024.f;
 static f32 terrainMeshGridSizeY = 1024.f;
 static f32 terrainMeshCellNumX = 256.f;
 static f32 terrainMeshCellNumY = 256.f;
 
-static u8 *getPixelP(u8 *image, u32 imageWidth, u32 imageHeight,
-                          v2i pos) {
-  i32 x = pos.x % imageWidth;
-  while (x < 0) x += imageWidth;
-  i32 y = pos.y % imageHeight;
-  while (y < 0) y += imageHeight;
-  return image + (4 * (y * imageWidth + x));
-}
-
-static v4 getPixel(u8 *image, u32 imageWidth, u32 imageHeight,
-                      v2i pos) {
-  u8 *p = getPixelP(image, imageWidth, imageHeight, pos);
-  return {(f32)p[0] / 255.f, (f32)p[1] / 255.f, (f32)p[2] / 255.f,
-          (f32)p[3] / 255.f};
-}
-
-static void setPixel(u8 *image, u32 imageWidth, u32 imageHeight,
-                     v2i pos, v4 color) {
-  u8 *p = getPixelP(image, imageWidth, imageHeight, pos);
-  u8 rgba[4] = {(u8)(color.r * 255.f), (u8)(color.g * 255.f),
-                (u8)(color.b * 255.f), (u8)(color.a * 255.f)};
-  p[0] = rgba[0];
-  p[1] = rgba[1];
-  p[2] = rgba[2];
-  p[3] = rgba[3];
-}
-
 f32 getGeometryHeight(v3 pos, car_game_state *game, v3 *normOut) {
+  if (game->terrain.stream) {
+    return terrainStreamHeight(game->terrain.stream, pos, normOut);
+  }
   i32 sizeX = heightMapImgSize.x;
   i32 sizeY = heightMapImgSize.y;
 
@@ -63,23 +34,26 @@ f32 getGeometryHeight(v3 pos, car_game_state *game, v3 *normOut) {
   f32 u = geomPosX - x;
   f32 v = geomPosY - y;
 
-  i32 xPlusOne = (x == sizeX - 1) ? 0 : x + 1;
-  i32 yPlusOne = (y == sizeY - 1) ? 0 : y + 1;
-
   // Approximate heights and normals
-  v4 c00 = game->terrain.geometry[sizeX * y + x];
-  v4 c10 = game->terrain.geometry[sizeX * y + xPlusOne];
-  v4 c01 = game->terrain.geometry[sizeX * yPlusOne + x];
-  v4 c11 = game->terrain.geometry[sizeX * yPlusOne + xPlusOne];
-
-  v3 n00 = {c00.y,c00.z,c00.w};
-  v3 n10 = {c10.y,c10.z,c10.w};
-  v3 n01 = {c01.y,c01.z,c01.w};
-  v3 n11 = {c11.y,c11.z,c11.w};
+  terrain_object *terrain = &game->terrain;
+  terrain_sample c00 = terrain->samples[terrainSampleIndex(sizeX, x, y)];
+  terrain_sample c10 = terrain->samples[terrainSampleIndex(sizeX, x + 1, y)];
+  terrain_sample c01 = terrain->samples[terrainSampleIndex(sizeX, x, y + 1)];
+  terrain_sample c11 =
+    terrain->samples[terrainSampleIndex(sizeX, x + 1, y + 1)];
+  f32 h00 = terrainUnpackHeight(terrain, c00);
+  f32 h10 = terrainUnpackHeight(terrain, c10);
+  f32 h01 = terrainUnpackHeight(terrain, c01);
+  f32 h11 = terrainUnpackHeight(terrain, c11);
+
+  v3 n00 = terrainUnpackNormal(c00);
+  v3 n10 = terrainUnpackNormal(c10);
+  v3 n01 = terrainUnpackNormal(c01);
+  v3 n11 = terrainUnpackNormal(c11);
 
   // Bilinear interpolate
-  f32 a = c00.x * (1.f - u) + c10.x * u;
-  f32 b = c01.x * (1.f - u) + c11.x * u;
+  f32 a = h00 * (1.f - u) + h10 * u;
+  f32 b = h01 * (1.f - u) + h11 * u;
   f32 h = a * (1.f - v) + b * v;
 
   v3 aN = n00 * (1.f - u) + n10 * u;
@@ -90,82 +64,378 @@ f32 getGeometryHeight(v3 pos, car_game_state *game, v3 *normOut) {
   return pos.z - h;
 }
 
-static void updateGeometryMesh(terrain_object *terrain, v3 *meshVertices,
-                               v4 *geometry) {
-  rt_image_data img = terrain->heightMapImg;
-  // NOTE: This assumes that geometry grid vertex count is same
-  //       as the heightmap pixel count
-  for (i16 y = 0; y < img.height; y++) {
-    for (i16 x = 0; x < img.width; x++) {
-      v4 height = getPixel((u8 *)img.pixels, img.width, img.height,
-                              (v2i){x, y});
-      v4 heightA = getPixel((u8 *)img.pixels, img.width, img.height,
-                               (v2i){x + 1, y});
-      v4 heightB = getPixel((u8 *)img.pixels, img.width, img.height,
-                               (v2i){x - 1, y});
-      v4 heightC = getPixel((u8 *)img.pixels, img.width, img.height,
-                               (v2i){x, y + 1});
-      v4 heightD = getPixel((u8 *)img.pixels, img.width, img.height,
-                               (v2i){x, y - 1});
-      v3 normal  = v3_normalize((v3){height.y, height.z, height.w} * 2.f - (v3){1.f, 1.f, 1.f});
-      v3 normalA = v3_normalize((v3){heightA.y, heightA.z, heightA.w} * 2.f - (v3){1.f, 1.f, 1.f});
-      v3 normalB = v3_normalize((v3){heightB.y, heightB.z, heightB.w} * 2.f - (v3){1.f, 1.f, 1.f});
-      v3 normalC = v3_normalize((v3){heightC.y, heightC.z, heightC.w} * 2.f - (v3){1.f, 1.f, 1.f});
-      v3 normalD = v3_normalize((v3){heightD.y, heightD.z, heightD.w} * 2.f - (v3){1.f, 1.f, 1.f});
-
-      v3 v = meshVertices[(y * img.width) + x];
-
-      // Smooth the geometry and normals a bit
-      v.z = (height.x + heightA.x + heightB.x + heightC.x + heightD.x) / 5.f;
-      v.z = v.z * heightMapScale.z - heightMapScale.z;
-      v3 n = (normal + normalA + normalB + normalC + normalD) / 5.f;
-
-      meshVertices[(y * img.width) + x] = v;
-      geometry[(y * img.width) + x] = (v4){v.z, n.x, n.y, n.z};
+// Same as getGeometryHeight for n points. Grid coordinates, the normal
+// decode and the interpolation run SIMD_WIDTH points at a time, only the
+// corner loads are done per lane. The float operations match the scalar
+// version.
+// Streamed terrain is sampled a point at a time.
+static void getGeometryHeightBatch(car_game_state *game, const v3 *pos, u32 n,
+                                   f32 *depth, v3 *normal) {
+  u32 wideNum = game->terrain.stream ? 0 : n;
+  i32 sizeX = heightMapImgSize.x;
+  i32 sizeY = heightMapImgSize.y;
+  terrain_object *terrain = &game->terrain;
+
+  f32w scaleX = f32w_splat(heightMapScale.x);
+  f32w scaleY = f32w_splat(heightMapScale.y);
+  f32w sizeXw = f32w_splat((f32)sizeX);
+  f32w sizeYw = f32w_splat((f32)sizeY);
+  f32w halfX = f32w_splat(sizeX * 0.5f);
+  f32w halfY = f32w_splat(sizeY * 0.5f);
+  f32w zero = f32w_zero();
+  f32w one = f32w_splat(1.f);
+
+  u32 i = 0;
+  for (; i + SIMD_WIDTH <= wideNum; i += SIMD_WIDTH) {
+    v3w p;
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      setLane(&p, lane, pos[i + lane]);
+    }
+    f32w geomPosX = f32w_add(f32w_div(p.x, scaleX), halfX);
+    f32w geomPosY = f32w_add(f32w_div(p.y, scaleY), halfY);
+
+    f32w mask = f32w_less(geomPosX, zero);
+    while (f32w_anyTrue(mask)) {
+      geomPosX = f32w_select(mask, f32w_add(geomPosX, sizeXw), geomPosX);
+      mask = f32w_less(geomPosX, zero);
+    }
+    mask = f32w_less(geomPosY, zero);
+    while (f32w_anyTrue(mask)) {
+      geomPosY = f32w_select(mask, f32w_add(geomPosY, sizeYw), geomPosY);
+      mask = f32w_less(geomPosY, zero);
+    }
+
+    f32w x = f32w_trunc(geomPosX);
+    f32w y = f32w_trunc(geomPosY);
+    f32w u = f32w_sub(geomPosX, x);
+    f32w v = f32w_sub(geomPosY, y);
+
+    terrain_sample_wide c00, c10, c01, c11;
+    terrain_sample *samples = terrain->samples;
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      i32 cx = (i32)getLane(&x, lane);
+      i32 cy = (i32)getLane(&y, lane);
+      terrainSetSampleLane(&c00, lane,
+                           samples[terrainSampleIndex(sizeX, cx, cy)]);
+      terrainSetSampleLane(&c10, lane,
+                           samples[terrainSampleIndex(sizeX, cx + 1, cy)]);
+      terrainSetSampleLane(&c01, lane,
+                           samples[terrainSampleIndex(sizeX, cx, cy + 1)]);
+      terrainSetSampleLane(
+        &c11, lane, samples[terrainSampleIndex(sizeX, cx + 1, cy + 1)]);
+    }
+    f32w h00 = terrainUnpackHeightWide(terrain, &c00);
+    f32w h10 = terrainUnpackHeightWide(terrain, &c10);
+    f32w h01 = terrainUnpackHeightWide(terrain, &c01);
+    f32w h11 = terrainUnpackHeightWide(terrain, &c11);
+    v3w n00 = terrainUnpackNormalWide(&c00);
+    v3w n10 = terrainUnpackNormalWide(&c10);
+    v3w n01 = terrainUnpackNormalWide(&c01);
+    v3w n11 = terrainUnpackNormalWide(&c11);
+
+    // Bilinear interpolate
+    f32w oneMinusU = f32w_sub(one, u);
+    f32w oneMinusV = f32w_sub(one, v);
+    f32w a = f32w_add(f32w_mul(h00, oneMinusU), f32w_mul(h10, u));
+    f32w b = f32w_add(f32w_mul(h01, oneMinusU), f32w_mul(h11, u));
+    f32w h = f32w_add(f32w_mul(a, oneMinusV), f32w_mul(b, v));
+
+    v3w aN = v3w_add(v3w_scale(n00, oneMinusU), v3w_scale(n10, u));
+    v3w bN = v3w_add(v3w_scale(n01, oneMinusU), v3w_scale(n11, u));
+    v3w normalW = v3w_add(v3w_scale(aN, oneMinusV), v3w_scale(bN, v));
+
+    f32w depthW = f32w_sub(p.z, h);
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      depth[i + lane] = getLane(&depthW, lane);
+      normal[i + lane] = getLane(&normalW, lane);
+    }
+  }
+  for (; i < n; i++) {
+    depth[i] = getGeometryHeight(pos[i], game, normal + i);
+  }
+}
+
+// Ray and sphere casts.
+//
+// The min-max pyramid keeps the height range of every square of 2^level
+// cells. A cast walks the cells along the ray in the 2D grid, starting
+// from the top level. A node the ray passes above over its whole extent
+// is skipped at once and the walk goes a level up, otherwise it goes a
+// level down. Only the cells at level 0 are intersected exactly. The
+// terrain wraps around like the height map texture.
+
+typedef struct terrain_hit {
+  // Along the ray, and the ray point or the sphere center at the hit
+  f32 distance;
+  v3 point;
+  v3 normal;
+} terrain_hit;
+
+// Floor of v / 2^shift for negative v as well
+inline i32 terrainNodeIndex(i32 v, u32 shift) {
+  return v >= 0 ? v >> shift : -((-v - 1) >> shift) - 1;
+}
+
+// Cells per side of the terrain the queries read, of the height map or
+// of the stream
+inline i32 terrainGridSize(terrain_object *terrain) {
+  return terrain->stream ? terrain->stream->cellNum : (i32)heightMapImgSize.x;
+}
+
+inline u32 terrainLevelNum(terrain_object *terrain) {
+  return terrain->stream ? terrain->stream->levelNum
+                         : (u32)TERRAIN_MINMAX_LEVEL_NUM;
+}
+
+// Meters per cell along x and y
+inline v2 terrainCellSize(terrain_object *terrain) {
+  if (terrain->stream) {
+    f32 cellSize = terrain->stream->header.cellSize;
+    return (v2){cellSize, cellSize};
+  }
+  return (v2){heightMapScale.x, heightMapScale.y};
+}
+
+// Samples at the corners (x, y), (x + 1, y), (x, y + 1) and (x + 1, y + 1)
+// of the cell
+inline void terrainCellCorners(terrain_object *terrain, i32 x, i32 y,
+                               v4 *corners) {
+  if (terrain->stream) {
+    terrainStreamCellCorners(terrain->stream, x, y, corners);
+    return;
+  }
+  i32 size = heightMapImgSize.x;
+  corners[0] = terrainSampleAt(terrain, size, x, y);
+  corners[1] = terrainSampleAt(terrain, size, x + 1, y);
+  corners[2] = terrainSampleAt(terrain, size, x, y + 1);
+  corners[3] = terrainSampleAt(terrain, size, x + 1, y + 1);
+}
+
+static void terrainBuildMinMax(terrain_object *terrain) {
+  i32 size = heightMapImgSize.x;
+  ASSERT((size >> TERRAIN_MINMAX_LEVEL_NUM) == 1);
+  // Level 1 from the 3x3 corners of each 2x2 cells
+  i32 n = size >> 1;
+  for (i32 y = 0; y < n; y++) {
+    for (i32 x = 0; x < n; x++) {
+      f32 lo = FLT_MAX;
+      f32 hi = -FLT_MAX;
+      for (i32 dy = 0; dy <= 2; dy++) {
+        for (i32 dx = 0; dx <= 2; dx++) {
+          f32 h = terrainHeightAt(terrain, size, 2 * x + dx, 2 * y + dy);
+          lo = MIN(lo, h);
+          hi = MAX(hi, h);
+        }
+      }
+      terrain->minMax[0][y * n + x] = (v2){lo, hi};
+    }
+  }
+  for (u32 level = 1; level < TERRAIN_MINMAX_LEVEL_NUM; level++) {
+    v2 *children = terrain->minMax[level - 1];
+    n = size >> (level + 1);
+    for (i32 y = 0; y < n; y++) {
+      for (i32 x = 0; x < n; x++) {
+        v2 a = children[(2 * y) * 2 * n + 2 * x];
+        v2 b = children[(2 * y) * 2 * n + 2 * x + 1];
+        v2 c = children[(2 * y + 1) * 2 * n + 2 * x];
+        v2 d = children[(2 * y + 1) * 2 * n + 2 * x + 1];
+        terrain->minMax[level][y * n + x] =
+          (v2){MIN(MIN(a.x, b.x), MIN(c.x, d.x)),
+               MAX(MAX(a.y, b.y), MAX(c.y, d.y))};
+      }
     }
   }
 }
 
-static f32 calcHeight(u8* pixels, i16 w, i16 h, i16 x, i16 y){
-  while (x < 0) x += w;
-  while (y < 0) y += h;
-  x = x % w;
-  y = y % h;
-  f32 height = getPixel(pixels, w, h, (v2i){x, y}).x;
-  // f32 noise1 = sinf(((f32)y / (f32)w) * PI) * 4.f;
-  // height += noise1;
+// Height range of the node at the level that has the cell x, y
+inline v2 terrainNodeMinMax(terrain_object *terrain, i32 size, u32 level,
+                            i32 x, i32 y) {
+  if (terrain->stream) {
+    return terrainStreamNodeMinMax(terrain->stream, level, x, y);
+  }
+  if (level == 0) {
+    f32 h00 = terrainHeightAt(terrain, size, x, y);
+    f32 h10 = terrainHeightAt(terrain, size, x + 1, y);
+    f32 h01 = terrainHeightAt(terrain, size, x, y + 1);
+    f32 h11 = terrainHeightAt(terrain, size, x + 1, y + 1);
+    return (v2){MIN(MIN(h00, h10), MIN(h01, h11)),
+                MAX(MAX(h00, h10), MAX(h01, h11))};
+  }
+  i32 n = size >> level;
+  i32 nodeX = terrainNodeIndex(x, level) & (n - 1);
+  i32 nodeY = terrainNodeIndex(y, level) & (n - 1);
+  return terrain->minMax[level - 1][nodeY * n + nodeX];
+}
 
-  return height;
+// Intersects the ray with the bilinear surface of one cell between
+// distances t0 and t1. The height along the ray is quadratic in the
+// distance, so is the gap between the ray and the surface.
+static b32 terrainCastCell(terrain_object *terrain, i32 cx, i32 cy,
+                           f32 ox, f32 oy, f32 dx, f32 dy, v3 origin,
+                           v3 direction, f32 lift, f32 t0, f32 t1,
+                           f32 *distance, v2 *uv) {
+  v4 corners[4];
+  terrainCellCorners(terrain, cx, cy, corners);
+  f32 h00 = corners[0].x + lift;
+  f32 h10 = corners[1].x + lift;
+  f32 h01 = corners[2].x + lift;
+  f32 h11 = corners[3].x + lift;
+  f32 B = h10 - h00;
+  f32 C = h01 - h00;
+  f32 E = h00 - h10 - h01 + h11;
+  f32 u0 = ox + dx * t0 - cx;
+  f32 v0 = oy + dy * t0 - cy;
+  f32 c = origin.z + direction.z * t0 - (h00 + B * u0 + C * v0 + E * u0 * v0);
+  f32 b = direction.z - (B * dx + C * dy + E * (u0 * dy + v0 * dx));
+  f32 a = -E * dx * dy;
+  f32 length = t1 - t0;
+
+  f32 s = -1.f;
+  if (c <= 0.f) {
+    s = 0.f;
+  } else if (fabsf(a) < 1e-12f) {
+    if (b < 0.f) {
+      s = -c / b;
+    }
+  } else {
+    f32 discriminant = b * b - 4.f * a * c;
+    if (discriminant >= 0.f) {
+      f32 q = -0.5f * (b + copysignf(sqrtf(discriminant), b));
+      f32 r0 = q / a;
+      f32 r1 = q != 0.f ? c / q : r0;
+      f32 lo = MIN(r0, r1);
+      f32 hi = MAX(r0, r1);
+      s = lo >= 0.f ? lo : hi;
+    }
+  }
+  if (!(s >= 0.f && s <= length)) {
+    return false;
+  }
+  *distance = t0 + s;
+  *uv = (v2){CLAMP(u0 + dx * s, 0.f, 1.f), CLAMP(v0 + dy * s, 0.f, 1.f)};
+  return true;
 }
 
-// Create normal map data from height map and embbed normal value
-// as g b a channels.
-static void embbedNormalMapData(rt_image_data img) {
-  i16 w = img.width, h = img.height;
-
-  for (i16 x = 0; x < w; x++) {
-    for (i16 y = 0; y < h; y++) {
-      f32 height = calcHeight((u8 *)img.pixels, w, h, x, y);
-
-      f32 l = calcHeight((u8 *)img.pixels, w, h, x - 1, y);
-      f32 b = calcHeight((u8 *)img.pixels, w, h, x, y + 1);
-      f32 r = calcHeight((u8 *)img.pixels, w, h, x + 1, y);
-      f32 t = calcHeight((u8 *)img.pixels, w, h, x, y - 1);
-
-      // Append normals as gba values
-      v3 A  = {0, 0, height * heightMapScale.z};
-      v3 B1 = {heightMapScale.y, 0, r * heightMapScale.z};
-      v3 B2 = {-heightMapScale.y, 0, l * heightMapScale.z};
-      v3 C1 = {0, heightMapScale.y, b * heightMapScale.z};
-      v3 C2 = {0, -heightMapScale.y, t * heightMapScale.z};
-      v3 n = LERP(calcNormal(A, B1, C1), calcNormal(A, B2, C2),0.5);
-
-      // Add normal map values as pixel g,b,a values.
-      setPixel((u8 *)img.pixels, w, h, (v2i){x, y},
-               {height, (n.x + 1.f) * 0.5f, (n.y + 1.f) * 0.5f,
-                (n.z + 1.f) * 0.5f});
+// Casts along the unit direction against the terrain surface raised by
+// lift. Starting under the surface is a hit at the origin.
+static b32 terrainCast(car_game_state *game, v3 origin, v3 direction,
+                       f32 maxDistance, f32 lift, terrain_hit *hit) {
+  terrain_object *terrain = &game->terrain;
+  i32 size = terrainGridSize(terrain);
+  v2 cellSize = terrainCellSize(terrain);
+  u32 levelNum = terrainLevelNum(terrain);
+  // Grid coordinates, x and y are in cells per meter of the ray
+  f32 ox = origin.x / cellSize.x + size * 0.5f;
+  f32 oy = origin.y / cellSize.y + size * 0.5f;
+  f32 dx = direction.x / cellSize.x;
+  f32 dy = direction.y / cellSize.y;
+  i32 cx = (i32)floorf(ox);
+  i32 cy = (i32)floorf(oy);
+
+  u32 level = levelNum;
+  f32 t = 0.f;
+  f32 distance;
+  v2 uv;
+  for (;;) {
+    i32 nodeSize = 1 << level;
+    i32 x0 = terrainNodeIndex(cx, level) * nodeSize;
+    i32 y0 = terrainNodeIndex(cy, level) * nodeSize;
+    f32 exitX = dx > 0.f ? (x0 + nodeSize - ox) / dx
+      : dx < 0.f ? (x0 - ox) / dx : FLT_MAX;
+    f32 exitY = dy > 0.f ? (y0 + nodeSize - oy) / dy
+      : dy < 0.f ? (y0 - oy) / dy : FLT_MAX;
+    f32 exit = MIN(MIN(exitX, exitY), maxDistance);
+    f32 lowest = origin.z + direction.z * (direction.z < 0.f ? exit : t);
+    v2 range = terrainNodeMinMax(terrain, size, level, cx, cy);
+    if (lowest <= range.y + lift) {
+      if (level > 0) {
+        level--;
+        continue;
+      }
+      if (terrainCastCell(terrain, cx, cy, ox, oy, dx, dy, origin,
+                          direction, lift, t, exit, &distance, &uv)) {
+        break;
+      }
+    }
+    if (exit >= maxDistance) {
+      return false;
     }
+    // Over to the next node through the face the ray leaves from
+    t = exit;
+    if (exitX <= exitY) {
+      cx = dx > 0.f ? x0 + nodeSize : x0 - 1;
+      cy = CLAMP((i32)floorf(oy + dy * t), y0, y0 + nodeSize - 1);
+    } else {
+      cy = dy > 0.f ? y0 + nodeSize : y0 - 1;
+      cx = CLAMP((i32)floorf(ox + dx * t), x0, x0 + nodeSize - 1);
+    }
+    level = MIN(level + 1, levelNum);
   }
+
+  // Normals are interpolated the same way as in getGeometryHeight
+  v4 c[4];
+  terrainCellCorners(terrain, cx, cy, c);
+  v3 aN = (v3){c[0].y, c[0].z, c[0].w} * (1.f - uv.u) +
+    (v3){c[1].y, c[1].z, c[1].w} * uv.u;
+  v3 bN = (v3){c[2].y, c[2].z, c[2].w} * (1.f - uv.u) +
+    (v3){c[3].y, c[3].z, c[3].w} * uv.u;
+  hit->distance = distance;
+  hit->point = origin + direction * distance;
+  hit->normal = aN * (1.f - uv.v) + bN * uv.v;
+  return true;
+}
+
+// direction must be of unit length
+static b32 terrainRaycast(car_game_state *game, v3 origin, v3 direction,
+                          f32 maxDistance, terrain_hit *hit) {
+  return terrainCast(game, origin, direction, maxDistance, 0.f, hit);
+}
+
+// Same contact rule as the wheel CCD: the sphere touches the terrain when
+// its center is radius above the surface, measured vertically.
+static b32 terrainSphereCast(car_game_state *game, v3 origin, v3 direction,
+                             f32 radius, f32 maxDistance, terrain_hit *hit) {
+  return terrainCast(game, origin, direction, maxDistance, radius, hit);
+}
+
+static const char *terrainHeightMapPath = "assets/cell_noise.png";
+static const char *terrainCachePath = "assets/cell_noise.bake";
+
+// Hills of the procedural terrain, below the start of the car so it
+// spawns above them
+static terrain_generator terrainProceduralGenerator() {
+  terrain_generator generator = {};
+  generator.noise = (noise_fractal){noise_basis_simplex, noise_fractal_fbm,
+                                    5, 1.f / 200.f, 2.f, 0.5f, 40.f, 1};
+  generator.heightScale = 6.f;
+  generator.baseHeight = -52.f;
+  return generator;
+}
+
+// Decodes the height map and bakes it to the normal embedded image, the
+// terrain and geometry grid meshes and the collision geometry
+static void terrainBake(terrain_object *terrain, memory_arena *tempArena,
+                        terrain_bake_data *bake) {
+  rt_image_data heightMapImg = platformApi->loadImage(terrainHeightMapPath, 4);
+  ASSERT(heightMapImg.width == heightMapImgSize.x &&
+         heightMapImg.height == heightMapImgSize.y);
+  // Physics is locked, the bake can use the worker queue
+  terrainBakeNormals(heightMapImg, tempArena);
+  bake->heightMapImg = heightMapImg;
+  bake->terrainMesh =
+    mesh_GridShape(tempArena, terrainMeshGridSizeX, terrainMeshGridSizeY,
+                   terrainMeshCellNumX, terrainMeshCellNumY, false, false,
+                   rt_primitive_triangles);
+  bake->geometryMesh = mesh_GridShape(
+    tempArena, geometrySize.x, geometrySize.y, heightMapImg.width,
+    heightMapImg.height, false, false, rt_primitive_lines);
+  // The geometry is the height map scaled down by heightMapScale.z
+  terrainSetHeightRange(terrain, -heightMapScale.z, 0.f);
+  terrainBakeGeometry(heightMapImg, (v3 *)bake->geometryMesh.vertexData,
+                      terrain, tempArena);
+  bake->samples = terrain->samples;
+  bake->heightMin = terrain->heightMin;
+  bake->heightStep = terrain->heightStep;
 }
 
 static void createTerrain(car_game_state *game,
@@ -176,7 +446,62 @@ static void createTerrain(car_game_state *game,
   // Terrain images and samplers
   if (terrain->terrain_model.terrainTexHandle == 0) {
     rt_image_data terrainImgData = platformApi->loadImage("assets/sand_base.png", 4);
-    rt_image_data heightMapImg = platformApi->loadImage("assets/cell_noise.png", 4);
+
+    u64 bakeBegin = platformApi->getPerformanceCounter();
+    terrain_cache_key cacheKey;
+    memset(&cacheKey, 0, sizeof(cacheKey));
+    cacheKey.sourceModTime =
+      (i64)platformApi->readFileModTime(terrainHeightMapPath);
+    cacheKey.imageWidth = (i32)heightMapImgSize.x;
+    cacheKey.imageHeight = (i32)heightMapImgSize.y;
+    cacheKey.heightMapScale = heightMapScale;
+    cacheKey.meshGridSize = (v2){terrainMeshGridSizeX, terrainMeshGridSizeY};
+    cacheKey.meshCellNum = (v2){terrainMeshCellNumX, terrainMeshCellNumY};
+    terrain_bake_data bake;
+    b32 procedural = platformApi->proceduralTerrain;
+    const char *tilesPath = procedural ? NULL : platformApi->terrainTilesPath;
+    b32 streamed = procedural || tilesPath;
+    usize sampleNum = (usize)cacheKey.imageWidth * cacheKey.imageHeight;
+    terrain->cacheFile = terrainCacheLoad(terrainCachePath, &cacheKey, &bake,
+                                          &terrain->cacheFileSize);
+    if (terrain->cacheFile) {
+      if (!streamed) {
+        memcpy(terrain->samples, bake.samples,
+               sampleNum * sizeof(terrain_sample));
+      }
+      terrain->heightMin = bake.heightMin;
+      terrain->heightStep = bake.heightStep;
+    } else {
+      if (streamed) {
+        // Only a tile file keeps the collision geometry
+        terrain->samples = pushArray(tempArena, sampleNum, terrain_sample);
+      }
+      terrainBake(terrain, tempArena, &bake);
+      if (!terrainCacheWrite(terrainCachePath, &cacheKey, &bake)) {
+        LOG(LOG_LEVEL_WARN, "Can't write terrain cache %s", terrainCachePath);
+      }
+    }
+    if (streamed) {
+      // Missing, older than the image or of another version
+      if (tilesPath &&
+          (platformApi->readFileModTime(tilesPath) < cacheKey.sourceModTime ||
+           !terrainStreamCheckFile(tilesPath))) {
+        terrain->samples = bake.samples;
+        if (!terrainStreamWriteTiles(terrain, cacheKey.imageWidth, tilesPath,
+                                     terrainStreamTileSize, tempArena)) {
+          LOG(LOG_LEVEL_ERROR, "Can't write terrain tiles %s", tilesPath);
+        }
+      }
+      terrain->samples = NULL;
+    } else {
+      terrainBuildMinMax(terrain);
+    }
+    LOG(LOG_LEVEL_DEBUG, "terrain %s in %.1f ms",
+        terrain->cacheFile ? "loaded from cache" : "baked",
+        (platformApi->getPerformanceCounter() - bakeBegin) * 1000.0 /
+        platformApi->getPerformanceFrequency());
+
+    rt_image_data heightMapImg = bake.heightMapImg;
     {
       rt_command_create_texture *cmd = rt_pushRenderCommandArray(
         rendererBuffer, create_texture, 2);
@@ -188,16 +513,11 @@ static void createTerrain(car_game_state *game,
       cmd++;
       cmd->image[0] = terrainImgData;
       cmd->imageHandle = &terrain->terrain_model.terrainTexHandle;
-
-      embbedNormalMapData(heightMapImg);
     }
 
     // Terrain mesh
     {
-      mesh_data terrainMeshData =
-        mesh_GridShape(tempArena, terrainMeshGridSizeX, terrainMeshGridSizeY,
-                       terrainMeshCellNumX, terrainMeshCellNumY, false, false,
-                       rt_primitive_triangles);
+      mesh_data terrainMeshData = bake.terrainMesh;
 
       rt_command_create_vertex_buffer *cmd = rt_pushRenderCommand(
         rendererBuffer, create_vertex_buffer);
@@ -219,11 +539,7 @@ static void createTerrain(car_game_state *game,
     }
     // Terrain geometry mesh
     {
-      mesh_data geometryMeshData = mesh_GridShape(
-        tempArena, geometrySize.x, geometrySize.y, heightMapImg.width,
-        heightMapImg.height, false, false, rt_primitive_lines);
-      updateGeometryMesh(terrain, (v3 *)geometryMeshData.vertexData,
-                         terrain->geometry);
+      mesh_data geometryMeshData = bake.geometryMesh;
       terrain->geometry_model.elementNum = geometryMeshData.indexNum;
       {
         rt_command_create_vertex_buffer *cmd = rt_pushRenderCommand(
@@ -244,6 +560,24 @@ static void createTerrain(car_game_state *game,
       }
     }
   }
+  if (platformApi->proceduralTerrain || platformApi->terrainTilesPath) {
+    // Opened again on a reload too, the permanent memory taken after it
+    // has to stay in place
+    terrainStreamClose(game);
+    b32 opened;
+    if (platformApi->proceduralTerrain) {
+      terrain_generator generator = terrainProceduralGenerator();
+      opened = terrainStreamOpenProcedural(
+        game, permanentArena, &generator, terrainStreamTileSize,
+        platformApi->terrainTileNum, heightMapScale.x,
+        platformApi->terrainTileBudget);
+    } else {
+      opened = terrainStreamOpen(game, permanentArena,
+                                 platformApi->terrainTilesPath,
+                                 platformApi->terrainTileBudget);
+    }
+    ASSERT(opened);
+  }
   // Terrain pipelines and shaders
   rt_shader_data terrainShader =
     importShader(tempArena, "./assets/shaders/terrain.vs",
@@ -456,7 +790,7 @@ static void renderTerrain(car_game_state *game, memory_arena *tempArena,
     v3 *lines = pushArray(tempArena, lineNumTotal, v3);
 
     u32 idx = 0;
-    v3 carPosition = game->car.body.chassis.position - game->camera.position;
+    v3 carPosition = game->world.renderPosition[game->car.chassis] - game->camera.position;
     for (u32 x = 0.f; x < lineNum; x++) {
       for (u32 y = 0.f; y < lineNum; y++) {
         v3 pos = {(f32)carPosition.x + x * lineSpace -
@@ -485,11 +819,22 @@ static void renderTerrain(car_game_state *game, memory_arena *tempArena,
   }
 }
 
+// A streamed terrain has no height map for the physics, the tile slots
+// are taken in createTerrain
 static void allocTerrain(
   car_game_state *game,
   memory_arena *permanentArea) {
-  game->terrain.geometry = pushArray(permanentArea, 
-                                     heightMapImgSize.x * heightMapImgSize.y, v4); 
+  if (platformApi &&
+      (platformApi->terrainTilesPath || platformApi->proceduralTerrain)) {
+    return;
+  }
+  game->terrain.samples = pushArray(permanentArea,
+                                    heightMapImgSize.x * heightMapImgSize.y,
+                                    terrain_sample);
+  for (u32 level = 1; level <= TERRAIN_MINMAX_LEVEL_NUM; level++) {
+    u32 n = (u32)heightMapImgSize.x >> level;
+    game->terrain.minMax[level - 1] = pushArray(permanentArea, n * n, v2);
+  }
 }
 
 static void terrainInit(car_game_state *game,
@@ -0,0 +1,270 @@
+#include "all.h"
+// Height map bake.
+//
+// At startup the height map image gets its normals embedded to the g, b
+// and a channels, and the smoothed collision geometry is built from the
+// image. Both stages split the rows to bands that run on the worker
+// queue. A band keeps three decoded rows, the row it bakes and the rows
+// above and below it, so each pixel is converted from bytes once per band
+// instead of once per neighbour. The decoded rows are padded with the
+// wrapped pixel on both ends and the math runs SIMD_WIDTH pixels at a time
+// with the same float operations as the per pixel version, the baked
+// bytes and geometry don't change.
+//
+// The normal stage reads only the r channel and writes only g, b and a,
+// so its bands can share the rows on their edges.
+
+#define TERRAIN_BAKE_MAX_TASKS 32
+#define TERRAIN_BAKE_MIN_ROWS 64
+// Three decoded rows of four channels and four output rows
+#define TERRAIN_BAKE_TASK_ROWS 16
+
+typedef enum terrain_bake_stage {
+  terrain_bake_stage_normals,
+  terrain_bake_stage_geometry,
+} terrain_bake_stage;
+
+typedef struct terrain_bake_context {
+  u8* pixels;
+  i32 width;
+  i32 height;
+  // Floats per scratch row, fits the padding and the last wide load
+  i32 stride;
+  v3* meshVertices;
+  terrain_object* terrain;
+} terrain_bake_context;
+
+// Index i holds the pixel x = i - 1
+typedef struct terrain_bake_row {
+  f32* height;
+  f32* normalX;
+  f32* normalY;
+  f32* normalZ;
+} terrain_bake_row;
+
+typedef struct terrain_bake_task {
+  terrain_bake_context* context;
+  terrain_bake_stage stage;
+  i32 rowBegin;
+  i32 rowEnd;
+  f32* scratch;
+} terrain_bake_task;
+
+inline i32 terrainBakeWrap(i32 v, i32 size) {
+  return v < 0 ? v + size : v >= size ? v - size : v;
+}
+
+// The normals are decoded only for the geometry stage, mapped back to
+// -1..1 and normalized.
+static void terrainBakeDecodeRow(terrain_bake_context* context, i32 y,
+                                 b32 normals, terrain_bake_row* row) {
+  i32 width = context->width;
+  u8* pixels = context->pixels + 4 * width * y;
+  for (i32 i = 0; i < width + 2; i++) {
+    u8* p = pixels + 4 * terrainBakeWrap(i - 1, width);
+    row->height[i] = (f32)p[0] / 255.f;
+    if (normals) {
+      row->normalX[i] = (f32)p[1] / 255.f;
+      row->normalY[i] = (f32)p[2] / 255.f;
+      row->normalZ[i] = (f32)p[3] / 255.f;
+    }
+  }
+  if (!normals) {
+    return;
+  }
+  f32w one = f32w_splat(1.f);
+  f32w two = f32w_splat(2.f);
+  for (i32 i = 0; i < width + 2; i += SIMD_WIDTH) {
+    v3w n = {f32w_loadu(row->normalX + i), f32w_loadu(row->normalY + i),
+             f32w_loadu(row->normalZ + i)};
+    n.x = f32w_sub(f32w_mul(n.x, two), one);
+    n.y = f32w_sub(f32w_mul(n.y, two), one);
+    n.z = f32w_sub(f32w_mul(n.z, two), one);
+    n = v3w_normalize(n);
+    f32w_store(row->normalX + i, n.x);
+    f32w_store(row->normalY + i, n.y);
+    f32w_store(row->normalZ + i, n.z);
+  }
+}
+
+// Averages the normals of the two triangle pairs around each pixel
+static void terrainBakeNormalRow(terrain_bake_context* context, i32 y,
+                                 terrain_bake_row* up, terrain_bake_row* row,
+                                 terrain_bake_row* down, f32** out) {
+  f32w zero = f32w_zero();
+  f32w one = f32w_splat(1.f);
+  f32w half = f32w_splat(0.5f);
+  f32w byteMax = f32w_splat(255.f);
+  f32w scaleY = f32w_splat(heightMapScale.y);
+  f32w negScaleY = f32w_splat(-heightMapScale.y);
+  f32w scaleZ = f32w_splat(heightMapScale.z);
+  i32 width = context->width;
+  for (i32 x = 0; x < width; x += SIMD_WIDTH) {
+    f32w h = f32w_loadu(row->height + x + 1);
+    f32w l = f32w_loadu(row->height + x);
+    f32w r = f32w_loadu(row->height + x + 2);
+    f32w b = f32w_loadu(down->height + x + 1);
+    f32w t = f32w_loadu(up->height + x + 1);
+
+    v3w a = {zero, zero, f32w_mul(h, scaleZ)};
+    v3w b1 = {scaleY, zero, f32w_mul(r, scaleZ)};
+    v3w b2 = {negScaleY, zero, f32w_mul(l, scaleZ)};
+    v3w c1 = {zero, scaleY, f32w_mul(b, scaleZ)};
+    v3w c2 = {zero, negScaleY, f32w_mul(t, scaleZ)};
+    v3w n1 = v3w_normalize(v3w_cross(v3w_sub(b1, a), v3w_sub(c1, a)));
+    v3w n2 = v3w_normalize(v3w_cross(v3w_sub(b2, a), v3w_sub(c2, a)));
+    v3w n = v3w_add(n1, v3w_scale(v3w_sub(n2, n1), half));
+
+    f32w_store(out[0] + x, f32w_mul(f32w_mul(f32w_add(n.x, one), half),
+                                    byteMax));
+    f32w_store(out[1] + x, f32w_mul(f32w_mul(f32w_add(n.y, one), half),
+                                    byteMax));
+    f32w_store(out[2] + x, f32w_mul(f32w_mul(f32w_add(n.z, one), half),
+                                    byteMax));
+  }
+  u8* pixels = context->pixels + 4 * width * y;
+  for (i32 x = 0; x < width; x++) {
+    u8* p = pixels + 4 * x;
+    p[1] = (u8)out[0][x];
+    p[2] = (u8)out[1][x];
+    p[3] = (u8)out[2][x];
+  }
+}
+
+// Smooths the height and the normal of each pixel with its four
+// neighbours
+static void terrainBakeGeometryRow(terrain_bake_context* context, i32 y,
+                                   terrain_bake_row* up,
+                                   terrain_bake_row* row,
+                                   terrain_bake_row* down, f32** out) {
+  f32w five = f32w_splat(5.f);
+  f32w scaleZ = f32w_splat(heightMapScale.z);
+  i32 width = context->width;
+  for (i32 x = 0; x < width; x += SIMD_WIDTH) {
+    f32w h = f32w_add(f32w_add(f32w_add(f32w_add(
+      f32w_loadu(row->height + x + 1), f32w_loadu(row->height + x + 2)),
+      f32w_loadu(row->height + x)), f32w_loadu(down->height + x + 1)),
+      f32w_loadu(up->height + x + 1));
+    h = f32w_div(h, five);
+    f32w_store(out[0] + x, f32w_sub(f32w_mul(h, scaleZ), scaleZ));
+
+    f32* center[3] = {row->normalX, row->normalY, row->normalZ};
+    f32* above[3] = {up->normalX, up->normalY, up->normalZ};
+    f32* below[3] = {down->normalX, down->normalY, down->normalZ};
+    for (u32 c = 0; c < 3; c++) {
+      f32w n = f32w_add(f32w_add(f32w_add(f32w_add(
+        f32w_loadu(center[c] + x + 1), f32w_loadu(center[c] + x + 2)),
+        f32w_loadu(center[c] + x)), f32w_loadu(below[c] + x + 1)),
+        f32w_loadu(above[c] + x + 1));
+      f32w_store(out[c + 1] + x, f32w_div(n, five));
+    }
+  }
+  v3* meshVertices = context->meshVertices + width * y;
+  terrain_object* terrain = context->terrain;
+  for (i32 x = 0; x < width; x++) {
+    f32 z = out[0][x];
+    meshVertices[x].z = z;
+    terrain->samples[terrainSampleIndex(width, x, y)] = terrainPackSample(
+      terrain, z, (v3){out[1][x], out[2][x], out[3][x]});
+  }
+}
+
+static void terrainBakeRunTask(terrain_bake_task* task) {
+  terrain_bake_context* context = task->context;
+  i32 stride = context->stride;
+  b32 normals = task->stage == terrain_bake_stage_geometry;
+  terrain_bake_row rows[3];
+  f32* scratch = task->scratch;
+  for (u32 i = 0; i < 3; i++) {
+    rows[i].height = scratch;
+    rows[i].normalX = scratch + stride;
+    rows[i].normalY = scratch + 2 * stride;
+    rows[i].normalZ = scratch + 3 * stride;
+    scratch += 4 * stride;
+  }
+  f32* out[4] = {scratch, scratch + stride, scratch + 2 * stride,
+                 scratch + 3 * stride};
+
+  i32 begin = task->rowBegin;
+  i32 height = context->height;
+  terrainBakeDecodeRow(context, terrainBakeWrap(begin - 1, height), normals,
+                       rows);
+  terrainBakeDecodeRow(context, begin, normals, rows + 1);
+  for (i32 y = begin; y < task->rowEnd; y++) {
+    terrain_bake_row* up = rows + (y - begin) % 3;
+    terrain_bake_row* row = rows + (y - begin + 1) % 3;
+    terrain_bake_row* down = rows + (y - begin + 2) % 3;
+    terrainBakeDecodeRow(context, terrainBakeWrap(y + 1, height), normals,
+                         down);
+    if (task->stage == terrain_bake_stage_normals) {
+      terrainBakeNormalRow(context, y, up, row, down, out);
+    } else {
+      terrainBakeGeometryRow(context, y, up, row, down, out);
+    }
+  }
+}
+
+static RT_WORK_CALLBACK(terrainBakeTaskCallback) {
+  terrainBakeRunTask((terrain_bake_task*)data);
+}
+
+// Uses the worker queue when the platform has one, the caller must be the
+// only thread adding work to it.
+static void terrainBakeRunStage(terrain_bake_context* context,
+                                terrain_bake_stage stage,
+                                memory_arena* tempArena) {
+  u32 taskNum = platformApi->workQueue ?
+    MIN(platformApi->workerThreadNum + 1,
+        (u32)context->height / TERRAIN_BAKE_MIN_ROWS) : 1;
+  taskNum = CLAMP(taskNum, 1u, (u32)TERRAIN_BAKE_MAX_TASKS);
+  context->stride = (context->width + SIMD_WIDTH - 1) / SIMD_WIDTH *
+    SIMD_WIDTH + SIMD_WIDTH;
+  usize taskFloats = (usize)TERRAIN_BAKE_TASK_ROWS * context->stride;
+  f32* scratch = pushArrayAligned(tempArena, taskNum * taskFloats, f32,
+                                  SIMD_ALIGNMENT);
+  memset(scratch, 0, taskNum * taskFloats * sizeof(f32));
+
+  terrain_bake_task tasks[TERRAIN_BAKE_MAX_TASKS];
+  i32 rowsPerTask = context->height / (i32)taskNum;
+  for (u32 i = 0; i < taskNum; i++) {
+    i32 rowBegin = (i32)i * rowsPerTask;
+    i32 rowEnd = i == taskNum - 1 ? context->height : rowBegin + rowsPerTask;
+    tasks[i] = (terrain_bake_task){context, stage, rowBegin, rowEnd,
+                                   scratch + i * taskFloats};
+    if (i > 0) {
+      platformApi->addWork(platformApi->workQueue, terrainBakeTaskCallback,
+                           tasks + i);
+    }
+  }
+  terrainBakeRunTask(tasks);
+  if (taskNum > 1) {
+    platformApi->completeAllWork(platformApi->workQueue);
+  }
+}
+
+// Create normal map data from height map and embbed normal value
+// as g b a channels.
+static void terrainBakeNormals(rt_image_data img, memory_arena* tempArena) {
+  terrain_bake_context context = {};
+  context.pixels = (u8*)img.pixels;
+  context.width = img.width;
+  context.height = img.height;
+  terrainBakeRunStage(&context, terrain_bake_stage_normals, tempArena);
+}
+
+// NOTE: This assumes that geometry grid vertex count is same
+//       as the heightmap pixel count. The height range of the terrain
+//       has to be set before.
+static void terrainBakeGeometry(rt_image_data img, v3* meshVertices,
+                                terrain_object* terrain,
+                                memory_arena* tempArena) {
+  ASSERT(img.width == img.height && (img.width & (img.width - 1)) == 0 &&
+         img.width >= TERRAIN_SAMPLE_TILE);
+  terrain_bake_context context = {};
+  context.pixels = (u8*)img.pixels;
+  context.width = img.width;
+  context.height = img.height;
+  context.meshVertices = meshVertices;
+  context.terrain = terrain;
+  terrainBakeRunStage(&context, terrain_bake_stage_geometry, tempArena);
+}
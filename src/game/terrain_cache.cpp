@@ -0,0 +1,143 @@
+#include "all.h"
+// Baked terrain cache.
+//
+// Decoding the height map png, embedding its normals and building the two
+// grid meshes only has to happen when the image or the bake parameters
+// change. The bake is written to a cache file (terrain_cache_header) and
+// the next start maps it and gives the renderer pointers into the mapping,
+// only the packed collision samples are copied out. The key holds the image
+// modification time and the parameters, any mismatch bakes again.
+
+#define TERRAIN_CACHE_ALIGNMENT 64
+
+static b32 terrainCacheKeyEqual(terrain_cache_key *a, terrain_cache_key *b) {
+  return a->sourceModTime == b->sourceModTime &&
+    a->imageWidth == b->imageWidth && a->imageHeight == b->imageHeight &&
+    memcmp(&a->heightMapScale, &b->heightMapScale, sizeof(v3)) == 0 &&
+    memcmp(&a->meshGridSize, &b->meshGridSize, sizeof(v2)) == 0 &&
+    memcmp(&a->meshCellNum, &b->meshCellNum, sizeof(v2)) == 0;
+}
+
+static b32 terrainCacheWrite(const char *path, terrain_cache_key *key,
+                             terrain_bake_data *data) {
+  terrain_cache_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = TERRAIN_CACHE_MAGIC;
+  header.version = TERRAIN_CACHE_VERSION;
+  header.key = *key;
+  header.terrainIndexNum = data->terrainMesh.indexNum;
+  header.geometryIndexNum = data->geometryMesh.indexNum;
+  header.heightMin = data->heightMin;
+  header.heightStep = data->heightStep;
+
+  usize pixelNum = (usize)key->imageWidth * key->imageHeight;
+  const void *sectionData[_terrain_cache_section_num] = {
+    data->heightMapImg.pixels,
+    data->terrainMesh.vertexData,
+    data->terrainMesh.indices,
+    data->geometryMesh.vertexData,
+    data->geometryMesh.indices,
+    data->samples,
+  };
+  usize sectionSize[_terrain_cache_section_num] = {
+    pixelNum * 4,
+    data->terrainMesh.vertexDataSize,
+    data->terrainMesh.indexDataSize,
+    data->geometryMesh.vertexDataSize,
+    data->geometryMesh.indexDataSize,
+    pixelNum * sizeof(terrain_sample),
+  };
+
+  // Header, then padding and data of every section
+  static const u8 padding[TERRAIN_CACHE_ALIGNMENT] = {};
+  rt_file_chunk chunks[1 + 2 * _terrain_cache_section_num];
+  u32 chunkNum = 1;
+  u64 offset = sizeof(terrain_cache_header);
+  for (u32 i = 0; i < _terrain_cache_section_num; i++) {
+    u64 aligned = alignForward(offset, TERRAIN_CACHE_ALIGNMENT);
+    chunks[chunkNum++] = (rt_file_chunk){padding, (usize)(aligned - offset)};
+    chunks[chunkNum++] = (rt_file_chunk){sectionData[i], sectionSize[i]};
+    header.sectionOffset[i] = aligned;
+    header.sectionSize[i] = sectionSize[i];
+    offset = aligned + sectionSize[i];
+  }
+  chunks[0] = (rt_file_chunk){&header, sizeof(header)};
+  return platformApi->writeBinaryFile(path, chunks, chunkNum);
+}
+
+// Maps the cache and points data to it when it was baked with key.
+// Returns the mapping that has to stay alive as long as data is used, or
+// NULL when the cache is missing, stale or broken.
+static void *terrainCacheLoad(const char *path, terrain_cache_key *key,
+                              terrain_bake_data *data, usize *fileSizeOut) {
+  usize fileSize = 0;
+  u8 *file = (u8 *)platformApi->mapFile(path, &fileSize);
+  if (!file) {
+    return NULL;
+  }
+  terrain_cache_header *header = (terrain_cache_header *)file;
+  b32 valid = fileSize >= sizeof(terrain_cache_header) &&
+    header->magic == TERRAIN_CACHE_MAGIC &&
+    header->version == TERRAIN_CACHE_VERSION &&
+    terrainCacheKeyEqual(&header->key, key);
+  for (u32 i = 0; valid && i < _terrain_cache_section_num; i++) {
+    u64 offset = header->sectionOffset[i];
+    u64 size = header->sectionSize[i];
+    valid = offset % TERRAIN_CACHE_ALIGNMENT == 0 &&
+      offset >= sizeof(terrain_cache_header) && size <= fileSize &&
+      offset <= fileSize - size;
+  }
+  u64 *sectionSize = header->sectionSize;
+  usize pixelNum = (usize)key->imageWidth * key->imageHeight;
+  valid = valid &&
+    sectionSize[terrain_cache_section_image] == pixelNum * 4 &&
+    sectionSize[terrain_cache_section_geometry] ==
+      pixelNum * sizeof(terrain_sample) &&
+    sectionSize[terrain_cache_section_terrain_indices] ==
+      (u64)header->terrainIndexNum * sizeof(u32) &&
+    sectionSize[terrain_cache_section_geometry_indices] ==
+      (u64)header->geometryIndexNum * sizeof(u32) &&
+    sectionSize[terrain_cache_section_terrain_vertices] % sizeof(v3) == 0 &&
+    sectionSize[terrain_cache_section_geometry_vertices] % sizeof(v3) == 0;
+  if (!valid) {
+    platformApi->unmapFile(file, fileSize);
+    return NULL;
+  }
+
+  u8 *section[_terrain_cache_section_num];
+  for (u32 i = 0; i < _terrain_cache_section_num; i++) {
+    section[i] = file + header->sectionOffset[i];
+  }
+  memset(data, 0, sizeof(terrain_bake_data));
+  rt_image_data *img = &data->heightMapImg;
+  img->width = (i16)key->imageWidth;
+  img->height = (i16)key->imageHeight;
+  img->depth = 3;
+  img->components = 4;
+  img->dataSize = (u32)sectionSize[terrain_cache_section_image];
+  img->pixels = section[terrain_cache_section_image];
+
+  mesh_data *mesh = &data->terrainMesh;
+  mesh->vertexData = (f32 *)section[terrain_cache_section_terrain_vertices];
+  mesh->indices = (u32 *)section[terrain_cache_section_terrain_indices];
+  mesh->vertexDataSize = sectionSize[terrain_cache_section_terrain_vertices];
+  mesh->indexDataSize = sectionSize[terrain_cache_section_terrain_indices];
+  mesh->vertexNum = (u32)(mesh->vertexDataSize / sizeof(v3));
+  mesh->vertexComponentNum = 3;
+  mesh->indexNum = header->terrainIndexNum;
+
+  mesh = &data->geometryMesh;
+  mesh->vertexData = (f32 *)section[terrain_cache_section_geometry_vertices];
+  mesh->indices = (u32 *)section[terrain_cache_section_geometry_indices];
+  mesh->vertexDataSize = sectionSize[terrain_cache_section_geometry_vertices];
+  mesh->indexDataSize = sectionSize[terrain_cache_section_geometry_indices];
+  mesh->vertexNum = (u32)(mesh->vertexDataSize / sizeof(v3));
+  mesh->vertexComponentNum = 3;
+  mesh->indexNum = header->geometryIndexNum;
+
+  data->samples = (terrain_sample *)section[terrain_cache_section_geometry];
+  data->heightMin = header->heightMin;
+  data->heightStep = header->heightStep;
+  *fileSizeOut = fileSize;
+  return file;
+}
@@ -0,0 +1,134 @@
+#include "all.h"
+// Packed height map samples.
+//
+// The physics queries read the height map as 32 bit samples
+// (terrain_sample), a quarter of the (height, normal) floats the bake
+// produces. The height is quantized to 16 bits over the height range of
+// the terrain. Height map normals always point up, so the normal is
+// encoded hemi-octahedral: projected to the octahedron, only the upper
+// half of which is used, and that half is rotated to fill the whole
+// square with 8 bits per axis. The axes map -1..1 to 0..254 so that the
+// flat normal decodes exactly.
+//
+// The samples are stored in tiles of 4x4, one cache line each, so the
+// four corners of a cell share a line in 9 cells of 16 and the cell
+// below doesn't sit a whole row away.
+//
+// Streamed tiles keep the same samples in rows, each tile with a height
+// range of its own (terrain_tile_info).
+
+// Step of the quantized heights that covers minHeight to maxHeight
+inline f32 terrainHeightStep(f32 minHeight, f32 maxHeight) {
+  return MAX(maxHeight - minHeight, 1e-3f) / 65535.f;
+}
+
+static void terrainSetHeightRange(terrain_object *terrain, f32 minHeight,
+                                  f32 maxHeight) {
+  terrain->heightMin = minHeight;
+  terrain->heightStep = terrainHeightStep(minHeight, maxHeight);
+}
+
+// Wraps x and y around the map like the height map texture, size is a
+// power of two
+inline u32 terrainSampleIndex(i32 size, i32 x, i32 y) {
+  u32 ux = (u32)x & (u32)(size - 1);
+  u32 uy = (u32)y & (u32)(size - 1);
+  u32 tile = uy / TERRAIN_SAMPLE_TILE * ((u32)size / TERRAIN_SAMPLE_TILE) +
+    ux / TERRAIN_SAMPLE_TILE;
+  return tile * TERRAIN_SAMPLE_TILE * TERRAIN_SAMPLE_TILE +
+    uy % TERRAIN_SAMPLE_TILE * TERRAIN_SAMPLE_TILE + ux % TERRAIN_SAMPLE_TILE;
+}
+
+inline u8 terrainQuantizeUnit(f32 v) {
+  return (u8)(CLAMP(v, -1.f, 1.f) * 127.f + 127.5f);
+}
+
+// Sample of the height quantized from heightMin in steps of heightStep
+static terrain_sample terrainEncodeSample(f32 heightMin, f32 heightStep,
+                                          f32 height, v3 normal) {
+  terrain_sample result;
+  f32 q = (height - heightMin) / heightStep + 0.5f;
+  result.height = (u16)CLAMP(q, 0.f, 65535.f);
+  f32 l1 = fabsf(normal.x) + fabsf(normal.y) + MAX(normal.z, 0.f);
+  f32 px = l1 > 0.f ? normal.x / l1 : 0.f;
+  f32 py = l1 > 0.f ? normal.y / l1 : 0.f;
+  result.normal = (u16)(terrainQuantizeUnit(px + py) |
+                        terrainQuantizeUnit(px - py) << 8);
+  return result;
+}
+
+static terrain_sample terrainPackSample(terrain_object *terrain, f32 height,
+                                        v3 normal) {
+  return terrainEncodeSample(terrain->heightMin, terrain->heightStep, height,
+                             normal);
+}
+
+inline f32 terrainDecodeHeight(f32 heightMin, f32 heightStep,
+                               terrain_sample sample) {
+  return heightMin + (f32)sample.height * heightStep;
+}
+
+inline f32 terrainUnpackHeight(terrain_object *terrain,
+                               terrain_sample sample) {
+  return terrainDecodeHeight(terrain->heightMin, terrain->heightStep, sample);
+}
+
+inline v3 terrainUnpackNormal(terrain_sample sample) {
+  f32 u = ((f32)(sample.normal & 0xff) - 127.f) * (1.f / 127.f);
+  f32 v = ((f32)(sample.normal >> 8) - 127.f) * (1.f / 127.f);
+  f32 px = (u + v) * 0.5f;
+  f32 py = (u - v) * 0.5f;
+  v3 n = {px, py, 1.f - fabsf(px) - fabsf(py)};
+  // The length is at least 1 / sqrt(3)
+  return n * (1.f / sqrtf(v3_dot(n, n)));
+}
+
+// SIMD_WIDTH samples, filled a lane at a time and decoded together. A
+// lane holds the height in the low half and the normal in the high half.
+typedef struct terrain_sample_wide {
+  u32 bits[SIMD_WIDTH];
+} terrain_sample_wide;
+
+inline void terrainSetSampleLane(terrain_sample_wide *w, u32 lane,
+                                 terrain_sample sample) {
+  w->bits[lane] = (u32)sample.height | (u32)sample.normal << 16;
+}
+
+// Same operations as terrainUnpackHeight
+inline f32w terrainUnpackHeightWide(terrain_object *terrain,
+                                    terrain_sample_wide *w) {
+  f32w height = f32w_fromBits(w->bits, 0, 0xffff);
+  return f32w_add(f32w_splat(terrain->heightMin),
+                  f32w_mul(height, f32w_splat(terrain->heightStep)));
+}
+
+// Same operations as terrainUnpackNormal
+inline v3w terrainUnpackNormalWide(terrain_sample_wide *w) {
+  f32w center = f32w_splat(127.f);
+  f32w scale = f32w_splat(1.f / 127.f);
+  f32w half = f32w_splat(0.5f);
+  f32w u = f32w_fromBits(w->bits, 16, 0xff);
+  f32w v = f32w_fromBits(w->bits, 24, 0xff);
+  u = f32w_mul(f32w_sub(u, center), scale);
+  v = f32w_mul(f32w_sub(v, center), scale);
+  v3w result;
+  result.x = f32w_mul(f32w_add(u, v), half);
+  result.y = f32w_mul(f32w_sub(u, v), half);
+  result.z = f32w_sub(f32w_sub(f32w_splat(1.f), f32w_abs(result.x)),
+                      f32w_abs(result.y));
+  f32w scaleN =
+    f32w_div(f32w_splat(1.f), f32w_sqrt(v3w_dot(result, result)));
+  return v3w_scale(result, scaleN);
+}
+
+// Sample as (height, normal)
+inline v4 terrainSampleAt(terrain_object *terrain, i32 size, i32 x, i32 y) {
+  terrain_sample sample = terrain->samples[terrainSampleIndex(size, x, y)];
+  v3 n = terrainUnpackNormal(sample);
+  return (v4){terrainUnpackHeight(terrain, sample), n.x, n.y, n.z};
+}
+
+inline f32 terrainHeightAt(terrain_object *terrain, i32 size, i32 x, i32 y) {
+  return terrainUnpackHeight(
+    terrain, terrain->samples[terrainSampleIndex(size, x, y)]);
+}
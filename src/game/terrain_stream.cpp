@@ -0,0 +1,720 @@
+#include "all.h"
+// Terrain streamed from a tile file or generated from noise.
+//
+// The whole tile file (terrain_tile_header) is mapped and the tiles are
+// copied to a fixed pool of slots as the cars move, so the memory taken
+// is set by the slot budget and the world size only by the file. The
+// pages of a copied tile are released where the platform can, elsewhere
+// they stay resident until the OS trims them. Tiles hold the packed
+// samples of terrain_sample.cpp, quantized over a height range per tile.
+// Procedural terrain has no file, a tile is generated from the noise of
+// the terrain_generator in place of the copy. At the start of every
+// physics step the tiles under the cars are loaded right away when
+// missing, and the tiles around the first car are queued to the
+// background loader ahead of time. The loader has several threads, each
+// load fills a slot of its own. When the pool is full, the tile needed
+// least recently is evicted.
+//
+// Slots only change in terrainStreamUpdate, so the queries of a step read
+// the same tiles whatever the loader is doing. Height queries read a tile
+// that isn't loaded as a flat plateau at its highest point, casts pass
+// over it as if it had no terrain.
+
+// Tiles closer than this to a car are loaded before the step
+static f32 terrainStreamRequiredDistance = 32.f;
+// Tiles closer than this to the first car are loaded in the background
+static f32 terrainStreamPrefetchDistance = 512.f;
+// Cells per tile side of the tile file the game writes
+static u32 terrainStreamTileSize = 64;
+
+// Tile size and count the stream can index
+static b32 terrainStreamCheckLayout(terrain_tile_header *header) {
+  u32 tileSize = header->tileSize;
+  u32 tileNum = header->tileNum;
+  return tileSize >= 2 && tileSize <= (1u << TERRAIN_TILE_MAX_LEVELS) &&
+    !(tileSize & (tileSize - 1)) && tileNum && !(tileNum & (tileNum - 1)) &&
+    (u64)tileSize * tileNum <= (1ull << TERRAIN_STREAM_MAX_LEVELS) &&
+    header->cellSize > 0.f;
+}
+
+static b32 terrainStreamCheckHeader(terrain_tile_header *header,
+                                    usize fileSize) {
+  if (fileSize < sizeof(terrain_tile_header) ||
+      header->magic != TERRAIN_TILE_MAGIC ||
+      header->version != TERRAIN_TILE_VERSION ||
+      !terrainStreamCheckLayout(header)) {
+    return false;
+  }
+  u32 tileSize = header->tileSize;
+  u32 tileNum = header->tileNum;
+  u64 sampleNum = (u64)(tileSize + 1) * (tileSize + 1);
+  u64 rangeEnd = sizeof(terrain_tile_header) +
+    (u64)tileNum * tileNum * sizeof(terrain_tile_info);
+  return header->tileStride >=
+      sampleNum * (sizeof(terrain_sample) + sizeof(u8)) &&
+    header->tileOffset >= rangeEnd &&
+    header->tileOffset + (u64)tileNum * tileNum * header->tileStride <=
+      fileSize;
+}
+
+// A tile file that terrainStreamOpen reads
+static b32 terrainStreamCheckFile(const char *path) {
+  usize fileSize = 0;
+  u8 *file = (u8 *)platformApi->mapFile(path, &fileSize);
+  if (!file) {
+    return false;
+  }
+  b32 valid = terrainStreamCheckHeader((terrain_tile_header *)file, fileSize);
+  platformApi->unmapFile(file, fileSize);
+  return valid;
+}
+
+// Range of the node x, y of a level from its four children in the level
+// below, n nodes per side
+inline v2 terrainStreamMergeRanges(v2 *children, u32 n, u32 x, u32 y) {
+  v2 a = children[(2 * y) * 2 * n + 2 * x];
+  v2 b = children[(2 * y) * 2 * n + 2 * x + 1];
+  v2 c = children[(2 * y + 1) * 2 * n + 2 * x];
+  v2 d = children[(2 * y + 1) * 2 * n + 2 * x + 1];
+  return (v2){MIN(MIN(a.x, b.x), MIN(c.x, d.x)),
+              MAX(MAX(a.y, b.y), MAX(c.y, d.y))};
+}
+
+// Floats per row of the generator heights, the tile and a sample on
+// every side in whole SIMD_WIDTH groups
+inline u32 terrainStreamHeightStride(u32 tileSize) {
+  return (tileSize + 3 + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+}
+
+// Bytes a slot takes for tiles of tileSize cells
+static usize terrainStreamSlotSize(u32 tileSize, b32 procedural) {
+  usize sampleNum = (usize)(tileSize + 1) * (tileSize + 1);
+  usize size = sampleNum * (sizeof(terrain_sample) + sizeof(u8));
+  for (u32 level = 1; (1u << level) < tileSize; level++) {
+    usize n = tileSize >> level;
+    size += n * n * sizeof(v2);
+  }
+  if (procedural) {
+    size += (usize)(tileSize + 3) * terrainStreamHeightStride(tileSize) *
+      sizeof(f32);
+  }
+  return size;
+}
+
+// Height and normal of a sample of the slot
+inline v4 terrainStreamDecodeSample(terrain_tile_slot *slot,
+                                    terrain_sample sample) {
+  v3 n = terrainUnpackNormal(sample);
+  return (v4){terrainDecodeHeight(slot->heightMin, slot->heightStep, sample),
+              n.x, n.y, n.z};
+}
+
+inline f32 terrainStreamSampleHeight(terrain_tile_slot *slot, usize idx) {
+  return terrainDecodeHeight(slot->heightMin, slot->heightStep,
+                             slot->samples[idx]);
+}
+
+// Writes the size x size height map of the terrain to a tile file of
+// tileSize cells per tile. The samples keep the quantization of the
+// height map, so the tiles decode to the same heights and normals. It's
+// all one material.
+static b32 terrainStreamWriteTiles(terrain_object *terrain, i32 size,
+                                   const char *path, u32 tileSize,
+                                   memory_arena *tempArena) {
+  const u32 pageSize = 4096;
+  u32 tileNum = (u32)size / tileSize;
+  u32 stride = tileSize + 1;
+  usize sampleNum = (usize)stride * stride;
+  usize dataSize = sampleNum * (sizeof(terrain_sample) + sizeof(u8));
+  usize rangeEnd = sizeof(terrain_tile_header) +
+    (usize)tileNum * tileNum * sizeof(terrain_tile_info);
+  terrain_tile_header header = {};
+  header.magic = TERRAIN_TILE_MAGIC;
+  header.version = TERRAIN_TILE_VERSION;
+  header.tileSize = tileSize;
+  header.tileNum = tileNum;
+  header.cellSize = heightMapScale.x;
+  header.tileStride = (u32)((dataSize + pageSize - 1) / pageSize * pageSize);
+  header.tileOffset = (rangeEnd + pageSize - 1) / pageSize * pageSize;
+  if (!terrainStreamCheckLayout(&header)) {
+    return false;
+  }
+
+  u8 *head = pushArrayZeros(tempArena, header.tileOffset, u8);
+  u8 *tiles =
+    pushArrayZeros(tempArena, (usize)tileNum * tileNum * header.tileStride, u8);
+  *(terrain_tile_header *)head = header;
+  terrain_tile_info *info =
+    (terrain_tile_info *)(head + sizeof(terrain_tile_header));
+  for (u32 ty = 0; ty < tileNum; ty++) {
+    for (u32 tx = 0; tx < tileNum; tx++) {
+      u32 idx = ty * tileNum + tx;
+      terrain_sample *samples =
+        (terrain_sample *)(tiles + (usize)idx * header.tileStride);
+      v2 range = {FLT_MAX, -FLT_MAX};
+      for (u32 j = 0; j < stride; j++) {
+        for (u32 i = 0; i < stride; i++) {
+          i32 x = (i32)(tx * tileSize + i);
+          i32 y = (i32)(ty * tileSize + j);
+          samples[j * stride + i] =
+            terrain->samples[terrainSampleIndex(size, x, y)];
+          f32 h = terrainHeightAt(terrain, size, x, y);
+          range.x = MIN(range.x, h);
+          range.y = MAX(range.y, h);
+        }
+      }
+      info[idx] = (terrain_tile_info){range, terrain->heightMin,
+                                      terrain->heightStep};
+    }
+  }
+  rt_file_chunk chunks[] = {
+    {head, header.tileOffset},
+    {tiles, (usize)tileNum * tileNum * header.tileStride},
+  };
+  return platformApi->writeBinaryFile(path, chunks, arrayLen(chunks));
+}
+
+// Takes the slots from the arena, as many as fit in budget bytes, and
+// builds the range levels above the tiles from the height range of every
+// tile in info. A height map stays allocated but the terrain queries read
+// the stream from now on.
+static terrain_stream *terrainStreamCreate(car_game_state *game,
+                                           memory_arena *arena,
+                                           terrain_tile_header *header,
+                                           const terrain_tile_info *info,
+                                           b32 procedural, usize budget) {
+  u32 tileSize = header->tileSize;
+  u32 tileShift = 0;
+  while ((1u << tileShift) < tileSize) tileShift++;
+  usize sampleNum = (usize)(tileSize + 1) * (tileSize + 1);
+  usize heightNum = (usize)(tileSize + 3) * terrainStreamHeightStride(tileSize);
+  u32 slotNum = (u32)(budget / terrainStreamSlotSize(tileSize, procedural));
+  if (slotNum == 0) {
+    LOG(LOG_LEVEL_ERROR, "Terrain tile budget of %zu bytes is below a tile",
+        budget);
+    return NULL;
+  }
+
+  terrain_stream *stream = pushType(arena, terrain_stream);
+  memset(stream, 0, sizeof(terrain_stream));
+  stream->header = *header;
+  stream->tileShift = tileShift;
+  stream->cellNum = (i32)(tileSize * header->tileNum);
+  while ((1 << stream->levelNum) < stream->cellNum) stream->levelNum++;
+
+  u32 tileNum = header->tileNum;
+  stream->tileSlot = pushArray(arena, tileNum * tileNum, u32);
+  for (u32 i = 0; i < tileNum * tileNum; i++) {
+    stream->tileSlot[i] = TERRAIN_TILE_NONE;
+  }
+  // The tile ranges stay in memory for the tiles that aren't
+  stream->minMax[0] = pushArray(arena, tileNum * tileNum, v2);
+  for (u32 i = 0; i < tileNum * tileNum; i++) {
+    stream->minMax[0][i] = info[i].range;
+  }
+  for (u32 level = 1; level <= stream->levelNum - tileShift; level++) {
+    u32 n = tileNum >> level;
+    stream->minMax[level] = pushArray(arena, n * n, v2);
+    for (u32 y = 0; y < n; y++) {
+      for (u32 x = 0; x < n; x++) {
+        stream->minMax[level][y * n + x] =
+          terrainStreamMergeRanges(stream->minMax[level - 1], n, x, y);
+      }
+    }
+  }
+
+  stream->slotNum = slotNum;
+  stream->slots = pushArray(arena, slotNum, terrain_tile_slot);
+  for (u32 i = 0; i < slotNum; i++) {
+    terrain_tile_slot *slot = stream->slots + i;
+    memset(slot, 0, sizeof(terrain_tile_slot));
+    slot->stream = stream;
+    slot->tile = TERRAIN_TILE_NONE;
+    slot->samples = pushArray(arena, sampleNum, terrain_sample);
+    slot->material = pushArray(arena, sampleNum, u8);
+    for (u32 level = 1; level < tileShift; level++) {
+      u32 n = tileSize >> level;
+      slot->minMax[level - 1] = pushArray(arena, n * n, v2);
+    }
+    if (procedural) {
+      slot->heights = pushArrayAligned(arena, heightNum, f32, SIMD_ALIGNMENT);
+    }
+  }
+
+  geometrySize = (v2){stream->cellNum * header->cellSize,
+                      stream->cellNum * header->cellSize};
+  game->terrain.stream = stream;
+  return stream;
+}
+
+// Maps the tile file and streams the terrain from it
+static b32 terrainStreamOpen(car_game_state *game, memory_arena *arena,
+                             const char *path, usize budget) {
+  usize fileSize = 0;
+  u8 *file = (u8 *)platformApi->mapFile(path, &fileSize);
+  if (!file) {
+    LOG(LOG_LEVEL_ERROR, "Can't map terrain tiles %s", path);
+    return false;
+  }
+  terrain_tile_header header = *(terrain_tile_header *)file;
+  if (!terrainStreamCheckHeader(&header, fileSize)) {
+    LOG(LOG_LEVEL_ERROR, "Invalid terrain tiles %s", path);
+    platformApi->unmapFile(file, fileSize);
+    return false;
+  }
+  terrain_stream *stream =
+    terrainStreamCreate(game, arena, &header,
+                        (terrain_tile_info *)(file + sizeof(terrain_tile_header)),
+                        false, budget);
+  if (!stream) {
+    platformApi->unmapFile(file, fileSize);
+    return false;
+  }
+  stream->file = file;
+  stream->fileSize = fileSize;
+  return true;
+}
+
+// Streams tileNum x tileNum tiles of tileSize cells that are generated
+// from the noise of the generator when loaded, nothing is read from disk.
+// The range of a tile is the whole height range of the generator until
+// the tile is generated.
+static b32 terrainStreamOpenProcedural(car_game_state *game,
+                                       memory_arena *arena,
+                                       terrain_generator *generator,
+                                       u32 tileSize, u32 tileNum,
+                                       f32 cellSize, usize budget) {
+  terrain_tile_header header = {};
+  header.magic = TERRAIN_TILE_MAGIC;
+  header.version = TERRAIN_TILE_VERSION;
+  header.tileSize = tileSize;
+  header.tileNum = tileNum;
+  header.cellSize = cellSize;
+  if (!terrainStreamCheckLayout(&header)) {
+    LOG(LOG_LEVEL_ERROR, "Invalid procedural terrain of %u tiles of %u cells",
+        tileNum, tileSize);
+    return false;
+  }
+  u32 infoNum = tileNum * tileNum;
+  terrain_tile_info *info = pushArray(arena, infoNum, terrain_tile_info);
+  f32 scale = fabsf(generator->heightScale);
+  v2 range = {generator->baseHeight - scale, generator->baseHeight + scale};
+  for (u32 i = 0; i < infoNum; i++) {
+    info[i] = (terrain_tile_info){range, range.x,
+                                  terrainHeightStep(range.x, range.y)};
+  }
+  terrain_stream *stream =
+    terrainStreamCreate(game, arena, &header, info, true, budget);
+  if (!stream) {
+    return false;
+  }
+  stream->generator = *generator;
+  return true;
+}
+
+// Waits for the queued loads and unmaps the file, the terrain queries go
+// back to the height map
+static void terrainStreamClose(car_game_state *game) {
+  terrain_stream *stream = game->terrain.stream;
+  if (!stream) {
+    return;
+  }
+  if (stream->queuedNum) {
+    platformApi->completeAllWork(platformApi->backgroundQueue);
+  }
+  if (stream->file) {
+    platformApi->unmapFile(stream->file, stream->fileSize);
+  }
+  game->terrain.stream = NULL;
+  geometrySize = (v2){heightMapImgSize.x * heightMapScale.x,
+                      heightMapImgSize.y * heightMapScale.y};
+}
+
+// Fills the slot with the samples of its tile from the generator. The
+// heights are sampled SIMD_WIDTH at a time with a border of one sample,
+// the normals are the central differences of the heights. The samples
+// are quantized over the height range of the tile. Samples are placed
+// like the height map: cell x is (x - cellNum / 2) * cellSize meters
+// from the origin. It's all one material.
+static void terrainStreamGenerate(terrain_stream *stream,
+                                  terrain_tile_slot *slot) {
+  terrain_generator *generator = &stream->generator;
+  i32 size = stream->header.tileSize;
+  i32 stride = size + 1;
+  i32 heightStride = (i32)terrainStreamHeightStride((u32)size);
+  i32 mask = stream->cellNum - 1;
+  f32 cellSize = stream->header.cellSize;
+  f32 half = stream->cellNum * 0.5f;
+  u32 tileNum = stream->header.tileNum;
+  i32 x0 = (i32)(slot->tile % tileNum) * size - 1;
+  i32 y0 = (i32)(slot->tile / tileNum) * size - 1;
+
+  f32w minusOne = f32w_splat(-1.f);
+  f32w one = f32w_splat(1.f);
+  f32w base = f32w_splat(generator->baseHeight);
+  f32w scale = f32w_splat(generator->heightScale);
+  for (i32 j = 0; j < size + 3; j++) {
+    f32w y = f32w_splat((((y0 + j) & mask) - half) * cellSize);
+    for (i32 i = 0; i < heightStride; i += SIMD_WIDTH) {
+      f32w x;
+      for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+        setLane(&x, lane, (((x0 + i + (i32)lane) & mask) - half) * cellSize);
+      }
+      f32w n = noiseSample2Wide(&generator->noise, x, y);
+      n = f32w_min(f32w_max(n, minusOne), one);
+      f32w_store(slot->heights + j * heightStride + i,
+                 f32w_add(base, f32w_mul(scale, n)));
+    }
+  }
+
+  f32 lo = FLT_MAX;
+  f32 hi = -FLT_MAX;
+  for (i32 j = 0; j < stride; j++) {
+    for (i32 i = 0; i < stride; i++) {
+      f32 h = slot->heights[(j + 1) * heightStride + i + 1];
+      lo = MIN(lo, h);
+      hi = MAX(hi, h);
+    }
+  }
+  slot->heightMin = lo;
+  slot->heightStep = terrainHeightStep(lo, hi);
+
+  f32 e = 2.f * cellSize;
+  for (i32 j = 0; j < stride; j++) {
+    for (i32 i = 0; i < stride; i++) {
+      f32 *h = slot->heights + (j + 1) * heightStride + i + 1;
+      v3 n = v3_normalize(
+        (v3){h[-1] - h[1], h[-heightStride] - h[heightStride], e});
+      slot->samples[j * stride + i] =
+        terrainEncodeSample(slot->heightMin, slot->heightStep, h[0], n);
+    }
+  }
+  memset(slot->material, 0, (usize)stride * stride);
+}
+
+// Copies a tile from the file or generates it to its slot and builds the
+// height ranges, on the background loader or on the physics thread
+static RT_WORK_CALLBACK(terrainStreamLoadTile) {
+  terrain_tile_slot *slot = (terrain_tile_slot *)data;
+  terrain_stream *stream = slot->stream;
+  i32 size = stream->header.tileSize;
+  i32 stride = size + 1;
+  usize sampleNum = (usize)stride * stride;
+  if (stream->file) {
+    terrain_tile_info *info =
+      (terrain_tile_info *)(stream->file + sizeof(terrain_tile_header)) +
+      slot->tile;
+    slot->heightMin = info->heightMin;
+    slot->heightStep = info->heightStep;
+    u8 *tile = stream->file + stream->header.tileOffset +
+      (usize)slot->tile * stream->header.tileStride;
+    memcpy(slot->samples, tile, sampleNum * sizeof(terrain_sample));
+    memcpy(slot->material, tile + sampleNum * sizeof(terrain_sample),
+           sampleNum);
+    // The copy is all that's needed from the file
+    if (platformApi->releaseMappedRange) {
+      platformApi->releaseMappedRange(tile, stream->header.tileStride);
+    }
+  } else {
+    terrainStreamGenerate(stream, slot);
+  }
+  v2 range = {FLT_MAX, -FLT_MAX};
+  for (usize i = 0; i < sampleNum; i++) {
+    f32 h = terrainStreamSampleHeight(slot, i);
+    range.x = MIN(range.x, h);
+    range.y = MAX(range.y, h);
+  }
+  slot->range = range;
+
+  if (stream->tileShift > 1) {
+    // Level 1 from the 3x3 samples of each 2x2 cells
+    i32 n = size >> 1;
+    for (i32 y = 0; y < n; y++) {
+      for (i32 x = 0; x < n; x++) {
+        f32 lo = FLT_MAX;
+        f32 hi = -FLT_MAX;
+        for (i32 dy = 0; dy <= 2; dy++) {
+          for (i32 dx = 0; dx <= 2; dx++) {
+            f32 h = terrainStreamSampleHeight(
+              slot, (usize)(2 * y + dy) * stride + 2 * x + dx);
+            lo = MIN(lo, h);
+            hi = MAX(hi, h);
+          }
+        }
+        slot->minMax[0][y * n + x] = (v2){lo, hi};
+      }
+    }
+  }
+  for (u32 level = 2; level < stream->tileShift; level++) {
+    u32 n = (u32)size >> level;
+    for (u32 y = 0; y < n; y++) {
+      for (u32 x = 0; x < n; x++) {
+        slot->minMax[level - 1][y * n + x] =
+          terrainStreamMergeRanges(slot->minMax[level - 2], n, x, y);
+      }
+    }
+  }
+  __atomic_store_n(&slot->loaded, 1, __ATOMIC_RELEASE);
+}
+
+// Puts the range of a loaded tile to the range levels, up to the top.
+// Only the physics thread changes the levels.
+static void terrainStreamSetTileRange(terrain_stream *stream, u32 tile,
+                                      v2 range) {
+  u32 tileNum = stream->header.tileNum;
+  u32 x = tile % tileNum;
+  u32 y = tile / tileNum;
+  stream->minMax[0][tile] = range;
+  for (u32 level = 1; level <= stream->levelNum - stream->tileShift;
+       level++) {
+    u32 n = tileNum >> level;
+    x >>= 1;
+    y >>= 1;
+    stream->minMax[level][y * n + x] =
+      terrainStreamMergeRanges(stream->minMax[level - 1], n, x, y);
+  }
+}
+
+// A free slot or the least recently used tile that isn't needed in this
+// update, TERRAIN_TILE_NONE when every slot is
+static u32 terrainStreamEvict(terrain_stream *stream) {
+  u32 oldest = TERRAIN_TILE_NONE;
+  for (u32 i = 0; i < stream->slotNum; i++) {
+    terrain_tile_slot *slot = stream->slots + i;
+    if (slot->state == terrain_slot_free) {
+      return i;
+    }
+    if (slot->state == terrain_slot_ready &&
+        slot->lastUsed != stream->updateNum &&
+        (oldest == TERRAIN_TILE_NONE ||
+         slot->lastUsed < stream->slots[oldest].lastUsed)) {
+      oldest = i;
+    }
+  }
+  if (oldest != TERRAIN_TILE_NONE) {
+    terrain_tile_slot *slot = stream->slots + oldest;
+    stream->tileSlot[slot->tile] = TERRAIN_TILE_NONE;
+    slot->state = terrain_slot_free;
+    stream->counters.evictionNum++;
+  }
+  return oldest;
+}
+
+// Marks the tile needed in this update and loads it if it isn't. A
+// required tile is loaded on the calling thread, also when the background
+// loader has it queued, the queued load is dropped when done.
+static void terrainStreamRequest(terrain_stream *stream, i32 tileX,
+                                 i32 tileY, b32 required) {
+  u32 tileNum = stream->header.tileNum;
+  u32 tile = (u32)(tileY & (tileNum - 1)) * tileNum +
+    (u32)(tileX & (tileNum - 1));
+  u32 slotIdx = stream->tileSlot[tile];
+  if (slotIdx != TERRAIN_TILE_NONE) {
+    terrain_tile_slot *slot = stream->slots + slotIdx;
+    slot->lastUsed = stream->updateNum;
+    if (slot->state == terrain_slot_ready || !required) {
+      return;
+    }
+    // Left to the loader, the tile gets a slot of its own
+    stream->tileSlot[tile] = TERRAIN_TILE_NONE;
+  }
+  b32 background = !required && platformApi->backgroundQueue;
+  if (background && stream->queuedNum == TERRAIN_STREAM_MAX_LOADS) {
+    return;
+  }
+  slotIdx = terrainStreamEvict(stream);
+  if (slotIdx == TERRAIN_TILE_NONE) {
+    if (required) {
+      LOG(LOG_LEVEL_WARN, "Terrain tile budget too small for the cars");
+    }
+    return;
+  }
+  terrain_tile_slot *slot = stream->slots + slotIdx;
+  slot->tile = tile;
+  slot->lastUsed = stream->updateNum;
+  slot->loaded = 0;
+  stream->tileSlot[tile] = slotIdx;
+  stream->counters.loadNum++;
+  if (background) {
+    slot->state = terrain_slot_loading;
+    stream->queuedNum++;
+    platformApi->addWork(platformApi->backgroundQueue, terrainStreamLoadTile,
+                         slot);
+  } else {
+    terrainStreamLoadTile(slot);
+    slot->state = terrain_slot_ready;
+    terrainStreamSetTileRange(stream, tile, slot->range);
+    stream->counters.syncLoadNum += required ? 1 : 0;
+  }
+}
+
+// Requests the tiles that a square of radius meters around the position
+// touches, nearest first
+static void terrainStreamRequestArea(terrain_stream *stream, v3 position,
+                                     f32 radius, b32 required) {
+  f32 tileMeters = stream->header.tileSize * stream->header.cellSize;
+  f32 half = stream->cellNum * stream->header.cellSize * 0.5f;
+  f32 gx = (position.x + half) / tileMeters;
+  f32 gy = (position.y + half) / tileMeters;
+  if (!(fabsf(gx) < 1e6f && fabsf(gy) < 1e6f)) {
+    // Blown up body, it's not on any tile
+    return;
+  }
+  i32 x0 = (i32)floorf(gx - radius / tileMeters);
+  i32 x1 = (i32)floorf(gx + radius / tileMeters);
+  i32 y0 = (i32)floorf(gy - radius / tileMeters);
+  i32 y1 = (i32)floorf(gy + radius / tileMeters);
+  i32 cx = (i32)floorf(gx);
+  i32 cy = (i32)floorf(gy);
+  i32 ringNum = MAX(MAX(cx - x0, x1 - cx), MAX(cy - y0, y1 - cy));
+  for (i32 ring = 0; ring <= ringNum; ring++) {
+    for (i32 y = MAX(cy - ring, y0); y <= MIN(cy + ring, y1); y++) {
+      for (i32 x = MAX(cx - ring, x0); x <= MIN(cx + ring, x1); x++) {
+        if (MAX(abs(x - cx), abs(y - cy)) == ring) {
+          terrainStreamRequest(stream, x, y, required);
+        }
+      }
+    }
+  }
+}
+
+// Called before every physics step, also for sleeping cars as a car can
+// wake up during the step.
+static void terrainStreamUpdate(car_game_state *game, car_state **cars,
+                                u32 carNum) {
+  terrain_stream *stream = game->terrain.stream;
+  if (!stream) {
+    return;
+  }
+  physics_world *world = &game->world;
+  stream->updateNum++;
+  for (u32 i = 0; i < stream->slotNum; i++) {
+    terrain_tile_slot *slot = stream->slots + i;
+    if (slot->state != terrain_slot_loading ||
+        !__atomic_load_n(&slot->loaded, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    stream->queuedNum--;
+    // Loaded on the physics thread meanwhile
+    if (stream->tileSlot[slot->tile] != i) {
+      slot->state = terrain_slot_free;
+      continue;
+    }
+    slot->state = terrain_slot_ready;
+    terrainStreamSetTileRange(stream, slot->tile, slot->range);
+  }
+  for (u32 i = 0; i < carNum; i++) {
+    terrainStreamRequestArea(stream, world->position[cars[i]->chassis],
+                             terrainStreamRequiredDistance, true);
+  }
+  if (carNum) {
+    terrainStreamRequestArea(stream, world->position[cars[0]->chassis],
+                             terrainStreamPrefetchDistance, false);
+  }
+}
+
+// Corner samples of the cell, see terrainCellCorners
+inline void terrainStreamCellCorners(terrain_stream *stream, i32 x, i32 y,
+                                     v4 *corners) {
+  i32 mask = stream->cellNum - 1;
+  x &= mask;
+  y &= mask;
+  u32 shift = stream->tileShift;
+  u32 tile = (u32)(y >> shift) * stream->header.tileNum + (u32)(x >> shift);
+  u32 slotIdx = stream->tileSlot[tile];
+  if (slotIdx != TERRAIN_TILE_NONE &&
+      stream->slots[slotIdx].state == terrain_slot_ready) {
+    terrain_tile_slot *slot = stream->slots + slotIdx;
+    i32 size = stream->header.tileSize;
+    i32 stride = size + 1;
+    terrain_sample *sample =
+      slot->samples + (y & (size - 1)) * stride + (x & (size - 1));
+    corners[0] = terrainStreamDecodeSample(slot, sample[0]);
+    corners[1] = terrainStreamDecodeSample(slot, sample[1]);
+    corners[2] = terrainStreamDecodeSample(slot, sample[stride]);
+    corners[3] = terrainStreamDecodeSample(slot, sample[stride + 1]);
+    return;
+  }
+  v4 plateau = {stream->minMax[0][tile].y, 0.f, 0.f, 1.f};
+  corners[0] = corners[1] = corners[2] = corners[3] = plateau;
+}
+
+// Height range of the node at the level that has the cell x, y, level
+// 0 is the cell itself. Within a tile that isn't loaded the range is
+// empty, so the casts pass over it.
+inline v2 terrainStreamNodeMinMax(terrain_stream *stream, u32 level, i32 x,
+                                  i32 y) {
+  i32 mask = stream->cellNum - 1;
+  x &= mask;
+  y &= mask;
+  u32 shift = stream->tileShift;
+  if (level > shift) {
+    i32 n = stream->cellNum >> level;
+    return stream->minMax[level - shift][(y >> level) * n + (x >> level)];
+  }
+  u32 tile = (u32)(y >> shift) * stream->header.tileNum + (u32)(x >> shift);
+  u32 slotIdx = stream->tileSlot[tile];
+  if (slotIdx == TERRAIN_TILE_NONE ||
+      stream->slots[slotIdx].state != terrain_slot_ready) {
+    return (v2){FLT_MAX, -FLT_MAX};
+  }
+  if (level == shift) {
+    return stream->minMax[0][tile];
+  }
+  if (level == 0) {
+    v4 c[4];
+    terrainStreamCellCorners(stream, x, y, c);
+    return (v2){MIN(MIN(c[0].x, c[1].x), MIN(c[2].x, c[3].x)),
+                MAX(MAX(c[0].x, c[1].x), MAX(c[2].x, c[3].x))};
+  }
+  i32 size = stream->header.tileSize;
+  i32 n = size >> level;
+  return stream->slots[slotIdx]
+    .minMax[level - 1][((y & (size - 1)) >> level) * n +
+                       ((x & (size - 1)) >> level)];
+}
+
+// Height difference and normal like getGeometryHeight
+static f32 terrainStreamHeight(terrain_stream *stream, v3 pos,
+                               v3 *normOut) {
+  f32 half = stream->cellNum * 0.5f;
+  f32 geomPosX = pos.x / stream->header.cellSize + half;
+  f32 geomPosY = pos.y / stream->header.cellSize + half;
+  f32 fx = floorf(geomPosX);
+  f32 fy = floorf(geomPosY);
+  f32 u = geomPosX - fx;
+  f32 v = geomPosY - fy;
+  v4 c[4];
+  terrainStreamCellCorners(stream, (i32)fx, (i32)fy, c);
+
+  f32 a = c[0].x * (1.f - u) + c[1].x * u;
+  f32 b = c[2].x * (1.f - u) + c[3].x * u;
+  f32 h = a * (1.f - v) + b * v;
+
+  v3 aN = (v3){c[0].y, c[0].z, c[0].w} * (1.f - u) +
+    (v3){c[1].y, c[1].z, c[1].w} * u;
+  v3 bN = (v3){c[2].y, c[2].z, c[2].w} * (1.f - u) +
+    (v3){c[3].y, c[3].z, c[3].w} * u;
+  *normOut = aN * (1.f - v) + bN * v;
+  return pos.z - h;
+}
+
+// Material byte of the sample nearest to the position, 0 outside loaded
+// tiles
+static u8 terrainStreamMaterial(terrain_stream *stream, v3 pos) {
+  f32 half = stream->cellNum * 0.5f;
+  i32 mask = stream->cellNum - 1;
+  i32 x = (i32)floorf(pos.x / stream->header.cellSize + half + 0.5f) & mask;
+  i32 y = (i32)floorf(pos.y / stream->header.cellSize + half + 0.5f) & mask;
+  u32 shift = stream->tileShift;
+  u32 slotIdx =
+    stream->tileSlot[(u32)(y >> shift) * stream->header.tileNum +
+                     (u32)(x >> shift)];
+  if (slotIdx == TERRAIN_TILE_NONE ||
+      stream->slots[slotIdx].state != terrain_slot_ready) {
+    return 0;
+  }
+  i32 size = stream->header.tileSize;
+  return stream->slots[slotIdx]
+    .material[(y & (size - 1)) * (size + 1) + (x & (size - 1))];
+}
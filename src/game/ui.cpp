@@ -25,7 +25,9 @@ void drawUI(ui_widget_context* widgetContext,
              v2i displaySize,
              f32 delta, memory_arena* tempArena) {
   car_state* car = &game->car;
-  rigid_body* chassis = &car->body.chassis;
+  render_state* state = game->renderState;
+  car_stats* stats = &state->carStats;
+  u32 chassis = car->chassis;
   mouse_state* mouse = &game->input.mouse;
   static f32 rpmHistory[HISTORY_SIZE] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
   static f32 slipRatioHistory[HISTORY_SIZE * 4] = {
@@ -49,11 +51,15 @@ void drawUI(ui_widget_context* widgetContext,
   static u32 selectedTabs = section_car;
   static b32 drawHistographs = false;
   static b32 drawCurves = false;
+  static b32 drawConvergence = false;
 
   updateTimer += delta;
   introTimer += delta;
   v2 debugPanelPos = {10, 10};
   v2 debugPanelSize = {450, 300};
+  if (selectedTabs == section_system) {
+    debugPanelSize.y = 520;
+  }
 
   v2 curvePanelSize = {200.f, 180.f};
   v2 curvePadding = {60.f, 55.f};
@@ -76,34 +82,34 @@ void drawUI(ui_widget_context* widgetContext,
       frictAdjHistory[i - 1 + HISTORY_SIZE * 2] = frictAdjHistory[i + HISTORY_SIZE * 2];
       frictAdjHistory[i - 1 + HISTORY_SIZE * 3] = frictAdjHistory[i + HISTORY_SIZE * 3];
     }
-    rpmHistory[HISTORY_SIZE - 1] = (f32)fabs(car->stats.rpm) / 8000.f * curvePanelSize.y;    
+    rpmHistory[HISTORY_SIZE - 1] = (f32)fabs(stats->rpm) / 8000.f * curvePanelSize.y;    
 
     slipRatioHistory[HISTORY_SIZE - 1] = 
-      (f32)CLAMP(car->stats.slipRatio[0] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipRatio[0] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
     slipRatioHistory[HISTORY_SIZE * 2 - 1] = 
-      (f32)CLAMP(car->stats.slipRatio[1] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipRatio[1] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
     slipRatioHistory[HISTORY_SIZE * 3 - 1] = 
-      (f32)CLAMP(car->stats.slipRatio[2] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipRatio[2] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
     slipRatioHistory[HISTORY_SIZE * 4 - 1] = 
-      (f32)CLAMP(car->stats.slipRatio[3] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipRatio[3] / 20.f,0.0f, 1.0f) * curvePanelSize.y;    
     
     slipAngleHistory[HISTORY_SIZE - 1] = 
-      (f32)CLAMP(car->stats.slipAngle[0] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipAngle[0] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
     slipAngleHistory[HISTORY_SIZE * 2 - 1] = 
-      (f32)CLAMP(car->stats.slipAngle[1] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipAngle[1] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
     slipAngleHistory[HISTORY_SIZE * 3 - 1] = 
-      (f32)CLAMP(car->stats.slipAngle[2] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipAngle[2] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
     slipAngleHistory[HISTORY_SIZE * 4 - 1] = 
-      (f32)CLAMP(car->stats.slipAngle[3] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
+      (f32)CLAMP(stats->slipAngle[3] / 2.f + 0.5f, 0.0f, 1.0f) * curvePanelSize.y;    
     
     frictAdjHistory[HISTORY_SIZE - 1] = 
-      (f32)car->stats.frictionAdjustment[0] * curvePanelSize.y;    
+      (f32)stats->frictionAdjustment[0] * curvePanelSize.y;    
     frictAdjHistory[HISTORY_SIZE * 2 - 1] = 
-      (f32)car->stats.frictionAdjustment[1] * curvePanelSize.y;    
+      (f32)stats->frictionAdjustment[1] * curvePanelSize.y;    
     frictAdjHistory[HISTORY_SIZE * 3 - 1] = 
-      (f32)car->stats.frictionAdjustment[2] * curvePanelSize.y;    
+      (f32)stats->frictionAdjustment[2] * curvePanelSize.y;    
     frictAdjHistory[HISTORY_SIZE * 4 - 1] = 
-      (f32)car->stats.frictionAdjustment[3] * curvePanelSize.y;    
+      (f32)stats->frictionAdjustment[3] * curvePanelSize.y;    
     updateTimer -= 0.1f;
   }
 
@@ -183,6 +189,56 @@ void drawUI(ui_widget_context* widgetContext,
                 "Simulation time (ms/frame):  %.4f", 
                 game->profiler.average[profiler_counter_entry_simulation]);
       cursor.y += lineHeight;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Substeps (island avg/max):  %.2f / %u",
+                game->profiler.averageSubsteps, game->profiler.peakSubsteps);
+      cursor.y += lineHeight;
+      for (u32 i = 0; i < _physics_timer_num; i++) {
+        v2 indent = {12.f * physicsTimerDepth[i], 0};
+        makeLabel(widgetContext, cursor + indent, widget_text_alignment_left,
+                  64, "%s (ms/frame):  %.4f", physicsTimerNames[i],
+                  game->profiler.physicsAverage[i]);
+        cursor.y += lineHeight;
+      }
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Contacts/step:  %.1f (warm start hits %.1f%%)",
+                game->profiler.averageContacts,
+                game->profiler.warmStartHitRate);
+      cursor.y += lineHeight;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Joints/step:  %.1f  Solved substeps/step:  %.1f",
+                game->profiler.averageJoints,
+                game->profiler.averagePassSubsteps);
+      cursor.y += lineHeight;
+      solver_convergence* convergence = &state->convergence;
+      u32 lastIteration = MAX(convergence->iterationNum, 1) - 1;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Relax passes:  %u/substep (%.1f%% skipped)",
+                relaxIterations, game->profiler.relaxSkipRate);
+      cursor.y += lineHeight;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Residual joints:  %.3f -> %.3f",
+                convergence->jointResidual[0],
+                convergence->jointResidual[lastIteration]);
+      cursor.y += lineHeight;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Residual contacts:  %.3f -> %.3f",
+                convergence->contactResidual[0],
+                convergence->contactResidual[lastIteration]);
+      cursor.y += lineHeight;
+      makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
+                "Joint error:  %.4f  Penetration:  %.4f",
+                convergence->jointPositionError,
+                convergence->contactPenetration);
+      cursor.y += lineHeight;
+      relaxEarlyExit =
+        checkboxWidget(widgetContext, cursor,
+                       relaxEarlyExit, STR("Relax early exit"), *mouse);
+      drawConvergence =
+        checkboxWidget(widgetContext,
+                       cursor + ((v2){debugPanelSize.x * 0.5f, 0}),
+                       drawConvergence, STR("Convergence"), *mouse);
+      cursor.y += lineHeight + 2;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64, 
                 "Audio processing time (ms/frame):  %.4f", 
                 game->profiler.average[profiler_counter_entry_audio]);
@@ -193,38 +249,38 @@ void drawUI(ui_widget_context* widgetContext,
     } else if (selectedTabs == section_car) {
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Speed (km/h):  %.3f",
-                v3_dot(chassis->forwardAxis, chassis->velocity) * 3.6f);
+                v3_dot(state->chassisForwardAxis, state->chassisVelocity) * 3.6f);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
-                "RPM (m/s):  %d",(i32)car->stats.rpm);
+                "RPM (m/s):  %d",(i32)stats->rpm);
       makeLabel(widgetContext, cursor + ((v2){debugPanelSize.x * 0.4f,0}),
                 widget_text_alignment_left, 64,
-                "Gear %d", car->stats.gear + 1);
+                "Gear %d", stats->gear + 1);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Velocity (m/s):  %.3f %.3f %.3f ",
-                chassis->velocity.x * delta, chassis->velocity.y * delta,
-                chassis->velocity.z * delta);
+                state->chassisVelocity.x * delta, state->chassisVelocity.y * delta,
+                state->chassisVelocity.z * delta);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Position:  %.3f %.3f %.3f ",
-                chassis->position.x, chassis->position.y,
-                chassis->position.z);
+                state->bodies.position[chassis].x, state->bodies.position[chassis].y,
+                state->bodies.position[chassis].z);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Tire extra friction:  %.3f %.3f %.3f %.3f",
-                game->car.stats.frictionAdjustment[0], game->car.stats.frictionAdjustment[1],
-                game->car.stats.frictionAdjustment[2], game->car.stats.frictionAdjustment[3]);
+                stats->frictionAdjustment[0], stats->frictionAdjustment[1],
+                stats->frictionAdjustment[2], stats->frictionAdjustment[3]);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Tire slip ratio:  %.3f %.3f %.3f %.3f",
-                game->car.stats.slipRatio[0], game->car.stats.slipRatio[1],
-                game->car.stats.slipRatio[2], game->car.stats.slipRatio[3]);
+                stats->slipRatio[0], stats->slipRatio[1],
+                stats->slipRatio[2], stats->slipRatio[3]);
       cursor.y += lineHeight;
       makeLabel(widgetContext, cursor, widget_text_alignment_left, 64,
                 "Tire slip angle:  %.3f %.3f %.3f %.3f",
-                game->car.stats.slipAngle[0], game->car.stats.slipAngle[1],
-                game->car.stats.slipAngle[2], game->car.stats.slipAngle[3]);
+                stats->slipAngle[0], stats->slipAngle[1],
+                stats->slipAngle[2], stats->slipAngle[3]);
       cursor.y += lineHeight;
       drawHistographs = 
         checkboxWidget(widgetContext, cursor,  
@@ -274,17 +330,17 @@ void drawUI(ui_widget_context* widgetContext,
     v2* slipValues = pushArray(tempArena, 4, v2);
 
     for (u32 i = 0; i < 4; i++){
-      f32 slipRatio = car->stats.slipRatio[i];
-      f32 slipAngle = car->stats.slipAngle[i];
+      f32 slipRatio = stats->slipRatio[i];
+      f32 slipAngle = stats->slipAngle[i];
       {
         f32 t = CLAMP(slipRatio / 2.f, 0.0f, 1.0f);
-        frictionValues[i] = {(t * curvePanelSize.x), curvePanelSize.y - (bezier6n(
-          car->properties.slipRatioForceCurve, t) * curvePanelSize.y)};
+        frictionValues[i] = {(t * curvePanelSize.x), curvePanelSize.y - (curveLutSample(
+          &state->slipRatioForce, t) * curvePanelSize.y)};
       }
       {
         f32 t = MIN(fabsf(slipAngle) / 2.f,1.f);
-        slipValues[i] = {(t * curvePanelSize.x), curvePanelSize.y - (bezier6n(
-          car->properties.slipAngleForceCurve,
+        slipValues[i] = {(t * curvePanelSize.x), curvePanelSize.y - (curveLutSample(
+          &state->slipAngleForce,
           t) * curvePanelSize.y)};
       }
     }
@@ -333,19 +389,45 @@ void drawUI(ui_widget_context* widgetContext,
                 STR("Slip angle friction AD curve"),
                 {0.f,20.f}, {0.0f, 1.0f},
                 STR("%.0f"), STR("%.1f"),
-                car->properties.slipAngleForceCurve,
-                arrayLen(car->properties.slipAngleForceCurve));
+                game->carProperties.slipAngleForceCurve,
+                arrayLen(game->carProperties.slipAngleForceCurve));
     curveWidget(widgetContext, slipRationPanelPos, curvePanelSize,
                 STR("Slip ratio friction AD curve"),
                 {0.f,20.f}, {0.0f, 1.0f},
                 STR("%.0f"), STR("%.1f"),
-                car->properties.slipRatioForceCurve,
-                arrayLen(car->properties.slipRatioForceCurve));
+                game->carProperties.slipRatioForceCurve,
+                arrayLen(game->carProperties.slipRatioForceCurve));
     curveWidget(widgetContext, torqueCurvePanelPos, curvePanelSize,
                 STR("Torque curve"),
-                {0.0f, 7000.f}, {0.f,car->properties.motorTorque},
+                {0.0f, 7000.f}, {0.f,game->carProperties.motorTorque},
                 STR("%.0f"), STR("%.0f"),
-                car->properties.motorTorqueCurve,
-                arrayLen(car->properties.motorTorqueCurve));
+                game->carProperties.motorTorqueCurve,
+                arrayLen(game->carProperties.motorTorqueCurve));
+    curveWindowPos.x -= curveWindowDim.x + 10;
+  }
+  if (drawConvergence) {
+    // log10 of the residuals of each pass of the last step, biased solve
+    // first
+    solver_convergence* convergence = &state->convergence;
+    u32 iterationNum = MAX(convergence->iterationNum, 1);
+    u32 pointNum = MAX(iterationNum, 2);
+    f32* residuals = pushArray(tempArena, pointNum * 2, f32);
+    for (u32 i = 0; i < pointNum; i++) {
+      u32 iteration = MIN(i, iterationNum - 1);
+      f32 joint = log10f(MAX(convergence->jointResidual[iteration], 1e-2f));
+      f32 contact =
+        log10f(MAX(convergence->contactResidual[iteration], 1e-2f));
+      residuals[i] = CLAMP((joint + 2.f) / 6.f, 0.f, 1.f) * curvePanelSize.y;
+      residuals[pointNum + i] =
+        CLAMP((contact + 2.f) / 6.f, 0.f, 1.f) * curvePanelSize.y;
+    }
+    v2 convergenceWindowDim = curvePanelSize + curvePadding * 2.f;
+    curveWindowPos.x += curveWindowDim.x - convergenceWindowDim.x;
+    panelWidget(widgetContext, curveWindowPos, convergenceWindowDim);
+    histographWidget(widgetContext, curveWindowPos + curvePadding,
+                     curvePanelSize, STR("Residual log10 (joints, contacts)"),
+                     {0.f, (f32)(pointNum - 1)}, {-2.f, 4.f},
+                     STR("%.1f"), STR("%.0f"),
+                     residuals, pointNum, 2);
   }
 } 
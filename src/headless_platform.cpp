@@ -0,0 +1,937 @@
+// Headless platform layer.
+// Runs the car simulation without SDL, a window or a GL context so the
+// physics can be measured and regression tested on machines without a
+// display. The game unity build is compiled directly into this binary.
+//
+// Usage: rotten_headless [--steps N] [--dt SEC] [--frame-dt SEC]
+//                        [--script PATH] [--terrain flat|waves]
+//                        [--tire bezier|pacejka] [--substeps N]
+//                        [--no-sleep] [--no-ccd] [--no-timers] [--no-lod]
+//                        [--relax N] [--relax-tol T] [--rewind N] [--verbose]
+//                        [--tiles PATH] [--procedural] [--tile-num N]
+//                        [--tile-budget MB]
+//        rotten_headless --write-tiles PATH [--terrain flat|waves]
+//        rotten_headless --sweep SPEC [--samples N] [--seed N] [--csv PATH]
+//                        [--threads N] [--dt SEC] [--terrain flat|waves]
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game/car_game.cpp"
+#include "core/file.c"
+#include "core/work_queue.c"
+#include "headless_scene.cpp"
+
+// Buttons held from the given step onwards until the next entry.
+typedef struct headless_input_entry {
+  u32 step;
+  u32 buttons;
+} headless_input_entry;
+
+#define HEADLESS_MAX_INPUT_ENTRIES 1024
+
+// Default script: launch, steer through a turn, brake and coast.
+static headless_input_entry headlessDefaultScript[] = {
+  {0,    headless_button_up},
+  {600,  headless_button_up | headless_button_left},
+  {900,  headless_button_up | headless_button_right},
+  {1200, headless_button_down},
+  {1500, 0},
+};
+
+static b32 headlessVerbose = false;
+
+static void headlessLog(LogLevel logLevel, const char *format, ...) {
+  if (logLevel < LOG_LEVEL_WARN && !headlessVerbose) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+static void headlessAssert(b32 cond, const char *condText, const char *function,
+                           i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+static u64 headlessPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static u64 headlessPerformanceFrequency() {
+  return 1000000000ull;
+}
+
+static void headlessToggleFullscreen() {}
+
+static void headlessFlushCommandBuffer(rt_command_buffer *buffer) {
+  memArena_clear(&buffer->arena);
+}
+
+static void *headlessLoadBinaryFile(const char *path, usize *fileSizeOut) {
+  void *buffer = NULL;
+  FILE *f = fopen(path, "rb");
+  if (f) {
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > 0) {
+      buffer = malloc(size + 1);
+      if (fread(buffer, size, 1, f) == 1) {
+        ((char *)buffer)[size] = '\0';
+        *fileSizeOut = size;
+      } else {
+        free(buffer);
+        buffer = NULL;
+      }
+    }
+    fclose(f);
+  }
+  return buffer;
+}
+
+static char *headlessLoadTextFile(const char *path, usize *fileSizeOut) {
+  return (char *)headlessLoadBinaryFile(path, fileSizeOut);
+}
+
+// Audio and images are not decoded in headless mode.
+static rt_audio_data headlessLoadOGG(const char *path) {
+  rt_audio_data result = {0};
+  return result;
+}
+
+static rt_image_data headlessLoadImage(const char *path, u8 channels) {
+  rt_image_data result = {0};
+  return result;
+}
+
+static u32 headlessParseScript(const char *path, headless_input_entry *entries,
+                               u32 maxEntries) {
+  usize size = 0;
+  char *text = headlessLoadTextFile(path, &size);
+  if (!text) {
+    fprintf(stderr, "Could not read input script %s\n", path);
+    exit(1);
+  }
+  u32 entryNum = 0;
+  char *line = strtok(text, "\n");
+  while (line && entryNum < maxEntries) {
+    char *token = line;
+    while (*token == ' ' || *token == '\t') token++;
+    if (*token != '#' && *token != '\0' && *token != '\r') {
+      headless_input_entry *entry = entries + entryNum++;
+      entry->step = (u32)strtoul(token, &token, 10);
+      entry->buttons = 0;
+      entry->buttons |= strstr(token, "up") ? headless_button_up : 0;
+      entry->buttons |= strstr(token, "down") ? headless_button_down : 0;
+      entry->buttons |= strstr(token, "left") ? headless_button_left : 0;
+      entry->buttons |= strstr(token, "right") ? headless_button_right : 0;
+      entry->buttons |= strstr(token, "reset") ? headless_button_reset : 0;
+    }
+    line = strtok(NULL, "\n");
+  }
+  free(text);
+  return entryNum;
+}
+
+// FNV-1a over the dynamic state of every body.
+static u64 headlessHashBytes(u64 hash, const void *data, usize size) {
+  const u8 *bytes = (const u8 *)data;
+  for (usize i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static u64 headlessHashBody(u64 hash, physics_world *world, u32 body) {
+  hash = headlessHashBytes(hash, world->position + body, sizeof(v3));
+  hash = headlessHashBytes(hash, world->velocity + body, sizeof(v3));
+  hash = headlessHashBytes(hash, world->angularVelocity + body, sizeof(v3));
+  hash = headlessHashBytes(hash, world->orientationQuat + body, sizeof(quat));
+  return hash;
+}
+
+// Parameter sweep.
+// Every run is one car with its own car_properties in its own world,
+// driven through a launch and a constant radius turn on the baked
+// terrain. The runs are split between threads, each thread owns one
+// world and reuses it run after run, the terrain is shared.
+//
+// The spec file has one parameter per line, `name v0 v1 ...` for a grid
+// over every combination, or `name min max` with --samples N for N
+// uniform random samples. Array elements are given as e.g. gearRatios[1].
+
+typedef struct sweep_param {
+  const char *name;
+  u32 offset;
+  u32 count;
+} sweep_param;
+
+#define SWEEP_PARAM(name, count) {#name, offsetof(car_properties, name), count}
+
+static sweep_param sweepParams[] = {
+  SWEEP_PARAM(chassisMass, 1),
+  SWEEP_PARAM(wheelMass, 1),
+  SWEEP_PARAM(frontWheelBaseFriction, 1),
+  SWEEP_PARAM(rearWheelBaseFriction, 1),
+  SWEEP_PARAM(slipRatioForceCurve, 6),
+  SWEEP_PARAM(slipRatioForceCoeff, 1),
+  SWEEP_PARAM(slipAngleForceCurve, 6),
+  SWEEP_PARAM(slipAngleForceCoeffFW, 1),
+  SWEEP_PARAM(slipAngleForceCoeffRW, 1),
+  SWEEP_PARAM(motorTorqueCurve, 6),
+  SWEEP_PARAM(motorTorque, 1),
+  SWEEP_PARAM(gearRatios, 6),
+  SWEEP_PARAM(suspensionPosHeight, 1),
+  SWEEP_PARAM(suspensionHz, 1),
+  SWEEP_PARAM(suspensionDamping, 1),
+  SWEEP_PARAM(engineInertia, 1),
+  SWEEP_PARAM(differentialRatio, 1),
+  SWEEP_PARAM(transmissionEfficiency, 1),
+  // B, C, D, E and Sv, used with --tire pacejka
+  SWEEP_PARAM(slipRatioPacejka, 5),
+  SWEEP_PARAM(slipAnglePacejka, 5),
+};
+
+#define SWEEP_MAX_AXES 16
+#define SWEEP_MAX_VALUES 64
+#define SWEEP_MAX_RUNS 1000000
+// Scenario: full throttle from standstill, then full throttle and full
+// left steering
+#define SWEEP_LAUNCH_TIME 8.f
+#define SWEEP_TURN_TIME 4.f
+#define SWEEP_G 9.81f
+
+typedef struct sweep_axis {
+  char label[64];
+  // Byte offset of the f32 in car_properties
+  u32 offset;
+  f32 values[SWEEP_MAX_VALUES];
+  u32 valueNum;
+} sweep_axis;
+
+typedef struct sweep_result {
+  // Negative if 100 km/h was not reached during the launch
+  f32 time100;
+  f32 topSpeed;
+  f32 maxLateralG;
+  // Largest angle between the velocity and the heading in the turn
+  f32 maxSideslip;
+  // Smallest z of the chassis up axis, below zero the car rolled over
+  f32 minUpright;
+  b32 stable;
+} sweep_result;
+
+typedef struct sweep_state {
+  sweep_axis axes[SWEEP_MAX_AXES];
+  u32 axisNum;
+  u32 runNum;
+  // Parameter values of each run, axisNum per run
+  f32 *runValues;
+  sweep_result *results;
+  u32 volatile nextRun;
+  terrain_object *terrain;
+  f32 dt;
+} sweep_state;
+
+typedef struct sweep_worker {
+  sweep_state *sweep;
+  void *memory;
+  usize memorySize;
+} sweep_worker;
+
+static b32 sweepParseAxis(char *line, sweep_axis *axis) {
+  char *token = strtok(line, " \t\r");
+  if (!token || *token == '#') {
+    return false;
+  }
+  char name[64];
+  u32 index = 0;
+  snprintf(name, sizeof(name), "%s", token);
+  char *bracket = strchr(name, '[');
+  if (bracket) {
+    *bracket = '\0';
+    index = (u32)strtoul(bracket + 1, NULL, 10);
+  }
+  sweep_param *param = NULL;
+  for (u32 i = 0; i < arrayLen(sweepParams); i++) {
+    if (strcmp(sweepParams[i].name, name) == 0) {
+      param = sweepParams + i;
+    }
+  }
+  if (!param || index >= param->count) {
+    fprintf(stderr, "Unknown sweep parameter %s\n", token);
+    exit(1);
+  }
+  snprintf(axis->label, sizeof(axis->label), "%s", token);
+  axis->offset = param->offset + index * sizeof(f32);
+  axis->valueNum = 0;
+  while ((token = strtok(NULL, " \t\r")) &&
+         axis->valueNum < SWEEP_MAX_VALUES) {
+    axis->values[axis->valueNum++] = strtof(token, NULL);
+  }
+  if (!axis->valueNum) {
+    fprintf(stderr, "No values for sweep parameter %s\n", axis->label);
+    exit(1);
+  }
+  return true;
+}
+
+// Grid runs go through every combination with the last axis changing
+// fastest, sampled runs pick each value uniformly between min and max.
+static void sweepLoadSpec(sweep_state *sweep, const char *path,
+                          u32 sampleNum, u32 seed) {
+  usize size = 0;
+  char *text = headlessLoadTextFile(path, &size);
+  if (!text) {
+    fprintf(stderr, "Could not read sweep spec %s\n", path);
+    exit(1);
+  }
+  char *next = text;
+  while (next && *next && sweep->axisNum < SWEEP_MAX_AXES) {
+    char *line = next;
+    next = strchr(line, '\n');
+    if (next) {
+      *next++ = '\0';
+    }
+    if (sweepParseAxis(line, sweep->axes + sweep->axisNum)) {
+      sweep->axisNum++;
+    }
+  }
+  free(text);
+
+  u64 runNum = 1;
+  if (sampleNum) {
+    runNum = sampleNum;
+  } else {
+    for (u32 a = 0; a < sweep->axisNum && runNum <= SWEEP_MAX_RUNS; a++) {
+      runNum *= sweep->axes[a].valueNum;
+    }
+  }
+  if (runNum > SWEEP_MAX_RUNS) {
+    fprintf(stderr, "Sweep has more than %u runs\n", SWEEP_MAX_RUNS);
+    exit(1);
+  }
+  sweep->runNum = (u32)runNum;
+  sweep->runValues =
+    (f32 *)malloc((usize)runNum * MAX(sweep->axisNum, 1u) * sizeof(f32));
+  sweep->results = (sweep_result *)calloc(runNum, sizeof(sweep_result));
+
+  u32 random = MAX(seed, 1u);
+  for (u32 run = 0; run < runNum; run++) {
+    f32 *values = sweep->runValues + run * sweep->axisNum;
+    u32 gridIdx = run;
+    for (i32 a = sweep->axisNum - 1; a >= 0; a--) {
+      sweep_axis *axis = sweep->axes + a;
+      if (sampleNum) {
+        // xorshift32
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        f32 t = (f32)(random >> 8) / (f32)(1 << 24);
+        f32 max = axis->values[axis->valueNum - 1];
+        values[a] = axis->values[0] + (max - axis->values[0]) * t;
+      } else {
+        values[a] = axis->values[gridIdx % axis->valueNum];
+        gridIdx /= axis->valueNum;
+      }
+    }
+  }
+}
+
+static void sweepRun(sweep_worker *worker, u32 run) {
+  sweep_state *sweep = worker->sweep;
+  car_properties properties = carProperties;
+  for (u32 a = 0; a < sweep->axisNum; a++) {
+    memcpy((u8 *)&properties + sweep->axes[a].offset,
+           sweep->runValues + run * sweep->axisNum + a, sizeof(f32));
+  }
+
+  // The world expects zeroed memory when it is built
+  memset(worker->memory, 0, worker->memorySize);
+  memory_arena arena;
+  memArena_init(&arena, worker->memory, worker->memorySize);
+  car_game_state *game = pushType(&arena, car_game_state);
+  game->terrain = *sweep->terrain;
+  allocCarWorld(game, &arena);
+  game->world.workQueue = NULL;
+  game->world.workerNum = 0;
+  car_state *car = &game->car;
+  headlessSetupCar(game, car, 0, &properties);
+  game->initialized = true;
+  game->state = game_state_game;
+  memory_arena tempMemory;
+  memArena_init(&tempMemory, (u8 *)arena.buffer + arena.head, arena.remaining);
+
+  physics_world *world = &game->world;
+  u32 chassis = car->chassis;
+  sweep_result result = {-1.f, 0.f, 0.f, 0.f, 1.f, true};
+  u32 launchSteps = (u32)(SWEEP_LAUNCH_TIME / sweep->dt);
+  u32 stepNum = launchSteps + (u32)(SWEEP_TURN_TIME / sweep->dt);
+  for (u32 step = 0; step < stepNum; step++) {
+    b32 turning = step >= launchSteps;
+    headlessApplyInput(&game->input, headless_button_up |
+                       (turning ? headless_button_left : 0));
+    memArena_clear(&tempMemory);
+    carStepWorld(game, &car, 1, &game->input, &tempMemory, sweep->dt);
+
+    for (u32 i = 0; i < RIGID_BODY_NUM && result.stable; i++) {
+      v3 p = world->position[chassis + i];
+      result.stable = fabsf(p.x) < geometrySize.x * 0.5f &&
+                      fabsf(p.y) < geometrySize.y * 0.5f && isfinite(p.z);
+    }
+    if (!result.stable) {
+      break;
+    }
+    m3x3 orientation = world->orientation[chassis];
+    v3 up = orientation * (v3){0.f, 0.f, 1.f};
+    v3 velocity = world->velocity[chassis];
+    f32 longSpeed = v3_dot(world->forwardAxis[chassis], velocity);
+    f32 sideSpeed = v3_dot(world->sideAxis[chassis], velocity);
+    result.topSpeed = MAX(result.topSpeed, longSpeed);
+    result.minUpright = MIN(result.minUpright, up.z);
+    if (!turning && result.time100 < 0.f && longSpeed >= 100.f / 3.6f) {
+      result.time100 = (step + 1) * sweep->dt;
+    }
+    if (turning) {
+      // Steady state lateral acceleration is speed times yaw rate
+      f32 yawRate = v3_dot(world->angularVelocity[chassis], up);
+      result.maxLateralG =
+        MAX(result.maxLateralG, fabsf(longSpeed * yawRate) / SWEEP_G);
+      if (fabsf(longSpeed) > 5.f) {
+        result.maxSideslip = MAX(result.maxSideslip,
+                                 fabsf(atan2f(sideSpeed, fabsf(longSpeed))));
+      }
+    }
+  }
+  result.stable = result.stable && result.minUpright > 0.f;
+  sweep->results[run] = result;
+}
+
+static RT_WORK_CALLBACK(sweepWorkerCallback) {
+  sweep_worker *worker = (sweep_worker *)data;
+  for (;;) {
+    u32 run = __atomic_fetch_add(&worker->sweep->nextRun, 1, __ATOMIC_RELAXED);
+    if (run >= worker->sweep->runNum) {
+      break;
+    }
+    sweepRun(worker, run);
+  }
+}
+
+static void sweepWriteCsv(sweep_state *sweep, FILE *out) {
+  fprintf(out, "run");
+  for (u32 a = 0; a < sweep->axisNum; a++) {
+    fprintf(out, ",%s", sweep->axes[a].label);
+  }
+  fprintf(out, ",time_0_100_s,top_speed_kmh,max_lateral_g,"
+               "max_sideslip_deg,min_upright,stable\n");
+  for (u32 run = 0; run < sweep->runNum; run++) {
+    sweep_result *result = sweep->results + run;
+    fprintf(out, "%u", run);
+    for (u32 a = 0; a < sweep->axisNum; a++) {
+      fprintf(out, ",%g", sweep->runValues[run * sweep->axisNum + a]);
+    }
+    if (result->time100 >= 0.f) {
+      fprintf(out, ",%.3f", result->time100);
+    } else {
+      fprintf(out, ",");
+    }
+    fprintf(out, ",%.2f,%.3f,%.2f,%.3f,%d\n", result->topSpeed * 3.6f,
+            result->maxLateralG, result->maxSideslip * 180.f / PI,
+            result->minUpright, result->stable ? 1 : 0);
+  }
+}
+
+// Runs the sweep on threadNum threads, all cores by default, and writes
+// one CSV row per run in run order.
+static i32 headlessSweep(car_game_state *game, const char *specPath,
+                         const char *csvPath, u32 sampleNum, u32 seed,
+                         u32 threadNum, f32 dt) {
+  sweep_state *sweep = (sweep_state *)calloc(1, sizeof(sweep_state));
+  sweepLoadSpec(sweep, specPath, sampleNum, seed);
+  sweep->terrain = &game->terrain;
+  sweep->dt = dt;
+
+  if (!threadNum) {
+    threadNum = (u32)MAX(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  }
+  threadNum = CLAMP(threadNum, 1u, (u32)WORK_QUEUE_MAX_THREADS);
+  static rt_work_queue sweepQueue;
+  workQueue_init(&sweepQueue, threadNum - 1);
+  sweep_worker *workers =
+    (sweep_worker *)calloc(threadNum, sizeof(sweep_worker));
+
+  u64 begin = headlessPerformanceCounter();
+  for (u32 i = 0; i < threadNum; i++) {
+    workers[i].sweep = sweep;
+    workers[i].memorySize = MEGABYTES(16);
+    workers[i].memory = malloc(workers[i].memorySize);
+    workQueue_add(&sweepQueue, sweepWorkerCallback, workers + i);
+  }
+  workQueue_completeAll(&sweepQueue);
+  f64 seconds =
+    (f64)(headlessPerformanceCounter() - begin) / headlessPerformanceFrequency();
+
+  FILE *out = csvPath ? fopen(csvPath, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Could not write %s\n", csvPath);
+    return 1;
+  }
+  sweepWriteCsv(sweep, out);
+  if (csvPath) {
+    fclose(out);
+  }
+  u32 stableNum = 0;
+  for (u32 run = 0; run < sweep->runNum; run++) {
+    stableNum += sweep->results[run].stable ? 1 : 0;
+  }
+  fprintf(stderr, "sweep: %u runs (%u stable) on %u threads in %.2f s, "
+          "%.1f runs/s\n", sweep->runNum, stableNum, threadNum, seconds,
+          seconds > 0.0 ? sweep->runNum / seconds : 0.0);
+  return 0;
+}
+
+// One frame of fixed steps, or the frame time worth of steps with
+// --frame-dt. Returns the number of steps taken.
+static u32 headlessStepFrame(car_game_state *game, car_state **cars,
+                             u32 carNum, memory_arena *tempMemory, f32 dt,
+                             f32 frameDt) {
+  memArena_clear(tempMemory);
+  if (frameDt > 0.f) {
+    return carStepFrame(game, cars, carNum, &game->input, tempMemory,
+                        frameDt);
+  }
+  carStepWorld(game, cars, carNum, &game->input, tempMemory, dt);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  u32 stepNum = 3600;
+  f32 dt = 1.f / 60.f;
+  f32 frameDt = 0.f;
+  const char *scriptPath = NULL;
+  u32 threadNum = 0;
+  u32 carNum = 1;
+  u32 rewindNum = 0;
+  const char *sweepPath = NULL;
+  const char *csvPath = NULL;
+  u32 sampleNum = 0;
+  u32 seed = 1;
+  headless_terrain terrainType = headless_terrain_flat;
+  const char *tilesPath = NULL;
+  const char *writeTilesPath = NULL;
+  b32 procedural = false;
+  // 16 procedural tiles a side cover as much as the height map
+  u32 tileNum = 16;
+  usize tileBudget = MEGABYTES(16);
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+      stepNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+      dt = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--frame-dt") == 0 && i + 1 < argc) {
+      frameDt = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (strcmp(argv[i], "--terrain") == 0 && i + 1 < argc) {
+      i++;
+      terrainType = strcmp(argv[i], "waves") == 0 ? headless_terrain_waves
+                                                  : headless_terrain_flat;
+    } else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+      useWideContactSolver = strcmp(argv[++i], "scalar") != 0;
+    } else if (strcmp(argv[i], "--cars") == 0 && i + 1 < argc) {
+      carNum = (u32)strtoul(argv[++i], NULL, 10);
+      carNum = CLAMP(carNum, 1u, (u32)MAX_CARS);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threadNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--substeps") == 0 && i + 1 < argc) {
+      u32 substeps = (u32)strtoul(argv[++i], NULL, 10);
+      subStepAmount = (u16)CLAMP(substeps, 1u, 64u);
+      adaptiveSubsteps = false;
+    } else if (strcmp(argv[i], "--tire") == 0 && i + 1 < argc) {
+      carProperties.tireModel = strcmp(argv[++i], "pacejka") == 0 ?
+        tire_model_pacejka : tire_model_bezier;
+    } else if (strcmp(argv[i], "--no-sleep") == 0) {
+      enableSleeping = false;
+    } else if (strcmp(argv[i], "--no-ccd") == 0) {
+      enableCCD = false;
+    } else if (strcmp(argv[i], "--no-timers") == 0) {
+      enablePhysicsTimers = false;
+    } else if (strcmp(argv[i], "--no-lod") == 0) {
+      enableCarLod = false;
+    } else if (strcmp(argv[i], "--relax") == 0 && i + 1 < argc) {
+      relaxIterations = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--relax-tol") == 0 && i + 1 < argc) {
+      relaxTolerance = strtof(argv[++i], NULL);
+      relaxEarlyExit = true;
+    } else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc) {
+      rewindNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+      sweepPath = argv[++i];
+    } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      sampleNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+      csvPath = argv[++i];
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      headlessVerbose = true;
+    } else if (strcmp(argv[i], "--tiles") == 0 && i + 1 < argc) {
+      tilesPath = argv[++i];
+    } else if (strcmp(argv[i], "--procedural") == 0) {
+      procedural = true;
+    } else if (strcmp(argv[i], "--tile-budget") == 0 && i + 1 < argc) {
+      tileBudget = MEGABYTES((usize)strtoul(argv[++i], NULL, 10));
+    } else if (strcmp(argv[i], "--write-tiles") == 0 && i + 1 < argc) {
+      writeTilesPath = argv[++i];
+    } else if (strcmp(argv[i], "--tile-num") == 0 && i + 1 < argc) {
+      tileNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--steps N] [--dt SEC] [--frame-dt SEC] "
+              "[--script PATH] "
+              "[--terrain flat|waves] [--solver wide|scalar] "
+              "[--tire bezier|pacejka] [--cars N] "
+              "[--threads N] [--substeps N] [--no-sleep] [--no-ccd] "
+              "[--no-timers] [--no-lod] [--relax N] [--relax-tol T] [--rewind N] "
+              "[--verbose] [--tiles PATH] [--procedural] [--tile-num N] "
+              "[--tile-budget MB]\n"
+              "       %s --sweep SPEC [--samples N] [--seed N] [--csv PATH] "
+              "[--threads N] [--dt SEC] [--terrain flat|waves]\n"
+              "       %s --write-tiles PATH [--terrain flat|waves]\n",
+              argv[0], argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  if (procedural && (!tileNum || (tileNum & (tileNum - 1)))) {
+    fprintf(stderr, "--tile-num must be a power of two\n");
+    return 1;
+  }
+
+  headless_input_entry *script = headlessDefaultScript;
+  u32 scriptNum = arrayLen(headlessDefaultScript);
+  if (scriptPath) {
+    script = (headless_input_entry *)malloc(HEADLESS_MAX_INPUT_ENTRIES *
+                                            sizeof(headless_input_entry));
+    scriptNum = headlessParseScript(scriptPath, script,
+                                    HEADLESS_MAX_INPUT_ENTRIES);
+  }
+
+  platform_state platform = {};
+  platform.api.logger = headlessLog;
+  platform.api.assert = headlessAssert;
+  platform.api.toggleFullscreen = headlessToggleFullscreen;
+  platform.api.flushCommandBuffer = headlessFlushCommandBuffer;
+  platform.api.getPerformanceCounter = headlessPerformanceCounter;
+  platform.api.getPerformanceFrequency = headlessPerformanceFrequency;
+  platform.api.readFileModTime = readFileModTime;
+  platform.api.loadBinaryFile = headlessLoadBinaryFile;
+  platform.api.loadTextFile = headlessLoadTextFile;
+  platform.api.loadOGG = headlessLoadOGG;
+  platform.api.loadImage = headlessLoadImage;
+  platform.api.mapFile = mapFile;
+  platform.api.unmapFile = unmapFile;
+  platform.api.releaseMappedRange = releaseMappedRange;
+  platform.api.writeBinaryFile = writeBinaryFile;
+  static rt_work_queue workQueue;
+  // Sweep threads run a world each, the solver stays single threaded
+  if (threadNum && !sweepPath) {
+    workQueue_init(&workQueue, threadNum);
+    platform.api.workQueue = &workQueue;
+    platform.api.workerThreadNum = workQueue.threadNum;
+    platform.api.addWork = workQueue_add;
+    platform.api.completeAllWork = workQueue_completeAll;
+  }
+
+  platform.permanentMemSize = MEGABYTES(32);
+  platform.temporaryMemSize = MEGABYTES(64);
+  platform.permanentMemBuffer = calloc(1, platform.permanentMemSize);
+  platform.temporaryMemBuffer = calloc(1, platform.temporaryMemSize);
+
+  platformApi = &platform.api;
+  ASSERT_ = platformApi->assert;
+  LOG = platformApi->logger;
+  MALLOC = _malloc;
+  REALLOC = _realloc;
+  FREE = _free;
+
+  memory_arena permanentMemory, tempMemory;
+  memArena_init(&permanentMemory, platform.permanentMemBuffer,
+                platform.permanentMemSize);
+  memArena_init(&tempMemory, platform.temporaryMemBuffer,
+                platform.temporaryMemSize);
+  stack = &tempMemory;
+
+  car_game_state *game = pushType(&permanentMemory, car_game_state);
+  _game = game;
+  allocTerrain(game, &permanentMemory);
+  allocCarWorld(game, &permanentMemory);
+  headlessBakeTerrain(game, terrainType);
+  if (writeTilesPath) {
+    // The tiles of the game, from the same samples as the height map
+    if (!terrainStreamWriteTiles(&game->terrain, heightMapImgSize.x,
+                                 writeTilesPath, terrainStreamTileSize,
+                                 &tempMemory)) {
+      fprintf(stderr, "Can't write %s\n", writeTilesPath);
+      return 1;
+    }
+    return 0;
+  }
+  if (sweepPath) {
+    return headlessSweep(game, sweepPath, csvPath, sampleNum, seed,
+                         threadNum, dt);
+  }
+  static rt_work_queue backgroundQueue;
+  if (tilesPath || procedural) {
+    // As many loader threads as workers, the tiles are generated in
+    // parallel
+    workQueue_init(&backgroundQueue, MAX(threadNum, 1u));
+    platform.api.backgroundQueue = &backgroundQueue;
+    platform.api.addWork = workQueue_add;
+    platform.api.completeAllWork = workQueue_completeAll;
+    // The tile and range tables take little next to the tiles
+    usize streamMemSize = tileBudget + MEGABYTES(16);
+    memory_arena streamMemory;
+    memArena_init(&streamMemory, malloc(streamMemSize), streamMemSize);
+    terrain_generator generator = headlessProceduralTerrain();
+    b32 opened = procedural ?
+      terrainStreamOpenProcedural(game, &streamMemory, &generator,
+                                  terrainStreamTileSize, tileNum,
+                                  heightMapScale.x, tileBudget) :
+      terrainStreamOpen(game, &streamMemory, tilesPath, tileBudget);
+    if (!opened) {
+      return 1;
+    }
+  }
+  car_state **cars = pushArray(&permanentMemory, carNum, car_state *);
+  cars[0] = &game->car;
+  for (u32 i = 1; i < carNum; i++) {
+    cars[i] = pushArrayZeros(&permanentMemory, 1, car_state);
+  }
+  for (u32 i = 0; i < carNum; i++) {
+    headlessSetupCar(game, cars[i], i, &carProperties);
+  }
+  game->initialized = true;
+  game->state = game_state_game;
+
+  // Snapshot after every frame and the input of the frame, --rewind
+  // re-simulates the last frames from them at the end
+  snapshot_ring rewindRing = {};
+  input_state *rewindInput = NULL;
+  u8 *finalSnapshot = NULL;
+  usize snapshotCapacity = 0;
+  u64 snapshotTicks = 0;
+  if (rewindNum) {
+    snapshotCapacity = snapshotMaxSize(game, cars, carNum);
+    usize rewindMemSize = (rewindNum + 1) * (snapshotCapacity + sizeof(usize)) +
+                          (rewindNum + 1) * sizeof(input_state) + KILOBYTES(4);
+    memory_arena rewindMemory;
+    memArena_init(&rewindMemory, malloc(rewindMemSize), rewindMemSize);
+    allocSnapshotRing(&rewindRing, &rewindMemory, rewindNum + 1,
+                      snapshotCapacity);
+    rewindInput = pushArray(&rewindMemory, rewindNum + 1, input_state);
+    finalSnapshot = (u8 *)malloc(snapshotCapacity);
+    snapshotRingPush(&rewindRing, game, cars, carNum);
+  }
+
+  u32 scriptIdx = 0;
+  u32 buttons = 0;
+  u64 simulationTicks = 0;
+  physicsStepDelta = dt;
+  u32 frameNum = 0;
+  u32 step = 0;
+  physics_world *world = &game->world;
+  f32 maxPenetration = 0.f;
+  b32 unstable = false;
+  for (; step < stepNum; frameNum++) {
+    while (scriptIdx < scriptNum && script[scriptIdx].step <= step) {
+      buttons = script[scriptIdx++].buttons;
+    }
+    headlessApplyInput(&game->input, buttons);
+
+    u64 begin = headlessPerformanceCounter();
+    step += headlessStepFrame(game, cars, carNum, &tempMemory, dt, frameDt);
+    simulationTicks += headlessPerformanceCounter() - begin;
+
+    if (rewindNum) {
+      rewindInput[frameNum % (rewindNum + 1)] = game->input;
+      begin = headlessPerformanceCounter();
+      snapshotRingPush(&rewindRing, game, cars, carNum);
+      snapshotTicks += headlessPerformanceCounter() - begin;
+    }
+
+    // Stop if the simulation blew up, the terrain queries don't wrap
+    // positions that far
+    for (u32 body = GROUND_BODY + 1; body < world->bodyNum && !unstable;
+         body++) {
+      v3 p = world->position[body];
+      unstable = !(fabsf(p.x) < geometrySize.x * 0.5f &&
+                   fabsf(p.y) < geometrySize.y * 0.5f && isfinite(p.z));
+    }
+    if (unstable) {
+      break;
+    }
+    for (u32 i = 0; i < carNum; i++) {
+      for (u32 w = 0; w < 4; w++) {
+        u32 wheel = cars[i]->chassis + 1 + w;
+        v3 normal;
+        f32 clearance =
+          getGeometryHeight(world->position[wheel], game, &normal) -
+          cars[i]->properties.wheelShape.radius;
+        maxPenetration = MAX(maxPenetration, -clearance);
+      }
+    }
+  }
+  // The last frame can run past the requested step count
+  stepNum = step;
+
+  // Go back rewindNum frames and run them again with the same input, the
+  // state has to come out bit exact
+  u32 rewoundNum = 0;
+  b32 rewindMatch = false;
+  u64 restoreTicks = 0;
+  usize snapshotBytes = 0;
+  if (rewindNum && !unstable) {
+    snapshotBytes = snapshotSave(game, cars, carNum, finalSnapshot,
+                                 snapshotCapacity);
+    rewoundNum = MIN(rewindNum, frameNum);
+    u64 begin = headlessPerformanceCounter();
+    snapshotRingRewind(&rewindRing, game, cars, carNum, rewoundNum);
+    restoreTicks = headlessPerformanceCounter() - begin;
+    for (u32 frame = frameNum - rewoundNum; frame < frameNum; frame++) {
+      game->input = rewindInput[frame % (rewindNum + 1)];
+      headlessStepFrame(game, cars, carNum, &tempMemory, dt, frameDt);
+      snapshotRingPush(&rewindRing, game, cars, carNum);
+    }
+    u8 *slot = rewindRing.buffer +
+      ((rewindRing.head + rewindRing.slotNum - 1) % rewindRing.slotNum) *
+      rewindRing.slotCapacity;
+    rewindMatch = memcmp(slot, finalSnapshot, snapshotBytes) == 0;
+  }
+
+  f64 seconds = (f64)simulationTicks / headlessPerformanceFrequency();
+  physics_counters *counters = &game->physicsTotals;
+  f64 averageSubsteps = counters->islandNum ?
+    (f64)counters->islandSubstepSum / counters->islandNum : 0.0;
+  u64 substepNum = (u64)(stepNum * averageSubsteps + 0.5);
+  u64 hash = 14695981039346656037ull;
+  for (u32 i = GROUND_BODY + 1; i < world->bodyNum; i++) {
+    hash = headlessHashBody(hash, world, i);
+  }
+
+  printf("steps:       %u\n", stepNum);
+  printf("dt:          %f\n", dt);
+  if (frameDt > 0.f) {
+    printf("frames:      %u (frame dt %f)\n", frameNum, frameDt);
+  }
+  if (adaptiveSubsteps) {
+    printf("substeps:    adaptive %u-%u (island avg %.2f, max %u)\n",
+           minSubStepAmount, maxSubStepAmount, averageSubsteps,
+           counters->islandSubstepMax);
+  } else {
+    printf("substeps:    %u\n", subStepAmount);
+  }
+  printf("ccd:         %s\n", enableCCD ? "on" : "off");
+  if (useWideContactSolver) {
+    printf("solver:      wide (%s, %d lanes)\n", SIMD_NAME, SIMD_WIDTH);
+  } else {
+    printf("solver:      scalar\n");
+  }
+  u32 raycastCarNum = 0;
+  for (u32 i = 0; i < carNum; i++) {
+    raycastCarNum += cars[i]->lod == car_lod_raycast ? 1 : 0;
+  }
+  printf("cars:        %u (%u raycast)\n", carNum, raycastCarNum);
+  if (game->terrain.stream) {
+    terrain_stream *stream = game->terrain.stream;
+    u32 residentNum = 0;
+    for (u32 i = 0; i < stream->slotNum; i++) {
+      residentNum += stream->slots[i].state == terrain_slot_ready ? 1 : 0;
+    }
+    printf("tiles:       %u of %u slots in, %u loads (%u on the physics "
+           "thread), %u evictions\n",
+           residentNum, stream->slotNum, stream->counters.loadNum,
+           stream->counters.syncLoadNum, stream->counters.evictionNum);
+  }
+  printf("threads:     %u\n", 1 + platform.api.workerThreadNum);
+  printf("pairs:       %u\n", world->broadphase.pairNum);
+  if (unstable) {
+    printf("unstable:    body left the terrain at step %u\n", step);
+  }
+  printf("penetration: %.4f m (deepest wheel)\n", maxPenetration);
+  if (rewindNum && !unstable) {
+    printf("rewind:      %u frames %s (snapshot %zu bytes, save %.1f ns, "
+           "restore %.1f ns)\n", rewoundNum,
+           rewindMatch ? "match" : "MISMATCH", snapshotBytes,
+           frameNum ? (f64)snapshotTicks / frameNum : 0.0,
+           (f64)restoreTicks);
+  }
+  printf("awake:       %u / %u bodies\n", world->awakeBodyNum,
+         world->bodyNum - 1);
+  printf("time:        %.6f s\n", seconds);
+  printf("steps/s:     %.1f\n", seconds > 0.0 ? stepNum / seconds : 0.0);
+  printf("ns/substep:  %.1f\n",
+         substepNum ? (f64)simulationTicks / substepNum : 0.0);
+  if (enablePhysicsTimers && counters->stepNum) {
+    f64 nsPerTick = 1e9 / headlessPerformanceFrequency();
+    for (u32 i = 0; i < _physics_timer_num; i++) {
+      printf("  %*s%-*s %10.1f ns/step\n", 2 * physicsTimerDepth[i], "",
+             18 - 2 * physicsTimerDepth[i], physicsTimerNames[i],
+             (f64)counters->ticks[i] * nsPerTick / counters->stepNum);
+    }
+  }
+  if (counters->stepNum) {
+    printf("contacts:    %.1f/step (warm start hits %.1f%%)\n",
+           (f64)counters->contactNum / counters->stepNum,
+           counters->contactNum ?
+           100.0 * counters->warmStartHitNum / counters->contactNum : 0.0);
+    printf("joints:      %.1f/step, %.1f substeps/step solved\n",
+           (f64)counters->jointNum / counters->stepNum,
+           (f64)counters->substepNum / counters->stepNum);
+    printf("relax:       %u passes/substep", relaxIterations);
+    if (relaxEarlyExit) {
+      printf(", early exit below %g (%llu run, %llu skipped)", relaxTolerance,
+             (unsigned long long)counters->relaxPassNum,
+             (unsigned long long)counters->relaxSkipNum);
+    }
+    printf("\n");
+  }
+  // Impulse change of each pass of the last step, biased solve first
+  solver_convergence *convergence = &world->convergence;
+  for (u32 i = 0; i < convergence->iterationNum; i++) {
+    printf("%s %-6s joints %.3e contacts %.3e\n",
+           i == 0 ? "residual:   " : "            ",
+           i == 0 ? "solve" : "relax", convergence->jointResidual[i],
+           convergence->contactResidual[i]);
+  }
+  printf("error:       joint %.5f, penetration %.5f m (last step)\n",
+         convergence->jointPositionError, convergence->contactPenetration);
+  for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
+    v3 position = world->position[game->car.chassis + i];
+    v3 velocity = world->velocity[game->car.chassis + i];
+    printf("body %u:      pos %.6f %.6f %.6f vel %.6f %.6f %.6f\n", i,
+           position.x, position.y, position.z,
+           velocity.x, velocity.y, velocity.z);
+  }
+  printf("state hash:  %016llx\n", (unsigned long long)hash);
+
+  terrainStreamClose(game);
+  return 0;
+}
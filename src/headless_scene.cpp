@@ -0,0 +1,119 @@
+// Scene setup shared by the headless runner and physics_bench: synthetic
+// terrain, cars without a model and scripted button input.
+
+typedef enum headless_button {
+  headless_button_up    = 1 << 0,
+  headless_button_down  = 1 << 1,
+  headless_button_left  = 1 << 2,
+  headless_button_right = 1 << 3,
+  headless_button_reset = 1 << 4,
+} headless_button;
+
+typedef enum headless_terrain {
+  headless_terrain_flat,
+  headless_terrain_waves,
+} headless_terrain;
+
+// Wheel pivots relative to the chassis origin. The game reads these from
+// the car model, which is not available in headless mode.
+// Order matches the model nodes: WheelBL, WheelBR, WheelFL, WheelFR.
+static v3 headlessWheelPivots[WHEEL_NUM] = {
+  {-1.35f,  0.78f, 0.3f},
+  {-1.35f, -0.78f, 0.3f},
+  { 1.35f,  0.78f, 0.3f},
+  { 1.35f, -0.78f, 0.3f},
+};
+
+static f32 headlessGroundHeight = -44.5f;
+
+static f32 headlessTerrainHeight(headless_terrain type, f32 x, f32 y,
+                                 v3 *normalOut) {
+  f32 height = headlessGroundHeight;
+  v3 normal = {0.f, 0.f, 1.f};
+  if (type == headless_terrain_waves) {
+    f32 a = 0.4f, k = 0.15f;
+    height += a * sinf(x * k) * cosf(y * k);
+    f32 dx = a * k * cosf(x * k) * cosf(y * k);
+    f32 dy = -a * k * sinf(x * k) * sinf(y * k);
+    normal = v3_normalize((v3){-dx, -dy, 1.f});
+  }
+  *normalOut = normal;
+  return height;
+}
+
+// Rolling hills for --procedural. The noise stays below the ground so
+// the cars start above it wherever they spawn.
+static terrain_generator headlessProceduralTerrain() {
+  terrain_generator generator = {};
+  generator.noise = (noise_fractal){noise_basis_simplex, noise_fractal_fbm,
+                                    5, 1.f / 200.f, 2.f, 0.5f, 40.f, 1};
+  generator.heightScale = 2.f;
+  generator.baseHeight = headlessGroundHeight - generator.heightScale;
+  return generator;
+}
+
+// Fills the collision samples with synthetic terrain the way
+// terrainBakeGeometry does. The waves stay within a meter of the ground.
+static void headlessBakeTerrain(car_game_state *game, headless_terrain type) {
+  i32 sizeX = heightMapImgSize.x;
+  i32 sizeY = heightMapImgSize.y;
+  terrainSetHeightRange(&game->terrain, headlessGroundHeight - 1.f,
+                        headlessGroundHeight + 1.f);
+  for (i32 y = 0; y < sizeY; y++) {
+    for (i32 x = 0; x < sizeX; x++) {
+      f32 worldX = (x - sizeX * 0.5f) * heightMapScale.x;
+      f32 worldY = (y - sizeY * 0.5f) * heightMapScale.y;
+      v3 n;
+      f32 h = headlessTerrainHeight(type, worldX, worldY, &n);
+      game->terrain.samples[terrainSampleIndex(sizeX, x, y)] =
+        terrainPackSample(&game->terrain, h, n);
+    }
+  }
+  terrainBuildMinMax(&game->terrain);
+  game->terrain.initialized = true;
+}
+
+// Extra cars are placed on a grid next to the first one. Cars don't
+// collide with each other so they only add solver work.
+static void headlessSetupCar(car_game_state *game, car_state *car, u32 idx,
+                             const car_properties *properties) {
+  for (i32 i = 0; i < WHEEL_NUM; i++) {
+    car->wheelModel[i].transform[0] =
+      m4x4_translate_make(v4_from_v3(headlessWheelPivots[i], 1.f));
+    car->wheelModel[i].meshNum = 1;
+  }
+  carAddToWorld(game, car);
+  car->properties = *properties;
+  carSetInitialState(game, car);
+  carSetupBody(game, car);
+
+  physics_world *world = &game->world;
+  v3 offset = {(f32)(idx % 8) * 8.f, (f32)(idx / 8) * 6.f, 0.f};
+  for (u32 i = 0; i < RIGID_BODY_NUM; i++) {
+    world->position[car->chassis + i] += offset;
+    world->origin[car->chassis + i] += offset;
+  }
+  car->initialized = true;
+}
+
+static button_state headlessButtonState(button_state prev, b32 down) {
+  if (down) {
+    return prev >= button_state_pressed ? button_state_held
+                                        : button_state_pressed;
+  }
+  return prev >= button_state_pressed ? button_state_released
+                                      : button_state_up;
+}
+
+static void headlessApplyInput(input_state *input, u32 buttons) {
+  input->moveUp =
+    headlessButtonState(input->moveUp, buttons & headless_button_up);
+  input->moveDown =
+    headlessButtonState(input->moveDown, buttons & headless_button_down);
+  input->moveLeft =
+    headlessButtonState(input->moveLeft, buttons & headless_button_left);
+  input->moveRight =
+    headlessButtonState(input->moveRight, buttons & headless_button_right);
+  input->reset =
+    headlessButtonState(input->reset, buttons & headless_button_reset);
+}
@@ -0,0 +1,281 @@
+// Noise benchmark.
+// Samples per second of the gradient and simplex noise in 2D and 3D, the
+// scalar version against the wide one that evaluates SIMD_WIDTH samples
+// per call. Both must give the same bits. The fractal table times the
+// fBm, ridged and domain warped sums of the wide noise, and the tile table
+// generates the tiles of the headless procedural terrain, once on the
+// calling thread only and once on the worker threads, the tiles must come
+// out the same.
+//
+// Usage: noise_bench [--threads N] [--samples N] [--tile-num N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game/car_game.cpp"
+#include "core/file.c"
+#include "core/work_queue.c"
+#include "headless_scene.cpp"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+typedef enum bench_noise {
+  bench_noise_gradient2,
+  bench_noise_gradient3,
+  bench_noise_simplex2,
+  bench_noise_simplex3,
+  _bench_noise_num,
+} bench_noise;
+
+static const char *benchNoiseNames[_bench_noise_num] = {
+  "gradient 2D", "gradient 3D", "simplex 2D", "simplex 3D",
+};
+
+// Samples on a skewed grid so the lanes don't share a lattice cell
+// pattern, z runs along the samples for the 3D noise
+static void benchMakePoints(f32 *x, f32 *y, f32 *z, u32 sampleNum) {
+  for (u32 i = 0; i < sampleNum; i++) {
+    x[i] = (f32)(i % 1024) * 0.173f - 60.f;
+    y[i] = (f32)(i / 1024) * 0.291f + (f32)(i % 7) * 0.05f - 40.f;
+    z[i] = (f32)i * 0.0007f;
+  }
+}
+
+static void benchScalar(bench_noise noise, const f32 *x, const f32 *y,
+                        const f32 *z, f32 *out, u32 sampleNum) {
+  for (u32 i = 0; i < sampleNum; i++) {
+    switch (noise) {
+      case bench_noise_gradient2:
+        out[i] = noiseGradient2(x[i], y[i], 7);
+        break;
+      case bench_noise_gradient3:
+        out[i] = noiseGradient3(x[i], y[i], z[i], 7);
+        break;
+      case bench_noise_simplex2:
+        out[i] = noiseSimplex2(x[i], y[i], 7);
+        break;
+      default:
+        out[i] = noiseSimplex3(x[i], y[i], z[i], 7);
+        break;
+    }
+  }
+}
+
+static void benchWide(bench_noise noise, const f32 *x, const f32 *y,
+                      const f32 *z, f32 *out, u32 sampleNum) {
+  for (u32 i = 0; i < sampleNum; i += SIMD_WIDTH) {
+    f32w wx = f32w_load(x + i);
+    f32w wy = f32w_load(y + i);
+    f32w wz = f32w_load(z + i);
+    f32w result;
+    switch (noise) {
+      case bench_noise_gradient2:
+        result = noiseGradient2Wide(wx, wy, 7);
+        break;
+      case bench_noise_gradient3:
+        result = noiseGradient3Wide(wx, wy, wz, 7);
+        break;
+      case bench_noise_simplex2:
+        result = noiseSimplex2Wide(wx, wy, 7);
+        break;
+      default:
+        result = noiseSimplex3Wide(wx, wy, wz, 7);
+        break;
+    }
+    f32w_store(out + i, result);
+  }
+}
+
+// FNV-1a over the samples, their quantization and the ranges of a
+// loaded tile
+static u64 benchHashSlot(terrain_tile_slot *slot) {
+  terrain_stream *stream = slot->stream;
+  u32 stride = stream->header.tileSize + 1;
+  u64 hash = 0xcbf29ce484222325ull;
+  const u8 *bytes = (const u8 *)slot->samples;
+  for (usize i = 0; i < (usize)stride * stride * sizeof(terrain_sample);
+       i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  f32 quantization[2] = {slot->heightMin, slot->heightStep};
+  bytes = (const u8 *)quantization;
+  for (usize i = 0; i < sizeof(quantization); i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  for (u32 level = 1; level < stream->tileShift; level++) {
+    u32 n = stream->header.tileSize >> level;
+    bytes = (const u8 *)slot->minMax[level - 1];
+    for (usize i = 0; i < (usize)n * n * sizeof(v2); i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+// Generates every tile of the stream, slotNum at a time, and keeps the
+// hash of each. Returns the ticks taken by the generation.
+static u64 benchGenerateTiles(terrain_stream *stream, rt_work_queue *queue,
+                              u64 *hashes) {
+  u32 tileNum = stream->header.tileNum * stream->header.tileNum;
+  u64 ticks = 0;
+  for (u32 first = 0; first < tileNum; first += stream->slotNum) {
+    u32 num = MIN(stream->slotNum, tileNum - first);
+    u64 begin = benchPerformanceCounter();
+    for (u32 i = 0; i < num; i++) {
+      terrain_tile_slot *slot = stream->slots + i;
+      slot->tile = first + i;
+      slot->loaded = 0;
+      if (queue && i > 0) {
+        workQueue_add(queue, terrainStreamLoadTile, slot);
+      }
+    }
+    // The calling thread takes the first tile, or all of them alone
+    u32 ownNum = queue ? 1 : num;
+    for (u32 i = 0; i < ownNum; i++) {
+      terrainStreamLoadTile(stream->slots + i);
+    }
+    if (queue) {
+      workQueue_completeAll(queue);
+    }
+    ticks += benchPerformanceCounter() - begin;
+    for (u32 i = 0; i < num; i++) {
+      hashes[first + i] = benchHashSlot(stream->slots + i);
+    }
+  }
+  return ticks;
+}
+
+int main(int argc, char **argv) {
+  u32 threadNum = (u32)sysconf(_SC_NPROCESSORS_ONLN);
+  u32 sampleNum = 1u << 20;
+  u32 tileNum = 16;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threadNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      sampleNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--tile-num") == 0 && i + 1 < argc) {
+      tileNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--threads N] [--samples N] [--tile-num N]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  threadNum = MAX(threadNum, 1u);
+  sampleNum = MAX(sampleNum / SIMD_WIDTH * SIMD_WIDTH, (u32)SIMD_WIDTH);
+
+  platform_state platform = {};
+  platform.api.assert = benchAssert;
+  platformApi = &platform.api;
+  ASSERT_ = platformApi->assert;
+  static rt_work_queue workQueue;
+  workQueue_init(&workQueue, threadNum - 1);
+
+  usize arenaSize = MEGABYTES(128);
+  memory_arena arena;
+  memArena_init(&arena, malloc(arenaSize), arenaSize);
+  f32 *x = pushArrayAligned(&arena, sampleNum, f32, SIMD_ALIGNMENT);
+  f32 *y = pushArrayAligned(&arena, sampleNum, f32, SIMD_ALIGNMENT);
+  f32 *z = pushArrayAligned(&arena, sampleNum, f32, SIMD_ALIGNMENT);
+  f32 *scalar = pushArrayAligned(&arena, sampleNum, f32, SIMD_ALIGNMENT);
+  f32 *wide = pushArrayAligned(&arena, sampleNum, f32, SIMD_ALIGNMENT);
+  benchMakePoints(x, y, z, sampleNum);
+
+  printf("%-12s %14s %14s %9s %6s\n", "noise", "scalar Ms/s", "wide Ms/s",
+         "speedup", "same");
+  b32 mismatch = false;
+  for (u32 n = 0; n < _bench_noise_num; n++) {
+    u64 begin = benchPerformanceCounter();
+    benchScalar((bench_noise)n, x, y, z, scalar, sampleNum);
+    u64 scalarTicks = benchPerformanceCounter() - begin;
+    begin = benchPerformanceCounter();
+    benchWide((bench_noise)n, x, y, z, wide, sampleNum);
+    u64 wideTicks = benchPerformanceCounter() - begin;
+    b32 same = memcmp(scalar, wide, sampleNum * sizeof(f32)) == 0;
+    mismatch |= !same;
+    printf("%-12s %14.1f %14.1f %8.2fx %6s\n", benchNoiseNames[n],
+           sampleNum * 1e3 / MAX(scalarTicks, 1ull),
+           sampleNum * 1e3 / MAX(wideTicks, 1ull),
+           (f64)scalarTicks / (f64)MAX(wideTicks, 1ull), same ? "yes" : "NO");
+  }
+
+  // Simplex 2D, five octaves like the headless hills
+  noise_fractal fractals[3] = {
+    {noise_basis_simplex, noise_fractal_fbm, 5, 0.05f, 2.f, 0.5f, 0.f, 1},
+    {noise_basis_simplex, noise_fractal_ridged, 5, 0.05f, 2.f, 0.5f, 0.f, 1},
+    {noise_basis_simplex, noise_fractal_fbm, 5, 0.05f, 2.f, 0.5f, 4.f, 1},
+  };
+  const char *fractalNames[3] = {"fbm", "ridged", "warp"};
+  printf("\n%-12s %14s %14s\n", "fractal", "2D Ms/s", "3D Ms/s");
+  for (u32 f = 0; f < 3; f++) {
+    u64 begin = benchPerformanceCounter();
+    for (u32 i = 0; i < sampleNum; i += SIMD_WIDTH) {
+      f32w_store(wide + i, noiseSample2Wide(fractals + f, f32w_load(x + i),
+                                            f32w_load(y + i)));
+    }
+    u64 ticks2 = benchPerformanceCounter() - begin;
+    begin = benchPerformanceCounter();
+    for (u32 i = 0; i < sampleNum; i += SIMD_WIDTH) {
+      f32w_store(wide + i,
+                 noiseSample3Wide(fractals + f, f32w_load(x + i),
+                                  f32w_load(y + i), f32w_load(z + i)));
+    }
+    u64 ticks3 = benchPerformanceCounter() - begin;
+    printf("%-12s %14.1f %14.1f\n", fractalNames[f],
+           sampleNum * 1e3 / MAX(ticks2, 1ull),
+           sampleNum * 1e3 / MAX(ticks3, 1ull));
+  }
+
+  car_game_state *game = (car_game_state *)calloc(1, sizeof(car_game_state));
+  terrain_generator generator = headlessProceduralTerrain();
+  u32 tileSize = 64;
+  usize tileBytes = terrainStreamSlotSize(tileSize, true);
+  // Enough slots for a few tiles per thread
+  b32 opened = terrainStreamOpenProcedural(game, &arena, &generator, tileSize,
+                                           tileNum, heightMapScale.x,
+                                           4 * threadNum * tileBytes);
+  if (!opened) {
+    fprintf(stderr, "Can't open a procedural stream of %u tiles\n", tileNum);
+    return 1;
+  }
+  terrain_stream *stream = game->terrain.stream;
+  u32 totalTiles = tileNum * tileNum;
+  u64 *hashes[2] = {(u64 *)malloc(totalTiles * sizeof(u64)),
+                    (u64 *)malloc(totalTiles * sizeof(u64))};
+  u64 ticks[2];
+  ticks[0] = benchGenerateTiles(stream, NULL, hashes[0]);
+  ticks[1] = benchGenerateTiles(stream, &workQueue, hashes[1]);
+  b32 same = memcmp(hashes[0], hashes[1], totalTiles * sizeof(u64)) == 0;
+  mismatch |= !same;
+  u64 tileSamples = (u64)totalTiles * (tileSize + 3) *
+    terrainStreamHeightStride(tileSize);
+  printf("\n%-12s %14s %14s %14s %6s\n", "tiles", "tiles/s", "Ms/s",
+         "ms", "same");
+  for (u32 threaded = 0; threaded <= 1; threaded++) {
+    printf("%-12s %14.1f %14.1f %14.1f %6s\n",
+           threaded ? "threads" : "1 thread",
+           totalTiles * 1e9 / MAX(ticks[threaded], 1ull),
+           tileSamples * 1e3 / MAX(ticks[threaded], 1ull),
+           ticks[threaded] / 1e6, same ? "yes" : "NO");
+  }
+  printf("%u tiles of %u cells, %u slots, threads: %u\n", totalTiles,
+         tileSize, stream->slotNum, 1 + workQueue.threadNum);
+  return mismatch ? 1 : 0;
+}
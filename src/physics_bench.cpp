@@ -0,0 +1,341 @@
+// Physics scenario benchmark.
+// Runs canned driving scenarios on flat headless terrain and reports the
+// step cost next to stability numbers, so a physics change can be judged
+// on both with one run:
+//   ns/step    average time of one fixed step
+//   p99        99th percentile step time
+//   drift      change of the mechanical energy (kinetic and potential) per
+//              second and kilogram, W/kg. Should stay at or below zero when
+//              nothing drives the car, driving adds the engine work.
+//   joint err  largest joint position error left after any step
+//   speed      average chassis speed at the end, to compare the raycast
+//              model against the full one
+//   top        top speed of the first car
+//   0-100 s    time the first car takes to reach 100 km/h
+//
+// When both straight runs are in, the raycast model has to reach the top
+// speed and 0-100 time of the full model within a tolerance, otherwise
+// the bench fails like on an unstable run.
+//
+// Every step is timed on its own around carStepWorld, the fixed step that
+// carUpdate runs, so the 64 car scenario steps all its cars the same way.
+// The rc- scenarios run every car on the raycast model.
+//
+// Usage: physics_bench [--steps N] [--scenario NAME] [--dt SEC]
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "game/car_game.cpp"
+#include "headless_scene.cpp"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static u64 benchPerformanceFrequency() {
+  return 1000000000ull;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+static void benchLog(LogLevel logLevel, const char *format, ...) {
+  if (logLevel < LOG_LEVEL_WARN) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+typedef enum bench_scenario_type {
+  bench_scenario_idle,
+  bench_scenario_straight,
+  bench_scenario_slalom,
+  bench_scenario_drift,
+  bench_scenario_drop,
+  bench_scenario_crowd,
+} bench_scenario_type;
+
+typedef struct bench_scenario {
+  const char *name;
+  bench_scenario_type type;
+  u32 carNum;
+  u32 stepNum;
+  car_lod lod;
+} bench_scenario;
+
+static bench_scenario benchScenarios[] = {
+  {"idle",        bench_scenario_idle,     1,   600,  car_lod_full},
+  {"straight",    bench_scenario_straight, 1,   1200, car_lod_full},
+  {"slalom",      bench_scenario_slalom,   1,   1200, car_lod_full},
+  {"drift",       bench_scenario_drift,    1,   900,  car_lod_full},
+  {"drop",        bench_scenario_drop,     1,   600,  car_lod_full},
+  {"64cars",      bench_scenario_crowd,    64,  600,  car_lod_full},
+  {"rc-idle",     bench_scenario_idle,     1,   600,  car_lod_raycast},
+  {"rc-straight", bench_scenario_straight, 1,   1200, car_lod_raycast},
+  {"rc-slalom",   bench_scenario_slalom,   1,   1200, car_lod_raycast},
+  {"rc-drift",    bench_scenario_drift,    1,   900,  car_lod_raycast},
+  {"rc-drop",     bench_scenario_drop,     1,   600,  car_lod_raycast},
+  {"rc-64cars",   bench_scenario_crowd,    64,  600,  car_lod_raycast},
+  {"rc-256cars",  bench_scenario_crowd,    256, 600,  car_lod_raycast},
+};
+
+// Height the drop scenario starts from
+static const f32 benchDropHeight = 10.f;
+
+// 100 km/h, the acceleration time is measured up to it
+static const f32 benchAccelSpeed = 100.f / 3.6f;
+
+// Largest relative difference of the raycast model to the full one
+static const f32 benchLodSpeedTolerance = 0.05f;
+static const f32 benchLodAccelTolerance = 0.1f;
+
+// The car has no handbrake, the drift brakes the driven rear wheels while
+// steering hard at speed so the rear steps out.
+static u32 benchScenarioButtons(bench_scenario_type type, u32 step) {
+  switch (type) {
+    case bench_scenario_idle:
+    case bench_scenario_drop:
+      return 0;
+    case bench_scenario_straight:
+    case bench_scenario_crowd:
+      return headless_button_up;
+    case bench_scenario_slalom:
+      if (step < 120) {
+        return headless_button_up;
+      }
+      return headless_button_up | ((step / 90) % 2 ? headless_button_left
+                                                   : headless_button_right);
+    case bench_scenario_drift:
+      if (step < 420) {
+        return headless_button_up;
+      }
+      return step < 600 ? headless_button_down | headless_button_left
+                        : headless_button_up | headless_button_left;
+      InvalidDefaultCase;
+  }
+  return 0;
+}
+
+static f64 benchMechanicalEnergy(physics_world *world) {
+  f64 energy = 0.0;
+  for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+    f32 mass = world->mass[body];
+    v3 w = world->angularVelocity[body];
+    f32 rotational = 0.f;
+    if (v3_length2(w) > 0.f) {
+      m3x3 inertia = m3x3_inverse(world->invWorlInertiaTensor[body]);
+      rotational = 0.5f * v3_dot(w, inertia * w);
+    }
+    energy += 0.5 * mass * v3_length2(world->velocity[body]) + rotational -
+      mass * v3_dot(Gravity, world->position[body]);
+  }
+  return energy;
+}
+
+static int benchCompareTicks(const void *a, const void *b) {
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  u32 stepOverride = 0;
+  const char *scenarioName = NULL;
+  f32 dt = 1.f / 60.f;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+      stepOverride = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+      scenarioName = argv[++i];
+    } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+      dt = strtof(argv[++i], NULL);
+    } else {
+      fprintf(stderr, "Usage: %s [--steps N] [--scenario NAME] [--dt SEC]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  platform_state platform = {};
+  platform.api.logger = benchLog;
+  platform.api.assert = benchAssert;
+  platform.api.getPerformanceCounter = benchPerformanceCounter;
+  platform.api.getPerformanceFrequency = benchPerformanceFrequency;
+  platformApi = &platform.api;
+  ASSERT_ = platformApi->assert;
+  LOG = platformApi->logger;
+  physicsStepDelta = dt;
+  // Every scenario runs its cars on one model
+  enableCarLod = false;
+
+  // The terrain is baked once and shared, every scenario builds its world
+  // from zeroed memory
+  usize terrainMemSize = MEGABYTES(24);
+  usize worldMemSize = MEGABYTES(32);
+  usize tempMemSize = MEGABYTES(64);
+  memory_arena terrainMemory, worldMemory, tempMemory;
+  memArena_init(&terrainMemory, calloc(1, terrainMemSize), terrainMemSize);
+  void *worldBuffer = malloc(worldMemSize);
+  memArena_init(&tempMemory, malloc(tempMemSize), tempMemSize);
+  stack = &tempMemory;
+
+  car_game_state *terrainGame = pushType(&terrainMemory, car_game_state);
+  allocTerrain(terrainGame, &terrainMemory);
+  headlessBakeTerrain(terrainGame, headless_terrain_flat);
+
+  u32 maxStepNum = 0;
+  for (u32 i = 0; i < arrayLen(benchScenarios); i++) {
+    maxStepNum = MAX(maxStepNum, benchScenarios[i].stepNum);
+  }
+  maxStepNum = stepOverride ? stepOverride : maxStepNum;
+  u64 *stepTicks = (u64 *)malloc(maxStepNum * sizeof(u64));
+  b32 scenarioRan[arrayLen(benchScenarios)] = {};
+  f32 scenarioTopSpeed[arrayLen(benchScenarios)];
+  f32 scenarioAccelTime[arrayLen(benchScenarios)];
+
+  printf("%-12s %5s %6s %12s %12s %12s %10s %8s %8s %8s\n", "scenario",
+         "cars", "steps", "ns/step", "p99 ns", "drift W/kg", "joint err",
+         "speed", "top", "0-100 s");
+  b32 found = false;
+  b32 unstable = false;
+  for (u32 s = 0; s < arrayLen(benchScenarios); s++) {
+    bench_scenario *scenario = benchScenarios + s;
+    if (scenarioName && strcmp(scenarioName, scenario->name) != 0) {
+      continue;
+    }
+    found = true;
+    u32 stepNum = stepOverride ? stepOverride : scenario->stepNum;
+
+    memset(worldBuffer, 0, worldMemSize);
+    memArena_init(&worldMemory, worldBuffer, worldMemSize);
+    car_game_state *game = pushType(&worldMemory, car_game_state);
+    game->terrain = terrainGame->terrain;
+    allocCarWorld(game, &worldMemory);
+    car_state **cars = pushArray(&worldMemory, scenario->carNum, car_state *);
+    cars[0] = &game->car;
+    for (u32 i = 1; i < scenario->carNum; i++) {
+      cars[i] = pushType(&worldMemory, car_state);
+    }
+    for (u32 i = 0; i < scenario->carNum; i++) {
+      headlessSetupCar(game, cars[i], i, &carProperties);
+    }
+    physics_world *world = &game->world;
+    for (u32 i = 0; i < scenario->carNum; i++) {
+      carSetLod(game, cars[i], scenario->lod);
+    }
+    if (scenario->type == bench_scenario_drop) {
+      for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+        world->position[body].z += benchDropHeight;
+        world->origin[body].z += benchDropHeight;
+      }
+    }
+    game->initialized = true;
+    game->state = game_state_game;
+
+    f32 totalMass = 0.f;
+    for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+      totalMass += world->mass[body];
+    }
+    f64 startEnergy = benchMechanicalEnergy(world);
+    f32 jointError = 0.f;
+    f32 topSpeed = 0.f;
+    f32 accelTime = 0.f;
+    u64 ticks = 0;
+    u32 step = 0;
+    for (; step < stepNum; step++) {
+      headlessApplyInput(&game->input,
+                         benchScenarioButtons(scenario->type, step));
+      memArena_clear(&tempMemory);
+      u64 begin = benchPerformanceCounter();
+      physicsWorldStoreState(world);
+      carStepWorld(game, cars, scenario->carNum, &game->input, &tempMemory,
+                   dt);
+      stepTicks[step] = benchPerformanceCounter() - begin;
+      ticks += stepTicks[step];
+      jointError = MAX(jointError, world->convergence.jointPositionError);
+      f32 carSpeed = v3_length(world->velocity[cars[0]->chassis]);
+      if (carSpeed >= benchAccelSpeed && topSpeed < benchAccelSpeed) {
+        accelTime = (step + 1) * dt;
+      }
+      topSpeed = MAX(topSpeed, carSpeed);
+
+      b32 blewUp = false;
+      for (u32 body = GROUND_BODY + 1; body < world->bodyNum; body++) {
+        v3 p = world->position[body];
+        blewUp |= !(fabsf(p.x) < geometrySize.x * 0.5f &&
+                    fabsf(p.y) < geometrySize.y * 0.5f && isfinite(p.z));
+      }
+      if (blewUp) {
+        step++;
+        break;
+      }
+    }
+    f64 drift = (benchMechanicalEnergy(world) - startEnergy) /
+      totalMass / (step * dt);
+    qsort(stepTicks, step, sizeof(u64), benchCompareTicks);
+    u64 p99 = stepTicks[MIN(step * 99 / 100, step - 1)];
+    f32 speed = 0.f;
+    for (u32 i = 0; i < scenario->carNum; i++) {
+      speed += v3_length(world->velocity[cars[i]->chassis]);
+    }
+    speed /= scenario->carNum;
+
+    printf("%-12s %5u %6u %12.1f %12llu %12.3f %10.5f %8.2f %8.2f %8.2f%s\n",
+           scenario->name, scenario->carNum, step, (f64)ticks / step,
+           (unsigned long long)p99, drift, jointError, speed, topSpeed,
+           accelTime, step < stepNum ? "  UNSTABLE" : "");
+    unstable |= step < stepNum;
+    scenarioRan[s] = true;
+    scenarioTopSpeed[s] = topSpeed;
+    scenarioAccelTime[s] = accelTime;
+  }
+  if (!found) {
+    fprintf(stderr, "Unknown scenario %s\n", scenarioName);
+    return 1;
+  }
+
+  b32 mismatch = false;
+  for (u32 r = 0; r < arrayLen(benchScenarios); r++) {
+    bench_scenario *raycast = benchScenarios + r;
+    if (!scenarioRan[r] || raycast->lod != car_lod_raycast ||
+        raycast->type != bench_scenario_straight) {
+      continue;
+    }
+    for (u32 f = 0; f < arrayLen(benchScenarios); f++) {
+      bench_scenario *full = benchScenarios + f;
+      if (!scenarioRan[f] || full->lod != car_lod_full ||
+          full->type != raycast->type || full->carNum != raycast->carNum) {
+        continue;
+      }
+      f32 speedError = scenarioTopSpeed[r] / scenarioTopSpeed[f] - 1.f;
+      // A run too short to reach 100 km/h only matches another one
+      f32 accelTimeR = scenarioAccelTime[r];
+      f32 accelTimeF = scenarioAccelTime[f];
+      f32 accelError = accelTimeR > 0.f && accelTimeF > 0.f
+        ? accelTimeR / accelTimeF - 1.f
+        : (accelTimeR == accelTimeF ? 0.f : 1.f);
+      b32 scenarioMismatch = fabsf(speedError) > benchLodSpeedTolerance ||
+        fabsf(accelError) > benchLodAccelTolerance;
+      printf("%s vs %s: top speed %+.1f%%, 0-100 %+.1f%%%s\n",
+             raycast->name, full->name, speedError * 100.f,
+             accelError * 100.f, scenarioMismatch ? "  MISMATCH" : "");
+      mismatch |= scenarioMismatch;
+    }
+  }
+  return unstable || mismatch ? 1 : 0;
+}
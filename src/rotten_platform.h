@@ -42,6 +42,12 @@ typedef struct rt_input {
   u32 eventNum;
 } rt_input;
 
+// One piece of a file written with writeBinaryFile
+typedef struct rt_file_chunk {
+  const void* data;
+  usize size;
+} rt_file_chunk;
+
 typedef struct rt_audio_data {
   i16* buffer;
   i32 sampleNum;
@@ -56,6 +62,13 @@ typedef LOGGER_PTR(loggerPtr);
                  int linenum, const char* filename)
 typedef ASSERT_PTR(assertPtr);
 
+// Work queue shared by the platform worker threads. Work is added from
+// one thread only, the one stepping the physics, completeAllWork also runs
+// work on the caller.
+typedef struct rt_work_queue rt_work_queue;
+#define RT_WORK_CALLBACK(name) void name(void* data)
+typedef RT_WORK_CALLBACK(rt_work_callback);
+
 typedef struct platform_api {
   assertPtr assert;
   loggerPtr logger;
@@ -72,6 +85,44 @@ typedef struct platform_api {
   char* (*loadTextFile)(const char* path, usize* fileSizeOut);
   rt_audio_data (*loadOGG)(const char* path);
   rt_image_data (*loadImage)(const char* path, u8 channels);
+  // Read only mapping of a whole file, NULL when it can't be mapped.
+  // releaseMappedRange lets the OS drop the pages of a range, they are
+  // read from the file again when touched. NULL where the OS can't drop
+  // the pages of a mapping (Windows).
+  void* (*mapFile)(const char* path, usize* fileSizeOut);
+  void (*unmapFile)(void* memory, usize size);
+  void (*releaseMappedRange)(void* memory, usize size);
+  // Writes the chunks one after another to a new file that replaces path
+  // once it's complete, so a reader never sees half of it
+  b32 (*writeBinaryFile)(const char* path, rt_file_chunk* chunks,
+                         u32 chunkNum);
+
+  rt_work_queue* workQueue;
+  u32 workerThreadNum;
+  void (*addWork)(rt_work_queue* queue, rt_work_callback* callback,
+                  void* data);
+  void (*completeAllWork)(rt_work_queue* queue);
+  // Threads for long running work like terrain streaming, added to with
+  // addWork. The work flags its own completion, completeAllWork only
+  // drains it when its results are dropped.
+  rt_work_queue* backgroundQueue;
+  // Tile file the game streams the physics terrain from instead of
+  // keeping the whole height map, NULL for the height map. The game
+  // writes it from the height map when it's missing or older. With
+  // proceduralTerrain the terrainTileNum x terrainTileNum tiles are
+  // generated from noise instead. Tile slots take up to terrainTileBudget
+  // bytes, see terrain_stream.cpp.
+  const char* terrainTilesPath;
+  b32 proceduralTerrain;
+  u32 terrainTileNum;
+  usize terrainTileBudget;
+
+  // Set when the platform calls gamePhysicsUpdate from a thread of its
+  // own. The platform holds the physics lock during those calls, the game
+  // takes it to change the physics state from the main thread.
+  b32 physicsThread;
+  void (*lockPhysics)();
+  void (*unlockPhysics)();
 } platform_api;
 
 typedef struct platform_state {
@@ -79,6 +130,9 @@ typedef struct platform_state {
   u32 permanentMemSize;
   void* temporaryMemBuffer;
   u32 temporaryMemSize;
+  // Temporary memory of the physics thread
+  void* physicsMemBuffer;
+  u32 physicsMemSize;
   platform_api api;
 } platform_state;
 
@@ -115,6 +169,7 @@ b32 gameUpdate(frame_time time, display_state display, platform_state platform,
                rt_input input,
                b32 reloaded, utime assetModTime);
 void audioCallback(audio_out audioOut, platform_state platform);
+f32 gamePhysicsUpdate(platform_state platform);
 
 #endif
 #define RT_GAME_UPDATE_AND_RENDER(name)                       \
@@ -123,6 +178,10 @@ void audioCallback(audio_out audioOut, platform_state platform);
             b32 reloaded, utime assetModTime)
 #define RT_GAME_AUDIO_CALLBACK(name)                       \
   void name(audio_out audioOut, platform_state platform)
+// Returns the seconds until the next physics step is due
+#define RT_GAME_PHYSICS_UPDATE(name)                       \
+  f32 name(platform_state platform)
 
 typedef RT_GAME_UPDATE_AND_RENDER(rt_gameUpdate);
 typedef RT_GAME_AUDIO_CALLBACK(rt_gameAudioUpdate);
+typedef RT_GAME_PHYSICS_UPDATE(rt_gamePhysicsUpdate);
@@ -1,3 +1,5 @@
+// For madvise in core/file.c
+#define _DEFAULT_SOURCE
 #include "SDL_video.h"
 #define SDL_MAIN_HANDLED
 
@@ -82,6 +84,7 @@ memory_arena SDLMemArena, platformMemArena;
 #include "core/sdl_file.c"
 #include "core/image.c"
 #include "core/audio.c"
+#include "core/work_queue.c"
 
 static SDL_Window* sdlWindow;
 static SDL_GLContext glContext;
@@ -95,6 +98,7 @@ typedef struct game_code {
 
   rt_gameUpdate* gameLoopFunc;
   rt_gameAudioUpdate* gameAudioFunc;
+  rt_gamePhysicsUpdate* gamePhysicsFunc;
 
   b32 isValid;
 } game_code;
@@ -119,6 +123,38 @@ typedef struct audio_callback_data {
 #endif
 } audio_callback_data;
 
+typedef struct physics_thread_data {
+  platform_state* platform;
+  rt_gamePhysicsUpdate* gamePhysicsFunc;
+  SDL_atomic_t quit;
+} physics_thread_data;
+
+static SDL_mutex* physicsLock;
+
+static void lockPhysics() {
+  SDL_LockMutex(physicsLock);
+}
+
+static void unlockPhysics() {
+  SDL_UnlockMutex(physicsLock);
+}
+
+// Physics runs at its own rate, the game returns the time until the next
+// step. The game code is only called with the lock held so reloading it
+// and building the world on the main thread wait for the update to end.
+static int SDLPhysicsThread(void* data) {
+  physics_thread_data* physics = (physics_thread_data*)data;
+  while (!SDL_AtomicGet(&physics->quit)) {
+    lockPhysics();
+    f32 wait = physics->gamePhysicsFunc(*physics->platform);
+    unlockPhysics();
+    // Sleeping is in whole milliseconds, late steps are caught up by the
+    // next update
+    SDL_Delay(MAX((u32)(wait * 1000.f), 1));
+  }
+  return 0;
+}
+
 static b32 SDLLoadGameCode(const char *libName, game_code *code, utime wt) {
   LOG(LOG_LEVEL_DEBUG, "Load Game code\n");
   code->libLastWriteTime = wt;
@@ -131,7 +167,11 @@ static b32 SDLLoadGameCode(const char *libName, game_code *code, utime wt) {
     code->gameAudioFunc = (rt_gameAudioUpdate *)SDL_LoadFunction(
         code->libGameCode, "gameAudioUpdate");
 
-    code->isValid = (code->gameLoopFunc && code->gameAudioFunc) != 0;
+    code->gamePhysicsFunc = (rt_gamePhysicsUpdate *)SDL_LoadFunction(
+        code->libGameCode, "gamePhysicsUpdate");
+
+    code->isValid = (code->gameLoopFunc && code->gameAudioFunc &&
+                     code->gamePhysicsFunc) != 0;
   }
   if (!code->libGameCode) {
     LOG(LOG_LEVEL_ERROR, "Could not load game code: %s\n", SDL_GetError());
@@ -358,9 +398,12 @@ int main(int arc, char **argv) {
   renderer_code rendererCode = {};
 
 #if DYNAMIC_LIB_LOAD
-  ASSERT(arc == 3 && "Please give game and renderer library names");
+  ASSERT(arc >= 3 && "Please give game and renderer library names");
   const char *gameCodeLib = argv[1];
   const char *rendererCodeLib = argv[2];
+  i32 firstOption = 3;
+#else
+  i32 firstOption = 1;
 #endif
 
   u32 SDLMemSize           = KILOBYTES(512);
@@ -368,11 +411,13 @@ int main(int arc, char **argv) {
 
   u32 gamePermanentMemSize = MEGABYTES(32);
   u32 gameTemporaryMemSize = MEGABYTES(64);
+  u32 gamePhysicsMemSize   = MEGABYTES(16);
   
   u64 totalMemorySize = SDLMemSize + 
     platformMemSize + 
     gamePermanentMemSize +
-    gameTemporaryMemSize; 
+    gameTemporaryMemSize +
+    gamePhysicsMemSize; 
   
   void *memoryBuffer = SDL_calloc(1, totalMemorySize);
     
@@ -383,9 +428,11 @@ int main(int arc, char **argv) {
 
   platform.permanentMemBuffer = memoryBuffer;
   platform.temporaryMemBuffer = memoryBuffer + gamePermanentMemSize;
+  platform.physicsMemBuffer = platform.temporaryMemBuffer + gameTemporaryMemSize;
 
   platform.permanentMemSize = gamePermanentMemSize;
   platform.temporaryMemSize = gameTemporaryMemSize;
+  platform.physicsMemSize = gamePhysicsMemSize;
 
   SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_DEBUG);
 
@@ -405,9 +452,53 @@ int main(int arc, char **argv) {
   platform.api.loadImage = _loadImage;
   platform.api.loadBinaryFile = _loadBinaryFile;
   platform.api.loadTextFile = _loadTextFile;
+  platform.api.mapFile = mapFile;
+  platform.api.unmapFile = unmapFile;
+  platform.api.releaseMappedRange = releaseMappedRange;
+  platform.api.writeBinaryFile = writeBinaryFile;
   platform.api.getPerformanceCounter = SDL_GetPerformanceCounter;
   platform.api.getPerformanceFrequency = SDL_GetPerformanceFrequency;
 
+  // The physics thread works as well and the main thread renders, so two
+  // threads less than cores
+  static rt_work_queue workQueue;
+  i32 cpuCount = SDL_GetCPUCount();
+  workQueue_init(&workQueue, cpuCount > 2 ? cpuCount - 2 : 0);
+  platform.api.workQueue = &workQueue;
+  platform.api.workerThreadNum = workQueue.threadNum;
+  platform.api.addWork = workQueue_add;
+  platform.api.completeAllWork = workQueue_completeAll;
+  // Generated tiles take a while each, the loader gets as many threads
+  // as the solver so the tiles ahead of a fast car are in on time
+  static rt_work_queue backgroundQueue;
+  workQueue_init(&backgroundQueue, MAX(workQueue.threadNum, 1));
+  platform.api.backgroundQueue = &backgroundQueue;
+
+  // --tiles PATH streams the physics terrain from a tile file,
+  // --procedural [--tile-num N] generates it and --tile-budget MB sets the
+  // memory of the tile slots
+  platform.api.terrainTileNum = 16;
+  platform.api.terrainTileBudget = MEGABYTES(4);
+  for (i32 i = firstOption; i < arc; i++) {
+    if (SDL_strcmp(argv[i], "--tiles") == 0 && i + 1 < arc) {
+      platform.api.terrainTilesPath = argv[++i];
+    } else if (SDL_strcmp(argv[i], "--procedural") == 0) {
+      platform.api.proceduralTerrain = true;
+    } else if (SDL_strcmp(argv[i], "--tile-num") == 0 && i + 1 < arc) {
+      platform.api.terrainTileNum = (u32)SDL_strtoul(argv[++i], NULL, 10);
+    } else if (SDL_strcmp(argv[i], "--tile-budget") == 0 && i + 1 < arc) {
+      platform.api.terrainTileBudget =
+        MEGABYTES((usize)SDL_strtoul(argv[++i], NULL, 10));
+    } else {
+      LOG(LOG_LEVEL_WARN, "Unknown option %s", argv[i]);
+    }
+  }
+
+  physicsLock = SDL_CreateMutex();
+  platform.api.physicsThread = true;
+  platform.api.lockPhysics = lockPhysics;
+  platform.api.unlockPhysics = unlockPhysics;
+
   gameCode.libGameCode = NULL;
   rendererCode.libRendererCode = NULL;
 
@@ -418,6 +509,7 @@ int main(int arc, char **argv) {
 #else
   platform.api.flushCommandBuffer = flushCommandBuffer;
   gameCode.gameLoopFunc = gameUpdate;
+  gameCode.gamePhysicsFunc = gamePhysicsUpdate;
   rendererCode.initRendererFunc = rendererInit;
 #endif
 
@@ -485,13 +577,23 @@ int main(int arc, char **argv) {
   
   rendererCode.initRendererFunc(LOG, ASSERT_, SDL_GL_GetProcAddress);
 
+  physics_thread_data physicsThreadData = {
+    .platform = &platform,
+    .gamePhysicsFunc = gameCode.gamePhysicsFunc
+  };
+  SDL_Thread* physicsThread =
+    SDL_CreateThread(SDLPhysicsThread, "physics", &physicsThreadData);
+
   b32 quit = false;
 
   u32 duration = 0.0;
-  u32 targetTimeMSec = 1000 / 60;
+  // Game runs once per frame with the real frame time, physics keeps its
+  // own fixed step. Long frames (breakpoints, window dragging) are clamped.
+  f32 maxFrameTime = 0.25f;
 
-  u32 currentTime = SDL_GetTicks();
-  u32 elapsedTimeMSec = 0;
+  u64 performanceFrequency = SDL_GetPerformanceFrequency();
+  u64 startCounter = SDL_GetPerformanceCounter();
+  u64 currentCounter = startCounter;
   u32 hotReloadTime = 0;
   utime assetFileModTime = readFileModTime("assets/modfile");
   b32 initialRun = true;
@@ -511,6 +613,7 @@ int main(int arc, char **argv) {
         utime wt = readFileModTime(gameCodeLib);
         if (wt != 0 && wt > gameCode.libLastWriteTime) {
           SDL_LockAudioDevice(audioDeviceId);
+          lockPhysics();
           SDL_UnloadObject(gameCode.libGameCode);
           SDLLoadGameCode(gameCodeLib, &gameCode, wt);
           gameCode.gameLoopFunc = (rt_gameUpdate *)SDL_LoadFunction(
@@ -518,7 +621,9 @@ int main(int arc, char **argv) {
           gameCode.gameAudioFunc = (rt_gameAudioUpdate *)SDL_LoadFunction(
               gameCode.libGameCode, "gameAudioUpdate");
           audioCallbackData.gameAudioFunc = gameCode.gameAudioFunc;
+          physicsThreadData.gamePhysicsFunc = gameCode.gamePhysicsFunc;
           reloaded = true;
+          unlockPhysics();
           SDL_UnlockAudioDevice(audioDeviceId);
         }
       }
@@ -536,32 +641,24 @@ int main(int arc, char **argv) {
       assetFileModTime = newAssetFileModTime;
     }
 #endif
-    u32 newTime = SDL_GetTicks();
-    u32 frameTimeMS = newTime - currentTime;
-    currentTime = newTime;
-
-    duration += frameTimeMS;
-
-    if (frameTimeMS > targetTimeMSec) {
-      frameTimeMS = targetTimeMSec;
-    }
-
-    elapsedTimeMSec += frameTimeMS;
-    hotReloadTime += frameTimeMS;
-
-    while (elapsedTimeMSec >= targetTimeMSec) {
-      elapsedTimeMSec -= targetTimeMSec;
-      f32 dt = (f32)targetTimeMSec / 1000.f;
-
-      parseInputs(&input);
-      quit = gameCode.gameLoopFunc(
-        (frame_time){.delta = dt, .duration = duration},
-        (display_state){.size = {windowWidth, windowHeight}},
-        platform, input,
-        reloaded, initialRun ? 0 : assetFileModTime);
-      swapWindow();
-      initialRun = false;
-    }
+    u64 newCounter = SDL_GetPerformanceCounter();
+    f32 frameTime =
+      (f32)(newCounter - currentCounter) / (f32)performanceFrequency;
+    currentCounter = newCounter;
+
+    duration = (u32)((newCounter - startCounter) * 1000 / performanceFrequency);
+    hotReloadTime += (u32)(frameTime * 1000.f);
+
+    f32 dt = MIN(frameTime, maxFrameTime);
+
+    parseInputs(&input);
+    quit = gameCode.gameLoopFunc(
+      (frame_time){.delta = dt, .duration = duration},
+      (display_state){.size = {windowWidth, windowHeight}},
+      platform, input,
+      reloaded, initialRun ? 0 : assetFileModTime);
+    swapWindow();
+    initialRun = false;
 #if AUDIO_RING_BUFFER
     i32 readCursor = audioBuffer.readCursor;
     i32 audioBytes = audioBuffer.bytesToBeWritten;
@@ -580,6 +677,9 @@ int main(int arc, char **argv) {
     }
 #endif
   }
+  SDL_AtomicSet(&physicsThreadData.quit, 1);
+  SDL_WaitThread(physicsThread, NULL);
+  SDL_DestroyMutex(physicsLock);
   deleteContext();  
   SDL_PauseAudioDevice(audioDeviceId, 1);
   SDL_CloseAudioDevice(audioDeviceId);
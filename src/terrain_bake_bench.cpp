@@ -0,0 +1,304 @@
+// Terrain bake benchmark.
+// Times the startup bake of a height map, the normals embedded to the
+// image and the smoothed collision geometry, for 1k, 4k and 8k maps. The
+// per pixel bake the game used before is kept here as the reference, the
+// row band bake runs once on the calling thread only and once with the
+// worker threads. Both must give the same image bytes and packed
+// collision samples, the reference geometry is packed after its bake. The
+// bake is then written to a terrain cache file and the cache column times
+// what a cached start does instead: mapping the file and copying the
+// samples out.
+//
+// Usage: terrain_bake_bench [--threads N] [--max-size N] [--cache PATH]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game/car_game.cpp"
+#include "core/file.c"
+#include "core/work_queue.c"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+// Reference bake, as the game did it before the row bands
+
+static u8 *referenceGetPixelP(u8 *image, u32 imageWidth, u32 imageHeight,
+                              v2i pos) {
+  i32 x = pos.x % imageWidth;
+  while (x < 0) x += imageWidth;
+  i32 y = pos.y % imageHeight;
+  while (y < 0) y += imageHeight;
+  return image + (4 * (y * imageWidth + x));
+}
+
+static v4 referenceGetPixel(u8 *image, u32 imageWidth, u32 imageHeight,
+                            v2i pos) {
+  u8 *p = referenceGetPixelP(image, imageWidth, imageHeight, pos);
+  return {(f32)p[0] / 255.f, (f32)p[1] / 255.f, (f32)p[2] / 255.f,
+          (f32)p[3] / 255.f};
+}
+
+static void referenceSetPixel(u8 *image, u32 imageWidth, u32 imageHeight,
+                              v2i pos, v4 color) {
+  u8 *p = referenceGetPixelP(image, imageWidth, imageHeight, pos);
+  u8 rgba[4] = {(u8)(color.r * 255.f), (u8)(color.g * 255.f),
+                (u8)(color.b * 255.f), (u8)(color.a * 255.f)};
+  p[0] = rgba[0];
+  p[1] = rgba[1];
+  p[2] = rgba[2];
+  p[3] = rgba[3];
+}
+
+static f32 referenceCalcHeight(u8 *pixels, i16 w, i16 h, i16 x, i16 y) {
+  while (x < 0) x += w;
+  while (y < 0) y += h;
+  x = x % w;
+  y = y % h;
+  return referenceGetPixel(pixels, w, h, (v2i){x, y}).x;
+}
+
+static void referenceBakeNormals(rt_image_data img) {
+  i16 w = img.width, h = img.height;
+  for (i16 x = 0; x < w; x++) {
+    for (i16 y = 0; y < h; y++) {
+      f32 height = referenceCalcHeight((u8 *)img.pixels, w, h, x, y);
+      f32 l = referenceCalcHeight((u8 *)img.pixels, w, h, x - 1, y);
+      f32 b = referenceCalcHeight((u8 *)img.pixels, w, h, x, y + 1);
+      f32 r = referenceCalcHeight((u8 *)img.pixels, w, h, x + 1, y);
+      f32 t = referenceCalcHeight((u8 *)img.pixels, w, h, x, y - 1);
+
+      v3 A  = {0, 0, height * heightMapScale.z};
+      v3 B1 = {heightMapScale.y, 0, r * heightMapScale.z};
+      v3 B2 = {-heightMapScale.y, 0, l * heightMapScale.z};
+      v3 C1 = {0, heightMapScale.y, b * heightMapScale.z};
+      v3 C2 = {0, -heightMapScale.y, t * heightMapScale.z};
+      v3 n = LERP(calcNormal(A, B1, C1), calcNormal(A, B2, C2), 0.5);
+
+      referenceSetPixel((u8 *)img.pixels, w, h, (v2i){x, y},
+                        {height, (n.x + 1.f) * 0.5f, (n.y + 1.f) * 0.5f,
+                         (n.z + 1.f) * 0.5f});
+    }
+  }
+}
+
+static v3 referenceDecodeNormal(v4 pixel) {
+  return v3_normalize((v3){pixel.y, pixel.z, pixel.w} * 2.f -
+                      (v3){1.f, 1.f, 1.f});
+}
+
+static void referenceBakeGeometry(rt_image_data img, v3 *meshVertices,
+                                  v4 *geometry) {
+  u8 *pixels = (u8 *)img.pixels;
+  for (i16 y = 0; y < img.height; y++) {
+    for (i16 x = 0; x < img.width; x++) {
+      v4 height = referenceGetPixel(pixels, img.width, img.height, {x, y});
+      v4 heightA = referenceGetPixel(pixels, img.width, img.height,
+                                     {x + 1, y});
+      v4 heightB = referenceGetPixel(pixels, img.width, img.height,
+                                     {x - 1, y});
+      v4 heightC = referenceGetPixel(pixels, img.width, img.height,
+                                     {x, y + 1});
+      v4 heightD = referenceGetPixel(pixels, img.width, img.height,
+                                     {x, y - 1});
+      v3 v = meshVertices[(y * img.width) + x];
+      v.z = (height.x + heightA.x + heightB.x + heightC.x + heightD.x) / 5.f;
+      v.z = v.z * heightMapScale.z - heightMapScale.z;
+      v3 n = (referenceDecodeNormal(height) + referenceDecodeNormal(heightA) +
+              referenceDecodeNormal(heightB) + referenceDecodeNormal(heightC) +
+              referenceDecodeNormal(heightD)) / 5.f;
+      meshVertices[(y * img.width) + x] = v;
+      geometry[(y * img.width) + x] = (v4){v.z, n.x, n.y, n.z};
+    }
+  }
+}
+
+static void referencePackGeometry(terrain_object *terrain, i32 size,
+                                  v4 *geometry) {
+  for (i32 y = 0; y < size; y++) {
+    for (i32 x = 0; x < size; x++) {
+      v4 g = geometry[y * size + x];
+      terrain->samples[terrainSampleIndex(size, x, y)] =
+        terrainPackSample(terrain, g.x, (v3){g.y, g.z, g.w});
+    }
+  }
+}
+
+// Rolling hills in the r channel, the bake fills the rest
+static void benchMakeHeightMap(u8 *pixels, i32 size) {
+  for (i32 y = 0; y < size; y++) {
+    for (i32 x = 0; x < size; x++) {
+      f32 u = (f32)x / size * 2.f * PI;
+      f32 v = (f32)y / size * 2.f * PI;
+      f32 h = 0.5f + 0.3f * sinf(u * 3.f) * cosf(v * 2.f) +
+        0.15f * sinf(u * 17.f + v * 11.f);
+      u8 *p = pixels + 4 * (y * size + x);
+      p[0] = (u8)(CLAMP(h, 0.f, 1.f) * 255.f);
+      p[1] = p[2] = p[3] = 0;
+    }
+  }
+}
+
+// FNV-1a over 64 bit words, all sizes are multiples of 8 bytes
+static u64 benchHash(const void *data, usize size, u64 hash) {
+  const u64 *words = (const u64 *)data;
+  for (usize i = 0; i < size / 8; i++) {
+    hash = (hash ^ words[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static u64 benchHashBake(rt_image_data img, v3 *meshVertices,
+                         terrain_sample *samples, usize pixelNum) {
+  u64 hash = 0xcbf29ce484222325ull;
+  hash = benchHash(img.pixels, pixelNum * 4, hash);
+  hash = benchHash(meshVertices, pixelNum * sizeof(v3), hash);
+  return benchHash(samples, pixelNum * sizeof(terrain_sample), hash);
+}
+
+int main(int argc, char **argv) {
+  u32 threadNum = (u32)sysconf(_SC_NPROCESSORS_ONLN);
+  u32 maxSize = 8192;
+  const char *cachePath = "terrain_bake_bench.cache";
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threadNum = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+      maxSize = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      cachePath = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [--threads N] [--max-size N] [--cache PATH]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  threadNum = MAX(threadNum, 1u);
+
+  platform_state platform = {};
+  platform.api.assert = benchAssert;
+  platform.api.mapFile = mapFile;
+  platform.api.unmapFile = unmapFile;
+  platform.api.writeBinaryFile = writeBinaryFile;
+  platformApi = &platform.api;
+  ASSERT_ = platformApi->assert;
+  static rt_work_queue workQueue;
+  workQueue_init(&workQueue, threadNum - 1);
+  platform.api.addWork = workQueue_add;
+  platform.api.completeAllWork = workQueue_completeAll;
+
+  usize tempMemSize = MEGABYTES(64);
+  memory_arena tempMemory;
+  memArena_init(&tempMemory, malloc(tempMemSize), tempMemSize);
+
+  terrain_object terrain = {};
+  terrainSetHeightRange(&terrain, -heightMapScale.z, 0.f);
+
+  printf("%6s %12s %12s %12s %9s %10s %6s\n", "size", "per pixel ms",
+         "1 thread ms", "threads ms", "speedup", "cache ms", "same");
+  b32 mismatch = false;
+  const u32 sizes[] = {1024, 4096, 8192};
+  for (u32 s = 0; s < arrayLen(sizes); s++) {
+    i32 size = (i32)sizes[s];
+    if ((u32)size > maxSize) continue;
+    usize pixelNum = (usize)size * size;
+    u8 *source = (u8 *)malloc(pixelNum * 4);
+    rt_image_data img = {};
+    img.width = (i16)size;
+    img.height = (i16)size;
+    img.components = 4;
+    img.dataSize = (u32)(pixelNum * 4);
+    img.pixels = malloc(pixelNum * 4);
+    v3 *meshVertices = (v3 *)calloc(pixelNum, sizeof(v3));
+    v4 *geometry = (v4 *)malloc(pixelNum * sizeof(v4));
+    terrain.samples =
+      (terrain_sample *)malloc(pixelNum * sizeof(terrain_sample));
+    benchMakeHeightMap(source, size);
+
+    memcpy(img.pixels, source, pixelNum * 4);
+    u64 begin = benchPerformanceCounter();
+    referenceBakeNormals(img);
+    referenceBakeGeometry(img, meshVertices, geometry);
+    u64 referenceTicks = benchPerformanceCounter() - begin;
+    referencePackGeometry(&terrain, size, geometry);
+    u64 referenceHash =
+      benchHashBake(img, meshVertices, terrain.samples, pixelNum);
+
+    u64 ticks[2];
+    b32 same = true;
+    for (u32 threaded = 0; threaded <= 1; threaded++) {
+      platform.api.workQueue = threaded ? &workQueue : NULL;
+      platform.api.workerThreadNum = threaded ? workQueue.threadNum : 0;
+      memcpy(img.pixels, source, pixelNum * 4);
+      memArena_clear(&tempMemory);
+      begin = benchPerformanceCounter();
+      terrainBakeNormals(img, &tempMemory);
+      terrainBakeGeometry(img, meshVertices, &terrain, &tempMemory);
+      ticks[threaded] = benchPerformanceCounter() - begin;
+      same &= benchHashBake(img, meshVertices, terrain.samples, pixelNum) ==
+        referenceHash;
+    }
+
+    // The meshes depend on the renderer grid, only the image and the
+    // samples go to the cache here
+    terrain_cache_key key;
+    memset(&key, 0, sizeof(key));
+    key.imageWidth = size;
+    key.imageHeight = size;
+    key.heightMapScale = heightMapScale;
+    terrain_bake_data bake = {};
+    bake.heightMapImg = img;
+    bake.samples = terrain.samples;
+    bake.heightMin = terrain.heightMin;
+    bake.heightStep = terrain.heightStep;
+    u64 cacheTicks = 0;
+    if (terrainCacheWrite(cachePath, &key, &bake)) {
+      memset(terrain.samples, 0, pixelNum * sizeof(terrain_sample));
+      begin = benchPerformanceCounter();
+      usize fileSize = 0;
+      void *file = terrainCacheLoad(cachePath, &key, &bake, &fileSize);
+      if (file) {
+        memcpy(terrain.samples, bake.samples,
+               pixelNum * sizeof(terrain_sample));
+      }
+      cacheTicks = benchPerformanceCounter() - begin;
+      same &= file && bake.heightStep == terrain.heightStep &&
+        benchHashBake(bake.heightMapImg, meshVertices, terrain.samples,
+                      pixelNum) == referenceHash;
+      if (file) {
+        unmapFile(file, fileSize);
+      }
+      remove(cachePath);
+    } else {
+      fprintf(stderr, "Can't write %s\n", cachePath);
+      same = false;
+    }
+    mismatch |= !same;
+
+    printf("%6d %12.1f %12.1f %12.1f %8.1fx %10.1f %6s\n", size,
+           referenceTicks / 1e6, ticks[0] / 1e6, ticks[1] / 1e6,
+           (f64)referenceTicks / (f64)MAX(ticks[1], 1ull), cacheTicks / 1e6,
+           same ? "yes" : "NO");
+    free(source);
+    free(img.pixels);
+    free(meshVertices);
+    free(geometry);
+    free(terrain.samples);
+  }
+  printf("threads: %u\n", 1 + workQueue.threadNum);
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+// Terrain cast benchmark.
+// Bakes a 1024x1024 height map of hills and flat plains, then times
+// terrainRaycast and terrainSphereCast against a brute force march that
+// samples the bilinear surface every 10 cm along the ray and bisects the
+// first crossing. Camera rays point down at the terrain nearby, line of
+// sight rays run about a kilometer close above the ground and map rays
+// cross most of the map high up, where the min-max levels skip the most.
+//
+// Usage: terrain_bench [--rays N] [--seed N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "game/car_game.cpp"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+static u32 benchRandomState = 1;
+
+static f32 benchRandom(f32 min, f32 max) {
+  // xorshift32
+  benchRandomState ^= benchRandomState << 13;
+  benchRandomState ^= benchRandomState >> 17;
+  benchRandomState ^= benchRandomState << 5;
+  return min + (max - min) * (f32)(benchRandomState >> 8) / (f32)(1 << 24);
+}
+
+static f32 benchHillHeight(f32 x, f32 y) {
+  f32 h = 30.f * sinf(x * 0.011f) * cosf(y * 0.007f) +
+    12.f * sinf(x * 0.031f + y * 0.023f) + 4.f * cosf(y * 0.09f);
+  // Flat plains where the hills dip low
+  return MAX(h, -10.f);
+}
+
+static void benchBakeTerrain(terrain_object *terrain) {
+  i32 size = heightMapImgSize.x;
+  const f32 e = 0.5f;
+  // The hills stay within 46 m of zero
+  terrainSetHeightRange(terrain, -10.f, 46.f);
+  for (i32 y = 0; y < size; y++) {
+    for (i32 x = 0; x < size; x++) {
+      f32 worldX = (x - size * 0.5f) * heightMapScale.x;
+      f32 worldY = (y - size * 0.5f) * heightMapScale.y;
+      f32 h = benchHillHeight(worldX, worldY);
+      f32 hx = benchHillHeight(worldX + e, worldY);
+      f32 hy = benchHillHeight(worldX, worldY + e);
+      v3 n = v3_normalize((v3){h - hx, h - hy, e});
+      terrain->samples[terrainSampleIndex(size, x, y)] =
+        terrainPackSample(terrain, h, n);
+    }
+  }
+  terrainBuildMinMax(terrain);
+}
+
+// Bilinear height at the grid position, wrapped like the casts
+static f32 benchSurfaceHeight(terrain_object *terrain, f32 gx, f32 gy) {
+  i32 size = heightMapImgSize.x;
+  f32 fx = floorf(gx);
+  f32 fy = floorf(gy);
+  i32 x = (i32)fx;
+  i32 y = (i32)fy;
+  f32 u = gx - fx;
+  f32 v = gy - fy;
+  f32 a = terrainHeightAt(terrain, size, x, y) * (1.f - u) +
+    terrainHeightAt(terrain, size, x + 1, y) * u;
+  f32 b = terrainHeightAt(terrain, size, x, y + 1) * (1.f - u) +
+    terrainHeightAt(terrain, size, x + 1, y + 1) * u;
+  return a * (1.f - v) + b * v;
+}
+
+static f32 benchGap(terrain_object *terrain, v3 origin, v3 direction,
+                    f32 lift, f32 t) {
+  v3 p = origin + direction * t;
+  i32 size = heightMapImgSize.x;
+  f32 gx = p.x / heightMapScale.x + size * 0.5f;
+  f32 gy = p.y / heightMapScale.y + size * 0.5f;
+  return p.z - benchSurfaceHeight(terrain, gx, gy) - lift;
+}
+
+static b32 bruteForceCast(terrain_object *terrain, v3 origin, v3 direction,
+                          f32 maxDistance, f32 lift, f32 *distance) {
+  const f32 step = 0.1f;
+  if (benchGap(terrain, origin, direction, lift, 0.f) <= 0.f) {
+    *distance = 0.f;
+    return true;
+  }
+  for (f32 t = 0.f; t < maxDistance; t += step) {
+    f32 t1 = MIN(t + step, maxDistance);
+    if (benchGap(terrain, origin, direction, lift, t1) > 0.f) continue;
+    f32 lo = t;
+    f32 hi = t1;
+    for (u32 i = 0; i < 16; i++) {
+      f32 mid = 0.5f * (lo + hi);
+      if (benchGap(terrain, origin, direction, lift, mid) > 0.f) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    *distance = hi;
+    return true;
+  }
+  return false;
+}
+
+typedef struct bench_ray {
+  v3 origin;
+  v3 direction;
+  f32 maxDistance;
+} bench_ray;
+
+enum bench_ray_set {
+  bench_ray_set_camera,
+  bench_ray_set_line_of_sight,
+  bench_ray_set_map,
+  _bench_ray_set_num
+};
+
+static const char *benchRaySetNames[] = {"camera", "sight", "map"};
+
+static bench_ray benchMakeRay(terrain_object *terrain, bench_ray_set set) {
+  f32 half = geometrySize.x * 0.5f;
+  bench_ray ray;
+  f32 x = benchRandom(-half, half);
+  f32 y = benchRandom(-half, half);
+  f32 angle = benchRandom(0.f, 2.f * PI);
+  i32 size = heightMapImgSize.x;
+  f32 ground = benchSurfaceHeight(terrain, x / heightMapScale.x + size * 0.5f,
+                                  y / heightMapScale.y + size * 0.5f);
+  f32 pitch;
+  switch (set) {
+    case bench_ray_set_camera:
+      ray.origin = (v3){x, y, ground + benchRandom(2.f, 10.f)};
+      pitch = benchRandom(-0.6f, -0.05f);
+      ray.maxDistance = 500.f;
+      break;
+    case bench_ray_set_line_of_sight:
+      ray.origin = (v3){x, y, ground + benchRandom(1.f, 3.f)};
+      pitch = benchRandom(-0.01f, 0.01f);
+      ray.maxDistance = 1000.f;
+      break;
+    case bench_ray_set_map:
+      ray.origin = (v3){x, y, benchRandom(20.f, 60.f)};
+      pitch = benchRandom(-0.02f, 0.f);
+      ray.maxDistance = geometrySize.x;
+      break;
+      InvalidDefaultCase;
+  }
+  ray.direction = v3_normalize((v3){cosf(angle) * cosf(pitch),
+                                    sinf(angle) * cosf(pitch), sinf(pitch)});
+  return ray;
+}
+
+int main(int argc, char **argv) {
+  u32 rayNum = 2000;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rays") == 0 && i + 1 < argc) {
+      u32 value = (u32)strtoul(argv[++i], NULL, 10);
+      rayNum = MAX(value, 1u);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      u32 value = (u32)strtoul(argv[++i], NULL, 10);
+      benchRandomState = MAX(value, 1u);
+    } else {
+      fprintf(stderr, "Usage: %s [--rays N] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+  ASSERT_ = benchAssert;
+
+  usize memSize = MEGABYTES(64);
+  void *permanentBuffer = malloc(memSize);
+  memory_arena permanentMemory;
+  memArena_init(&permanentMemory, permanentBuffer, memSize);
+  car_game_state *game = pushType(&permanentMemory, car_game_state);
+  memset(game, 0, sizeof(car_game_state));
+  allocTerrain(game, &permanentMemory);
+  terrain_object *terrain = &game->terrain;
+  benchBakeTerrain(terrain);
+
+  bench_ray *rays = pushArray(&permanentMemory, rayNum, bench_ray);
+  f32 *distances = pushArray(&permanentMemory, rayNum, f32);
+  b32 *hits = pushArray(&permanentMemory, rayNum, b32);
+  const f32 sphereRadius = 0.5f;
+  // The march steps 10 cm at a time, it can miss a grazing hit
+  const f32 tolerance = 0.05f;
+
+  printf("%8s %8s %8s %12s %12s %9s %10s\n", "rays", "cast", "hits",
+         "ns/cast", "ns/march", "speedup", "mismatch");
+  u32 mismatchSum = 0;
+  for (u32 set = 0; set < _bench_ray_set_num; set++) {
+    for (u32 sphere = 0; sphere <= 1; sphere++) {
+      f32 lift = sphere ? sphereRadius : 0.f;
+      for (u32 i = 0; i < rayNum; i++) {
+        rays[i] = benchMakeRay(terrain, (bench_ray_set)set);
+      }
+
+      u64 begin = benchPerformanceCounter();
+      u32 hitNum = 0;
+      for (u32 i = 0; i < rayNum; i++) {
+        terrain_hit hit;
+        hits[i] = sphere
+          ? terrainSphereCast(game, rays[i].origin, rays[i].direction,
+                              sphereRadius, rays[i].maxDistance, &hit)
+          : terrainRaycast(game, rays[i].origin, rays[i].direction,
+                           rays[i].maxDistance, &hit);
+        distances[i] = hit.distance;
+        hitNum += hits[i] ? 1 : 0;
+      }
+      u64 castTicks = benchPerformanceCounter() - begin;
+
+      begin = benchPerformanceCounter();
+      u32 mismatchNum = 0;
+      for (u32 i = 0; i < rayNum; i++) {
+        f32 distance = 0.f;
+        b32 hit = bruteForceCast(terrain, rays[i].origin, rays[i].direction,
+                                 rays[i].maxDistance, lift, &distance);
+        if (hit != hits[i] ||
+            (hit && fabsf(distance - distances[i]) > tolerance)) {
+          mismatchNum++;
+        }
+      }
+      u64 marchTicks = benchPerformanceCounter() - begin;
+      mismatchSum += mismatchNum;
+
+      printf("%8s %8s %8u %12.1f %12.1f %8.1fx %10u\n",
+             benchRaySetNames[set], sphere ? "sphere" : "ray", hitNum,
+             (f64)castTicks / rayNum, (f64)marchTicks / rayNum,
+             (f64)marchTicks / (f64)MAX(castTicks, 1ull), mismatchNum);
+    }
+  }
+  // A few grazing rays may touch the surface between two march samples
+  return mismatchSum * 100 > rayNum * _bench_ray_set_num * 2 ? 1 : 0;
+}
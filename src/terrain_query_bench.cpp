@@ -0,0 +1,287 @@
+// Terrain query benchmark.
+// Bakes a 1024x1024 height map of hills to the (height, normal) floats the
+// physics used to read and to the packed terrain samples it reads now,
+// then times the contact generation queries on both: the old batch query
+// kept here as the reference against getGeometryHeightBatch. Map points
+// are spread over the whole map, car points are the wheel and chassis
+// points of 64 cars a few meters apart, like one physics step of a race.
+// The depth and normal errors of the packed samples are reported against
+// the reference.
+//
+// Usage: terrain_query_bench [--points N] [--passes N] [--seed N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "game/car_game.cpp"
+
+static u64 benchPerformanceCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void benchAssert(b32 cond, const char *condText, const char *function,
+                        i32 linenum, const char *filename) {
+  if (!cond) {
+    fprintf(stderr, "Assertion failed: %s, %s %s:%d\n", condText, function,
+            filename, linenum);
+    abort();
+  }
+}
+
+static u32 benchRandomState = 1;
+
+static f32 benchRandom(f32 min, f32 max) {
+  // xorshift32
+  benchRandomState ^= benchRandomState << 13;
+  benchRandomState ^= benchRandomState >> 17;
+  benchRandomState ^= benchRandomState << 5;
+  return min + (max - min) * (f32)(benchRandomState >> 8) / (f32)(1 << 24);
+}
+
+static f32 benchHillHeight(f32 x, f32 y) {
+  return 30.f * sinf(x * 0.011f) * cosf(y * 0.007f) +
+    12.f * sinf(x * 0.031f + y * 0.023f) + 4.f * cosf(y * 0.09f);
+}
+
+// Fills the reference rows and the packed samples with the same hills
+static void benchBakeTerrain(terrain_object *terrain, v4 *geometry) {
+  i32 size = heightMapImgSize.x;
+  const f32 e = 0.5f;
+  f32 lo = FLT_MAX;
+  f32 hi = -FLT_MAX;
+  for (i32 y = 0; y < size; y++) {
+    for (i32 x = 0; x < size; x++) {
+      f32 worldX = (x - size * 0.5f) * heightMapScale.x;
+      f32 worldY = (y - size * 0.5f) * heightMapScale.y;
+      f32 h = benchHillHeight(worldX, worldY);
+      f32 hx = benchHillHeight(worldX + e, worldY);
+      f32 hy = benchHillHeight(worldX, worldY + e);
+      v3 n = v3_normalize((v3){h - hx, h - hy, e});
+      geometry[size * y + x] = (v4){h, n.x, n.y, n.z};
+      lo = MIN(lo, h);
+      hi = MAX(hi, h);
+    }
+  }
+  terrainSetHeightRange(terrain, lo, hi);
+  for (i32 y = 0; y < size; y++) {
+    for (i32 x = 0; x < size; x++) {
+      v4 g = geometry[size * y + x];
+      terrain->samples[terrainSampleIndex(size, x, y)] =
+        terrainPackSample(terrain, g.x, (v3){g.y, g.z, g.w});
+    }
+  }
+}
+
+// getGeometryHeightBatch on (height, normal) floats in rows
+static void referenceGeometryHeightBatch(v4 *geometry, const v3 *pos, u32 n,
+                                         f32 *depth, v3 *normal) {
+  i32 sizeX = heightMapImgSize.x;
+  i32 sizeY = heightMapImgSize.y;
+  f32w scaleX = f32w_splat(heightMapScale.x);
+  f32w scaleY = f32w_splat(heightMapScale.y);
+  f32w sizeXw = f32w_splat((f32)sizeX);
+  f32w sizeYw = f32w_splat((f32)sizeY);
+  f32w halfX = f32w_splat(sizeX * 0.5f);
+  f32w halfY = f32w_splat(sizeY * 0.5f);
+  f32w zero = f32w_zero();
+  f32w one = f32w_splat(1.f);
+
+  ASSERT(n % SIMD_WIDTH == 0);
+  for (u32 i = 0; i < n; i += SIMD_WIDTH) {
+    v3w p;
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      setLane(&p, lane, pos[i + lane]);
+    }
+    f32w geomPosX = f32w_add(f32w_div(p.x, scaleX), halfX);
+    f32w geomPosY = f32w_add(f32w_div(p.y, scaleY), halfY);
+
+    f32w mask = f32w_less(geomPosX, zero);
+    while (f32w_anyTrue(mask)) {
+      geomPosX = f32w_select(mask, f32w_add(geomPosX, sizeXw), geomPosX);
+      mask = f32w_less(geomPosX, zero);
+    }
+    mask = f32w_less(geomPosY, zero);
+    while (f32w_anyTrue(mask)) {
+      geomPosY = f32w_select(mask, f32w_add(geomPosY, sizeYw), geomPosY);
+      mask = f32w_less(geomPosY, zero);
+    }
+
+    f32w x = f32w_trunc(geomPosX);
+    f32w y = f32w_trunc(geomPosY);
+    f32w u = f32w_sub(geomPosX, x);
+    f32w v = f32w_sub(geomPosY, y);
+
+    f32w h00, h10, h01, h11;
+    v3w n00, n10, n01, n11;
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      i32 cx = (i32)getLane(&x, lane);
+      i32 cy = (i32)getLane(&y, lane);
+      i32 cxPlusOne = (cx == sizeX - 1) ? 0 : cx + 1;
+      i32 cyPlusOne = (cy == sizeY - 1) ? 0 : cy + 1;
+      v4 c00 = geometry[sizeX * cy + cx];
+      v4 c10 = geometry[sizeX * cy + cxPlusOne];
+      v4 c01 = geometry[sizeX * cyPlusOne + cx];
+      v4 c11 = geometry[sizeX * cyPlusOne + cxPlusOne];
+      setLane(&h00, lane, c00.x);
+      setLane(&h10, lane, c10.x);
+      setLane(&h01, lane, c01.x);
+      setLane(&h11, lane, c11.x);
+      setLane(&n00, lane, (v3){c00.y, c00.z, c00.w});
+      setLane(&n10, lane, (v3){c10.y, c10.z, c10.w});
+      setLane(&n01, lane, (v3){c01.y, c01.z, c01.w});
+      setLane(&n11, lane, (v3){c11.y, c11.z, c11.w});
+    }
+
+    f32w oneMinusU = f32w_sub(one, u);
+    f32w oneMinusV = f32w_sub(one, v);
+    f32w a = f32w_add(f32w_mul(h00, oneMinusU), f32w_mul(h10, u));
+    f32w b = f32w_add(f32w_mul(h01, oneMinusU), f32w_mul(h11, u));
+    f32w h = f32w_add(f32w_mul(a, oneMinusV), f32w_mul(b, v));
+
+    v3w aN = v3w_add(v3w_scale(n00, oneMinusU), v3w_scale(n10, u));
+    v3w bN = v3w_add(v3w_scale(n01, oneMinusU), v3w_scale(n11, u));
+    v3w normalW = v3w_add(v3w_scale(aN, oneMinusV), v3w_scale(bN, v));
+
+    f32w depthW = f32w_sub(p.z, h);
+    for (u32 lane = 0; lane < SIMD_WIDTH; lane++) {
+      depth[i + lane] = getLane(&depthW, lane);
+      normal[i + lane] = getLane(&normalW, lane);
+    }
+  }
+}
+
+enum bench_point_set {
+  bench_point_set_map,
+  bench_point_set_cars,
+  _bench_point_set_num
+};
+
+static const char *benchPointSetNames[] = {"map", "cars"};
+
+#define BENCH_CAR_NUM 64
+// Four wheels and five chassis points
+#define BENCH_CAR_POINTS 9
+// Points per query call, about one physics step of all the cars
+#define BENCH_BATCH_POINTS (BENCH_CAR_NUM * BENCH_CAR_POINTS)
+
+static void benchMakePoints(bench_point_set set, v3 *points, u32 pointNum) {
+  f32 half = geometrySize.x * 0.5f;
+  v2 cars[BENCH_CAR_NUM];
+  // Cars race in a pack a couple hundred meters across
+  v2 track = {benchRandom(-half, half), benchRandom(-half, half)};
+  for (u32 i = 0; i < BENCH_CAR_NUM; i++) {
+    cars[i] = (v2){track.x + benchRandom(-100.f, 100.f),
+                   track.y + benchRandom(-100.f, 100.f)};
+  }
+  for (u32 i = 0; i < pointNum; i++) {
+    f32 x, y;
+    if (set == bench_point_set_map) {
+      x = benchRandom(-half, half);
+      y = benchRandom(-half, half);
+    } else {
+      v2 car = cars[(i / BENCH_CAR_POINTS) % BENCH_CAR_NUM];
+      x = car.x + benchRandom(-2.5f, 2.5f);
+      y = car.y + benchRandom(-1.5f, 1.5f);
+    }
+    points[i] = (v3){x, y, benchHillHeight(x, y) + benchRandom(-0.5f, 1.f)};
+  }
+}
+
+int main(int argc, char **argv) {
+  u32 pointNum = 1 << 16;
+  u32 passNum = 20;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+      u32 value = (u32)strtoul(argv[++i], NULL, 10);
+      pointNum = MAX(value, 1u);
+    } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+      u32 value = (u32)strtoul(argv[++i], NULL, 10);
+      passNum = MAX(value, 1u);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      u32 value = (u32)strtoul(argv[++i], NULL, 10);
+      benchRandomState = MAX(value, 1u);
+    } else {
+      fprintf(stderr, "Usage: %s [--points N] [--passes N] [--seed N]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  ASSERT_ = benchAssert;
+  // Whole batches only
+  pointNum = (pointNum + BENCH_BATCH_POINTS - 1) / BENCH_BATCH_POINTS *
+    BENCH_BATCH_POINTS;
+
+  usize cellNum = (usize)heightMapImgSize.x * heightMapImgSize.y;
+  usize memSize = MEGABYTES(64) + cellNum * sizeof(v4) +
+    (usize)pointNum * 4 * (sizeof(v3) + sizeof(f32));
+  void *permanentBuffer = malloc(memSize);
+  memory_arena permanentMemory;
+  memArena_init(&permanentMemory, permanentBuffer, memSize);
+  car_game_state *game = pushType(&permanentMemory, car_game_state);
+  memset(game, 0, sizeof(car_game_state));
+  allocTerrain(game, &permanentMemory);
+  terrain_object *terrain = &game->terrain;
+  v4 *geometry = pushArray(&permanentMemory, cellNum, v4);
+  benchBakeTerrain(terrain, geometry);
+
+  v3 *points = pushArray(&permanentMemory, pointNum, v3);
+  f32 *referenceDepth = pushArray(&permanentMemory, pointNum, f32);
+  v3 *referenceNormal = pushArray(&permanentMemory, pointNum, v3);
+  f32 *depth = pushArray(&permanentMemory, pointNum, f32);
+  v3 *normal = pushArray(&permanentMemory, pointNum, v3);
+
+  printf("terrain bytes: floats %zu, packed %zu\n", cellNum * sizeof(v4),
+         cellNum * sizeof(terrain_sample));
+  printf("%6s %10s %12s %12s %9s %12s %12s\n", "points", "queries",
+         "ns/floats", "ns/packed", "speedup", "depth err m", "normal deg");
+  f32 depthErrorMax = 0.f;
+  f32 normalErrorMax = 0.f;
+  for (u32 set = 0; set < _bench_point_set_num; set++) {
+    benchMakePoints((bench_point_set)set, points, pointNum);
+
+    u64 referenceTicks = 0;
+    u64 packedTicks = 0;
+    for (u32 pass = 0; pass < passNum; pass++) {
+      u64 begin = benchPerformanceCounter();
+      for (u32 i = 0; i < pointNum; i += BENCH_BATCH_POINTS) {
+        referenceGeometryHeightBatch(geometry, points + i, BENCH_BATCH_POINTS,
+                                     referenceDepth + i, referenceNormal + i);
+      }
+      referenceTicks += benchPerformanceCounter() - begin;
+
+      begin = benchPerformanceCounter();
+      for (u32 i = 0; i < pointNum; i += BENCH_BATCH_POINTS) {
+        getGeometryHeightBatch(game, points + i, BENCH_BATCH_POINTS,
+                               depth + i, normal + i);
+      }
+      packedTicks += benchPerformanceCounter() - begin;
+    }
+
+    f32 depthError = 0.f;
+    f32 normalError = 0.f;
+    for (u32 i = 0; i < pointNum; i++) {
+      depthError = MAX(depthError, fabsf(depth[i] - referenceDepth[i]));
+      f32 cosAngle = v3_dot(v3_normalize(normal[i]),
+                            v3_normalize(referenceNormal[i]));
+      f32 angle = acosf(CLAMP(cosAngle, -1.f, 1.f)) * 180.f / PI;
+      normalError = MAX(normalError, angle);
+    }
+    depthErrorMax = MAX(depthErrorMax, depthError);
+    normalErrorMax = MAX(normalErrorMax, normalError);
+
+    u64 queryNum = (u64)pointNum * passNum;
+    printf("%6s %10llu %12.2f %12.2f %8.2fx %12.5f %12.3f\n",
+           benchPointSetNames[set], (unsigned long long)queryNum,
+           (f64)referenceTicks / queryNum, (f64)packedTicks / queryNum,
+           (f64)referenceTicks / (f64)MAX(packedTicks, 1ull), depthError,
+           normalError);
+  }
+  // Half a height step from rounding, a bit more from the interpolation,
+  // and about half a degree per axis for the normals
+  b32 accurate = depthErrorMax <= terrain->heightStep &&
+    normalErrorMax <= 1.5f;
+  return accurate ? 0 : 1;
+}